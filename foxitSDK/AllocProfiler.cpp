@@ -0,0 +1,411 @@
+﻿#include "AllocProfiler.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+//Base of the module this file is linked into, the SDK is linked into the same one.
+extern "C" IMAGE_DOS_HEADER __ImageBase;
+#else
+#include <dlfcn.h>
+#include <execinfo.h>
+#endif
+
+using namespace foxitSDK;
+
+static const char* const g_HandleNames[FSDK_HANDLE_COUNT] = { "document", "page", "textpage", "bitmap", "renderer", "rendercontext", "progress" };
+
+//Frames of RecordStack and the hook that called it.
+#define FSDK_PROFILE_SKIPFRAMES		2
+
+static void AppendFormat(std::string& text, const char* format, ...)
+{
+	char buffer[512];
+	va_list args;
+	va_start(args, format);
+	int size = vsnprintf(buffer, sizeof(buffer), format, args);
+	va_end(args);
+	if (size > 0)
+		text.append(buffer, (size_t)size < sizeof(buffer) ? (size_t)size : sizeof(buffer) - 1);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Class CMy_AllocProfiler
+CMy_AllocProfiler::CMy_AllocProfiler()
+{
+	m_bRunning = false;
+	m_nSampleBytes = 0;
+	m_iGeneration = 0;
+	m_nAllocs = 0;
+	m_nAllocBytes = 0;
+	m_nSampled = 0;
+	for (int i = 0; i < FSDK_PROFILE_BUCKETS; i++)
+	{
+		m_Buckets[i].allocs = 0;
+		m_Buckets[i].bytes = 0;
+		m_Buckets[i].liveBlocks = 0;
+		m_Buckets[i].liveBytes = 0;
+	}
+}
+
+CMy_AllocProfiler::~CMy_AllocProfiler()
+{
+	Stop();
+}
+
+void CMy_AllocProfiler::Start(uint64_t nSampleBytes)
+{
+	Stop();
+	for (int i = 0; i < FSDK_PROFILE_SHARDS; i++)
+	{
+		std::lock_guard<std::mutex> lock(m_Shards[i].lock);
+		m_Shards[i].blocks.clear();
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_StackLock);
+		m_Stacks.clear();
+		m_StackIndex.clear();
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_HandleLock);
+		m_Handles.clear();
+	}
+	for (int i = 0; i < FSDK_PROFILE_BUCKETS; i++)
+	{
+		m_Buckets[i].allocs = 0;
+		m_Buckets[i].bytes = 0;
+		m_Buckets[i].liveBlocks = 0;
+		m_Buckets[i].liveBytes = 0;
+	}
+	m_nAllocs = 0;
+	m_nAllocBytes = 0;
+	m_nSampled = 0;
+	m_nSampleBytes = nSampleBytes;
+	m_iGeneration++;
+	m_bRunning = true;
+}
+
+void CMy_AllocProfiler::Stop()
+{
+	m_bRunning = false;
+}
+
+int CMy_AllocProfiler::SizeToBucket(size_t size)
+{
+	int iBucket = 0;
+	while (iBucket < FSDK_PROFILE_BUCKETS - 1 && ((uint64_t)1 << iBucket) <= (uint64_t)size)
+		iBucket++;
+	return iBucket;
+}
+
+CMy_AllocProfiler::Shard& CMy_AllocProfiler::GetShard(const void* ptr)
+{
+	//Blocks are at least 16 byte aligned, the low bits say nothing.
+	uintptr_t key = (uintptr_t)ptr >> 4;
+	return m_Shards[(key ^ (key >> 8)) % FSDK_PROFILE_SHARDS];
+}
+
+bool CMy_AllocProfiler::ShouldSample(size_t size)
+{
+	struct Countdown
+	{
+		uint32_t	generation;
+		int64_t		bytesLeft;
+	};
+	static thread_local Countdown s_Countdown = { 0, 0 };
+
+	uint64_t nInterval = m_nSampleBytes.load(std::memory_order_relaxed);
+	if (nInterval == 0)
+		return true;
+	uint32_t iGeneration = m_iGeneration.load(std::memory_order_relaxed);
+	if (s_Countdown.generation != iGeneration)
+	{
+		s_Countdown.generation = iGeneration;
+		s_Countdown.bytesLeft = (int64_t)nInterval;
+	}
+	s_Countdown.bytesLeft -= (int64_t)size;
+	if (s_Countdown.bytesLeft > 0)
+		return false;
+	s_Countdown.bytesLeft = (int64_t)nInterval;
+	return true;
+}
+
+uint32_t CMy_AllocProfiler::RecordStack()
+{
+	Stack stack;
+	memset(&stack, 0, sizeof(stack));
+#ifdef _WIN32
+	stack.depth = RtlCaptureStackBackTrace(FSDK_PROFILE_SKIPFRAMES, FSDK_PROFILE_MAXFRAMES, stack.frames, NULL);
+#else
+	void* frames[FSDK_PROFILE_MAXFRAMES + FSDK_PROFILE_SKIPFRAMES];
+	int depth = backtrace(frames, FSDK_PROFILE_MAXFRAMES + FSDK_PROFILE_SKIPFRAMES);
+	for (int i = FSDK_PROFILE_SKIPFRAMES; i < depth; i++)
+		stack.frames[stack.depth++] = frames[i];
+#endif
+	if (stack.depth == 0)
+		return 0;
+
+	//FNV-1a over the return addresses.
+	uint64_t hash = 14695981039346656037ULL;
+	for (uint32_t i = 0; i < stack.depth; i++)
+	{
+		hash ^= (uint64_t)(uintptr_t)stack.frames[i];
+		hash *= 1099511628211ULL;
+	}
+
+	std::lock_guard<std::mutex> lock(m_StackLock);
+	std::vector<uint32_t>& ids = m_StackIndex[hash];
+	for (size_t i = 0; i < ids.size(); i++)
+	{
+		Stack& known = m_Stacks[ids[i] - 1];
+		if (known.depth == stack.depth && memcmp(known.frames, stack.frames, stack.depth * sizeof(void*)) == 0)
+			return ids[i];
+	}
+	m_Stacks.push_back(stack);
+	ids.push_back((uint32_t)m_Stacks.size());
+	return (uint32_t)m_Stacks.size();
+}
+
+void CMy_AllocProfiler::AddBlock(void* ptr, size_t size, uint32_t iStack)
+{
+	int iBucket = SizeToBucket(size);
+	m_Buckets[iBucket].allocs++;
+	m_Buckets[iBucket].bytes += size;
+	m_Buckets[iBucket].liveBlocks++;
+	m_Buckets[iBucket].liveBytes += size;
+	m_nAllocs++;
+	m_nAllocBytes += size;
+
+	Block block;
+	block.size = size;
+	block.stack = iStack;
+	Block stale;
+	Shard& shard = GetShard(ptr);
+	{
+		std::lock_guard<std::mutex> lock(shard.lock);
+		std::pair<std::unordered_map<const void*, Block>::iterator, bool> result = shard.blocks.insert(std::make_pair((const void*)ptr, block));
+		if (result.second)
+			return;
+		//The address was freed and handed out again before its free was seen, drop the old record.
+		stale = result.first->second;
+		result.first->second = block;
+	}
+	iBucket = SizeToBucket(stale.size);
+	m_Buckets[iBucket].liveBlocks--;
+	m_Buckets[iBucket].liveBytes -= stale.size;
+}
+
+bool CMy_AllocProfiler::RemoveBlock(void* ptr, Block* pBlock)
+{
+	Shard& shard = GetShard(ptr);
+	{
+		std::lock_guard<std::mutex> lock(shard.lock);
+		std::unordered_map<const void*, Block>::iterator it = shard.blocks.find(ptr);
+		if (it == shard.blocks.end())
+			return false;
+		*pBlock = it->second;
+		shard.blocks.erase(it);
+	}
+	int iBucket = SizeToBucket(pBlock->size);
+	m_Buckets[iBucket].liveBlocks--;
+	m_Buckets[iBucket].liveBytes -= pBlock->size;
+	return true;
+}
+
+void CMy_AllocProfiler::OnAlloc(void* ptr, size_t size)
+{
+	if (!ptr || !IsRunning())
+		return;
+	uint32_t iStack = 0;
+	if (ShouldSample(size))
+	{
+		iStack = RecordStack();
+		if (iStack)
+			m_nSampled++;
+	}
+	AddBlock(ptr, size, iStack);
+}
+
+void CMy_AllocProfiler::OnRealloc(void* oldPtr, void* newPtr, size_t newSize)
+{
+	if (!newPtr || !IsRunning())
+		return;
+	Block block;
+	if (!oldPtr || !RemoveBlock(oldPtr, &block))
+	{
+		OnAlloc(newPtr, newSize);
+		return;
+	}
+	AddBlock(newPtr, newSize, block.stack);
+}
+
+void CMy_AllocProfiler::OnFree(void* ptr)
+{
+	if (!ptr || !IsRunning())
+		return;
+	Block block;
+	RemoveBlock(ptr, &block);
+}
+
+void CMy_AllocProfiler::OnHandleCreated(FSDK_HandleType type, const void* handle)
+{
+	if (!handle || !IsRunning())
+		return;
+	Handle record;
+	record.type = type;
+	record.stack = RecordStack();
+	std::lock_guard<std::mutex> lock(m_HandleLock);
+	m_Handles[handle] = record;
+}
+
+void CMy_AllocProfiler::OnHandleReleased(const void* handle)
+{
+	if (!handle || !IsRunning())
+		return;
+	std::lock_guard<std::mutex> lock(m_HandleLock);
+	m_Handles.erase(handle);
+}
+
+FSDK_AllocProfileStats CMy_AllocProfiler::GetStats()
+{
+	FSDK_AllocProfileStats stats;
+	memset(&stats, 0, sizeof(stats));
+	stats.allocCount = m_nAllocs;
+	stats.allocBytes = m_nAllocBytes;
+	stats.sampledCount = m_nSampled;
+	for (int i = 0; i < FSDK_PROFILE_BUCKETS; i++)
+	{
+		stats.liveBlocks += m_Buckets[i].liveBlocks;
+		stats.liveBytes += m_Buckets[i].liveBytes;
+	}
+	std::lock_guard<std::mutex> lock(m_HandleLock);
+	stats.liveHandles = m_Handles.size();
+	return stats;
+}
+
+std::string CMy_AllocProfiler::FormatFrame(void* frame)
+{
+	char buffer[320];
+#ifdef _WIN32
+	const char* pBase = (const char*)&__ImageBase;
+	const IMAGE_NT_HEADERS* pHeaders = (const IMAGE_NT_HEADERS*)(pBase + __ImageBase.e_lfanew);
+	const char* pFrame = (const char*)frame;
+	//Module offsets stay valid across runs and resolve against the PDB.
+	if (pFrame >= pBase && pFrame < pBase + pHeaders->OptionalHeader.SizeOfImage)
+		snprintf(buffer, sizeof(buffer), "foxitSDK+0x%llx", (unsigned long long)(pFrame - pBase));
+	else
+		snprintf(buffer, sizeof(buffer), "0x%p", frame);
+#else
+	Dl_info info;
+	if (dladdr(frame, &info) && info.dli_fname)
+	{
+		const char* pName = strrchr(info.dli_fname, '/');
+		pName = pName ? pName + 1 : info.dli_fname;
+		snprintf(buffer, sizeof(buffer), "%s+0x%llx%s%s", pName, (unsigned long long)((const char*)frame - (const char*)info.dli_fbase),
+			info.dli_sname ? " " : "", info.dli_sname ? info.dli_sname : "");
+	}
+	else
+		snprintf(buffer, sizeof(buffer), "%p", frame);
+#endif
+	return std::string(buffer);
+}
+
+std::string CMy_AllocProfiler::GetReport(bool bListAll)
+{
+	std::string text;
+	FSDK_AllocProfileStats stats = GetStats();
+	uint64_t nInterval = m_nSampleBytes;
+	AppendFormat(text, "SDK allocation profile%s\n", IsRunning() ? "" : " (stopped)");
+	AppendFormat(text, "allocations: %llu, %llu bytes, %llu with call stacks (one per %llu bytes)\n",
+		(unsigned long long)stats.allocCount, (unsigned long long)stats.allocBytes, (unsigned long long)stats.sampledCount, (unsigned long long)nInterval);
+	AppendFormat(text, "live: %llu blocks, %llu bytes, %llu handles\n\n",
+		(unsigned long long)stats.liveBlocks, (unsigned long long)stats.liveBytes, (unsigned long long)stats.liveHandles);
+
+	text += "size below       allocs            bytes      live blocks       live bytes\n";
+	for (int i = 0; i < FSDK_PROFILE_BUCKETS; i++)
+	{
+		if (m_Buckets[i].allocs == 0 && m_Buckets[i].liveBlocks == 0)
+			continue;
+		char limit[32];
+		if (i == FSDK_PROFILE_BUCKETS - 1)
+			snprintf(limit, sizeof(limit), "max");
+		else
+			snprintf(limit, sizeof(limit), "%llu", (unsigned long long)1 << i);
+		AppendFormat(text, "%10s %12llu %16llu %16llu %16llu\n", limit, (unsigned long long)m_Buckets[i].allocs.load(),
+			(unsigned long long)m_Buckets[i].bytes.load(), (unsigned long long)m_Buckets[i].liveBlocks.load(), (unsigned long long)m_Buckets[i].liveBytes.load());
+	}
+
+	//Live sampled blocks per call site. A sample stands for at least the interval it was drawn from.
+	struct Site
+	{
+		uint32_t	stack;
+		uint64_t	blocks;
+		uint64_t	bytes;
+		uint64_t	estimate;
+	};
+	std::vector<Block> blocks;
+	std::vector<const void*> addresses;
+	std::unordered_map<uint32_t, Site> sites;
+	for (int i = 0; i < FSDK_PROFILE_SHARDS; i++)
+	{
+		std::lock_guard<std::mutex> lock(m_Shards[i].lock);
+		for (std::unordered_map<const void*, Block>::const_iterator it = m_Shards[i].blocks.begin(); it != m_Shards[i].blocks.end(); ++it)
+		{
+			if (bListAll)
+			{
+				addresses.push_back(it->first);
+				blocks.push_back(it->second);
+			}
+			if (!it->second.stack)
+				continue;
+			Site& site = sites[it->second.stack];
+			site.stack = it->second.stack;
+			site.blocks++;
+			site.bytes += it->second.size;
+			site.estimate += std::max<uint64_t>(it->second.size, nInterval);
+		}
+	}
+	std::vector<Site> ordered;
+	for (std::unordered_map<uint32_t, Site>::const_iterator it = sites.begin(); it != sites.end(); ++it)
+		ordered.push_back(it->second);
+	std::sort(ordered.begin(), ordered.end(), [](const Site& a, const Site& b) { return a.estimate > b.estimate; });
+	size_t nSites = bListAll ? ordered.size() : std::min<size_t>(ordered.size(), FSDK_PROFILE_TOPSITES);
+
+	std::lock_guard<std::mutex> stackLock(m_StackLock);
+	AppendFormat(text, "\nlive call sites: %llu\n", (unsigned long long)ordered.size());
+	for (size_t i = 0; i < nSites; i++)
+	{
+		const Stack& stack = m_Stacks[ordered[i].stack - 1];
+		AppendFormat(text, "site %u: %llu sampled blocks, %llu bytes, about %llu bytes live\n", ordered[i].stack,
+			(unsigned long long)ordered[i].blocks, (unsigned long long)ordered[i].bytes, (unsigned long long)ordered[i].estimate);
+		for (uint32_t j = 0; j < stack.depth; j++)
+			AppendFormat(text, "    %s\n", FormatFrame(stack.frames[j]).c_str());
+	}
+	if (!bListAll)
+		return text;
+
+	std::lock_guard<std::mutex> handleLock(m_HandleLock);
+	AppendFormat(text, "\nlive handles: %llu\n", (unsigned long long)m_Handles.size());
+	for (std::unordered_map<const void*, Handle>::const_iterator it = m_Handles.begin(); it != m_Handles.end(); ++it)
+	{
+		AppendFormat(text, "%s %p\n", g_HandleNames[it->second.type], it->first);
+		if (!it->second.stack)
+			continue;
+		const Stack& stack = m_Stacks[it->second.stack - 1];
+		for (uint32_t j = 0; j < stack.depth; j++)
+			AppendFormat(text, "    %s\n", FormatFrame(stack.frames[j]).c_str());
+	}
+
+	AppendFormat(text, "\nlive blocks: %llu\n", (unsigned long long)blocks.size());
+	for (size_t i = 0; i < blocks.size(); i++)
+	{
+		if (blocks[i].stack)
+			AppendFormat(text, "%p %llu bytes, site %u\n", addresses[i], (unsigned long long)blocks[i].size, blocks[i].stack);
+		else
+			AppendFormat(text, "%p %llu bytes\n", addresses[i], (unsigned long long)blocks[i].size);
+	}
+	return text;
+}
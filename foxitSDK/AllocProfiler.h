@@ -0,0 +1,140 @@
+﻿#pragma once
+
+/** Common header files. */
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace foxitSDK
+{
+	//Kinds of SDK objects whose handles CMy_AllocProfiler keeps track of.
+	enum FSDK_HandleType
+	{
+		FSDK_HANDLE_DOCUMENT = 0,
+		FSDK_HANDLE_PAGE,			// A parsed page, released by FSPDF_Page_Clear.
+		FSDK_HANDLE_TEXTPAGE,
+		FSDK_HANDLE_BITMAP,
+		FSDK_HANDLE_RENDERER,
+		FSDK_HANDLE_RENDERCONTEXT,
+		FSDK_HANDLE_PROGRESS,
+		FSDK_HANDLE_COUNT
+	};
+
+	//Counters of CMy_AllocProfiler since it was started.
+	struct FSDK_AllocProfileStats
+	{
+		uint64_t	allocCount;
+		uint64_t	allocBytes;
+		uint64_t	sampledCount;		// Allocations whose call stack was captured.
+		uint64_t	liveBlocks;
+		uint64_t	liveBytes;
+		uint64_t	liveHandles;
+	};
+
+	//Opt-in profiler fed by the SDK memory handler.
+	//While running it keeps a log2 histogram of allocation sizes, the size of every live block, and the call stack of
+	//about one allocation per nSampleBytes allocated on each thread, so large and frequent allocations are both seen.
+	//Wrapper code reports the SDK handles it creates and releases, so whatever is still alive can be listed at exit.
+	//Blocks allocated before Start are unknown to it and their frees are ignored.
+	class CMy_AllocProfiler
+	{
+	public:
+		CMy_AllocProfiler();
+		~CMy_AllocProfiler();
+
+		//Drop what was recorded before and start recording. 0 captures the stack of every allocation.
+		void		Start(uint64_t nSampleBytes);
+		//Stop recording. What was recorded stays available for GetReport.
+		void		Stop();
+		bool		IsRunning() const { return m_bRunning.load(std::memory_order_relaxed); }
+
+		//Memory handler hooks, called after the underlying allocator. No-ops while stopped.
+		void		OnAlloc(void* ptr, size_t size);
+		//newPtr is NULL if the reallocation failed. The block keeps the call stack of its first allocation.
+		void		OnRealloc(void* oldPtr, void* newPtr, size_t newSize);
+		void		OnFree(void* ptr);
+
+		void		OnHandleCreated(FSDK_HandleType type, const void* handle);
+		void		OnHandleReleased(const void* handle);
+
+		FSDK_AllocProfileStats	GetStats();
+
+		//Text report: size histogram and the call sites holding the most live memory.
+		//With bListAll every live handle and block follows, which is what a leak report at exit needs.
+		std::string	GetReport(bool bListAll);
+
+	private:
+		enum
+		{
+			FSDK_PROFILE_MAXFRAMES = 16,
+			FSDK_PROFILE_BUCKETS = 33,		// Bucket i holds sizes below 2^i, the last one everything from 2GB.
+			FSDK_PROFILE_SHARDS = 16,
+			FSDK_PROFILE_TOPSITES = 20
+		};
+
+		struct Stack
+		{
+			void*		frames[FSDK_PROFILE_MAXFRAMES];
+			uint32_t	depth;
+		};
+
+		struct Block
+		{
+			size_t		size;
+			uint32_t	stack;			// Index into m_Stacks plus one, 0 if not sampled.
+		};
+
+		struct Handle
+		{
+			FSDK_HandleType	type;
+			uint32_t	stack;
+		};
+
+		//Live blocks are spread over shards by address to keep lock contention down.
+		struct Shard
+		{
+			std::mutex	lock;
+			std::unordered_map<const void*, Block>	blocks;
+		};
+
+		struct Bucket
+		{
+			std::atomic<uint64_t>	allocs;
+			std::atomic<uint64_t>	bytes;
+			std::atomic<uint64_t>	liveBlocks;
+			std::atomic<uint64_t>	liveBytes;
+		};
+
+		static int		SizeToBucket(size_t size);
+		Shard&			GetShard(const void* ptr);
+		//Whether this allocation is due for a stack, counting down per thread.
+		bool			ShouldSample(size_t size);
+		//Capture the caller's stack and return its id, 0 on failure. Identical stacks share an id.
+		uint32_t		RecordStack();
+		void			AddBlock(void* ptr, size_t size, uint32_t iStack);
+		//Remove a block, returns false if it is unknown.
+		bool			RemoveBlock(void* ptr, Block* pBlock);
+
+		static std::string	FormatFrame(void* frame);
+
+		std::atomic<bool>		m_bRunning;
+		std::atomic<uint64_t>	m_nSampleBytes;
+		std::atomic<uint32_t>	m_iGeneration;		// Bumped by Start so threads restart their countdown.
+		std::atomic<uint64_t>	m_nAllocs;
+		std::atomic<uint64_t>	m_nAllocBytes;
+		std::atomic<uint64_t>	m_nSampled;
+		Bucket					m_Buckets[FSDK_PROFILE_BUCKETS];
+		Shard					m_Shards[FSDK_PROFILE_SHARDS];
+
+		std::mutex				m_StackLock;
+		std::vector<Stack>		m_Stacks;
+		std::unordered_map<uint64_t, std::vector<uint32_t> >	m_StackIndex;		// Stack hash to ids.
+
+		std::mutex				m_HandleLock;
+		std::unordered_map<const void*, Handle>	m_Handles;
+	};
+}
@@ -0,0 +1,354 @@
+﻿#include "BlockCache.h"
+
+#include <string.h>
+#include <vector>
+
+using namespace foxitSDK;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Class CMy_AccessPattern
+CMy_AccessPattern::CMy_AccessPattern(uint64_t nGapTolerance)
+{
+	m_nGapTolerance = nGapTolerance;
+	Reset();
+}
+
+void CMy_AccessPattern::Reset()
+{
+	m_bHasLast = false;
+	m_iLastOffset = 0;
+	m_iLastEnd = 0;
+	m_iStride = 0;
+	m_nRun = 0;
+	m_Pattern = FSDK_ACCESS_RANDOM;
+}
+
+FSDK_AccessPatternType CMy_AccessPattern::Update(uint64_t offset, size_t size)
+{
+	FSDK_AccessPatternType pattern = FSDK_ACCESS_RANDOM;
+	if (m_bHasLast)
+	{
+		int64_t iDelta = (int64_t)(offset - m_iLastOffset);
+		if (offset >= m_iLastOffset && offset <= m_iLastEnd + m_nGapTolerance)
+			pattern = FSDK_ACCESS_SEQUENTIAL;
+		else if (iDelta == m_iStride)
+			pattern = FSDK_ACCESS_STRIDED;
+		m_iStride = iDelta;
+	}
+
+	if (pattern == FSDK_ACCESS_RANDOM)
+		m_nRun = 0;
+	else
+		m_nRun = pattern == m_Pattern ? m_nRun + 1 : 1;
+	m_Pattern = pattern;
+	m_bHasLast = true;
+	m_iLastOffset = offset;
+	m_iLastEnd = offset + size;
+	return pattern;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Class CMy_BlockCache
+CMy_BlockCache::CMy_BlockCache(IMy_FileSource* pSource, bool bOwnSource, size_t nBlockSize, size_t nMaxBlocks, size_t nMaxReadAhead)
+{
+	m_pSource = pSource;
+	m_bOwnSource = bOwnSource;
+	m_iFileSize = pSource ? pSource->GetSize() : 0;
+	m_nBlockSize = nBlockSize ? nBlockSize : 64 * 1024;
+	m_nMaxBlocks = nMaxBlocks < 2 ? 2 : nMaxBlocks;
+	//Keep at least half of the cache for blocks that were actually asked for.
+	m_nMaxReadAhead = nMaxReadAhead < m_nMaxBlocks / 2 ? nMaxReadAhead : m_nMaxBlocks / 2;
+	//Reads that skip less than a block still hit the next block, so they count as sequential.
+	m_Pattern = CMy_AccessPattern(m_nBlockSize);
+	m_nReadAhead = 0;
+	memset(&m_Stats, 0, sizeof(m_Stats));
+}
+
+CMy_BlockCache::~CMy_BlockCache()
+{
+	Clear();
+	if (m_bOwnSource && m_pSource)
+		delete m_pSource;
+	m_pSource = NULL;
+}
+
+uint64_t CMy_BlockCache::GetSize()
+{
+	return m_iFileSize;
+}
+
+void CMy_BlockCache::Clear()
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	for (auto it = m_Blocks.begin(); it != m_Blocks.end(); ++it)
+		DropBlock(&it->second);
+	m_Blocks.clear();
+	m_LRU.clear();
+	m_Pattern.Reset();
+	m_nReadAhead = 0;
+}
+
+uint64_t CMy_BlockCache::GetCachedBytes()
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	uint64_t nBytes = 0;
+	for (auto it = m_Blocks.begin(); it != m_Blocks.end(); ++it)
+		nBytes += it->second.length;
+	return nBytes;
+}
+
+FSDK_BlockCacheStats CMy_BlockCache::GetStats()
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	return m_Stats;
+}
+
+void CMy_BlockCache::ResetStats()
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	memset(&m_Stats, 0, sizeof(m_Stats));
+}
+
+void CMy_BlockCache::ChooseGeometry(uint64_t iFileSize, size_t* pBlockSize, size_t* pMaxBlocks, size_t* pMaxReadAhead)
+{
+	const uint64_t MB = 1024 * 1024;
+	size_t nBlockSize, nMaxBlocks;
+	if (iFileSize < 64 * MB)
+	{
+		nBlockSize = 64 * 1024;
+		nMaxBlocks = 256;
+	}
+	else if (iFileSize < 1024 * MB)
+	{
+		nBlockSize = 128 * 1024;
+		nMaxBlocks = 256;
+	}
+	else if (iFileSize < 4096 * MB)
+	{
+		nBlockSize = 256 * 1024;
+		nMaxBlocks = 192;
+	}
+	else
+	{
+		nBlockSize = 1024 * 1024;
+		nMaxBlocks = 64;
+	}
+
+	//Never read ahead more than 4MB in one go.
+	size_t nMaxReadAhead = (size_t)(4 * MB) / nBlockSize;
+	if (nMaxReadAhead > nMaxBlocks / 2)
+		nMaxReadAhead = nMaxBlocks / 2;
+
+	if (pBlockSize)
+		*pBlockSize = nBlockSize;
+	if (pMaxBlocks)
+		*pMaxBlocks = nMaxBlocks;
+	if (pMaxReadAhead)
+		*pMaxReadAhead = nMaxReadAhead;
+}
+
+CMy_BlockCache* CMy_BlockCache::CreateForSource(IMy_FileSource* pSource, bool bOwnSource)
+{
+	size_t nBlockSize = 0, nMaxBlocks = 0, nMaxReadAhead = 0;
+	ChooseGeometry(pSource ? pSource->GetSize() : 0, &nBlockSize, &nMaxBlocks, &nMaxReadAhead);
+	return new CMy_BlockCache(pSource, bOwnSource, nBlockSize, nMaxBlocks, nMaxReadAhead);
+}
+
+bool CMy_BlockCache::ReadAt(uint64_t offset, void* buffer, size_t size)
+{
+	if (!m_pSource || !buffer || offset > m_iFileSize || size > m_iFileSize - offset)
+		return false;
+	if (size == 0)
+		return true;
+
+	std::lock_guard<std::mutex> lock(m_Lock);
+	m_Stats.bytesRequested += size;
+	FSDK_AccessPatternType pattern = m_Pattern.Update(offset, size);
+	if (pattern == FSDK_ACCESS_SEQUENTIAL)
+		m_Stats.sequentialReads++;
+	else if (pattern == FSDK_ACCESS_STRIDED)
+		m_Stats.stridedReads++;
+
+	unsigned char* pDest = (unsigned char*)buffer;
+	uint64_t iFirst = offset / m_nBlockSize;
+	uint64_t iLast = (offset + size - 1) / m_nBlockSize;
+	bool bMissed = false;
+	size_t nBefore = 0, nAfter = 0;
+	for (uint64_t index = iFirst; index <= iLast;)
+	{
+		uint64_t iRunLast = index;
+		Block* pBlock = FindBlock(index);
+		if (pBlock)
+		{
+			m_Stats.hits++;
+		}
+		else
+		{
+			//The read-ahead window follows the pattern of the request, adapt it once.
+			if (!bMissed)
+			{
+				ReadAheadFor(pattern, offset, size, &nBefore, &nAfter);
+				bMissed = true;
+			}
+
+			//Coalesce the adjacent missing blocks of the request, at most half the cache in one go
+			//so the blocks just loaded can't be evicted before they are copied.
+			while (iRunLast < iLast && iRunLast - index + 1 < m_nMaxBlocks / 2 && m_Blocks.find(iRunLast + 1) == m_Blocks.end())
+				iRunLast++;
+			m_Stats.misses += iRunLast - index + 1;
+
+			pBlock = LoadBlocks(index, iRunLast, index == iFirst ? nBefore : 0, iRunLast == iLast ? nAfter : 0);
+			if (!pBlock)
+				return false;
+		}
+
+		for (; index <= iRunLast; index++)
+		{
+			if (!pBlock)
+				pBlock = &m_Blocks.find(index)->second;
+			pBlock->prefetched = false;
+
+			uint64_t iBlockStart = index * m_nBlockSize;
+			size_t nBegin = (size_t)(index == iFirst ? offset - iBlockStart : 0);
+			size_t nEnd = (size_t)(index == iLast ? offset + size - iBlockStart : pBlock->length);
+			memcpy(pDest, pBlock->data + nBegin, nEnd - nBegin);
+			pDest += nEnd - nBegin;
+			pBlock = NULL;
+		}
+	}
+	return true;
+}
+
+void CMy_BlockCache::ReadAheadFor(FSDK_AccessPatternType pattern, uint64_t offset, size_t size, size_t* pBefore, size_t* pAfter)
+{
+	*pBefore = 0;
+	*pAfter = 0;
+	if (pattern == FSDK_ACCESS_RANDOM)
+	{
+		m_nReadAhead = 0;
+		return;
+	}
+
+	//Grow the window while the reader keeps its pattern.
+	m_nReadAhead = m_nReadAhead ? (m_nReadAhead * 2 < m_nMaxReadAhead ? m_nReadAhead * 2 : m_nMaxReadAhead) : 1;
+	if (m_nReadAhead > m_nMaxReadAhead)
+		m_nReadAhead = m_nMaxReadAhead;
+	if (pattern == FSDK_ACCESS_SEQUENTIAL)
+	{
+		*pAfter = m_nReadAhead;
+		return;
+	}
+
+	//Strided: read the span up to the furthest next stride that still fits in the window.
+	//Strides wider than the window are left alone, they would mostly load bytes nobody asked for.
+	uint64_t iFirst = offset / m_nBlockSize;
+	uint64_t iLast = (offset + size - 1) / m_nBlockSize;
+	int64_t iStride = m_Pattern.GetStride();
+	if (iStride > 0)
+	{
+		uint64_t iLimit = (iLast + m_nReadAhead + 1) * m_nBlockSize;
+		uint64_t k = (iLimit - offset - size) / (uint64_t)iStride;
+		if (k > 0)
+		{
+			uint64_t iEnd = offset + k * (uint64_t)iStride + size - 1;
+			*pAfter = (size_t)(iEnd / m_nBlockSize - iLast);
+		}
+	}
+	else if (iStride < 0)
+	{
+		uint64_t iLimit = iFirst > m_nReadAhead ? (iFirst - m_nReadAhead) * m_nBlockSize : 0;
+		uint64_t k = (offset - iLimit) / (uint64_t)(-iStride);
+		if (k > 0)
+			*pBefore = (size_t)(iFirst - (offset - k * (uint64_t)(-iStride)) / m_nBlockSize);
+	}
+}
+
+CMy_BlockCache::Block* CMy_BlockCache::FindBlock(uint64_t index)
+{
+	auto it = m_Blocks.find(index);
+	if (it == m_Blocks.end())
+		return NULL;
+	m_LRU.splice(m_LRU.begin(), m_LRU, it->second.lru);
+	return &it->second;
+}
+
+CMy_BlockCache::Block* CMy_BlockCache::LoadBlocks(uint64_t iWantFirst, uint64_t iWantLast, size_t nBefore, size_t nAfter)
+{
+	if (iWantFirst * m_nBlockSize >= m_iFileSize)
+		return NULL;
+
+	//Stop the read-ahead at either end of the file or at the first block that is already cached.
+	uint64_t iBlockCount = (m_iFileSize + m_nBlockSize - 1) / m_nBlockSize;
+	size_t nAhead = 0;
+	while (nAhead < nAfter && iWantLast + nAhead + 1 < iBlockCount && m_Blocks.find(iWantLast + nAhead + 1) == m_Blocks.end())
+		nAhead++;
+	size_t nBehind = 0;
+	while (nBehind < nBefore && iWantFirst > nBehind && m_Blocks.find(iWantFirst - nBehind - 1) == m_Blocks.end())
+		nBehind++;
+
+	uint64_t index = iWantFirst - nBehind;
+	size_t count = (size_t)(iWantLast - iWantFirst + 1) + nBehind + nAhead;
+	uint64_t iStart = index * m_nBlockSize;
+	uint64_t iEnd = iStart + (uint64_t)count * m_nBlockSize;
+	if (iEnd > m_iFileSize)
+		iEnd = m_iFileSize;
+	size_t nLength = (size_t)(iEnd - iStart);
+
+	//One source read for the whole run, then split it into blocks.
+	std::vector<unsigned char> staging(nLength);
+	if (!m_pSource->ReadAt(iStart, staging.data(), nLength))
+		return NULL;
+	m_Stats.sourceReads++;
+	m_Stats.bytesRead += nLength;
+	m_Stats.mergedReads += iWantLast - iWantFirst;
+	m_Stats.readAheadBlocks += nBehind + nAhead;
+
+	//Insert read-ahead blocks first and the wanted ones backwards, so iWantFirst ends up most recently used.
+	size_t nWanted = count - nBehind - nAhead;
+	for (size_t k = 0; k < nBehind; k++)
+		InsertBlock(index + k, staging.data() + k * m_nBlockSize, m_nBlockSize, true);
+	for (size_t k = nBehind + nWanted; k < count; k++)
+		InsertBlock(index + k, staging.data() + k * m_nBlockSize, nLength - k * m_nBlockSize < m_nBlockSize ? nLength - k * m_nBlockSize : m_nBlockSize, true);
+	for (size_t k = nBehind + nWanted; k-- > nBehind;)
+		InsertBlock(index + k, staging.data() + k * m_nBlockSize, nLength - k * m_nBlockSize < m_nBlockSize ? nLength - k * m_nBlockSize : m_nBlockSize, false);
+
+	EvictIfNeeded();
+	return &m_Blocks.find(iWantFirst)->second;
+}
+
+void CMy_BlockCache::InsertBlock(uint64_t index, const unsigned char* pData, size_t nLength, bool bPrefetched)
+{
+	Block block;
+	block.data = new unsigned char[m_nBlockSize];
+	block.length = nLength;
+	block.prefetched = bPrefetched;
+	if (bPrefetched)
+		m_Stats.prefetchBytes += nLength;
+	memcpy(block.data, pData, nLength);
+	m_LRU.push_front(index);
+	block.lru = m_LRU.begin();
+	m_Blocks[index] = block;
+}
+
+void CMy_BlockCache::DropBlock(Block* pBlock)
+{
+	if (pBlock->prefetched)
+		m_Stats.wastedPrefetchBytes += pBlock->length;
+	delete[] pBlock->data;
+	pBlock->data = NULL;
+}
+
+void CMy_BlockCache::EvictIfNeeded()
+{
+	while (m_Blocks.size() > m_nMaxBlocks && !m_LRU.empty())
+	{
+		uint64_t index = m_LRU.back();
+		m_LRU.pop_back();
+		auto it = m_Blocks.find(index);
+		if (it != m_Blocks.end())
+		{
+			DropBlock(&it->second);
+			m_Blocks.erase(it);
+		}
+	}
+}
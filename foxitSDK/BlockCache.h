@@ -0,0 +1,127 @@
+﻿#pragma once
+
+/** Common header files. */
+#include <stdint.h>
+#include <stddef.h>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+#include "FileSource.h"
+
+namespace foxitSDK
+{
+	//Counters collected by CMy_BlockCache.
+	struct FSDK_BlockCacheStats
+	{
+		uint64_t	hits;				// Blocks served from the cache.
+		uint64_t	misses;				// Blocks that had to be read from the source.
+		uint64_t	bytesRequested;		// Bytes asked for by callers of ReadAt.
+		uint64_t	bytesRead;			// Bytes actually read from the source, read-ahead included.
+		uint64_t	readAheadBlocks;	// Blocks loaded speculatively beyond the requested range.
+		uint64_t	sourceReads;		// ReadAt calls on the source.
+		uint64_t	mergedReads;		// Per-block reads saved by loading adjacent missing blocks in one source read.
+		uint64_t	prefetchBytes;		// Bytes loaded speculatively.
+		uint64_t	wastedPrefetchBytes;	// Speculative bytes evicted or cleared without ever being read.
+		uint64_t	sequentialReads;	// Requests classified as sequential.
+		uint64_t	stridedReads;		// Requests classified as strided.
+	};
+
+	//Access patterns recognized by CMy_AccessPattern.
+	enum FSDK_AccessPatternType
+	{
+		FSDK_ACCESS_RANDOM = 0,
+		FSDK_ACCESS_SEQUENTIAL,
+		FSDK_ACCESS_STRIDED
+	};
+
+	//Classifies a stream of reads by their offsets.
+	//A read is sequential when it starts inside the previous one or at most nGapTolerance bytes after it,
+	//and strided once the distance between read starts repeats, forwards or backwards.
+	class CMy_AccessPattern
+	{
+	public:
+		CMy_AccessPattern(uint64_t nGapTolerance = 0);
+
+		//Feed one read and return the pattern it continues.
+		FSDK_AccessPatternType	Update(uint64_t offset, size_t size);
+		void					Reset();
+
+		FSDK_AccessPatternType	GetPattern() const { return m_Pattern; }
+		int64_t					GetStride() const { return m_iStride; }
+		//Number of reads in a row that followed the current pattern.
+		uint32_t				GetRunLength() const { return m_nRun; }
+
+	private:
+		uint64_t				m_nGapTolerance;
+		bool					m_bHasLast;
+		uint64_t				m_iLastOffset;
+		uint64_t				m_iLastEnd;
+		int64_t					m_iStride;		// Distance between the last two read starts.
+		uint32_t				m_nRun;
+		FSDK_AccessPatternType	m_Pattern;
+	};
+
+	//Block cache with adaptive read-ahead in front of an IMy_FileSource.
+	//Blocks are aligned to nBlockSize in the file and kept in LRU order, at most nMaxBlocks of them.
+	//Adjacent missing blocks of a request are loaded with one source read. A miss in a sequential or strided
+	//run doubles the read-ahead window, any other miss resets it. Sequential runs read ahead the next blocks,
+	//strided runs read the span up to the next strides when it fits in the window.
+	class CMy_BlockCache : public IMy_FileSource
+	{
+	public:
+		CMy_BlockCache(IMy_FileSource* pSource, bool bOwnSource, size_t nBlockSize = 64 * 1024, size_t nMaxBlocks = 256, size_t nMaxReadAhead = 16);
+		virtual ~CMy_BlockCache();
+
+		virtual uint64_t	GetSize();
+		virtual bool		ReadAt(uint64_t offset, void* buffer, size_t size);
+
+		//Drop every cached block. Counters are kept.
+		void				Clear();
+
+		//Bytes held in cached blocks.
+		uint64_t			GetCachedBytes();
+
+		//Pick cache geometry for a file of iFileSize bytes. Blocks get larger as the file grows, so the
+		//number of entries (and their metadata) stays bounded and read-ahead is capped in bytes, not blocks.
+		static void			ChooseGeometry(uint64_t iFileSize, size_t* pBlockSize, size_t* pMaxBlocks, size_t* pMaxReadAhead);
+
+		//Create a cache sized with ChooseGeometry for pSource.
+		static CMy_BlockCache*	CreateForSource(IMy_FileSource* pSource, bool bOwnSource);
+
+		FSDK_BlockCacheStats	GetStats();
+		void					ResetStats();
+
+	private:
+		struct Block
+		{
+			unsigned char*					data;
+			size_t							length;
+			std::list<uint64_t>::iterator	lru;
+			bool							prefetched;		// Loaded by read-ahead and not read yet.
+		};
+
+		Block*				FindBlock(uint64_t index);
+		//Load the missing blocks [iWantFirst, iWantLast] with nBefore/nAfter extra blocks of read-ahead, in one read.
+		Block*				LoadBlocks(uint64_t iWantFirst, uint64_t iWantLast, size_t nBefore, size_t nAfter);
+		void				ReadAheadFor(FSDK_AccessPatternType pattern, uint64_t offset, size_t size, size_t* pBefore, size_t* pAfter);
+		void				InsertBlock(uint64_t index, const unsigned char* pData, size_t nLength, bool bPrefetched);
+		void				DropBlock(Block* pBlock);
+		void				EvictIfNeeded();
+
+		IMy_FileSource*		m_pSource;
+		bool				m_bOwnSource;
+		uint64_t			m_iFileSize;
+		size_t				m_nBlockSize;
+		size_t				m_nMaxBlocks;
+		size_t				m_nMaxReadAhead;
+
+		std::mutex								m_Lock;
+		std::unordered_map<uint64_t, Block>		m_Blocks;
+		std::list<uint64_t>						m_LRU;			// Most recently used at the front.
+
+		CMy_AccessPattern	m_Pattern;
+		size_t				m_nReadAhead;		// Current read-ahead window, in blocks.
+		FSDK_BlockCacheStats	m_Stats;
+	};
+}
@@ -0,0 +1,139 @@
+﻿#include "FileSource.h"
+
+#include <chrono>
+#include <thread>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+using namespace foxitSDK;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Class CMy_PosixFileSource
+CMy_PosixFileSource::CMy_PosixFileSource()
+{
+#ifdef _WIN32
+	m_pFile = NULL;
+#else
+	m_iFd = -1;
+#endif
+	m_iFileSize = 0;
+}
+
+CMy_PosixFileSource::~CMy_PosixFileSource()
+{
+	Close();
+}
+
+bool CMy_PosixFileSource::Open(const char* path)
+{
+	Close();
+	if (!path)
+		return false;
+
+#ifdef _WIN32
+	if (fopen_s(&m_pFile, path, "rb") != 0 || !m_pFile)
+	{
+		m_pFile = NULL;
+		return false;
+	}
+	_fseeki64(m_pFile, 0, SEEK_END);
+	m_iFileSize = (uint64_t)_ftelli64(m_pFile);
+#else
+	m_iFd = open(path, O_RDONLY);
+	if (m_iFd < 0)
+		return false;
+	struct stat st;
+	if (fstat(m_iFd, &st) != 0)
+	{
+		Close();
+		return false;
+	}
+	m_iFileSize = (uint64_t)st.st_size;
+#endif
+	return true;
+}
+
+void CMy_PosixFileSource::Close()
+{
+#ifdef _WIN32
+	if (m_pFile)
+		fclose(m_pFile);
+	m_pFile = NULL;
+#else
+	if (m_iFd >= 0)
+		close(m_iFd);
+	m_iFd = -1;
+#endif
+	m_iFileSize = 0;
+}
+
+uint64_t CMy_PosixFileSource::GetSize()
+{
+	return m_iFileSize;
+}
+
+bool CMy_PosixFileSource::ReadAt(uint64_t offset, void* buffer, size_t size)
+{
+	if (!buffer || offset > m_iFileSize || size > m_iFileSize - offset)
+		return false;
+
+#ifdef _WIN32
+	std::lock_guard<std::mutex> lock(m_Lock);
+	if (!m_pFile || _fseeki64(m_pFile, (__int64)offset, SEEK_SET) != 0)
+		return false;
+	return fread(buffer, 1, size, m_pFile) == size;
+#else
+	if (m_iFd < 0)
+		return false;
+	unsigned char* pDest = (unsigned char*)buffer;
+	while (size > 0)
+	{
+		ssize_t nRead = pread(m_iFd, pDest, size, (off_t)offset);
+		if (nRead <= 0)
+			return false;
+		pDest += nRead;
+		offset += (uint64_t)nRead;
+		size -= (size_t)nRead;
+	}
+	return true;
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Class CMy_ThrottledFileSource
+CMy_ThrottledFileSource::CMy_ThrottledFileSource(IMy_FileSource* pSource, bool bOwnSource, uint32_t nLatencyMs, uint64_t iBytesPerSecond)
+{
+	m_pSource = pSource;
+	m_bOwnSource = bOwnSource;
+	m_nLatencyMs = nLatencyMs;
+	m_iBytesPerSecond = iBytesPerSecond;
+}
+
+CMy_ThrottledFileSource::~CMy_ThrottledFileSource()
+{
+	if (m_bOwnSource && m_pSource)
+		delete m_pSource;
+	m_pSource = NULL;
+}
+
+uint64_t CMy_ThrottledFileSource::GetSize()
+{
+	return m_pSource ? m_pSource->GetSize() : 0;
+}
+
+bool CMy_ThrottledFileSource::ReadAt(uint64_t offset, void* buffer, size_t size)
+{
+	if (!m_pSource)
+		return false;
+
+	uint64_t iDelayUs = (uint64_t)m_nLatencyMs * 1000;
+	if (m_iBytesPerSecond)
+		iDelayUs += (uint64_t)size * 1000000 / m_iBytesPerSecond;
+	if (iDelayUs)
+		std::this_thread::sleep_for(std::chrono::microseconds(iDelayUs));
+	return m_pSource->ReadAt(offset, buffer, size);
+}
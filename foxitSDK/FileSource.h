@@ -0,0 +1,66 @@
+﻿#pragma once
+
+/** Common header files. */
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <mutex>
+
+namespace foxitSDK
+{
+	//Random-access byte source behind the SDK file callbacks.
+	//Implementations must allow ReadAt to be called from several threads.
+	class IMy_FileSource
+	{
+	public:
+		virtual ~IMy_FileSource() {}
+
+		//Total size of the source, in bytes.
+		virtual uint64_t	GetSize() = 0;
+
+		//Read exactly size bytes starting at offset. Returns false on short read or I/O error.
+		virtual bool		ReadAt(uint64_t offset, void* buffer, size_t size) = 0;
+	};
+
+	//Source over a plain file on disk (pread on POSIX, stdio elsewhere).
+	//Has no WinRT dependency, so the read path can be driven headlessly.
+	class CMy_PosixFileSource : public IMy_FileSource
+	{
+	public:
+		CMy_PosixFileSource();
+		virtual ~CMy_PosixFileSource();
+
+		bool				Open(const char* path);
+		void				Close();
+
+		virtual uint64_t	GetSize();
+		virtual bool		ReadAt(uint64_t offset, void* buffer, size_t size);
+
+	private:
+#ifdef _WIN32
+		FILE*				m_pFile;
+		std::mutex			m_Lock;			// stdio keeps a single file position.
+#else
+		int					m_iFd;
+#endif
+		uint64_t			m_iFileSize;
+	};
+
+	//IMy_FileSource that simulates slow storage: every read waits nLatencyMs plus size / iBytesPerSecond.
+	class CMy_ThrottledFileSource : public IMy_FileSource
+	{
+	public:
+		//iBytesPerSecond of 0 means no bandwidth limit.
+		CMy_ThrottledFileSource(IMy_FileSource* pSource, bool bOwnSource, uint32_t nLatencyMs, uint64_t iBytesPerSecond);
+		virtual ~CMy_ThrottledFileSource();
+
+		virtual uint64_t	GetSize();
+		virtual bool		ReadAt(uint64_t offset, void* buffer, size_t size);
+
+	private:
+		IMy_FileSource*		m_pSource;
+		bool				m_bOwnSource;
+		uint32_t			m_nLatencyMs;
+		uint64_t			m_iBytesPerSecond;
+	};
+}
@@ -0,0 +1,176 @@
+﻿#include "IncrementalSave.h"
+
+#include <string.h>
+#include <vector>
+
+using namespace foxitSDK;
+
+//Journal layout: magic, base size, tail size, checksum of the tail (all little endian), then the tail itself.
+#define FSDK_JOURNAL_MAGIC			"FSDKAPJ1"
+#define FSDK_JOURNAL_HEADERSIZE		32
+#define FSDK_APPEND_PIECESIZE		(1024 * 1024)
+
+static void PutUInt64(unsigned char* pDest, uint64_t value)
+{
+	for (int i = 0; i < 8; i++)
+		pDest[i] = (unsigned char)(value >> (i * 8));
+}
+
+static uint64_t GetUInt64(const unsigned char* pSrc)
+{
+	uint64_t value = 0;
+	for (int i = 0; i < 8; i++)
+		value |= (uint64_t)pSrc[i] << (i * 8);
+	return value;
+}
+
+//FNV-1a, enough to tell a complete journal from a torn one.
+static uint64_t UpdateChecksum(uint64_t hash, const unsigned char* pData, size_t size)
+{
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= pData[i];
+		hash *= 0x100000001B3ULL;
+	}
+	return hash;
+}
+
+static const uint64_t FSDK_CHECKSUM_SEED = 0xCBF29CE484222325ULL;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Class CMy_IncrementalAppender
+CMy_IncrementalAppender::CMy_IncrementalAppender(IMy_FileSink* pTarget, IMy_FileSink* pJournal, uint64_t iBaseSize)
+{
+	m_pTarget = pTarget;
+	m_pJournal = pJournal;
+	m_iBaseSize = iBaseSize;
+}
+
+bool CMy_IncrementalAppender::Append(CMy_WriteBuffer* pDelta, uint64_t iTailSize, FSDK_IncrementalSaveStats* pStats)
+{
+	if (pStats)
+		memset(pStats, 0, sizeof(FSDK_IncrementalSaveStats));
+	if (!m_pTarget || !pDelta)
+		return false;
+
+	//Someone else changed the file since it was loaded, the SDK's offsets would be wrong.
+	if (m_pTarget->GetSize() != m_iBaseSize + iTailSize)
+		return false;
+
+	if (m_pJournal && !WriteJournal(iTailSize))
+	{
+		ClearJournal();
+		return false;
+	}
+
+	uint64_t iDeltaSize = pDelta->GetSize();
+	if (!CopyToTarget(pDelta, iDeltaSize) || !m_pTarget->Truncate(m_iBaseSize + iDeltaSize) || !m_pTarget->Flush())
+	{
+		if (m_pJournal)
+			Recover(m_pJournal, m_pTarget);
+		else if (m_pTarget->Truncate(m_iBaseSize))
+			m_pTarget->Flush();
+		return false;
+	}
+
+	//Commit: from here on the new revision is the one that survives a crash.
+	if (m_pJournal && !ClearJournal())
+		return false;
+
+	if (pStats)
+	{
+		pStats->bytesWritten = iDeltaSize;
+		pStats->bytesSkipped = m_iBaseSize;
+	}
+	return true;
+}
+
+bool CMy_IncrementalAppender::Recover(IMy_FileSink* pJournal, IMy_FileSink* pTarget)
+{
+	if (!pJournal || !pTarget)
+		return false;
+	if (pJournal->GetSize() < FSDK_JOURNAL_HEADERSIZE)
+		return pJournal->GetSize() == 0 || (pJournal->Truncate(0) && pJournal->Flush());
+
+	unsigned char header[FSDK_JOURNAL_HEADERSIZE];
+	if (!pJournal->ReadAt(0, header, sizeof(header)))
+		return false;
+	uint64_t iBaseSize = GetUInt64(header + 8);
+	uint64_t iTailSize = GetUInt64(header + 16);
+	uint64_t iChecksum = GetUInt64(header + 24);
+
+	//A torn journal means step 1 never finished, the target was not touched yet.
+	bool bComplete = memcmp(header, FSDK_JOURNAL_MAGIC, 8) == 0 && pJournal->GetSize() == FSDK_JOURNAL_HEADERSIZE + iTailSize;
+	std::vector<unsigned char> piece;
+	uint64_t hash = FSDK_CHECKSUM_SEED;
+	for (uint64_t pos = 0; bComplete && pos < iTailSize;)
+	{
+		size_t nCount = (size_t)(iTailSize - pos < FSDK_APPEND_PIECESIZE ? iTailSize - pos : FSDK_APPEND_PIECESIZE);
+		piece.resize(nCount);
+		if (!pJournal->ReadAt(FSDK_JOURNAL_HEADERSIZE + pos, piece.data(), nCount))
+			return false;
+		hash = UpdateChecksum(hash, piece.data(), nCount);
+		pos += nCount;
+	}
+	if (bComplete && hash != iChecksum)
+		bComplete = false;
+
+	if (bComplete)
+	{
+		//Put the previous tail back and cut off whatever the interrupted append wrote.
+		for (uint64_t pos = 0; pos < iTailSize;)
+		{
+			size_t nCount = (size_t)(iTailSize - pos < FSDK_APPEND_PIECESIZE ? iTailSize - pos : FSDK_APPEND_PIECESIZE);
+			piece.resize(nCount);
+			if (!pJournal->ReadAt(FSDK_JOURNAL_HEADERSIZE + pos, piece.data(), nCount) || !pTarget->WriteAt(iBaseSize + pos, piece.data(), nCount))
+				return false;
+			pos += nCount;
+		}
+		if (!pTarget->Truncate(iBaseSize + iTailSize) || !pTarget->Flush())
+			return false;
+	}
+	return pJournal->Truncate(0) && pJournal->Flush();
+}
+
+bool CMy_IncrementalAppender::WriteJournal(uint64_t iTailSize)
+{
+	//Save the previous tail first, the header goes last so a torn journal never looks complete.
+	std::vector<unsigned char> piece;
+	uint64_t hash = FSDK_CHECKSUM_SEED;
+	if (!m_pJournal->Truncate(0))
+		return false;
+	for (uint64_t pos = 0; pos < iTailSize;)
+	{
+		size_t nCount = (size_t)(iTailSize - pos < FSDK_APPEND_PIECESIZE ? iTailSize - pos : FSDK_APPEND_PIECESIZE);
+		piece.resize(nCount);
+		if (!m_pTarget->ReadAt(m_iBaseSize + pos, piece.data(), nCount) || !m_pJournal->WriteAt(FSDK_JOURNAL_HEADERSIZE + pos, piece.data(), nCount))
+			return false;
+		hash = UpdateChecksum(hash, piece.data(), nCount);
+		pos += nCount;
+	}
+
+	unsigned char header[FSDK_JOURNAL_HEADERSIZE];
+	memcpy(header, FSDK_JOURNAL_MAGIC, 8);
+	PutUInt64(header + 8, m_iBaseSize);
+	PutUInt64(header + 16, iTailSize);
+	PutUInt64(header + 24, hash);
+	return m_pJournal->WriteAt(0, header, sizeof(header)) && m_pJournal->Flush();
+}
+
+bool CMy_IncrementalAppender::ClearJournal()
+{
+	return m_pJournal->Truncate(0) && m_pJournal->Flush();
+}
+
+bool CMy_IncrementalAppender::CopyToTarget(CMy_WriteBuffer* pSource, uint64_t iSize)
+{
+	std::vector<unsigned char> piece((size_t)(iSize < FSDK_APPEND_PIECESIZE ? iSize : FSDK_APPEND_PIECESIZE));
+	for (uint64_t pos = 0; pos < iSize;)
+	{
+		size_t nCount = (size_t)(iSize - pos < piece.size() ? iSize - pos : piece.size());
+		if (!pSource->ReadAt(pos, piece.data(), nCount) || !m_pTarget->WriteAt(m_iBaseSize + pos, piece.data(), nCount))
+			return false;
+		pos += nCount;
+	}
+	return true;
+}
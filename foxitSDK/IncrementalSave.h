@@ -0,0 +1,50 @@
+﻿#pragma once
+
+/** Common header files. */
+#include <stdint.h>
+#include <stddef.h>
+
+#include "WriteBuffer.h"
+#include "WriteBehind.h"
+
+namespace foxitSDK
+{
+	//Result of an incremental append-save.
+	struct FSDK_IncrementalSaveStats
+	{
+		uint64_t	bytesWritten;		// Bytes of the new revision section written to the file.
+		uint64_t	bytesSkipped;		// Bytes of the original file left untouched.
+	};
+
+	//Appends the revision section produced by FSPDF_SAVEFLAG_INCREMENTONLY to the end of the original file.
+	//
+	//The SDK always returns every change since the document was loaded, so the section replaces whatever
+	//a previous append left after the original data. To stay crash-safe an append goes:
+	//  1. journal: record the original size and the previous tail, flush;
+	//  2. target: write the new tail at the original size, cut the file there, flush;
+	//  3. journal: clear, flush. This is the commit point.
+	//If the process dies before 3, Recover() puts the previous tail back, so the file is either the old or the new revision.
+	class CMy_IncrementalAppender
+	{
+	public:
+		//iBaseSize is the size of the file the document was loaded from. pJournal may be NULL, then steps 1 and 3 are skipped.
+		CMy_IncrementalAppender(IMy_FileSink* pTarget, IMy_FileSink* pJournal, uint64_t iBaseSize);
+
+		//iTailSize is the size of the tail written by the previous append, 0 for the first one.
+		//On failure the target is rolled back to the previous tail, or to the original data when there is no journal.
+		bool			Append(CMy_WriteBuffer* pDelta, uint64_t iTailSize, FSDK_IncrementalSaveStats* pStats);
+
+		//Undo an append that did not reach its commit point. Returns true if the target is consistent afterwards,
+		//including when there was nothing to recover.
+		static bool		Recover(IMy_FileSink* pJournal, IMy_FileSink* pTarget);
+
+	private:
+		bool			WriteJournal(uint64_t iTailSize);
+		bool			ClearJournal();
+		bool			CopyToTarget(CMy_WriteBuffer* pSource, uint64_t iSize);
+
+		IMy_FileSink*	m_pTarget;
+		IMy_FileSink*	m_pJournal;
+		uint64_t		m_iBaseSize;
+	};
+}
@@ -0,0 +1,580 @@
+﻿#include "IoTrace.h"
+
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+using namespace foxitSDK;
+
+#define FSDK_IOTRACE_MAGIC			"FSDKIOT1"
+#define FSDK_IOTRACE_RECORDSIZE		32
+
+static void PutUInt32(unsigned char* pDest, uint32_t value)
+{
+	for (int i = 0; i < 4; i++)
+		pDest[i] = (unsigned char)(value >> (i * 8));
+}
+
+static void PutUInt64(unsigned char* pDest, uint64_t value)
+{
+	for (int i = 0; i < 8; i++)
+		pDest[i] = (unsigned char)(value >> (i * 8));
+}
+
+static uint32_t GetUInt32(const unsigned char* pSrc)
+{
+	uint32_t value = 0;
+	for (int i = 0; i < 4; i++)
+		value |= (uint32_t)pSrc[i] << (i * 8);
+	return value;
+}
+
+static uint64_t GetUInt64(const unsigned char* pSrc)
+{
+	uint64_t value = 0;
+	for (int i = 0; i < 8; i++)
+		value |= (uint64_t)pSrc[i] << (i * 8);
+	return value;
+}
+
+static uint64_t FileSizeToUInt64(const FSCRT_FILESIZE* size)
+{
+	return ((uint64_t)size->hiSize << 32) | size->loSize;
+}
+
+//path is UTF-8.
+static FILE* OpenTraceFile(const char* path, const char* mode)
+{
+#ifdef _WIN32
+	int nLength = MultiByteToWideChar(CP_UTF8, 0, path, -1, NULL, 0);
+	if (nLength <= 0)
+		return NULL;
+	std::wstring widePath(nLength, L'\0');
+	MultiByteToWideChar(CP_UTF8, 0, path, -1, &widePath[0], nLength);
+	std::wstring wideMode(mode, mode + strlen(mode));
+	FILE* pFile = NULL;
+	if (_wfopen_s(&pFile, widePath.c_str(), wideMode.c_str()) != 0)
+		return NULL;
+	return pFile;
+#else
+	return fopen(path, mode);
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Class CMy_IoTraceRecorder
+CMy_IoTraceRecorder::CMy_IoTraceRecorder()
+{
+	m_pFile = NULL;
+	m_nRecords = 0;
+	m_Start = std::chrono::steady_clock::now();
+}
+
+CMy_IoTraceRecorder::~CMy_IoTraceRecorder()
+{
+	Close();
+}
+
+bool CMy_IoTraceRecorder::Open(const char* path)
+{
+	Close();
+	if (!path)
+		return false;
+
+	std::lock_guard<std::mutex> lock(m_Lock);
+	m_pFile = OpenTraceFile(path, "wb");
+	if (!m_pFile)
+		return false;
+	if (fwrite(FSDK_IOTRACE_MAGIC, 1, 8, m_pFile) != 8)
+	{
+		fclose(m_pFile);
+		m_pFile = NULL;
+		return false;
+	}
+	m_nRecords = 0;
+	m_Start = std::chrono::steady_clock::now();
+	return true;
+}
+
+void CMy_IoTraceRecorder::Close()
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	if (m_pFile)
+		fclose(m_pFile);
+	m_pFile = NULL;
+}
+
+uint64_t CMy_IoTraceRecorder::GetRecordCount()
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	return m_nRecords;
+}
+
+uint64_t CMy_IoTraceRecorder::Now() const
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_Start).count();
+}
+
+void CMy_IoTraceRecorder::Record(FSDK_IoTraceOp op, uint64_t offset, uint64_t size, uint64_t startNs, bool bOk)
+{
+	uint64_t iEndNs = Now();
+	unsigned char record[FSDK_IOTRACE_RECORDSIZE];
+	memset(record, 0, sizeof(record));
+	record[0] = (unsigned char)op;
+	record[1] = bOk ? 1 : 0;
+	PutUInt32(record + 4, size > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t)size);
+	PutUInt64(record + 8, offset);
+	PutUInt64(record + 16, startNs);
+	PutUInt64(record + 24, iEndNs > startNs ? iEndNs - startNs : 0);
+
+	//stdio buffers the records, the trace is written out in large pieces.
+	std::lock_guard<std::mutex> lock(m_Lock);
+	if (!m_pFile)
+		return;
+	if (fwrite(record, 1, sizeof(record), m_pFile) == sizeof(record))
+		m_nRecords++;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Class CMy_IoTraceReader
+CMy_IoTraceReader::CMy_IoTraceReader()
+{
+	m_pFile = NULL;
+}
+
+CMy_IoTraceReader::~CMy_IoTraceReader()
+{
+	Close();
+}
+
+bool CMy_IoTraceReader::Open(const char* path)
+{
+	Close();
+	if (!path)
+		return false;
+
+	m_pFile = OpenTraceFile(path, "rb");
+	if (!m_pFile)
+		return false;
+	char magic[8];
+	if (fread(magic, 1, 8, m_pFile) != 8 || memcmp(magic, FSDK_IOTRACE_MAGIC, 8) != 0)
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void CMy_IoTraceReader::Close()
+{
+	if (m_pFile)
+		fclose(m_pFile);
+	m_pFile = NULL;
+}
+
+bool CMy_IoTraceReader::Next(FSDK_IoTraceRecord* pRecord)
+{
+	unsigned char record[FSDK_IOTRACE_RECORDSIZE];
+	if (!m_pFile || !pRecord || fread(record, 1, sizeof(record), m_pFile) != sizeof(record))
+		return false;
+
+	pRecord->op = record[0];
+	pRecord->ok = record[1];
+	pRecord->size = GetUInt32(record + 4);
+	pRecord->offset = GetUInt64(record + 8);
+	pRecord->startNs = GetUInt64(record + 16);
+	pRecord->latencyNs = GetUInt64(record + 24);
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Class CMy_TracingFile
+CMy_TracingFile::CMy_TracingFile()
+{
+	m_pInner = NULL;
+	m_pRecorder = NULL;
+	ReleaseFileHandle();
+}
+
+CMy_TracingFile::~CMy_TracingFile()
+{
+}
+
+void CMy_TracingFile::InitFileHandle(FSCRT_FILEHANDLER* pInner, CMy_IoTraceRecorder* pRecorder)
+{
+	m_pInner = pInner;
+	m_pRecorder = pRecorder;
+	clientData = this;
+	Release = g_PrivateRelease;
+	GetSize = g_PrivateGetSize;
+	ReadBlock = g_PrivateReadBlock;
+	WriteBlock = g_PrivateWriteBlock;
+	Flush = g_PrivateFlush;
+	Truncate = g_PrivateTruncate;
+}
+
+void CMy_TracingFile::ReleaseFileHandle()
+{
+	m_pInner = NULL;
+	m_pRecorder = NULL;
+	clientData = NULL;
+	Release = NULL;
+	GetSize = NULL;
+	ReadBlock = NULL;
+	WriteBlock = NULL;
+	Flush = NULL;
+	Truncate = NULL;
+}
+
+void CMy_TracingFile::g_PrivateRelease(FS_LPVOID clientData)
+{
+	CMy_TracingFile* pFile = (CMy_TracingFile*)clientData;
+	if (pFile && pFile->m_pInner && pFile->m_pInner->Release)
+		pFile->m_pInner->Release(pFile->m_pInner->clientData);
+}
+
+FS_DWORD CMy_TracingFile::g_PrivateGetSize(FS_LPVOID clientData)
+{
+	CMy_TracingFile* pFile = (CMy_TracingFile*)clientData;
+	if (!pFile || !pFile->m_pInner)
+		return 0;
+
+	uint64_t iStart = pFile->m_pRecorder ? pFile->m_pRecorder->Now() : 0;
+	FS_DWORD size = pFile->m_pInner->GetSize(pFile->m_pInner->clientData);
+	if (pFile->m_pRecorder)
+		pFile->m_pRecorder->Record(FSDK_IOTRACE_GETSIZE, 0, size, iStart, true);
+	return size;
+}
+
+FS_RESULT CMy_TracingFile::g_PrivateReadBlock(FS_LPVOID clientData, FS_DWORD offset, FS_LPVOID buffer, FS_DWORD size)
+{
+	CMy_TracingFile* pFile = (CMy_TracingFile*)clientData;
+	if (!pFile || !pFile->m_pInner)
+		return FSCRT_ERRCODE_FILE;
+
+	uint64_t iStart = pFile->m_pRecorder ? pFile->m_pRecorder->Now() : 0;
+	FS_RESULT ret = pFile->m_pInner->ReadBlock(pFile->m_pInner->clientData, offset, buffer, size);
+	if (pFile->m_pRecorder)
+		pFile->m_pRecorder->Record(FSDK_IOTRACE_READ, offset, size, iStart, ret == FSCRT_ERRCODE_SUCCESS);
+	return ret;
+}
+
+FS_RESULT CMy_TracingFile::g_PrivateWriteBlock(FS_LPVOID clientData, FS_DWORD offset, FS_LPCVOID buffer, FS_DWORD size)
+{
+	CMy_TracingFile* pFile = (CMy_TracingFile*)clientData;
+	if (!pFile || !pFile->m_pInner)
+		return FSCRT_ERRCODE_FILE;
+
+	uint64_t iStart = pFile->m_pRecorder ? pFile->m_pRecorder->Now() : 0;
+	FS_RESULT ret = pFile->m_pInner->WriteBlock(pFile->m_pInner->clientData, offset, buffer, size);
+	if (pFile->m_pRecorder)
+		pFile->m_pRecorder->Record(FSDK_IOTRACE_WRITE, offset, size, iStart, ret == FSCRT_ERRCODE_SUCCESS);
+	return ret;
+}
+
+FS_RESULT CMy_TracingFile::g_PrivateFlush(FS_LPVOID clientData)
+{
+	CMy_TracingFile* pFile = (CMy_TracingFile*)clientData;
+	if (!pFile || !pFile->m_pInner)
+		return FSCRT_ERRCODE_FILE;
+
+	uint64_t iStart = pFile->m_pRecorder ? pFile->m_pRecorder->Now() : 0;
+	FS_RESULT ret = pFile->m_pInner->Flush(pFile->m_pInner->clientData);
+	if (pFile->m_pRecorder)
+		pFile->m_pRecorder->Record(FSDK_IOTRACE_FLUSH, 0, 0, iStart, ret == FSCRT_ERRCODE_SUCCESS);
+	return ret;
+}
+
+FS_RESULT CMy_TracingFile::g_PrivateTruncate(FS_LPVOID clientData, FS_DWORD size)
+{
+	CMy_TracingFile* pFile = (CMy_TracingFile*)clientData;
+	if (!pFile || !pFile->m_pInner)
+		return FSCRT_ERRCODE_FILE;
+
+	uint64_t iStart = pFile->m_pRecorder ? pFile->m_pRecorder->Now() : 0;
+	FS_RESULT ret = pFile->m_pInner->Truncate(pFile->m_pInner->clientData, size);
+	if (pFile->m_pRecorder)
+		pFile->m_pRecorder->Record(FSDK_IOTRACE_TRUNCATE, size, size, iStart, ret == FSCRT_ERRCODE_SUCCESS);
+	return ret;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Class CMy_TracingFileL
+CMy_TracingFileL::CMy_TracingFileL()
+{
+	m_pInner = NULL;
+	m_pRecorder = NULL;
+	ReleaseFileHandle();
+}
+
+CMy_TracingFileL::~CMy_TracingFileL()
+{
+}
+
+void CMy_TracingFileL::InitFileHandle(FSCRT_FILEHANDLER_L* pInner, CMy_IoTraceRecorder* pRecorder)
+{
+	m_pInner = pInner;
+	m_pRecorder = pRecorder;
+	clientData = this;
+	Release = g_PrivateRelease;
+	GetSize = g_PrivateGetSize;
+	ReadBlock = g_PrivateReadBlock;
+	WriteBlock = g_PrivateWriteBlock;
+	Flush = g_PrivateFlush;
+	Truncate = g_PrivateTruncate;
+}
+
+void CMy_TracingFileL::ReleaseFileHandle()
+{
+	m_pInner = NULL;
+	m_pRecorder = NULL;
+	clientData = NULL;
+	Release = NULL;
+	GetSize = NULL;
+	ReadBlock = NULL;
+	WriteBlock = NULL;
+	Flush = NULL;
+	Truncate = NULL;
+}
+
+void CMy_TracingFileL::g_PrivateRelease(FS_LPVOID clientData)
+{
+	CMy_TracingFileL* pFile = (CMy_TracingFileL*)clientData;
+	if (pFile && pFile->m_pInner && pFile->m_pInner->Release)
+		pFile->m_pInner->Release(pFile->m_pInner->clientData);
+}
+
+FS_RESULT CMy_TracingFileL::g_PrivateGetSize(FS_LPVOID clientData, FSCRT_FILESIZE* size)
+{
+	CMy_TracingFileL* pFile = (CMy_TracingFileL*)clientData;
+	if (!pFile || !pFile->m_pInner)
+		return FSCRT_ERRCODE_FILE;
+
+	uint64_t iStart = pFile->m_pRecorder ? pFile->m_pRecorder->Now() : 0;
+	FS_RESULT ret = pFile->m_pInner->GetSize(pFile->m_pInner->clientData, size);
+	if (pFile->m_pRecorder)
+		pFile->m_pRecorder->Record(FSDK_IOTRACE_GETSIZE, 0, (ret == FSCRT_ERRCODE_SUCCESS && size) ? FileSizeToUInt64(size) : 0, iStart, ret == FSCRT_ERRCODE_SUCCESS);
+	return ret;
+}
+
+FS_RESULT CMy_TracingFileL::g_PrivateReadBlock(FS_LPVOID clientData, const FSCRT_FILESIZE* offset, FS_LPVOID buffer, const FSCRT_FILESIZE* size)
+{
+	CMy_TracingFileL* pFile = (CMy_TracingFileL*)clientData;
+	if (!pFile || !pFile->m_pInner)
+		return FSCRT_ERRCODE_FILE;
+	if (!offset || !size)
+		return FSCRT_ERRCODE_PARAM;
+
+	uint64_t iStart = pFile->m_pRecorder ? pFile->m_pRecorder->Now() : 0;
+	FS_RESULT ret = pFile->m_pInner->ReadBlock(pFile->m_pInner->clientData, offset, buffer, size);
+	if (pFile->m_pRecorder)
+		pFile->m_pRecorder->Record(FSDK_IOTRACE_READ, FileSizeToUInt64(offset), FileSizeToUInt64(size), iStart, ret == FSCRT_ERRCODE_SUCCESS);
+	return ret;
+}
+
+FS_RESULT CMy_TracingFileL::g_PrivateWriteBlock(FS_LPVOID clientData, const FSCRT_FILESIZE* offset, FS_LPCVOID buffer, const FSCRT_FILESIZE* size)
+{
+	CMy_TracingFileL* pFile = (CMy_TracingFileL*)clientData;
+	if (!pFile || !pFile->m_pInner)
+		return FSCRT_ERRCODE_FILE;
+	if (!offset || !size)
+		return FSCRT_ERRCODE_PARAM;
+
+	uint64_t iStart = pFile->m_pRecorder ? pFile->m_pRecorder->Now() : 0;
+	FS_RESULT ret = pFile->m_pInner->WriteBlock(pFile->m_pInner->clientData, offset, buffer, size);
+	if (pFile->m_pRecorder)
+		pFile->m_pRecorder->Record(FSDK_IOTRACE_WRITE, FileSizeToUInt64(offset), FileSizeToUInt64(size), iStart, ret == FSCRT_ERRCODE_SUCCESS);
+	return ret;
+}
+
+FS_RESULT CMy_TracingFileL::g_PrivateFlush(FS_LPVOID clientData)
+{
+	CMy_TracingFileL* pFile = (CMy_TracingFileL*)clientData;
+	if (!pFile || !pFile->m_pInner)
+		return FSCRT_ERRCODE_FILE;
+
+	uint64_t iStart = pFile->m_pRecorder ? pFile->m_pRecorder->Now() : 0;
+	FS_RESULT ret = pFile->m_pInner->Flush(pFile->m_pInner->clientData);
+	if (pFile->m_pRecorder)
+		pFile->m_pRecorder->Record(FSDK_IOTRACE_FLUSH, 0, 0, iStart, ret == FSCRT_ERRCODE_SUCCESS);
+	return ret;
+}
+
+FS_RESULT CMy_TracingFileL::g_PrivateTruncate(FS_LPVOID clientData, const FSCRT_FILESIZE* fileSize)
+{
+	CMy_TracingFileL* pFile = (CMy_TracingFileL*)clientData;
+	if (!pFile || !pFile->m_pInner)
+		return FSCRT_ERRCODE_FILE;
+	if (!fileSize)
+		return FSCRT_ERRCODE_PARAM;
+
+	uint64_t iStart = pFile->m_pRecorder ? pFile->m_pRecorder->Now() : 0;
+	FS_RESULT ret = pFile->m_pInner->Truncate(pFile->m_pInner->clientData, fileSize);
+	if (pFile->m_pRecorder)
+		pFile->m_pRecorder->Record(FSDK_IOTRACE_TRUNCATE, FileSizeToUInt64(fileSize), FileSizeToUInt64(fileSize), iStart, ret == FSCRT_ERRCODE_SUCCESS);
+	return ret;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Class CMy_IoTraceReplay
+static void SummarizeLatency(std::vector<uint64_t>& latencies, FSDK_LatencySummary* pSummary)
+{
+	memset(pSummary, 0, sizeof(FSDK_LatencySummary));
+	if (latencies.empty())
+		return;
+
+	//Nearest-rank percentiles.
+	std::sort(latencies.begin(), latencies.end());
+	size_t n = latencies.size();
+	uint64_t iTotal = 0;
+	for (size_t i = 0; i < n; i++)
+		iTotal += latencies[i];
+	pSummary->count = n;
+	pSummary->p50 = latencies[(n * 50 + 99) / 100 - 1];
+	pSummary->p90 = latencies[(n * 90 + 99) / 100 - 1];
+	pSummary->p99 = latencies[(n * 99 + 99) / 100 - 1];
+	pSummary->max = latencies[n - 1];
+	pSummary->mean = iTotal / n;
+}
+
+static void FinishStats(std::vector<uint64_t>& readLatencies, std::vector<uint64_t>& writeLatencies, FSDK_IoReplayStats* pStats)
+{
+	uint64_t iReadNs = 0;
+	for (size_t i = 0; i < readLatencies.size(); i++)
+		iReadNs += readLatencies[i];
+	pStats->readMBps = iReadNs ? (double)pStats->bytesRead / (1024.0 * 1024.0) / ((double)iReadNs / 1e9) : 0;
+	SummarizeLatency(readLatencies, &pStats->readLatency);
+	SummarizeLatency(writeLatencies, &pStats->writeLatency);
+}
+
+bool CMy_IoTraceReplay::Run(const char* tracePath, IMy_FileSource* pSource, IMy_FileSink* pSink, bool bKeepTiming, FSDK_IoReplayStats* pStats)
+{
+	if (!pSource || !pStats)
+		return false;
+	memset(pStats, 0, sizeof(FSDK_IoReplayStats));
+	CMy_IoTraceReader reader;
+	if (!reader.Open(tracePath))
+		return false;
+
+	std::vector<unsigned char> buffer;
+	std::vector<uint64_t> readLatencies, writeLatencies;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	FSDK_IoTraceRecord record;
+	while (reader.Next(&record))
+	{
+		if (bKeepTiming)
+			std::this_thread::sleep_until(start + std::chrono::nanoseconds(record.startNs));
+
+		std::chrono::steady_clock::time_point callStart = std::chrono::steady_clock::now();
+		bool bOk = true;
+		bool bSkipped = false;
+		switch (record.op)
+		{
+		case FSDK_IOTRACE_GETSIZE:
+			pSource->GetSize();
+			pStats->otherOps++;
+			break;
+		case FSDK_IOTRACE_READ:
+			if (buffer.size() < record.size)
+				buffer.resize(record.size);
+			bOk = pSource->ReadAt(record.offset, buffer.data(), record.size);
+			pStats->reads++;
+			if (bOk)
+				pStats->bytesRead += record.size;
+			break;
+		case FSDK_IOTRACE_WRITE:
+			pStats->writes++;
+			if (!pSink)
+			{
+				bSkipped = true;
+				break;
+			}
+			//Contents are not recorded, write zeros of the same size.
+			if (buffer.size() < record.size)
+				buffer.resize(record.size);
+			memset(buffer.data(), 0, record.size);
+			bOk = pSink->WriteAt(record.offset, buffer.data(), record.size);
+			if (bOk)
+				pStats->bytesWritten += record.size;
+			break;
+		case FSDK_IOTRACE_FLUSH:
+			pStats->otherOps++;
+			if (pSink)
+				bOk = pSink->Flush();
+			else
+				bSkipped = true;
+			break;
+		case FSDK_IOTRACE_TRUNCATE:
+			pStats->otherOps++;
+			if (pSink)
+				bOk = pSink->Truncate(record.offset);
+			else
+				bSkipped = true;
+			break;
+		default:
+			bSkipped = true;
+			break;
+		}
+		uint64_t iLatency = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - callStart).count();
+
+		if (bSkipped)
+			pStats->skippedOps++;
+		else if (!bOk)
+			pStats->failedOps++;
+		else if (record.op == FSDK_IOTRACE_READ)
+			readLatencies.push_back(iLatency);
+		else if (record.op == FSDK_IOTRACE_WRITE)
+			writeLatencies.push_back(iLatency);
+	}
+	pStats->elapsedNs = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	FinishStats(readLatencies, writeLatencies, pStats);
+	return true;
+}
+
+bool CMy_IoTraceReplay::Summarize(const char* tracePath, FSDK_IoReplayStats* pStats)
+{
+	if (!pStats)
+		return false;
+	memset(pStats, 0, sizeof(FSDK_IoReplayStats));
+	CMy_IoTraceReader reader;
+	if (!reader.Open(tracePath))
+		return false;
+
+	std::vector<uint64_t> readLatencies, writeLatencies;
+	FSDK_IoTraceRecord record;
+	while (reader.Next(&record))
+	{
+		if (record.startNs + record.latencyNs > pStats->elapsedNs)
+			pStats->elapsedNs = record.startNs + record.latencyNs;
+		if (record.op == FSDK_IOTRACE_READ)
+			pStats->reads++;
+		else if (record.op == FSDK_IOTRACE_WRITE)
+			pStats->writes++;
+		else
+			pStats->otherOps++;
+
+		if (!record.ok)
+		{
+			pStats->failedOps++;
+			continue;
+		}
+		if (record.op == FSDK_IOTRACE_READ)
+		{
+			pStats->bytesRead += record.size;
+			readLatencies.push_back(record.latencyNs);
+		}
+		else if (record.op == FSDK_IOTRACE_WRITE)
+		{
+			pStats->bytesWritten += record.size;
+			writeLatencies.push_back(record.latencyNs);
+		}
+	}
+	FinishStats(readLatencies, writeLatencies, pStats);
+	return true;
+}
@@ -0,0 +1,167 @@
+﻿#pragma once
+
+/** Common header files. */
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <chrono>
+#include <mutex>
+
+/** Include header files of SDK. */
+#include "../foxitSDK/include/fsdk.h"
+
+#include "FileSource.h"
+#include "WriteBehind.h"
+
+namespace foxitSDK
+{
+	//Calls recorded in an I/O trace.
+	enum FSDK_IoTraceOp
+	{
+		FSDK_IOTRACE_GETSIZE = 1,
+		FSDK_IOTRACE_READ,
+		FSDK_IOTRACE_WRITE,
+		FSDK_IOTRACE_FLUSH,
+		FSDK_IOTRACE_TRUNCATE
+	};
+
+	//One traced call. On disk it takes 32 bytes, little endian:
+	//op (1), ok (1), reserved (2), size (4), offset (8), start (8), latency (8).
+	//A trace file is the 8 byte magic "FSDKIOT1" followed by the records in the order the calls finished.
+	struct FSDK_IoTraceRecord
+	{
+		uint8_t		op;				// One of FSDK_IoTraceOp.
+		uint8_t		ok;				// 1 if the call succeeded.
+		uint32_t	size;			// Bytes read or written, new size for truncate. Saturates at 4GB - 1.
+		uint64_t	offset;
+		uint64_t	startNs;		// When the call began, since the recorder was opened.
+		uint64_t	latencyNs;
+	};
+
+	//Appends FSDK_IoTraceRecord entries to a trace file. Thread safe.
+	class CMy_IoTraceRecorder
+	{
+	public:
+		CMy_IoTraceRecorder();
+		~CMy_IoTraceRecorder();
+
+		bool		Open(const char* path);
+		void		Close();
+		bool		IsOpen() const { return m_pFile != NULL; }
+		uint64_t	GetRecordCount();
+
+		//Time since Open, in nanoseconds. Take it before the call and pass it to Record.
+		uint64_t	Now() const;
+		void		Record(FSDK_IoTraceOp op, uint64_t offset, uint64_t size, uint64_t startNs, bool bOk);
+
+	private:
+		FILE*		m_pFile;
+		std::mutex	m_Lock;
+		std::chrono::steady_clock::time_point	m_Start;
+		uint64_t	m_nRecords;
+	};
+
+	//Reads the records of a trace file back.
+	class CMy_IoTraceReader
+	{
+	public:
+		CMy_IoTraceReader();
+		~CMy_IoTraceReader();
+
+		bool		Open(const char* path);
+		void		Close();
+
+		//Returns false at the end of the trace or on a truncated record.
+		bool		Next(FSDK_IoTraceRecord* pRecord);
+
+	private:
+		FILE*		m_pFile;
+	};
+
+	//Inherited class of FSCRT_FILEHANDLER which forwards every call to another handler and records it.
+	class CMy_TracingFile : public FSCRT_FILEHANDLER
+	{
+	public:
+		CMy_TracingFile();
+		~CMy_TracingFile();
+
+		//Neither pInner nor pRecorder is owned. Release is forwarded, so the inner handler cleans up as usual.
+		void InitFileHandle(FSCRT_FILEHANDLER* pInner, CMy_IoTraceRecorder* pRecorder);
+		void ReleaseFileHandle();
+
+		//Inherited callback funtions.
+		static void g_PrivateRelease(FS_LPVOID clientData);
+		static FS_DWORD g_PrivateGetSize(FS_LPVOID clientData);
+		static FS_RESULT g_PrivateReadBlock(FS_LPVOID clientData, FS_DWORD offset, FS_LPVOID buffer, FS_DWORD size);
+		static FS_RESULT g_PrivateWriteBlock(FS_LPVOID clientData, FS_DWORD offset, FS_LPCVOID buffer, FS_DWORD size);
+		static FS_RESULT g_PrivateFlush(FS_LPVOID clientData);
+		static FS_RESULT g_PrivateTruncate(FS_LPVOID clientData, FS_DWORD size);
+
+	private:
+		FSCRT_FILEHANDLER*		m_pInner;
+		CMy_IoTraceRecorder*	m_pRecorder;
+	};
+
+	//64-bit variant of CMy_TracingFile.
+	class CMy_TracingFileL : public FSCRT_FILEHANDLER_L
+	{
+	public:
+		CMy_TracingFileL();
+		~CMy_TracingFileL();
+
+		void InitFileHandle(FSCRT_FILEHANDLER_L* pInner, CMy_IoTraceRecorder* pRecorder);
+		void ReleaseFileHandle();
+
+		//Inherited callback funtions.
+		static void g_PrivateRelease(FS_LPVOID clientData);
+		static FS_RESULT g_PrivateGetSize(FS_LPVOID clientData, FSCRT_FILESIZE* size);
+		static FS_RESULT g_PrivateReadBlock(FS_LPVOID clientData, const FSCRT_FILESIZE* offset, FS_LPVOID buffer, const FSCRT_FILESIZE* size);
+		static FS_RESULT g_PrivateWriteBlock(FS_LPVOID clientData, const FSCRT_FILESIZE* offset, FS_LPCVOID buffer, const FSCRT_FILESIZE* size);
+		static FS_RESULT g_PrivateFlush(FS_LPVOID clientData);
+		static FS_RESULT g_PrivateTruncate(FS_LPVOID clientData, const FSCRT_FILESIZE* fileSize);
+
+	private:
+		FSCRT_FILEHANDLER_L*	m_pInner;
+		CMy_IoTraceRecorder*	m_pRecorder;
+	};
+
+	//Latency distribution, in nanoseconds.
+	struct FSDK_LatencySummary
+	{
+		uint64_t	count;
+		uint64_t	p50;
+		uint64_t	p90;
+		uint64_t	p99;
+		uint64_t	max;
+		uint64_t	mean;
+	};
+
+	//Result of a trace replay, or of summarizing a recorded trace.
+	struct FSDK_IoReplayStats
+	{
+		uint64_t	reads;
+		uint64_t	writes;
+		uint64_t	otherOps;			// GetSize, Flush and Truncate.
+		uint64_t	skippedOps;			// Writes and truncates with no sink to replay them on.
+		uint64_t	failedOps;
+		uint64_t	bytesRead;
+		uint64_t	bytesWritten;
+		uint64_t	elapsedNs;			// Wall time of the replay, or span of the recorded trace.
+		double		readMBps;			// bytesRead over the time spent in reads.
+		FSDK_LatencySummary	readLatency;
+		FSDK_LatencySummary	writeLatency;
+	};
+
+	//Runs a recorded trace against a file backend: buffered CMy_PosixFileSource, CMy_MappedFileSource,
+	//CMy_BlockCache, CMy_ThrottledFileSource or anything else behind IMy_FileSource.
+	class CMy_IoTraceReplay
+	{
+	public:
+		//Reads go to pSource. Writes, flushes and truncates go to pSink, or are skipped if it is NULL.
+		//With bKeepTiming every call waits for its recorded start time, otherwise calls run back to back.
+		static bool		Run(const char* tracePath, IMy_FileSource* pSource, IMy_FileSink* pSink, bool bKeepTiming, FSDK_IoReplayStats* pStats);
+
+		//Statistics of the calls as they were recorded.
+		static bool		Summarize(const char* tracePath, FSDK_IoReplayStats* pStats);
+	};
+}
@@ -0,0 +1,293 @@
+﻿#include "MappedFile.h"
+
+#include <string.h>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "BlockCache.h"
+
+using namespace foxitSDK;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Class CMy_FileMapping
+CMy_FileMapping::CMy_FileMapping()
+{
+	m_pData = NULL;
+	m_iSize = 0;
+#ifdef _WIN32
+	m_hFile = INVALID_HANDLE_VALUE;
+	m_hMapping = NULL;
+#endif
+}
+
+CMy_FileMapping::~CMy_FileMapping()
+{
+	Unmap();
+}
+
+bool CMy_FileMapping::Map(const char* path)
+{
+	Unmap();
+	if (!path)
+		return false;
+
+#ifdef _WIN32
+	int nLength = MultiByteToWideChar(CP_UTF8, 0, path, -1, NULL, 0);
+	if (nLength <= 0)
+		return false;
+	std::wstring widePath(nLength, L'\0');
+	MultiByteToWideChar(CP_UTF8, 0, path, -1, &widePath[0], nLength);
+
+	//Share writes so an incremental save can append while the file is mapped.
+	m_hFile = CreateFile2(widePath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, OPEN_EXISTING, NULL);
+	if (m_hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	FILE_STANDARD_INFO info;
+	if (!GetFileInformationByHandleEx(m_hFile, FileStandardInfo, &info, sizeof(info)) || info.EndOfFile.QuadPart <= 0
+		|| (uint64_t)info.EndOfFile.QuadPart > (uint64_t)SIZE_MAX)
+	{
+		Unmap();
+		return false;
+	}
+	m_iSize = (uint64_t)info.EndOfFile.QuadPart;
+
+	m_hMapping = CreateFileMappingFromApp(m_hFile, NULL, PAGE_READONLY, 0, NULL);
+	if (!m_hMapping)
+	{
+		Unmap();
+		return false;
+	}
+	m_pData = (const unsigned char*)MapViewOfFileFromApp(m_hMapping, FILE_MAP_READ, 0, 0);
+	if (!m_pData)
+	{
+		Unmap();
+		return false;
+	}
+#else
+	int iFd = open(path, O_RDONLY);
+	if (iFd < 0)
+		return false;
+	struct stat st;
+	if (fstat(iFd, &st) != 0 || st.st_size <= 0 || (uint64_t)st.st_size > (uint64_t)SIZE_MAX)
+	{
+		close(iFd);
+		return false;
+	}
+	void* pData = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, iFd, 0);
+	//The mapping keeps its own reference to the file.
+	close(iFd);
+	if (pData == MAP_FAILED)
+		return false;
+	m_pData = (const unsigned char*)pData;
+	m_iSize = (uint64_t)st.st_size;
+#endif
+	return true;
+}
+
+void CMy_FileMapping::Unmap()
+{
+#ifdef _WIN32
+	if (m_pData)
+		UnmapViewOfFile(m_pData);
+	if (m_hMapping)
+		CloseHandle(m_hMapping);
+	if (m_hFile != INVALID_HANDLE_VALUE)
+		CloseHandle(m_hFile);
+	m_hMapping = NULL;
+	m_hFile = INVALID_HANDLE_VALUE;
+#else
+	if (m_pData)
+		munmap((void*)m_pData, (size_t)m_iSize);
+#endif
+	m_pData = NULL;
+	m_iSize = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Class CMy_MappedFileSource
+CMy_MappedFileSource::CMy_MappedFileSource()
+{
+	m_pFallback = NULL;
+	m_bOwnFallback = false;
+}
+
+CMy_MappedFileSource::~CMy_MappedFileSource()
+{
+	Close();
+}
+
+bool CMy_MappedFileSource::Open(const char* path, IMy_FileSource* pFallback, bool bOwnFallback)
+{
+	Close();
+	m_pFallback = pFallback;
+	m_bOwnFallback = bOwnFallback;
+	if (m_Mapping.Map(path))
+		return true;
+
+	//Mapping failed: serve buffered reads instead.
+	if (!m_pFallback)
+	{
+		CMy_PosixFileSource* pFile = new CMy_PosixFileSource();
+		if (!pFile->Open(path))
+		{
+			delete pFile;
+			return false;
+		}
+		m_pFallback = CMy_BlockCache::CreateForSource(pFile, true);
+		m_bOwnFallback = true;
+	}
+	return true;
+}
+
+void CMy_MappedFileSource::Close()
+{
+	m_Mapping.Unmap();
+	if (m_bOwnFallback && m_pFallback)
+		delete m_pFallback;
+	m_pFallback = NULL;
+	m_bOwnFallback = false;
+}
+
+uint64_t CMy_MappedFileSource::GetSize()
+{
+	if (m_Mapping.IsMapped())
+		return m_Mapping.GetSize();
+	return m_pFallback ? m_pFallback->GetSize() : 0;
+}
+
+bool CMy_MappedFileSource::ReadAt(uint64_t offset, void* buffer, size_t size)
+{
+	if (!m_Mapping.IsMapped())
+		return m_pFallback ? m_pFallback->ReadAt(offset, buffer, size) : false;
+
+	uint64_t iSize = m_Mapping.GetSize();
+	if (!buffer || offset > iSize || size > iSize - offset)
+		return false;
+	memcpy(buffer, m_Mapping.GetData() + offset, size);
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Class CMy_MappedFile
+CMy_MappedFile::CMy_MappedFile()
+{
+	clientData = NULL;
+	Release = NULL;
+	GetSize = NULL;
+	ReadBlock = NULL;
+	WriteBlock = NULL;
+	Flush = NULL;
+	Truncate = NULL;
+	m_pWriteHandler = NULL;
+}
+
+CMy_MappedFile::~CMy_MappedFile()
+{
+	m_Source.Close();
+}
+
+bool CMy_MappedFile::InitFileHandle(const char* path, IMy_FileSource* pFallback, bool bOwnFallback, FSCRT_FILEHANDLER* pWriteHandler)
+{
+	if (!m_Source.Open(path, pFallback, bOwnFallback))
+		return false;
+
+	m_pWriteHandler = pWriteHandler;
+	clientData = this;
+	Release = g_PrivateRelease;
+	GetSize = g_PrivateGetSize;
+	ReadBlock = g_PrivateReadBlock;
+	WriteBlock = g_PrivateWriteBlock;
+	Flush = g_PrivateFlush;
+	Truncate = g_PrivateTruncate;
+	return true;
+}
+
+void CMy_MappedFile::ReleaseFileHandle()
+{
+	m_Source.Close();
+	m_pWriteHandler = NULL;
+	clientData = NULL;
+	Release = NULL;
+	GetSize = NULL;
+	ReadBlock = NULL;
+	WriteBlock = NULL;
+	Flush = NULL;
+	Truncate = NULL;
+}
+
+void CMy_MappedFile::g_PrivateRelease(FS_LPVOID clientData)
+{
+	CMy_MappedFile* pFile = (CMy_MappedFile*)clientData;
+	if (!pFile)
+		return;
+
+	//Drop the mapping now, the handler object itself is owned by the caller.
+	pFile->m_Source.Close();
+	if (pFile->m_pWriteHandler && pFile->m_pWriteHandler->Release)
+		pFile->m_pWriteHandler->Release(pFile->m_pWriteHandler->clientData);
+	pFile->m_pWriteHandler = NULL;
+}
+
+FS_DWORD CMy_MappedFile::g_PrivateGetSize(FS_LPVOID clientData)
+{
+	CMy_MappedFile* pFile = (CMy_MappedFile*)clientData;
+	if (!pFile)
+		return 0;
+	uint64_t iSize = pFile->m_Source.GetSize();
+	return iSize > 0xFFFFFFFF ? 0xFFFFFFFF : (FS_DWORD)iSize;
+}
+
+FS_RESULT CMy_MappedFile::g_PrivateReadBlock(FS_LPVOID clientData, FS_DWORD offset, FS_LPVOID buffer, FS_DWORD size)
+{
+	CMy_MappedFile* pFile = (CMy_MappedFile*)clientData;
+	if (!pFile || !buffer)
+		return FSCRT_ERRCODE_PARAM;
+
+	const CMy_FileMapping& mapping = pFile->m_Source.GetMapping();
+	if (mapping.IsMapped())
+	{
+		//Zero-copy path: one bounds-checked memcpy out of the mapping.
+		uint64_t iSize = mapping.GetSize();
+		if ((uint64_t)offset > iSize || (uint64_t)size > iSize - offset)
+			return FSCRT_ERRCODE_FILE;
+		memcpy(buffer, mapping.GetData() + offset, size);
+		return FSCRT_ERRCODE_SUCCESS;
+	}
+
+	if (!pFile->m_Source.ReadAt(offset, buffer, size))
+		return FSCRT_ERRCODE_FILE;
+	return FSCRT_ERRCODE_SUCCESS;
+}
+
+FS_RESULT CMy_MappedFile::g_PrivateWriteBlock(FS_LPVOID clientData, FS_DWORD offset, FS_LPCVOID buffer, FS_DWORD size)
+{
+	CMy_MappedFile* pFile = (CMy_MappedFile*)clientData;
+	if (!pFile || !pFile->m_pWriteHandler)
+		return FSCRT_ERRCODE_FILE;
+	return pFile->m_pWriteHandler->WriteBlock(pFile->m_pWriteHandler->clientData, offset, buffer, size);
+}
+
+FS_RESULT CMy_MappedFile::g_PrivateFlush(FS_LPVOID clientData)
+{
+	CMy_MappedFile* pFile = (CMy_MappedFile*)clientData;
+	if (!pFile || !pFile->m_pWriteHandler)
+		return FSCRT_ERRCODE_SUCCESS;
+	return pFile->m_pWriteHandler->Flush(pFile->m_pWriteHandler->clientData);
+}
+
+FS_RESULT CMy_MappedFile::g_PrivateTruncate(FS_LPVOID clientData, FS_DWORD size)
+{
+	CMy_MappedFile* pFile = (CMy_MappedFile*)clientData;
+	if (!pFile || !pFile->m_pWriteHandler)
+		return FSCRT_ERRCODE_SUCCESS;
+	return pFile->m_pWriteHandler->Truncate(pFile->m_pWriteHandler->clientData, size);
+}
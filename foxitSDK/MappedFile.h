@@ -0,0 +1,85 @@
+﻿#pragma once
+
+/** Common header files. */
+#include <stdint.h>
+#include <stddef.h>
+
+/** Include header files of SDK. */
+#include "../foxitSDK/include/fsdk.h"
+
+#include "FileSource.h"
+
+namespace foxitSDK
+{
+	//Portable read-only file mapping: mmap on POSIX, CreateFileMappingFromApp/MapViewOfFileFromApp on Windows.
+	class CMy_FileMapping
+	{
+	public:
+		CMy_FileMapping();
+		~CMy_FileMapping();
+
+		//Map the whole file. path is UTF-8. Fails for empty files and for files larger than the address space.
+		bool					Map(const char* path);
+		void					Unmap();
+
+		bool					IsMapped() const { return m_pData != NULL; }
+		const unsigned char*	GetData() const { return m_pData; }
+		uint64_t				GetSize() const { return m_iSize; }
+
+	private:
+		const unsigned char*	m_pData;
+		uint64_t				m_iSize;
+#ifdef _WIN32
+		void*					m_hFile;
+		void*					m_hMapping;
+#endif
+	};
+
+	//IMy_FileSource reading from a mapped file, or from a fallback source when mapping is not possible.
+	class CMy_MappedFileSource : public IMy_FileSource
+	{
+	public:
+		CMy_MappedFileSource();
+		virtual ~CMy_MappedFileSource();
+
+		//Try to map path. If that fails, reads go to pFallback; with no fallback a buffered CMy_PosixFileSource is opened.
+		bool				Open(const char* path, IMy_FileSource* pFallback = NULL, bool bOwnFallback = false);
+		void				Close();
+		bool				IsMapped() const { return m_Mapping.IsMapped(); }
+		const CMy_FileMapping&	GetMapping() const { return m_Mapping; }
+
+		virtual uint64_t	GetSize();
+		virtual bool		ReadAt(uint64_t offset, void* buffer, size_t size);
+
+	private:
+		CMy_FileMapping		m_Mapping;
+		IMy_FileSource*		m_pFallback;
+		bool				m_bOwnFallback;
+	};
+
+	//Inherited class of FSCRT_FILEHANDLER which reads straight out of a file mapping.
+	//Writes, flush and truncate are forwarded to an optional write handler so saving keeps working.
+	class CMy_MappedFile : public FSCRT_FILEHANDLER
+	{
+	public:
+		CMy_MappedFile();
+		~CMy_MappedFile();
+
+		bool InitFileHandle(const char* path, IMy_FileSource* pFallback = NULL, bool bOwnFallback = false, FSCRT_FILEHANDLER* pWriteHandler = NULL);
+		void ReleaseFileHandle();
+		bool IsMapped() const { return m_Source.IsMapped(); }
+		uint64_t GetFileSize() { return m_Source.GetSize(); }
+
+		//Inherited callback funtions.
+		static void g_PrivateRelease(FS_LPVOID clientData);
+		static FS_DWORD g_PrivateGetSize(FS_LPVOID clientData);
+		static FS_RESULT g_PrivateReadBlock(FS_LPVOID clientData, FS_DWORD offset, FS_LPVOID buffer, FS_DWORD size);
+		static FS_RESULT g_PrivateWriteBlock(FS_LPVOID clientData, FS_DWORD offset, FS_LPCVOID buffer, FS_DWORD size);
+		static FS_RESULT g_PrivateFlush(FS_LPVOID clientData);
+		static FS_RESULT g_PrivateTruncate(FS_LPVOID clientData, FS_DWORD size);
+
+	private:
+		CMy_MappedFileSource	m_Source;
+		FSCRT_FILEHANDLER*		m_pWriteHandler;
+	};
+}
@@ -0,0 +1,298 @@
+﻿#include "MemoryAccounting.h"
+
+#include <string.h>
+
+using namespace foxitSDK;
+
+//Prefix in front of every block handed to the SDK.
+struct FSDK_AccountingHeader
+{
+	void*		pTag;
+	uint64_t	size;
+};
+
+static_assert(sizeof(FSDK_AccountingHeader) == 16, "keep blocks 16 byte aligned");
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Class CMy_MemoryAccounting
+CMy_MemoryAccounting::Counters::Counters()
+	: live(0), peak(0), allocs(0), frees(0)
+{
+}
+
+void CMy_MemoryAccounting::Counters::Add(size_t nBytes)
+{
+	uint64_t iLive = (live += nBytes);
+	uint64_t iPeak = peak.load();
+	while (iLive > iPeak && !peak.compare_exchange_weak(iPeak, iLive))
+		;
+}
+
+void CMy_MemoryAccounting::Counters::GetUsage(FSDK_MemoryUsage* pUsage) const
+{
+	pUsage->liveBytes = live;
+	pUsage->peakBytes = peak;
+	pUsage->allocCount = allocs;
+	pUsage->freeCount = frees;
+}
+
+bool CMy_MemoryAccounting::Counters::IsIdle() const
+{
+	//frees is the last field a Free touches.
+	return frees.load(std::memory_order_acquire) == allocs.load();
+}
+
+CMy_MemoryAccounting::CMy_MemoryAccounting(CMy_BudgetAllocator* pInner)
+	: m_pInner(pInner), m_iNextDocId(1)
+{
+}
+
+CMy_MemoryAccounting::~CMy_MemoryAccounting()
+{
+	//Blocks still alive keep pointers to their tags, so only idle documents are deleted.
+	std::lock_guard<std::mutex> lock(m_Lock);
+	for (std::map<uint64_t, Document*>::iterator it = m_Documents.begin(); it != m_Documents.end(); ++it)
+		m_Retired.push_back(it->second);
+	m_Documents.clear();
+	SweepRetired();
+}
+
+CMy_MemoryAccounting::Tag*& CMy_MemoryAccounting::CurrentTag()
+{
+	static thread_local Tag* s_pTag = NULL;
+	return s_pTag;
+}
+
+void* CMy_MemoryAccounting::Alloc(size_t size)
+{
+	if (size > SIZE_MAX - sizeof(FSDK_AccountingHeader))
+		return NULL;
+	FSDK_AccountingHeader* pHeader = (FSDK_AccountingHeader*)m_pInner->Alloc(size + sizeof(FSDK_AccountingHeader));
+	if (!pHeader)
+		return NULL;
+
+	Tag* pTag = CurrentTag();
+	pHeader->pTag = pTag;
+	pHeader->size = size;
+	if (pTag)
+	{
+		pTag->pDocument->Add(size);
+		pTag->pDocument->allocs++;
+		pTag->counters.Add(size);
+		pTag->counters.allocs++;
+	}
+	return pHeader + 1;
+}
+
+void* CMy_MemoryAccounting::Realloc(void* ptr, size_t newSize)
+{
+	if (!ptr)
+		return Alloc(newSize);
+	if (newSize == 0)
+		return ptr;
+	if (newSize > SIZE_MAX - sizeof(FSDK_AccountingHeader))
+		return NULL;
+
+	FSDK_AccountingHeader* pHeader = (FSDK_AccountingHeader*)ptr - 1;
+	size_t nOldSize = (size_t)pHeader->size;
+	FSDK_AccountingHeader* pNew = (FSDK_AccountingHeader*)m_pInner->Realloc(pHeader, newSize + sizeof(FSDK_AccountingHeader));
+	if (!pNew)
+		return NULL;
+
+	//The block is alive on both sides, so its tag can't be deleted in between.
+	Tag* pTag = (Tag*)pNew->pTag;
+	pNew->size = newSize;
+	if (pTag)
+	{
+		if (newSize >= nOldSize)
+		{
+			pTag->pDocument->Add(newSize - nOldSize);
+			pTag->counters.Add(newSize - nOldSize);
+		}
+		else
+		{
+			pTag->pDocument->live -= nOldSize - newSize;
+			pTag->counters.live -= nOldSize - newSize;
+		}
+	}
+	return pNew + 1;
+}
+
+void CMy_MemoryAccounting::Free(void* ptr)
+{
+	if (!ptr)
+		return;
+
+	FSDK_AccountingHeader* pHeader = (FSDK_AccountingHeader*)ptr - 1;
+	Tag* pTag = (Tag*)pHeader->pTag;
+	size_t nSize = (size_t)pHeader->size;
+	m_pInner->Free(pHeader);
+	if (pTag)
+	{
+		pTag->pDocument->live -= nSize;
+		pTag->pDocument->frees++;
+		pTag->counters.live -= nSize;
+		//Last touch, a sweep may delete the tag right after.
+		pTag->counters.frees.fetch_add(1, std::memory_order_release);
+	}
+}
+
+uint64_t CMy_MemoryAccounting::AddDocument()
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	SweepRetired();
+	uint64_t iDocId = m_iNextDocId++;
+	m_Documents[iDocId] = new Document();
+	return iDocId;
+}
+
+void CMy_MemoryAccounting::RemoveDocument(uint64_t iDocId)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	std::map<uint64_t, Document*>::iterator it = m_Documents.find(iDocId);
+	if (it == m_Documents.end())
+		return;
+	m_Retired.push_back(it->second);
+	m_Documents.erase(it);
+
+	for (std::map<const void*, std::pair<uint64_t, int32_t> >::iterator page = m_Pages.begin(); page != m_Pages.end();)
+	{
+		if (page->second.first == iDocId)
+			page = m_Pages.erase(page);
+		else
+			++page;
+	}
+	SweepRetired();
+}
+
+void CMy_MemoryAccounting::SweepRetired()
+{
+	for (size_t i = 0; i < m_Retired.size();)
+	{
+		Document* pDocument = m_Retired[i];
+		bool bIdle = true;
+		for (std::map<int64_t, Tag*>::iterator it = pDocument->tags.begin(); it != pDocument->tags.end() && bIdle; ++it)
+			bIdle = it->second->counters.IsIdle();
+		if (!bIdle)
+		{
+			i++;
+			continue;
+		}
+		for (std::map<int64_t, Tag*>::iterator it = pDocument->tags.begin(); it != pDocument->tags.end(); ++it)
+			delete it->second;
+		delete pDocument;
+		m_Retired[i] = m_Retired.back();
+		m_Retired.pop_back();
+	}
+}
+
+void CMy_MemoryAccounting::BindPage(const void* page, uint64_t iDocId, int32_t iPageIndex)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	m_Pages[page] = std::make_pair(iDocId, iPageIndex);
+}
+
+void CMy_MemoryAccounting::UnbindPage(const void* page)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	m_Pages.erase(page);
+}
+
+CMy_MemoryAccounting::Tag* CMy_MemoryAccounting::GetTag(uint64_t iDocId, int32_t iPageIndex, FSDK_MemoryOp op)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	std::map<uint64_t, Document*>::iterator it = m_Documents.find(iDocId);
+	if (it == m_Documents.end())
+		return NULL;
+
+	Document* pDocument = it->second;
+	if (iPageIndex < -1)
+		iPageIndex = -1;
+	int64_t iKey = (int64_t)iPageIndex * FSDK_MEMOP_COUNT + op;
+	Tag*& pTag = pDocument->tags[iKey];
+	if (!pTag)
+	{
+		pTag = new Tag();
+		pTag->pDocument = &pDocument->counters;
+		pTag->pageIndex = iPageIndex;
+		pTag->op = op;
+	}
+	return pTag;
+}
+
+CMy_MemoryAccounting::Tag* CMy_MemoryAccounting::GetPageTag(const void* page, FSDK_MemoryOp op)
+{
+	uint64_t iDocId = 0;
+	int32_t iPageIndex = -1;
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		std::map<const void*, std::pair<uint64_t, int32_t> >::iterator it = m_Pages.find(page);
+		if (it == m_Pages.end())
+			return NULL;
+		iDocId = it->second.first;
+		iPageIndex = it->second.second;
+	}
+	return GetTag(iDocId, iPageIndex, op);
+}
+
+bool CMy_MemoryAccounting::GetDocumentUsage(uint64_t iDocId, FSDK_MemoryUsage* pUsage)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	std::map<uint64_t, Document*>::iterator it = m_Documents.find(iDocId);
+	if (it == m_Documents.end())
+		return false;
+	it->second->counters.GetUsage(pUsage);
+	return true;
+}
+
+bool CMy_MemoryAccounting::GetPageUsage(uint64_t iDocId, int32_t iPageIndex, FSDK_MemoryOp op, FSDK_MemoryUsage* pUsage)
+{
+	memset(pUsage, 0, sizeof(*pUsage));
+	std::lock_guard<std::mutex> lock(m_Lock);
+	std::map<uint64_t, Document*>::iterator it = m_Documents.find(iDocId);
+	if (it == m_Documents.end())
+		return false;
+	if (iPageIndex < -1)
+		iPageIndex = -1;
+	std::map<int64_t, Tag*>::iterator tag = it->second->tags.find((int64_t)iPageIndex * FSDK_MEMOP_COUNT + op);
+	if (tag != it->second->tags.end())
+		tag->second->counters.GetUsage(pUsage);
+	return true;
+}
+
+bool CMy_MemoryAccounting::GetTagUsage(uint64_t iDocId, std::vector<FSDK_MemoryTagUsage>& usage)
+{
+	usage.clear();
+	std::lock_guard<std::mutex> lock(m_Lock);
+	std::map<uint64_t, Document*>::iterator it = m_Documents.find(iDocId);
+	if (it == m_Documents.end())
+		return false;
+	for (std::map<int64_t, Tag*>::iterator tag = it->second->tags.begin(); tag != it->second->tags.end(); ++tag)
+	{
+		FSDK_MemoryTagUsage entry;
+		entry.pageIndex = tag->second->pageIndex;
+		entry.op = tag->second->op;
+		tag->second->counters.GetUsage(&entry.usage);
+		usage.push_back(entry);
+	}
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Class CMy_MemoryScope
+CMy_MemoryScope::CMy_MemoryScope(CMy_MemoryAccounting* pAccounting, uint64_t iDocId, int32_t iPageIndex, FSDK_MemoryOp op)
+{
+	m_pPrevious = CMy_MemoryAccounting::CurrentTag();
+	CMy_MemoryAccounting::CurrentTag() = pAccounting ? pAccounting->GetTag(iDocId, iPageIndex, op) : NULL;
+}
+
+CMy_MemoryScope::CMy_MemoryScope(CMy_MemoryAccounting* pAccounting, const void* page, FSDK_MemoryOp op)
+{
+	m_pPrevious = CMy_MemoryAccounting::CurrentTag();
+	CMy_MemoryAccounting::CurrentTag() = pAccounting ? pAccounting->GetPageTag(page, op) : NULL;
+}
+
+CMy_MemoryScope::~CMy_MemoryScope()
+{
+	CMy_MemoryAccounting::CurrentTag() = m_pPrevious;
+}
@@ -0,0 +1,135 @@
+﻿#pragma once
+
+/** Common header files. */
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "MemoryBudget.h"
+
+namespace foxitSDK
+{
+	//Operations SDK memory is charged to.
+	enum FSDK_MemoryOp
+	{
+		FSDK_MEMOP_OTHER = 0,
+		FSDK_MEMOP_OPEN,
+		FSDK_MEMOP_PARSE,
+		FSDK_MEMOP_RENDER,
+		FSDK_MEMOP_TEXT,
+		FSDK_MEMOP_SAVE,
+		FSDK_MEMOP_COUNT
+	};
+
+	//Counters of one tag or one document. Bytes are the sizes the SDK asked for.
+	struct FSDK_MemoryUsage
+	{
+		uint64_t	liveBytes;
+		uint64_t	peakBytes;
+		uint64_t	allocCount;
+		uint64_t	freeCount;
+	};
+
+	//Usage of one (page, operation) pair of a document. pageIndex is -1 for work not tied to a page.
+	struct FSDK_MemoryTagUsage
+	{
+		int32_t			pageIndex;
+		FSDK_MemoryOp	op;
+		FSDK_MemoryUsage	usage;
+	};
+
+	//Allocator layer that charges every SDK allocation to the tag active on the calling thread.
+	//Tags are (document, page, operation) and are made active with CMy_MemoryScope. Each block carries a 16 byte
+	//prefix pointing at its tag, so it is credited back to the same tag whichever thread frees it.
+	//Allocations made outside any scope are charged to nothing and only show in the inner allocator's counters.
+	class CMy_MemoryAccounting
+	{
+	public:
+		CMy_MemoryAccounting(CMy_BudgetAllocator* pInner);
+		~CMy_MemoryAccounting();
+
+		CMy_BudgetAllocator*	GetBudget() { return m_pInner; }
+
+		void*		Alloc(size_t size);
+		//Same contract as FSCRT_MEMMGRHANDLER::Realloc. A block stays with the tag it was allocated under.
+		void*		Realloc(void* ptr, size_t newSize);
+		void		Free(void* ptr);
+
+		//Start accounting for a newly opened document, returns its id. Ids are never reused.
+		uint64_t	AddDocument();
+		//Stop accounting for a document. Its counters go away once all its blocks are freed.
+		void		RemoveDocument(uint64_t iDocId);
+
+		//Remember which document and page a page handle belongs to, for scopes that only have the handle.
+		void		BindPage(const void* page, uint64_t iDocId, int32_t iPageIndex);
+		void		UnbindPage(const void* page);
+
+		bool		GetDocumentUsage(uint64_t iDocId, FSDK_MemoryUsage* pUsage);
+		//Usage of one tag, all zero if nothing was charged to it yet.
+		bool		GetPageUsage(uint64_t iDocId, int32_t iPageIndex, FSDK_MemoryOp op, FSDK_MemoryUsage* pUsage);
+		//Usage of every tag of a document, ordered by page then operation.
+		bool		GetTagUsage(uint64_t iDocId, std::vector<FSDK_MemoryTagUsage>& usage);
+
+	private:
+		friend class CMy_MemoryScope;
+
+		struct Counters
+		{
+			std::atomic<uint64_t>	live;
+			std::atomic<uint64_t>	peak;
+			std::atomic<uint64_t>	allocs;
+			std::atomic<uint64_t>	frees;
+
+			Counters();
+			void	Add(size_t nBytes);
+			void	GetUsage(FSDK_MemoryUsage* pUsage) const;
+			//No blocks refer to the counters any more.
+			bool	IsIdle() const;
+		};
+
+		struct Tag
+		{
+			Counters		counters;
+			Counters*		pDocument;
+			int32_t			pageIndex;
+			FSDK_MemoryOp	op;
+		};
+
+		struct Document
+		{
+			Counters		counters;
+			std::map<int64_t, Tag*>	tags;		// Keyed by page index * FSDK_MEMOP_COUNT + op.
+		};
+
+		//Tag for a scope, created on first use. NULL for unknown documents.
+		Tag*		GetTag(uint64_t iDocId, int32_t iPageIndex, FSDK_MemoryOp op);
+		Tag*		GetPageTag(const void* page, FSDK_MemoryOp op);
+		//Delete retired documents whose blocks have all been freed. Called with m_Lock held.
+		void		SweepRetired();
+
+		static Tag*&	CurrentTag();
+
+		CMy_BudgetAllocator*	m_pInner;
+		std::mutex				m_Lock;
+		uint64_t				m_iNextDocId;
+		std::map<uint64_t, Document*>	m_Documents;
+		std::vector<Document*>	m_Retired;
+		std::map<const void*, std::pair<uint64_t, int32_t> >	m_Pages;
+	};
+
+	//Makes a tag current on this thread for its lifetime. Scopes nest, the previous tag comes back on exit.
+	class CMy_MemoryScope
+	{
+	public:
+		CMy_MemoryScope(CMy_MemoryAccounting* pAccounting, uint64_t iDocId, int32_t iPageIndex, FSDK_MemoryOp op);
+		//For code that only holds a page handle bound with BindPage.
+		CMy_MemoryScope(CMy_MemoryAccounting* pAccounting, const void* page, FSDK_MemoryOp op);
+		~CMy_MemoryScope();
+
+	private:
+		CMy_MemoryAccounting::Tag*	m_pPrevious;
+	};
+}
@@ -0,0 +1,126 @@
+﻿#include "MemoryBudget.h"
+
+using namespace foxitSDK;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Class CMy_BudgetAllocator
+CMy_BudgetAllocator::CMy_BudgetAllocator(CMy_PoolAllocator* pPool)
+	: m_pPool(pPool), m_iLimit(0), m_iUsed(0), m_iPeak(0), m_iFailedAllocs(0), m_iOutOfMemoryEvents(0), m_iRecoveries(0)
+{
+}
+
+CMy_BudgetAllocator::~CMy_BudgetAllocator()
+{
+}
+
+void CMy_BudgetAllocator::SetLimit(uint64_t nLimitBytes)
+{
+	m_iLimit = nLimitBytes;
+}
+
+bool CMy_BudgetAllocator::Reserve(size_t nBytes)
+{
+	uint64_t iLimit = m_iLimit;
+	uint64_t iUsed = m_iUsed.load();
+	do
+	{
+		if (iLimit && (nBytes > iLimit || iUsed > iLimit - nBytes))
+			return false;
+	} while (!m_iUsed.compare_exchange_weak(iUsed, iUsed + nBytes));
+
+	UpdatePeak(iUsed + nBytes);
+	return true;
+}
+
+void CMy_BudgetAllocator::Charge(size_t nBytes)
+{
+	UpdatePeak(m_iUsed += nBytes);
+}
+
+void CMy_BudgetAllocator::UpdatePeak(uint64_t iUsed)
+{
+	uint64_t iPeak = m_iPeak.load();
+	while (iUsed > iPeak && !m_iPeak.compare_exchange_weak(iPeak, iUsed))
+		;
+}
+
+void CMy_BudgetAllocator::Unreserve(size_t nBytes)
+{
+	m_iUsed -= nBytes;
+}
+
+void* CMy_BudgetAllocator::Alloc(size_t size)
+{
+	void* ptr = m_pPool->Alloc(size);
+	if (!ptr)
+	{
+		m_iFailedAllocs++;
+		return NULL;
+	}
+	//Charge the usable size, a size class may round the request up.
+	if (!Reserve(CMy_PoolAllocator::GetBlockSize(ptr)))
+	{
+		m_pPool->Free(ptr);
+		m_iFailedAllocs++;
+		return NULL;
+	}
+	return ptr;
+}
+
+void* CMy_BudgetAllocator::Realloc(void* ptr, size_t newSize)
+{
+	if (!ptr)
+		return Alloc(newSize);
+	if (newSize == 0)
+		return ptr;
+
+	size_t nOldSize = CMy_PoolAllocator::GetBlockSize(ptr);
+	if (newSize <= nOldSize)
+	{
+		void* pNew = m_pPool->Realloc(ptr, newSize);
+		if (pNew)
+		{
+			Unreserve(nOldSize);
+			Charge(CMy_PoolAllocator::GetBlockSize(pNew));
+		}
+		return pNew;
+	}
+
+	//Growing: the old block stays charged until the new one is in place, as both are live for the copy.
+	if (!Reserve(newSize))
+	{
+		m_iFailedAllocs++;
+		return NULL;
+	}
+	void* pNew = m_pPool->Realloc(ptr, newSize);
+	Unreserve(newSize);
+	if (!pNew)
+	{
+		m_iFailedAllocs++;
+		return NULL;
+	}
+	Unreserve(nOldSize);
+	//The block is already in use, so it is charged even if rounding takes it slightly past the limit.
+	Charge(CMy_PoolAllocator::GetBlockSize(pNew));
+	return pNew;
+}
+
+void CMy_BudgetAllocator::Free(void* ptr)
+{
+	if (!ptr)
+		return;
+	Unreserve(CMy_PoolAllocator::GetBlockSize(ptr));
+	m_pPool->Free(ptr);
+}
+
+FSDK_MemoryBudgetStats CMy_BudgetAllocator::GetStats()
+{
+	FSDK_MemoryBudgetStats stats;
+	stats.limitBytes = m_iLimit;
+	stats.usedBytes = m_iUsed;
+	stats.peakBytes = m_iPeak;
+	stats.failedAllocs = m_iFailedAllocs;
+	stats.outOfMemoryEvents = m_iOutOfMemoryEvents;
+	stats.recoveries = m_iRecoveries;
+	return stats;
+}
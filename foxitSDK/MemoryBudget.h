@@ -0,0 +1,62 @@
+﻿#pragma once
+
+/** Common header files. */
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+#include "PoolAllocator.h"
+
+namespace foxitSDK
+{
+	//Counters of CMy_BudgetAllocator.
+	struct FSDK_MemoryBudgetStats
+	{
+		uint64_t	limitBytes;			// 0 if unlimited.
+		uint64_t	usedBytes;			// Usable size of the live blocks.
+		uint64_t	peakBytes;
+		uint64_t	failedAllocs;		// Requests refused because of the limit or failed in the pool.
+		uint64_t	outOfMemoryEvents;	// Times the SDK reported it ran out of memory.
+		uint64_t	recoveries;			// Documents recovered after running out of memory.
+	};
+
+	//Puts a hard cap on the memory handed to the SDK beyond its fixed arena.
+	//Blocks come from a CMy_PoolAllocator; a request that would take the usable size of all live blocks over the
+	//limit fails with NULL instead, which the SDK turns into FSCRT_ERRCODE_OUTOFMEMORY.
+	class CMy_BudgetAllocator
+	{
+	public:
+		CMy_BudgetAllocator(CMy_PoolAllocator* pPool);
+		~CMy_BudgetAllocator();
+
+		//0 lifts the limit. Lowering it below the current use only makes new requests fail.
+		void		SetLimit(uint64_t nLimitBytes);
+		uint64_t	GetLimit() const { return m_iLimit; }
+
+		void*		Alloc(size_t size);
+		//Same contract as FSCRT_MEMMGRHANDLER::Realloc: NULL ptr allocates, newSize 0 returns ptr unchanged.
+		void*		Realloc(void* ptr, size_t newSize);
+		void		Free(void* ptr);
+
+		void		NoteOutOfMemory() { m_iOutOfMemoryEvents++; }
+		void		NoteRecovery() { m_iRecoveries++; }
+
+		FSDK_MemoryBudgetStats	GetStats();
+
+	private:
+		//Take nBytes from the budget, false if that would pass the limit.
+		bool		Reserve(size_t nBytes);
+		void		Unreserve(size_t nBytes);
+		//Take nBytes regardless of the limit, for blocks that already exist.
+		void		Charge(size_t nBytes);
+		void		UpdatePeak(uint64_t iUsed);
+
+		CMy_PoolAllocator*		m_pPool;
+		std::atomic<uint64_t>	m_iLimit;
+		std::atomic<uint64_t>	m_iUsed;
+		std::atomic<uint64_t>	m_iPeak;
+		std::atomic<uint64_t>	m_iFailedAllocs;
+		std::atomic<uint64_t>	m_iOutOfMemoryEvents;
+		std::atomic<uint64_t>	m_iRecoveries;
+	};
+}
@@ -0,0 +1,290 @@
+﻿#include "MemoryGovernor.h"
+
+#include <string.h>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace foxitSDK;
+
+static const char* const g_LevelNames[FSDK_PRESSURE_COUNT] = { "normal", "elevated", "high", "critical" };
+static const char* const g_EventNames[] = { "sample", "level", "cachesize", "release" };
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Class CMy_MemoryGovernor
+CMy_MemoryGovernor::CMy_MemoryGovernor()
+{
+	memset(&m_Config, 0, sizeof(m_Config));
+	m_Level = FSDK_PRESSURE_NORMAL;
+	m_nCacheSizeMB = 0;
+	m_nNormalSamples = 0;
+	m_pLog = NULL;
+	m_bRunning = false;
+	m_bStop = false;
+	m_Start = std::chrono::steady_clock::now();
+}
+
+CMy_MemoryGovernor::~CMy_MemoryGovernor()
+{
+	Stop();
+}
+
+void CMy_MemoryGovernor::SetSources(const std::function<uint64_t()>& pLiveBytes, const std::function<void(uint32_t)>& pSetCacheSize)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	m_LiveBytes = pLiveBytes;
+	m_SetCacheSize = pSetCacheSize;
+}
+
+bool CMy_MemoryGovernor::Start(const FSDK_GovernorConfig& config, const char* csvPath)
+{
+	Stop();
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		m_Config = config;
+		if (m_Config.intervalMs == 0)
+			m_Config.intervalMs = 1000;
+		if (m_Config.cacheSizeMinMB > m_Config.cacheSizeMaxMB)
+			m_Config.cacheSizeMinMB = m_Config.cacheSizeMaxMB;
+		m_Level = FSDK_PRESSURE_NORMAL;
+		m_nNormalSamples = 0;
+	}
+
+	if (csvPath && *csvPath)
+	{
+		std::lock_guard<std::mutex> lock(m_EventLock);
+#ifdef _WIN32
+		int size = MultiByteToWideChar(CP_UTF8, 0, csvPath, -1, NULL, 0);
+		std::vector<wchar_t> wpath(size > 0 ? size : 1, L'\0');
+		MultiByteToWideChar(CP_UTF8, 0, csvPath, -1, &wpath[0], size);
+		if (_wfopen_s(&m_pLog, &wpath[0], L"w") != 0)
+			m_pLog = NULL;
+#else
+		m_pLog = fopen(csvPath, "w");
+#endif
+		if (!m_pLog)
+			return false;
+		fprintf(m_pLog, "time_ms,event,level,rss_bytes,live_bytes,value,name\n");
+	}
+
+	uint64_t rss = GetProcessRSS();
+	ApplyCacheSize(m_Config.cacheSizeMaxMB, rss, m_LiveBytes ? m_LiveBytes() : 0);
+
+	m_bStop = false;
+	m_bRunning = true;
+	m_Thread = std::thread(&CMy_MemoryGovernor::ThreadProc, this);
+	return true;
+}
+
+void CMy_MemoryGovernor::Stop()
+{
+	if (m_Thread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_WakeLock);
+			m_bStop = true;
+		}
+		m_Wake.notify_all();
+		m_Thread.join();
+	}
+	m_bRunning = false;
+
+	std::lock_guard<std::mutex> lock(m_EventLock);
+	if (m_pLog)
+		fclose(m_pLog);
+	m_pLog = NULL;
+}
+
+void CMy_MemoryGovernor::ThreadProc()
+{
+	std::unique_lock<std::mutex> lock(m_WakeLock);
+	while (!m_bStop)
+	{
+		lock.unlock();
+		Sample();
+		lock.lock();
+		m_Wake.wait_for(lock, std::chrono::milliseconds(m_Config.intervalMs), [this]() { return m_bStop; });
+	}
+}
+
+FSDK_MemoryPressure CMy_MemoryGovernor::Sample()
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	uint64_t rss = GetProcessRSS();
+	uint64_t live = m_LiveBytes ? m_LiveBytes() : 0;
+
+	int iLevel = FSDK_PRESSURE_NORMAL;
+	for (int i = FSDK_PRESSURE_ELEVATED; i < FSDK_PRESSURE_COUNT; i++)
+	{
+		if ((m_Config.rssThresholds[i] && rss >= m_Config.rssThresholds[i]) || (m_Config.liveThresholds[i] && live >= m_Config.liveThresholds[i]))
+			iLevel = i;
+	}
+	FSDK_MemoryPressure level = (FSDK_MemoryPressure)iLevel;
+	AddEvent(FSDK_GOVERNOR_SAMPLE, rss, live, 0, NULL);
+	if (level != m_Level)
+	{
+		FSDK_MemoryPressure previous = m_Level;
+		m_Level = level;
+		AddEvent(FSDK_GOVERNOR_LEVEL, rss, live, (uint64_t)previous, NULL);
+	}
+
+	if (level == FSDK_PRESSURE_NORMAL)
+	{
+		//Give the SDK its cache back gradually once pressure has been gone for a while.
+		if (++m_nNormalSamples >= m_Config.relaxSamples && m_nCacheSizeMB < m_Config.cacheSizeMaxMB)
+		{
+			uint32_t nSize = m_nCacheSizeMB ? m_nCacheSizeMB * 2 : 1;
+			ApplyCacheSize(nSize < m_Config.cacheSizeMaxMB ? nSize : m_Config.cacheSizeMaxMB, rss, live);
+			m_nNormalSamples = 0;
+		}
+		return level;
+	}
+	m_nNormalSamples = 0;
+
+	//Cheapest first: a smaller SDK cache.
+	uint32_t nSize = level == FSDK_PRESSURE_CRITICAL ? m_Config.cacheSizeMinMB : m_nCacheSizeMB / 2;
+	if (nSize < m_Config.cacheSizeMinMB)
+		nSize = m_Config.cacheSizeMinMB;
+	if (nSize != m_nCacheSizeMB)
+		ApplyCacheSize(nSize, rss, live);
+
+	//Then consumers in priority order, until the excess over the elevated level is released.
+	uint64_t nExcess = 0;
+	if (m_Config.rssThresholds[FSDK_PRESSURE_ELEVATED] && rss > m_Config.rssThresholds[FSDK_PRESSURE_ELEVATED])
+		nExcess = rss - m_Config.rssThresholds[FSDK_PRESSURE_ELEVATED];
+	if (m_Config.liveThresholds[FSDK_PRESSURE_ELEVATED] && live > m_Config.liveThresholds[FSDK_PRESSURE_ELEVATED])
+		nExcess = std::max(nExcess, live - m_Config.liveThresholds[FSDK_PRESSURE_ELEVATED]);
+	uint64_t nReleased = 0;
+	for (size_t i = 0; i < m_Consumers.size() && (nReleased < nExcess || level == FSDK_PRESSURE_CRITICAL); i++)
+	{
+		if (m_Consumers[i].minLevel > level)
+			continue;
+		uint64_t nBytes = m_Consumers[i].pConsumer->ReleaseMemory(level);
+		if (nBytes)
+		{
+			nReleased += nBytes;
+			AddEvent(FSDK_GOVERNOR_RELEASE, rss, live, nBytes, m_Consumers[i].name);
+		}
+	}
+	return level;
+}
+
+FSDK_MemoryPressure CMy_MemoryGovernor::GetLevel()
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	return m_Level;
+}
+
+uint32_t CMy_MemoryGovernor::GetCacheSizeMB()
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	return m_nCacheSizeMB;
+}
+
+void CMy_MemoryGovernor::ApplyCacheSize(uint32_t nSizeMB, uint64_t rss, uint64_t live)
+{
+	m_nCacheSizeMB = nSizeMB;
+	if (m_SetCacheSize)
+		m_SetCacheSize(nSizeMB);
+	AddEvent(FSDK_GOVERNOR_CACHESIZE, rss, live, nSizeMB, NULL);
+}
+
+void CMy_MemoryGovernor::Register(IMy_MemoryConsumer* pConsumer, const char* name, int iPriority, FSDK_MemoryPressure minLevel)
+{
+	if (!pConsumer)
+		return;
+	Consumer consumer;
+	consumer.pConsumer = pConsumer;
+	memset(consumer.name, 0, sizeof(consumer.name));
+	if (name)
+		strncpy(consumer.name, name, sizeof(consumer.name) - 1);
+	consumer.iPriority = iPriority;
+	consumer.minLevel = minLevel;
+
+	std::lock_guard<std::mutex> lock(m_Lock);
+	std::vector<Consumer>::iterator it = m_Consumers.begin();
+	while (it != m_Consumers.end() && it->iPriority <= iPriority)
+		++it;
+	m_Consumers.insert(it, consumer);
+}
+
+void CMy_MemoryGovernor::Unregister(IMy_MemoryConsumer* pConsumer)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	for (size_t i = 0; i < m_Consumers.size(); i++)
+	{
+		if (m_Consumers[i].pConsumer == pConsumer)
+		{
+			m_Consumers.erase(m_Consumers.begin() + i);
+			return;
+		}
+	}
+}
+
+uint64_t CMy_MemoryGovernor::NowMs() const
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - m_Start).count();
+}
+
+void CMy_MemoryGovernor::AddEvent(FSDK_GovernorEventType type, uint64_t rss, uint64_t live, uint64_t value, const char* name)
+{
+	FSDK_GovernorEvent event;
+	event.timeMs = NowMs();
+	event.type = type;
+	event.level = m_Level;
+	event.rssBytes = rss;
+	event.liveBytes = live;
+	event.value = value;
+	memset(event.name, 0, sizeof(event.name));
+	if (name)
+		strncpy(event.name, name, sizeof(event.name) - 1);
+
+	std::lock_guard<std::mutex> lock(m_EventLock);
+	//Drop the oldest half when nobody collects them.
+	if (m_Events.size() >= FSDK_GOVERNOR_MAXEVENTS)
+		m_Events.erase(m_Events.begin(), m_Events.begin() + FSDK_GOVERNOR_MAXEVENTS / 2);
+	m_Events.push_back(event);
+	if (m_pLog)
+	{
+		fprintf(m_pLog, "%llu,%s,%s,%llu,%llu,%llu,%s\n", (unsigned long long)event.timeMs, g_EventNames[type], g_LevelNames[event.level],
+			(unsigned long long)rss, (unsigned long long)live, (unsigned long long)value, event.name);
+		if (type != FSDK_GOVERNOR_SAMPLE)
+			fflush(m_pLog);
+	}
+}
+
+void CMy_MemoryGovernor::TakeEvents(std::vector<FSDK_GovernorEvent>& events)
+{
+	std::lock_guard<std::mutex> lock(m_EventLock);
+	events.swap(m_Events);
+	m_Events.clear();
+}
+
+uint64_t CMy_MemoryGovernor::GetProcessRSS()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	memset(&counters, 0, sizeof(counters));
+	counters.cb = sizeof(counters);
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return 0;
+	return (uint64_t)counters.WorkingSetSize;
+#else
+	//Second field of /proc/self/statm is the resident set, in pages.
+	FILE* pFile = fopen("/proc/self/statm", "r");
+	if (!pFile)
+		return 0;
+	unsigned long long nSize = 0, nResident = 0;
+	int n = fscanf(pFile, "%llu %llu", &nSize, &nResident);
+	fclose(pFile);
+	if (n != 2)
+		return 0;
+	long nPageSize = sysconf(_SC_PAGESIZE);
+	return (uint64_t)nResident * (uint64_t)(nPageSize > 0 ? nPageSize : 4096);
+#endif
+}
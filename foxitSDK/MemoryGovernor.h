@@ -0,0 +1,140 @@
+﻿#pragma once
+
+/** Common header files. */
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace foxitSDK
+{
+	//Memory pressure levels, in increasing order.
+	enum FSDK_MemoryPressure
+	{
+		FSDK_PRESSURE_NORMAL = 0,
+		FSDK_PRESSURE_ELEVATED,
+		FSDK_PRESSURE_HIGH,
+		FSDK_PRESSURE_CRITICAL,
+		FSDK_PRESSURE_COUNT
+	};
+
+	//Something holding memory the governor can ask back, e.g. a read cache or the SDK caches of a document.
+	class IMy_MemoryConsumer
+	{
+	public:
+		virtual ~IMy_MemoryConsumer() {}
+
+		//Give back what can be given back at this level. Returns the bytes released, an estimate is fine.
+		//Called on the governor thread.
+		virtual uint64_t	ReleaseMemory(FSDK_MemoryPressure level) = 0;
+	};
+
+	//Thresholds and steps of CMy_MemoryGovernor. A threshold of 0 is never crossed.
+	struct FSDK_GovernorConfig
+	{
+		uint64_t	rssThresholds[FSDK_PRESSURE_COUNT];		// Process resident set size per level, index 0 unused.
+		uint64_t	liveThresholds[FSDK_PRESSURE_COUNT];	// Live bytes of the SDK allocator per level, index 0 unused.
+		uint32_t	intervalMs;			// Time between samples.
+		uint32_t	cacheSizeMaxMB;		// SDK cache size under normal pressure.
+		uint32_t	cacheSizeMinMB;		// Floor of the step-down.
+		uint32_t	relaxSamples;		// Normal samples in a row before the cache size steps back up.
+	};
+
+	enum FSDK_GovernorEventType
+	{
+		FSDK_GOVERNOR_SAMPLE = 0,		// value: 0.
+		FSDK_GOVERNOR_LEVEL,			// value: previous level.
+		FSDK_GOVERNOR_CACHESIZE,		// value: new SDK cache size in MB.
+		FSDK_GOVERNOR_RELEASE			// value: bytes released by the consumer in name.
+	};
+
+	//One governor decision, or one sample.
+	struct FSDK_GovernorEvent
+	{
+		uint64_t	timeMs;				// Since the governor was created.
+		FSDK_GovernorEventType	type;
+		FSDK_MemoryPressure		level;
+		uint64_t	rssBytes;
+		uint64_t	liveBytes;
+		uint64_t	value;
+		char		name[32];
+	};
+
+	//Watches process RSS and the SDK allocator's live bytes and acts when they cross the configured levels:
+	//steps the SDK cache size down (halving, straight to the floor at critical), then asks registered consumers
+	//to release memory, lowest priority number first, until the excess over the elevated thresholds is covered.
+	//After a run of normal samples the cache size doubles back towards the maximum.
+	//Every sample and decision is kept as an event and optionally appended to a CSV file.
+	class CMy_MemoryGovernor
+	{
+	public:
+		CMy_MemoryGovernor();
+		~CMy_MemoryGovernor();
+
+		//pLiveBytes samples the allocator, pSetCacheSize applies an SDK cache size in MB. Either may be empty.
+		void		SetSources(const std::function<uint64_t()>& pLiveBytes, const std::function<void(uint32_t)>& pSetCacheSize);
+
+		//Start sampling on a background thread. csvPath (UTF-8) may be NULL.
+		bool		Start(const FSDK_GovernorConfig& config, const char* csvPath);
+		void		Stop();
+		bool		IsRunning() const { return m_bRunning; }
+
+		//Take one sample and act on it. Start calls this periodically, it can also be driven by hand.
+		FSDK_MemoryPressure	Sample();
+		FSDK_MemoryPressure	GetLevel();
+		uint32_t	GetCacheSizeMB();
+
+		//Consumers with minLevel at or below the current level are asked in increasing priority order.
+		//pConsumer must stay valid until Unregister returns; Unregister waits for a running release.
+		void		Register(IMy_MemoryConsumer* pConsumer, const char* name, int iPriority, FSDK_MemoryPressure minLevel);
+		void		Unregister(IMy_MemoryConsumer* pConsumer);
+
+		//Move the events recorded since the last call into events. At most FSDK_GOVERNOR_MAXEVENTS are kept.
+		void		TakeEvents(std::vector<FSDK_GovernorEvent>& events);
+
+		//Resident set size of this process, 0 if unknown.
+		static uint64_t	GetProcessRSS();
+
+	private:
+		enum { FSDK_GOVERNOR_MAXEVENTS = 4096 };
+
+		struct Consumer
+		{
+			IMy_MemoryConsumer*	pConsumer;
+			char				name[32];
+			int					iPriority;
+			FSDK_MemoryPressure	minLevel;
+		};
+
+		void		ThreadProc();
+		void		AddEvent(FSDK_GovernorEventType type, uint64_t rss, uint64_t live, uint64_t value, const char* name);
+		void		ApplyCacheSize(uint32_t nSizeMB, uint64_t rss, uint64_t live);
+		uint64_t	NowMs() const;
+
+		FSDK_GovernorConfig		m_Config;
+		std::function<uint64_t()>	m_LiveBytes;
+		std::function<void(uint32_t)>	m_SetCacheSize;
+
+		std::mutex				m_Lock;			// Held while sampling, so consumers can't go away mid-release.
+		std::vector<Consumer>	m_Consumers;	// Sorted by priority.
+		FSDK_MemoryPressure		m_Level;
+		uint32_t				m_nCacheSizeMB;
+		uint32_t				m_nNormalSamples;
+
+		std::mutex				m_EventLock;
+		std::vector<FSDK_GovernorEvent>	m_Events;
+		FILE*					m_pLog;
+
+		std::thread				m_Thread;
+		std::mutex				m_WakeLock;
+		std::condition_variable	m_Wake;
+		bool					m_bRunning;
+		bool					m_bStop;
+		std::chrono::steady_clock::time_point	m_Start;
+	};
+}
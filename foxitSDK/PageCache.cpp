@@ -0,0 +1,257 @@
+﻿#include "PageCache.h"
+
+#include <string.h>
+#include <list>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+
+using namespace foxitSDK;
+
+//One page index of the cache. It is released once it is neither cached nor held.
+struct CMy_PageCache::Entry
+{
+	FSDK_CachedPage		page;
+	std::weak_ptr<FSDK_CachedPage>	pin;	// The references handed out, expired when there are none.
+	int32_t				nPins;		// Groups of references handed out that are not all let go yet.
+	bool				bCached;
+	bool				bIndexed;	// Still found by its page index, false once Clear forgot it.
+	std::list<Entry*>::iterator	lru;	// Position in Core::pages while bCached.
+};
+
+//The cache's state. Every method but Unpin is called with lock held.
+struct CMy_PageCache::Core : public std::enable_shared_from_this<CMy_PageCache::Core>
+{
+	std::mutex			lock;
+	std::condition_variable	unpinned;	// Signalled when a group of references is let go.
+	std::function<void(FSCRT_PAGE)>	release;
+	std::list<Entry*>	pages;		// Cached pages, most recently used first.
+	std::map<int32_t, Entry*>	index;	// Cached pages and the held ones dropped from the cache.
+	size_t				nHeld;		// Groups of references handed out that are not all let go yet, of all entries.
+	size_t				nMaxPages;
+	uint64_t			nBudget;
+	uint64_t			nBytes;
+	FSDK_PageCacheStats	stats;
+
+	//A reference to the entry's page. The last one of a group lets go through Unpin.
+	std::shared_ptr<FSDK_CachedPage>	Pin(Entry* pEntry)
+	{
+		std::shared_ptr<FSDK_CachedPage> pPage = pEntry->pin.lock();
+		if (pPage)
+			return pPage;
+		std::shared_ptr<Core> pCore = shared_from_this();
+		pPage = std::shared_ptr<FSDK_CachedPage>(&pEntry->page, [pCore, pEntry](FSDK_CachedPage*)
+		{
+			pCore->Unpin(pEntry);
+		});
+		pEntry->pin = pPage;
+		pEntry->nPins++;
+		nHeld++;
+		return pPage;
+	}
+
+	void	Unpin(Entry* pEntry)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		pEntry->nPins--;
+		nHeld--;
+		ReleaseIfUnused(pEntry);
+		unpinned.notify_all();
+	}
+
+	void	ReleaseIfUnused(Entry* pEntry)
+	{
+		if (pEntry->nPins > 0 || pEntry->bCached)
+			return;
+		if (pEntry->bIndexed)
+			index.erase(pEntry->page.pageIndex);
+		if (pEntry->page.page)
+			release(pEntry->page.page);
+		delete pEntry;
+	}
+
+	//Put an entry into the cache as the most recently used, unless it is too large to be kept.
+	void	Adopt(Entry* pEntry)
+	{
+		if (nMaxPages == 0 || pEntry->page.bytes > nBudget)
+			return;
+		EvictTo(nMaxPages - 1, nBudget - pEntry->page.bytes);
+		pages.push_front(pEntry);
+		pEntry->lru = pages.begin();
+		pEntry->bCached = true;
+		nBytes += pEntry->page.bytes;
+	}
+
+	//Take an entry out of the cache, releasing it if nobody holds it.
+	void	Uncache(Entry* pEntry)
+	{
+		pages.erase(pEntry->lru);
+		pEntry->bCached = false;
+		nBytes -= pEntry->page.bytes;
+		ReleaseIfUnused(pEntry);
+	}
+
+	//Pin an entry and make it the most recently used, caching a held one again.
+	std::shared_ptr<FSDK_CachedPage>	Use(Entry* pEntry)
+	{
+		//Pinned before it is cached again, so making room can't release it.
+		std::shared_ptr<FSDK_CachedPage> pPage = Pin(pEntry);
+		if (pEntry->bCached)
+			pages.splice(pages.begin(), pages, pEntry->lru);
+		else
+			Adopt(pEntry);
+		return pPage;
+	}
+
+	//Drop least recently used pages until at most nKeepPages pages and nKeepBytes bytes are left. Returns the bytes
+	//of the pages released, held ones free nothing yet.
+	uint64_t	EvictTo(size_t nKeepPages, uint64_t nKeepBytes)
+	{
+		uint64_t nReleased = 0;
+		while (!pages.empty() && (pages.size() > nKeepPages || nBytes > nKeepBytes))
+		{
+			Entry* pOldest = pages.back();
+			if (pOldest->nPins == 0)
+				nReleased += pOldest->page.bytes;
+			stats.evictions++;
+			Uncache(pOldest);
+		}
+		return nReleased;
+	}
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Class CMy_PageCache
+CMy_PageCache::CMy_PageCache(size_t nMaxPages, uint64_t nBudgetBytes, const std::function<void(FSCRT_PAGE)>& release)
+	: m_pCore(std::make_shared<Core>())
+{
+	m_pCore->release = release;
+	m_pCore->nMaxPages = nMaxPages;
+	m_pCore->nBudget = nBudgetBytes;
+	m_pCore->nBytes = 0;
+	m_pCore->nHeld = 0;
+	memset(&m_pCore->stats, 0, sizeof(m_pCore->stats));
+}
+
+CMy_PageCache::~CMy_PageCache()
+{
+	Clear();
+}
+
+void CMy_PageCache::SetLimits(size_t nMaxPages, uint64_t nBudgetBytes)
+{
+	std::lock_guard<std::mutex> lock(m_pCore->lock);
+	m_pCore->nMaxPages = nMaxPages;
+	m_pCore->nBudget = nBudgetBytes;
+	m_pCore->EvictTo(nMaxPages, nBudgetBytes);
+}
+
+std::shared_ptr<FSDK_CachedPage> CMy_PageCache::Lookup(int32_t iPageIndex)
+{
+	std::lock_guard<std::mutex> lock(m_pCore->lock);
+	std::map<int32_t, Entry*>::iterator it = m_pCore->index.find(iPageIndex);
+	if (it == m_pCore->index.end())
+	{
+		m_pCore->stats.misses++;
+		return std::shared_ptr<FSDK_CachedPage>();
+	}
+	m_pCore->stats.hits++;
+	return m_pCore->Use(it->second);
+}
+
+std::shared_ptr<FSDK_CachedPage> CMy_PageCache::Find(int32_t iPageIndex)
+{
+	std::lock_guard<std::mutex> lock(m_pCore->lock);
+	std::map<int32_t, Entry*>::iterator it = m_pCore->index.find(iPageIndex);
+	if (it == m_pCore->index.end())
+		return std::shared_ptr<FSDK_CachedPage>();
+	return m_pCore->Pin(it->second);
+}
+
+FSCRT_PAGE CMy_PageCache::Take(int32_t iPageIndex)
+{
+	std::unique_lock<std::mutex> lock(m_pCore->lock);
+	std::map<int32_t, Entry*>::iterator it = m_pCore->index.find(iPageIndex);
+	if (it == m_pCore->index.end())
+		return NULL;
+	//Forgotten first so nobody gets a new reference. Take counts as a holder itself, so the holders letting go
+	//don't release the page.
+	Entry* pEntry = it->second;
+	m_pCore->index.erase(it);
+	pEntry->bIndexed = false;
+	pEntry->nPins++;
+	if (pEntry->bCached)
+		m_pCore->Uncache(pEntry);
+	m_pCore->unpinned.wait(lock, [pEntry]() { return pEntry->nPins == 1; });
+	FSCRT_PAGE page = pEntry->page.page;
+	delete pEntry;
+	return page;
+}
+
+std::shared_ptr<FSDK_CachedPage> CMy_PageCache::Insert(int32_t iPageIndex, FSCRT_PAGE page, uint64_t nBytes)
+{
+	if (!page)
+		return std::shared_ptr<FSDK_CachedPage>();
+	std::lock_guard<std::mutex> lock(m_pCore->lock);
+	std::map<int32_t, Entry*>::iterator it = m_pCore->index.find(iPageIndex);
+	if (it != m_pCore->index.end())
+	{
+		//Lost a race with another parse of the page. The same handle must stay alive for the entry.
+		if (page != it->second->page.page)
+			m_pCore->release(page);
+		return m_pCore->Use(it->second);
+	}
+	Entry* pEntry = new Entry;
+	pEntry->page.page = page;
+	pEntry->page.pageIndex = iPageIndex;
+	pEntry->page.bytes = nBytes;
+	pEntry->nPins = 0;
+	pEntry->bCached = false;
+	pEntry->bIndexed = true;
+	m_pCore->index[iPageIndex] = pEntry;
+	std::shared_ptr<FSDK_CachedPage> pPage = m_pCore->Pin(pEntry);
+	m_pCore->Adopt(pEntry);
+	if (pEntry->bCached)
+		m_pCore->stats.insertions++;
+	return pPage;
+}
+
+void CMy_PageCache::Clear()
+{
+	std::lock_guard<std::mutex> lock(m_pCore->lock);
+	std::map<int32_t, Entry*> index;
+	index.swap(m_pCore->index);
+	for (std::map<int32_t, Entry*>::iterator it = index.begin(); it != index.end(); ++it)
+	{
+		Entry* pEntry = it->second;
+		pEntry->bIndexed = false;
+		if (pEntry->bCached)
+			m_pCore->Uncache(pEntry);
+	}
+}
+
+void CMy_PageCache::WaitForHolders()
+{
+	std::unique_lock<std::mutex> lock(m_pCore->lock);
+	Core* pCore = m_pCore.get();
+	pCore->unpinned.wait(lock, [pCore]() { return pCore->nHeld == 0; });
+}
+
+FSDK_PageCacheStats CMy_PageCache::GetStats()
+{
+	std::lock_guard<std::mutex> lock(m_pCore->lock);
+	FSDK_PageCacheStats stats = m_pCore->stats;
+	stats.pages = m_pCore->pages.size();
+	stats.bytes = m_pCore->nBytes;
+	stats.maxPages = m_pCore->nMaxPages;
+	stats.budgetBytes = m_pCore->nBudget;
+	return stats;
+}
+
+uint64_t CMy_PageCache::ReleaseMemory(FSDK_MemoryPressure level)
+{
+	std::lock_guard<std::mutex> lock(m_pCore->lock);
+	if (level >= FSDK_PRESSURE_HIGH)
+		return m_pCore->EvictTo(0, 0);
+	return m_pCore->EvictTo(m_pCore->pages.size() / 2, m_pCore->nBytes / 2);
+}
@@ -0,0 +1,86 @@
+﻿#pragma once
+
+/** Common header files. */
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+#include <memory>
+
+/** Include header files of SDK. */
+#include "../foxitSDK/include/fsdk.h"
+
+#include "MemoryGovernor.h"
+
+namespace foxitSDK
+{
+	//A parsed page handed out by CMy_PageCache. Whoever holds a reference keeps the page alive: the page is cleared
+	//when the cache has dropped it and the last reference goes, on the thread that lets it go.
+	struct FSDK_CachedPage
+	{
+		FSCRT_PAGE	page;
+		int32_t		pageIndex;
+		uint64_t	bytes;			// SDK memory the parse took, an estimate.
+	};
+
+	//Counters of CMy_PageCache.
+	struct FSDK_PageCacheStats
+	{
+		uint64_t	hits;
+		uint64_t	misses;
+		uint64_t	insertions;
+		uint64_t	evictions;
+		uint64_t	pages;
+		uint64_t	bytes;
+		uint64_t	maxPages;
+		uint64_t	budgetBytes;
+	};
+
+	//Parsed pages of one document, least recently used dropped first once there are more than a number of pages or
+	//they take more than a byte budget. Pages are reference counted, so a page dropped while a render still uses it
+	//lives on until the render is done. Every page goes through the release function the cache was made with, which
+	//must clear it with FSPDF_Page_Clear. All references must be gone before the document is closed.
+	//FSPDF_Doc_GetPage returns the same handle for a page index every time, so the cache keeps one entry per index:
+	//a page dropped while still held is still found by Lookup, which takes it back, and the handle is cleared only
+	//once it is neither cached nor held. Pages are released with the cache's lock held.
+	//As a memory consumer it halves at elevated pressure and empties at high; pages in use stay alive regardless.
+	class CMy_PageCache : public IMy_MemoryConsumer
+	{
+	public:
+		CMy_PageCache(size_t nMaxPages, uint64_t nBudgetBytes, const std::function<void(FSCRT_PAGE)>& release);
+		virtual ~CMy_PageCache();
+
+		//Evicts right away if the cache is over the new limits. A limit of 0 disables caching.
+		void		SetLimits(size_t nMaxPages, uint64_t nBudgetBytes);
+
+		//NULL on a miss. A hit makes the page the most recently used, a held page dropped before is cached again.
+		std::shared_ptr<FSDK_CachedPage>	Lookup(int32_t iPageIndex);
+		//Same as Lookup, but leaves the order and the counters alone.
+		std::shared_ptr<FSDK_CachedPage>	Find(int32_t iPageIndex);
+
+		//Take a newly parsed page over. If the index has an entry already, that one is returned and page is released
+		//only if it is another handle. The page is handed back even when it is too large to be kept.
+		std::shared_ptr<FSDK_CachedPage>	Insert(int32_t iPageIndex, FSCRT_PAGE page, uint64_t nBytes);
+
+		//Hand a page over to the caller and forget it, without releasing it. NULL if the index has no entry. A page
+		//still referenced is no longer handed out, and Take blocks until the last reference is gone.
+		FSCRT_PAGE	Take(int32_t iPageIndex);
+
+		//Forget every page, before the document closes. Pages still referenced are cleared when their last reference
+		//goes, and are no longer found by their index.
+		void		Clear();
+
+		//Block until every reference the cache handed out is gone, so the document can be closed.
+		void		WaitForHolders();
+
+		FSDK_PageCacheStats	GetStats();
+
+		virtual uint64_t	ReleaseMemory(FSDK_MemoryPressure level);
+
+	private:
+		struct Entry;
+		struct Core;
+
+		//Shared with the references handed out, which may outlive the cache.
+		std::shared_ptr<Core>	m_pCore;
+	};
+}
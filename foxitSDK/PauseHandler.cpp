@@ -0,0 +1,66 @@
+﻿#include "PauseHandler.h"
+
+using namespace foxitSDK;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Class CMy_CancelToken
+CMy_CancelToken::CMy_CancelToken()
+{
+	m_bCancelled = false;
+}
+
+void CMy_CancelToken::Cancel()
+{
+	m_bCancelled = true;
+}
+
+bool CMy_CancelToken::IsCancelled() const
+{
+	return m_bCancelled;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Class CMy_TimeSlicePause
+CMy_TimeSlicePause::CMy_TimeSlicePause(uint32_t nSliceMs, const CMy_CancelToken* pCancel)
+{
+	clientData = this;
+	NeedPauseNow = g_PrivateNeedPauseNow;
+	m_Slice = std::chrono::milliseconds(nSliceMs);
+	m_pCancel = pCancel;
+	BeginSlice();
+}
+
+void CMy_TimeSlicePause::BeginSlice()
+{
+	m_Deadline = std::chrono::steady_clock::now() + m_Slice;
+}
+
+bool CMy_TimeSlicePause::IsCancelled() const
+{
+	return m_pCancel && m_pCancel->IsCancelled();
+}
+
+FS_RESULT CMy_TimeSlicePause::Run(FSCRT_PROGRESS progress, const std::function<void(FSCRT_PROGRESS)>& onSlice)
+{
+	FS_RESULT ret = FSCRT_ERRCODE_TOBECONTINUED;
+	while (ret == FSCRT_ERRCODE_TOBECONTINUED)
+	{
+		if (IsCancelled())
+			return FSDK_ERRCODE_CANCELLED;
+		BeginSlice();
+		ret = FSCRT_Progress_Continue(progress, this);
+		if (onSlice)
+			onSlice(progress);
+	}
+	return ret;
+}
+
+FS_BOOL CMy_TimeSlicePause::g_PrivateNeedPauseNow(FS_LPVOID clientData)
+{
+	CMy_TimeSlicePause* pPause = (CMy_TimeSlicePause*)clientData;
+	if (!pPause)
+		return 0;
+	if (pPause->IsCancelled())
+		return 1;
+	return pPause->m_Slice.count() > 0 && std::chrono::steady_clock::now() >= pPause->m_Deadline;
+}
@@ -0,0 +1,55 @@
+﻿#pragma once
+
+/** Common header files. */
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+
+/** Include header files of SDK. */
+#include "../foxitSDK/include/fsdk.h"
+
+//Result of a render, parse or save stopped through its CMy_CancelToken, outside the range of FSCRT_ERRCODE_XXX.
+#define FSDK_ERRCODE_CANCELLED		-1000
+
+namespace foxitSDK
+{
+	//Set by whoever supersedes an operation, polled by the operation from any thread. Once cancelled it stays cancelled.
+	class CMy_CancelToken
+	{
+	public:
+		CMy_CancelToken();
+
+		void	Cancel();
+		bool	IsCancelled() const;
+
+	private:
+		std::atomic<bool>	m_bCancelled;
+	};
+
+	//Inherited class of FSCRT_PAUSEHANDLER which lets a progressive process run for a fixed time slice.
+	//Call BeginSlice before each FSCRT_Progress_Continue; the process pauses once the slice is used up, or right away
+	//once pCancel is cancelled. The SDK asks between page objects, so a cancelled process stops within milliseconds.
+	//A slice of 0 has no limit: the process only pauses when it is cancelled.
+	class CMy_TimeSlicePause : public FSCRT_PAUSEHANDLER
+	{
+	public:
+		CMy_TimeSlicePause(uint32_t nSliceMs = 100, const CMy_CancelToken* pCancel = NULL);
+
+		void	BeginSlice();
+		bool	IsCancelled() const;
+
+		//Continue progress one slice at a time until it is finished, fails or is cancelled. onSlice, if set, is called
+		//after every slice. Returns the last result of FSCRT_Progress_Continue, or FSDK_ERRCODE_CANCELLED if the process
+		//was cancelled before it finished; the caller still releases progress.
+		FS_RESULT	Run(FSCRT_PROGRESS progress, const std::function<void(FSCRT_PROGRESS)>& onSlice = nullptr);
+
+		//Inherited callback funtions.
+		static FS_BOOL g_PrivateNeedPauseNow(FS_LPVOID clientData);
+
+	private:
+		std::chrono::steady_clock::duration		m_Slice;
+		std::chrono::steady_clock::time_point	m_Deadline;
+		const CMy_CancelToken*	m_pCancel;
+	};
+}
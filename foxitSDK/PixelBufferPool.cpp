@@ -0,0 +1,181 @@
+﻿#include "PixelBufferPool.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+using namespace foxitSDK;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Class CMy_PixelBufferPool
+CMy_PixelBufferPool::CMy_PixelBufferPool(uint64_t nMaxIdleBytes)
+{
+	m_nMaxIdle = nMaxIdleBytes;
+	memset(&m_Stats, 0, sizeof(m_Stats));
+}
+
+CMy_PixelBufferPool::~CMy_PixelBufferPool()
+{
+	TrimIdle(0);
+}
+
+void CMy_PixelBufferPool::SetMaxIdleBytes(uint64_t nBytes)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	m_nMaxIdle = nBytes;
+	TrimIdle(m_nMaxIdle);
+}
+
+int32_t CMy_PixelBufferPool::GetAlignedStride(int32_t width, int32_t bytesPerPixel)
+{
+	int32_t stride = width * bytesPerPixel;
+	return (stride + FSDK_PIXELBUFFER_ALIGN - 1) / FSDK_PIXELBUFFER_ALIGN * FSDK_PIXELBUFFER_ALIGN;
+}
+
+FSDK_PixelBuffer* CMy_PixelBufferPool::Allocate(size_t nCapacity)
+{
+	FSDK_PixelBuffer* pBuffer = new (std::nothrow) FSDK_PixelBuffer;
+	if (!pBuffer)
+		return NULL;
+#ifdef _WIN32
+	pBuffer->data = (uint8_t*)_aligned_malloc(nCapacity, FSDK_PIXELBUFFER_ALIGN);
+#else
+	void* pData = NULL;
+	pBuffer->data = posix_memalign(&pData, FSDK_PIXELBUFFER_ALIGN, nCapacity) == 0 ? (uint8_t*)pData : NULL;
+#endif
+	if (!pBuffer->data)
+	{
+		delete pBuffer;
+		return NULL;
+	}
+	pBuffer->capacity = nCapacity;
+	return pBuffer;
+}
+
+void CMy_PixelBufferPool::Free(FSDK_PixelBuffer* pBuffer)
+{
+#ifdef _WIN32
+	_aligned_free(pBuffer->data);
+#else
+	free(pBuffer->data);
+#endif
+	delete pBuffer;
+}
+
+FSDK_PixelBuffer* CMy_PixelBufferPool::Acquire(int32_t width, int32_t height, int32_t bytesPerPixel)
+{
+	if (width <= 0 || height <= 0 || bytesPerPixel <= 0)
+		return NULL;
+	int32_t stride = GetAlignedStride(width, bytesPerPixel);
+	size_t nSize = (size_t)stride * height;
+
+	FSDK_PixelBuffer* pBuffer = NULL;
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		m_Stats.acquired++;
+		std::list<FSDK_PixelBuffer*>::iterator best = m_Idle.end();
+		for (std::list<FSDK_PixelBuffer*>::iterator it = m_Idle.begin(); it != m_Idle.end(); ++it)
+		{
+			size_t nCapacity = (*it)->capacity;
+			if (nCapacity >= nSize && nCapacity <= nSize + nSize / 4 && (best == m_Idle.end() || nCapacity < (*best)->capacity))
+				best = it;
+		}
+		if (best != m_Idle.end())
+		{
+			pBuffer = *best;
+			m_Idle.erase(best);
+			m_Stats.idleBuffers--;
+			m_Stats.idleBytes -= pBuffer->capacity;
+			m_Stats.reused++;
+		}
+	}
+	if (!pBuffer)
+	{
+		pBuffer = Allocate(nSize);
+		if (!pBuffer)
+			return NULL;
+		std::lock_guard<std::mutex> lock(m_Lock);
+		m_Stats.allocated++;
+	}
+	pBuffer->width = width;
+	pBuffer->height = height;
+	pBuffer->stride = stride;
+
+	std::lock_guard<std::mutex> lock(m_Lock);
+	m_Stats.liveBuffers++;
+	m_Stats.liveBytes += pBuffer->capacity;
+	return pBuffer;
+}
+
+void CMy_PixelBufferPool::Release(FSDK_PixelBuffer* pBuffer)
+{
+	if (!pBuffer)
+		return;
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		m_Stats.liveBuffers--;
+		m_Stats.liveBytes -= pBuffer->capacity;
+		if (pBuffer->capacity <= m_nMaxIdle)
+		{
+			TrimIdle(m_nMaxIdle - pBuffer->capacity);
+			m_Idle.push_front(pBuffer);
+			m_Stats.idleBuffers++;
+			m_Stats.idleBytes += pBuffer->capacity;
+			return;
+		}
+	}
+	Free(pBuffer);
+}
+
+void CMy_PixelBufferPool::Preallocate(int32_t width, int32_t height, int32_t bytesPerPixel, size_t nCount)
+{
+	if (width <= 0 || height <= 0 || bytesPerPixel <= 0)
+		return;
+	size_t nSize = (size_t)GetAlignedStride(width, bytesPerPixel) * height;
+	for (size_t i = 0; i < nCount; i++)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_Lock);
+			if (m_Stats.idleBytes + nSize > m_nMaxIdle)
+				return;
+		}
+		FSDK_PixelBuffer* pBuffer = Allocate(nSize);
+		if (!pBuffer)
+			return;
+		std::lock_guard<std::mutex> lock(m_Lock);
+		m_Stats.allocated++;
+		m_Idle.push_back(pBuffer);
+		m_Stats.idleBuffers++;
+		m_Stats.idleBytes += pBuffer->capacity;
+	}
+}
+
+uint64_t CMy_PixelBufferPool::TrimIdle(uint64_t nBytes)
+{
+	uint64_t nReleased = 0;
+	while (m_Stats.idleBytes > nBytes && !m_Idle.empty())
+	{
+		FSDK_PixelBuffer* pBuffer = m_Idle.back();
+		m_Idle.pop_back();
+		m_Stats.idleBuffers--;
+		m_Stats.idleBytes -= pBuffer->capacity;
+		nReleased += pBuffer->capacity;
+		Free(pBuffer);
+	}
+	return nReleased;
+}
+
+FSDK_PixelBufferPoolStats CMy_PixelBufferPool::GetStats()
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	return m_Stats;
+}
+
+uint64_t CMy_PixelBufferPool::ReleaseMemory(FSDK_MemoryPressure /*level*/)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	return TrimIdle(0);
+}
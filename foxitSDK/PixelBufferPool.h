@@ -0,0 +1,77 @@
+﻿#pragma once
+
+/** Common header files. */
+#include <stdint.h>
+#include <stddef.h>
+#include <list>
+#include <mutex>
+
+#include "MemoryGovernor.h"
+
+//Buffers and their rows start on this boundary: a cache line, and wide enough for any vector load.
+#define FSDK_PIXELBUFFER_ALIGN		64
+
+namespace foxitSDK
+{
+	//A pixel buffer handed out by CMy_PixelBufferPool. Rows are stride bytes apart, stride is a multiple of
+	//FSDK_PIXELBUFFER_ALIGN. Contents are whatever the previous user left.
+	struct FSDK_PixelBuffer
+	{
+		uint8_t*	data;
+		int32_t		width;
+		int32_t		height;
+		int32_t		stride;
+		size_t		capacity;		// Bytes available at data, at least stride * height.
+	};
+
+	//Counters of CMy_PixelBufferPool.
+	struct FSDK_PixelBufferPoolStats
+	{
+		uint64_t	acquired;
+		uint64_t	reused;			// Acquires served by an idle buffer.
+		uint64_t	allocated;		// Acquires that had to allocate.
+		uint64_t	liveBuffers;	// Handed out and not released yet.
+		uint64_t	liveBytes;
+		uint64_t	idleBuffers;
+		uint64_t	idleBytes;
+	};
+
+	//Pixel buffers kept for reuse, so rendering the same viewport over and over allocates nothing.
+	//Released buffers are kept up to a byte limit, least recently released dropped first. An acquire takes the smallest
+	//idle buffer that fits unless it is more than a quarter too large, so thumbnails don't tie up page-sized buffers.
+	//As a memory consumer it drops all idle buffers.
+	class CMy_PixelBufferPool : public IMy_MemoryConsumer
+	{
+	public:
+		CMy_PixelBufferPool(uint64_t nMaxIdleBytes);
+		virtual ~CMy_PixelBufferPool();
+
+		void		SetMaxIdleBytes(uint64_t nBytes);
+
+		//NULL if width or height is not positive or memory is short.
+		FSDK_PixelBuffer*	Acquire(int32_t width, int32_t height, int32_t bytesPerPixel);
+		//Give a buffer back. It may be freed right away if the idle limit is reached.
+		void		Release(FSDK_PixelBuffer* pBuffer);
+
+		//Allocate nCount idle buffers of that size ahead of time, within the idle limit.
+		void		Preallocate(int32_t width, int32_t height, int32_t bytesPerPixel, size_t nCount);
+
+		FSDK_PixelBufferPoolStats	GetStats();
+
+		virtual uint64_t	ReleaseMemory(FSDK_MemoryPressure level);
+
+		//Bytes from one row to the next for a row of width pixels.
+		static int32_t	GetAlignedStride(int32_t width, int32_t bytesPerPixel);
+
+	private:
+		static FSDK_PixelBuffer*	Allocate(size_t nCapacity);
+		static void		Free(FSDK_PixelBuffer* pBuffer);
+		//Free idle buffers, oldest first, until at most nBytes are idle. Called with m_Lock held.
+		uint64_t		TrimIdle(uint64_t nBytes);
+
+		std::mutex		m_Lock;
+		std::list<FSDK_PixelBuffer*>	m_Idle;		// Most recently released first.
+		uint64_t		m_nMaxIdle;
+		FSDK_PixelBufferPoolStats	m_Stats;
+	};
+}
@@ -0,0 +1,480 @@
+﻿#include "PixelConvert.h"
+
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define FSDK_PIXEL_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define FSDK_TARGET_SSE2
+#define FSDK_TARGET_AVX2
+#else
+#include <cpuid.h>
+//Kernels are built for their instruction set whatever the compiler flags, the CPU check decides what runs.
+#define FSDK_TARGET_SSE2	__attribute__((target("sse2")))
+#define FSDK_TARGET_AVX2	__attribute__((target("avx2")))
+#endif
+#endif
+
+using namespace foxitSDK;
+
+//Gray weights in 1/256, summing to 256 so white stays 255.
+#define FSDK_GRAY_R		77
+#define FSDK_GRAY_G		151
+#define FSDK_GRAY_B		28
+
+//Repacks at least this large bypass the cache: the destination is handed on, not read back.
+#define FSDK_REPACK_STREAMBYTES		(4 * 1024 * 1024)
+
+//GetBest times each kernel on a frame of this size, about one render tile, best of a few runs.
+#define FSDK_CALIBRATE_WIDTH		256
+#define FSDK_CALIBRATE_HEIGHT		64
+#define FSDK_CALIBRATE_RUNS			5
+//A wider instruction set is only picked when it is this much faster, in percent. At the same speed the narrower
+//one keeps the core's clock up and is more predictable.
+#define FSDK_CALIBRATE_MARGIN		10
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Scalar kernels, also used for the pixels left over by the vector kernels.
+static inline void RgbxToBgraPixels(const uint8_t* src, uint8_t* dst, int32_t count)
+{
+	for (int32_t i = 0; i < count; i++, src += 4, dst += 4)
+	{
+		uint8_t r = src[0];
+		uint8_t g = src[1];
+		uint8_t b = src[2];
+		dst[0] = b;
+		dst[1] = g;
+		dst[2] = r;
+		dst[3] = 0xff;
+	}
+}
+
+static inline void RgbxToRgbaPixels(const uint8_t* src, uint8_t* dst, int32_t count)
+{
+	for (int32_t i = 0; i < count; i++, src += 4, dst += 4)
+	{
+		dst[0] = src[0];
+		dst[1] = src[1];
+		dst[2] = src[2];
+		dst[3] = 0xff;
+	}
+}
+
+static inline void RgbxToGray8Pixels(const uint8_t* src, uint8_t* dst, int32_t count)
+{
+	for (int32_t i = 0; i < count; i++, src += 4)
+		dst[i] = (uint8_t)((src[0] * FSDK_GRAY_R + src[1] * FSDK_GRAY_G + src[2] * FSDK_GRAY_B + 128) >> 8);
+}
+
+static void RgbxToBgraScalar(const uint8_t* src, int32_t srcStride, uint8_t* dst, int32_t dstStride, int32_t width, int32_t height)
+{
+	for (int32_t y = 0; y < height; y++)
+		RgbxToBgraPixels(src + (size_t)y * srcStride, dst + (size_t)y * dstStride, width);
+}
+
+static void RgbxToRgbaScalar(const uint8_t* src, int32_t srcStride, uint8_t* dst, int32_t dstStride, int32_t width, int32_t height)
+{
+	for (int32_t y = 0; y < height; y++)
+		RgbxToRgbaPixels(src + (size_t)y * srcStride, dst + (size_t)y * dstStride, width);
+}
+
+static void RgbxToGray8Scalar(const uint8_t* src, int32_t srcStride, uint8_t* dst, int32_t dstStride, int32_t width, int32_t height)
+{
+	for (int32_t y = 0; y < height; y++)
+		RgbxToGray8Pixels(src + (size_t)y * srcStride, dst + (size_t)y * dstStride, width);
+}
+
+static void RepackScalar(const uint8_t* src, int32_t srcStride, uint8_t* dst, int32_t dstStride, int32_t rowBytes, int32_t height)
+{
+	if (src == dst && srcStride == dstStride)
+		return;
+	for (int32_t y = 0; y < height; y++)
+		memmove(dst + (size_t)y * dstStride, src + (size_t)y * srcStride, (size_t)rowBytes);
+}
+
+#ifdef FSDK_PIXEL_X86
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//SSE2 kernels, 4 pixels a vector. SSE2 has no byte shuffle, red and blue trade places with 32-bit shifts.
+FSDK_TARGET_SSE2 static void RgbxToBgraSse2(const uint8_t* src, int32_t srcStride, uint8_t* dst, int32_t dstStride, int32_t width, int32_t height)
+{
+	const __m128i redBlue = _mm_set1_epi32(0x00ff00ff);
+	const __m128i green = _mm_set1_epi32(0x0000ff00);
+	const __m128i alpha = _mm_set1_epi32((int)0xff000000);
+	for (int32_t y = 0; y < height; y++)
+	{
+		const uint8_t* s = src + (size_t)y * srcStride;
+		uint8_t* d = dst + (size_t)y * dstStride;
+		int32_t x = 0;
+		for (; x + 4 <= width; x += 4)
+		{
+			__m128i p = _mm_loadu_si128((const __m128i*)(s + x * 4));
+			__m128i rb = _mm_and_si128(p, redBlue);
+			__m128i swapped = _mm_or_si128(_mm_slli_epi32(rb, 16), _mm_srli_epi32(rb, 16));
+			__m128i out = _mm_or_si128(_mm_or_si128(swapped, _mm_and_si128(p, green)), alpha);
+			_mm_storeu_si128((__m128i*)(d + x * 4), out);
+		}
+		RgbxToBgraPixels(s + x * 4, d + x * 4, width - x);
+	}
+}
+
+FSDK_TARGET_SSE2 static void RgbxToRgbaSse2(const uint8_t* src, int32_t srcStride, uint8_t* dst, int32_t dstStride, int32_t width, int32_t height)
+{
+	const __m128i alpha = _mm_set1_epi32((int)0xff000000);
+	for (int32_t y = 0; y < height; y++)
+	{
+		const uint8_t* s = src + (size_t)y * srcStride;
+		uint8_t* d = dst + (size_t)y * dstStride;
+		int32_t x = 0;
+		for (; x + 8 <= width; x += 8)
+		{
+			__m128i p0 = _mm_loadu_si128((const __m128i*)(s + x * 4));
+			__m128i p1 = _mm_loadu_si128((const __m128i*)(s + x * 4 + 16));
+			_mm_storeu_si128((__m128i*)(d + x * 4), _mm_or_si128(p0, alpha));
+			_mm_storeu_si128((__m128i*)(d + x * 4 + 16), _mm_or_si128(p1, alpha));
+		}
+		RgbxToRgbaPixels(s + x * 4, d + x * 4, width - x);
+	}
+}
+
+//Gray of 8 pixels as 16-bit values. The weighted sum stays below 65536, so 16-bit products wrapping as signed is harmless.
+FSDK_TARGET_SSE2 static inline __m128i GrayOf8Sse2(__m128i lo, __m128i hi)
+{
+	const __m128i byteMask = _mm_set1_epi32(0xff);
+	__m128i r = _mm_packs_epi32(_mm_and_si128(lo, byteMask), _mm_and_si128(hi, byteMask));
+	__m128i g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 8), byteMask), _mm_and_si128(_mm_srli_epi32(hi, 8), byteMask));
+	__m128i b = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 16), byteMask), _mm_and_si128(_mm_srli_epi32(hi, 16), byteMask));
+	__m128i sum = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(FSDK_GRAY_R)), _mm_mullo_epi16(g, _mm_set1_epi16(FSDK_GRAY_G)));
+	sum = _mm_add_epi16(sum, _mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(FSDK_GRAY_B)), _mm_set1_epi16(128)));
+	return _mm_srli_epi16(sum, 8);
+}
+
+FSDK_TARGET_SSE2 static void RgbxToGray8Sse2(const uint8_t* src, int32_t srcStride, uint8_t* dst, int32_t dstStride, int32_t width, int32_t height)
+{
+	for (int32_t y = 0; y < height; y++)
+	{
+		const uint8_t* s = src + (size_t)y * srcStride;
+		uint8_t* d = dst + (size_t)y * dstStride;
+		int32_t x = 0;
+		for (; x + 16 <= width; x += 16)
+		{
+			const __m128i* p = (const __m128i*)(s + x * 4);
+			__m128i gray0 = GrayOf8Sse2(_mm_loadu_si128(p), _mm_loadu_si128(p + 1));
+			__m128i gray1 = GrayOf8Sse2(_mm_loadu_si128(p + 2), _mm_loadu_si128(p + 3));
+			_mm_storeu_si128((__m128i*)(d + x), _mm_packus_epi16(gray0, gray1));
+		}
+		RgbxToGray8Pixels(s + x * 4, d + x, width - x);
+	}
+}
+
+FSDK_TARGET_SSE2 static void RepackSse2(const uint8_t* src, int32_t srcStride, uint8_t* dst, int32_t dstStride, int32_t rowBytes, int32_t height)
+{
+	if (src == dst && srcStride == dstStride)
+		return;
+	//Rows of two buffers may overlap only when repacking in place, which memmove handles.
+	bool bStream = (uint64_t)rowBytes * height >= FSDK_REPACK_STREAMBYTES && (src + (size_t)srcStride * height <= dst || dst + (size_t)dstStride * height <= src);
+	if (!bStream)
+	{
+		RepackScalar(src, srcStride, dst, dstStride, rowBytes, height);
+		return;
+	}
+	for (int32_t y = 0; y < height; y++)
+	{
+		const uint8_t* s = src + (size_t)y * srcStride;
+		uint8_t* d = dst + (size_t)y * dstStride;
+		int32_t x = 0;
+		//Streaming stores need 16-byte aligned addresses; copy up to the boundary first.
+		int32_t head = (int32_t)((16 - ((uintptr_t)d & 15)) & 15);
+		if (head > rowBytes)
+			head = rowBytes;
+		memcpy(d, s, (size_t)head);
+		for (x = head; x + 64 <= rowBytes; x += 64)
+		{
+			__m128i v0 = _mm_loadu_si128((const __m128i*)(s + x));
+			__m128i v1 = _mm_loadu_si128((const __m128i*)(s + x + 16));
+			__m128i v2 = _mm_loadu_si128((const __m128i*)(s + x + 32));
+			__m128i v3 = _mm_loadu_si128((const __m128i*)(s + x + 48));
+			_mm_stream_si128((__m128i*)(d + x), v0);
+			_mm_stream_si128((__m128i*)(d + x + 16), v1);
+			_mm_stream_si128((__m128i*)(d + x + 32), v2);
+			_mm_stream_si128((__m128i*)(d + x + 48), v3);
+		}
+		memcpy(d + x, s + x, (size_t)(rowBytes - x));
+	}
+	_mm_sfence();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//AVX2 kernels, 8 pixels a vector.
+FSDK_TARGET_AVX2 static void RgbxToBgraAvx2(const uint8_t* src, int32_t srcStride, uint8_t* dst, int32_t dstStride, int32_t width, int32_t height)
+{
+	const __m256i shuffle = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+		2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+	const __m256i alpha = _mm256_set1_epi32((int)0xff000000);
+	for (int32_t y = 0; y < height; y++)
+	{
+		const uint8_t* s = src + (size_t)y * srcStride;
+		uint8_t* d = dst + (size_t)y * dstStride;
+		int32_t x = 0;
+		for (; x + 16 <= width; x += 16)
+		{
+			__m256i p0 = _mm256_loadu_si256((const __m256i*)(s + x * 4));
+			__m256i p1 = _mm256_loadu_si256((const __m256i*)(s + x * 4 + 32));
+			_mm256_storeu_si256((__m256i*)(d + x * 4), _mm256_or_si256(_mm256_shuffle_epi8(p0, shuffle), alpha));
+			_mm256_storeu_si256((__m256i*)(d + x * 4 + 32), _mm256_or_si256(_mm256_shuffle_epi8(p1, shuffle), alpha));
+		}
+		RgbxToBgraPixels(s + x * 4, d + x * 4, width - x);
+	}
+}
+
+FSDK_TARGET_AVX2 static void RgbxToRgbaAvx2(const uint8_t* src, int32_t srcStride, uint8_t* dst, int32_t dstStride, int32_t width, int32_t height)
+{
+	const __m256i alpha = _mm256_set1_epi32((int)0xff000000);
+	for (int32_t y = 0; y < height; y++)
+	{
+		const uint8_t* s = src + (size_t)y * srcStride;
+		uint8_t* d = dst + (size_t)y * dstStride;
+		int32_t x = 0;
+		for (; x + 16 <= width; x += 16)
+		{
+			__m256i p0 = _mm256_loadu_si256((const __m256i*)(s + x * 4));
+			__m256i p1 = _mm256_loadu_si256((const __m256i*)(s + x * 4 + 32));
+			_mm256_storeu_si256((__m256i*)(d + x * 4), _mm256_or_si256(p0, alpha));
+			_mm256_storeu_si256((__m256i*)(d + x * 4 + 32), _mm256_or_si256(p1, alpha));
+		}
+		RgbxToRgbaPixels(s + x * 4, d + x * 4, width - x);
+	}
+}
+
+//Gray of 16 pixels as 16-bit values, in the lane order _mm256_packs_epi32 leaves them.
+FSDK_TARGET_AVX2 static inline __m256i GrayOf16Avx2(__m256i lo, __m256i hi)
+{
+	const __m256i byteMask = _mm256_set1_epi32(0xff);
+	__m256i r = _mm256_packs_epi32(_mm256_and_si256(lo, byteMask), _mm256_and_si256(hi, byteMask));
+	__m256i g = _mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(lo, 8), byteMask), _mm256_and_si256(_mm256_srli_epi32(hi, 8), byteMask));
+	__m256i b = _mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(lo, 16), byteMask), _mm256_and_si256(_mm256_srli_epi32(hi, 16), byteMask));
+	__m256i sum = _mm256_add_epi16(_mm256_mullo_epi16(r, _mm256_set1_epi16(FSDK_GRAY_R)), _mm256_mullo_epi16(g, _mm256_set1_epi16(FSDK_GRAY_G)));
+	sum = _mm256_add_epi16(sum, _mm256_add_epi16(_mm256_mullo_epi16(b, _mm256_set1_epi16(FSDK_GRAY_B)), _mm256_set1_epi16(128)));
+	return _mm256_srli_epi16(sum, 8);
+}
+
+FSDK_TARGET_AVX2 static void RgbxToGray8Avx2(const uint8_t* src, int32_t srcStride, uint8_t* dst, int32_t dstStride, int32_t width, int32_t height)
+{
+	//The packs work within 128-bit lanes and leave groups of 4 pixels in the order 0 2 4 6 1 3 5 7.
+	const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+	for (int32_t y = 0; y < height; y++)
+	{
+		const uint8_t* s = src + (size_t)y * srcStride;
+		uint8_t* d = dst + (size_t)y * dstStride;
+		int32_t x = 0;
+		for (; x + 32 <= width; x += 32)
+		{
+			const __m256i* p = (const __m256i*)(s + x * 4);
+			__m256i gray0 = GrayOf16Avx2(_mm256_loadu_si256(p), _mm256_loadu_si256(p + 1));
+			__m256i gray1 = GrayOf16Avx2(_mm256_loadu_si256(p + 2), _mm256_loadu_si256(p + 3));
+			__m256i packed = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(gray0, gray1), order);
+			_mm256_storeu_si256((__m256i*)(d + x), packed);
+		}
+		RgbxToGray8Pixels(s + x * 4, d + x, width - x);
+	}
+}
+
+FSDK_TARGET_AVX2 static void RepackAvx2(const uint8_t* src, int32_t srcStride, uint8_t* dst, int32_t dstStride, int32_t rowBytes, int32_t height)
+{
+	if (src == dst && srcStride == dstStride)
+		return;
+	bool bStream = (uint64_t)rowBytes * height >= FSDK_REPACK_STREAMBYTES && (src + (size_t)srcStride * height <= dst || dst + (size_t)dstStride * height <= src);
+	if (!bStream)
+	{
+		RepackScalar(src, srcStride, dst, dstStride, rowBytes, height);
+		return;
+	}
+	for (int32_t y = 0; y < height; y++)
+	{
+		const uint8_t* s = src + (size_t)y * srcStride;
+		uint8_t* d = dst + (size_t)y * dstStride;
+		int32_t x = 0;
+		int32_t head = (int32_t)((32 - ((uintptr_t)d & 31)) & 31);
+		if (head > rowBytes)
+			head = rowBytes;
+		memcpy(d, s, (size_t)head);
+		for (x = head; x + 128 <= rowBytes; x += 128)
+		{
+			__m256i v0 = _mm256_loadu_si256((const __m256i*)(s + x));
+			__m256i v1 = _mm256_loadu_si256((const __m256i*)(s + x + 32));
+			__m256i v2 = _mm256_loadu_si256((const __m256i*)(s + x + 64));
+			__m256i v3 = _mm256_loadu_si256((const __m256i*)(s + x + 96));
+			_mm256_stream_si256((__m256i*)(d + x), v0);
+			_mm256_stream_si256((__m256i*)(d + x + 32), v1);
+			_mm256_stream_si256((__m256i*)(d + x + 64), v2);
+			_mm256_stream_si256((__m256i*)(d + x + 96), v3);
+		}
+		memcpy(d + x, s + x, (size_t)(rowBytes - x));
+	}
+	_mm_sfence();
+}
+#endif
+
+static const FSDK_PixelKernels g_PixelKernels[FSDK_PIXELISA_COUNT] =
+{
+	{ "scalar", RgbxToBgraScalar, RgbxToRgbaScalar, RgbxToGray8Scalar, RepackScalar },
+#ifdef FSDK_PIXEL_X86
+	{ "sse2", RgbxToBgraSse2, RgbxToRgbaSse2, RgbxToGray8Sse2, RepackSse2 },
+	{ "avx2", RgbxToBgraAvx2, RgbxToRgbaAvx2, RgbxToGray8Avx2, RepackAvx2 },
+#else
+	{ "sse2", NULL, NULL, NULL, NULL },
+	{ "avx2", NULL, NULL, NULL, NULL },
+#endif
+};
+
+static FSDK_PixelIsa DetectIsa()
+{
+#ifdef FSDK_PIXEL_X86
+	unsigned int leaf1[4] = { 0 };
+	unsigned int leaf7[4] = { 0 };
+	unsigned int maxLeaf = 0;
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	maxLeaf = (unsigned int)info[0];
+	__cpuid(info, 1);
+	memcpy(leaf1, info, sizeof(leaf1));
+	if (maxLeaf >= 7)
+	{
+		__cpuidex(info, 7, 0);
+		memcpy(leaf7, info, sizeof(leaf7));
+	}
+#else
+	maxLeaf = __get_cpuid_max(0, NULL);
+	if (maxLeaf >= 1)
+		__cpuid(1, leaf1[0], leaf1[1], leaf1[2], leaf1[3]);
+	if (maxLeaf >= 7)
+		__cpuid_count(7, 0, leaf7[0], leaf7[1], leaf7[2], leaf7[3]);
+#endif
+	bool bSse2 = (leaf1[3] & (1u << 26)) != 0;
+	//AVX2 also needs the OS to save the upper halves of the registers: OSXSAVE, then XCR0 bits 1 and 2.
+	bool bAvx2 = (leaf7[1] & (1u << 5)) != 0 && (leaf1[2] & (1u << 27)) != 0 && (leaf1[2] & (1u << 28)) != 0;
+	if (bAvx2)
+	{
+#ifdef _MSC_VER
+		unsigned long long xcr0 = _xgetbv(0);
+#else
+		unsigned int xcrLow = 0, xcrHigh = 0;
+		__asm__ volatile("xgetbv" : "=a"(xcrLow), "=d"(xcrHigh) : "c"(0));
+		unsigned long long xcr0 = ((unsigned long long)xcrHigh << 32) | xcrLow;
+#endif
+		bAvx2 = (xcr0 & 6) == 6;
+	}
+	if (bAvx2 && bSse2)
+		return FSDK_PIXELISA_AVX2;
+	if (bSse2)
+		return FSDK_PIXELISA_SSE2;
+#endif
+	return FSDK_PIXELISA_SCALAR;
+}
+
+//The fastest of one kernel over the instruction sets up to GetBestIsa. run calls the kernel once on the
+//calibration frame.
+template <typename TProc, typename TRun>
+static TProc PickFastest(TProc FSDK_PixelKernels::* kernel, const TRun& run)
+{
+	TProc best = NULL;
+	double bestSeconds = 0;
+	for (int isa = FSDK_PIXELISA_SCALAR; isa <= CMy_PixelConvert::GetBestIsa(); isa++)
+	{
+		TProc proc = g_PixelKernels[isa].*kernel;
+		if (!proc)
+			continue;
+		double seconds = 0;
+		for (int i = 0; i < FSDK_CALIBRATE_RUNS; i++)
+		{
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			run(proc);
+			double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			if (i == 0 || elapsed < seconds)
+				seconds = elapsed;
+		}
+		if (!best || seconds * (100 + FSDK_CALIBRATE_MARGIN) < bestSeconds * 100)
+		{
+			best = proc;
+			bestSeconds = seconds;
+		}
+	}
+	return best;
+}
+
+//Pick each kernel by timing it: which instruction set wins differs by kernel and CPU, a wider one isn't always faster.
+static FSDK_PixelKernels MeasureBest()
+{
+	const int32_t width = FSDK_CALIBRATE_WIDTH;
+	const int32_t height = FSDK_CALIBRATE_HEIGHT;
+	const int32_t stride = width * 4;
+	std::vector<uint8_t> src((size_t)stride * height);
+	std::vector<uint8_t> dst((size_t)stride * height);
+	for (size_t i = 0; i < src.size(); i++)
+		src[i] = (uint8_t)(i * 7);
+
+	FSDK_PixelKernels best;
+	best.name = "measured";
+	best.rgbxToBgra = PickFastest(&FSDK_PixelKernels::rgbxToBgra, [&](FSDK_PixelConvertProc proc)
+	{
+		proc(&src[0], stride, &dst[0], stride, width, height);
+	});
+	best.rgbxToRgba = PickFastest(&FSDK_PixelKernels::rgbxToRgba, [&](FSDK_PixelConvertProc proc)
+	{
+		proc(&src[0], stride, &dst[0], stride, width, height);
+	});
+	best.rgbxToGray8 = PickFastest(&FSDK_PixelKernels::rgbxToGray8, [&](FSDK_PixelConvertProc proc)
+	{
+		proc(&src[0], stride, &dst[0], width, width, height);
+	});
+	best.repack = PickFastest(&FSDK_PixelKernels::repack, [&](FSDK_PixelRepackProc proc)
+	{
+		proc(&src[0], stride, &dst[0], stride, stride, height);
+	});
+	return best;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Class CMy_PixelConvert
+FSDK_PixelIsa CMy_PixelConvert::GetBestIsa()
+{
+	static const FSDK_PixelIsa s_Isa = DetectIsa();
+	return s_Isa;
+}
+
+const FSDK_PixelKernels* CMy_PixelConvert::GetKernels(FSDK_PixelIsa isa)
+{
+	if (isa < FSDK_PIXELISA_SCALAR || isa > GetBestIsa())
+		return NULL;
+	return &g_PixelKernels[isa];
+}
+
+const FSDK_PixelKernels* CMy_PixelConvert::GetBest()
+{
+	static const FSDK_PixelKernels s_Best = MeasureBest();
+	return &s_Best;
+}
+
+void CMy_PixelConvert::RgbxToBgra(const uint8_t* src, int32_t srcStride, uint8_t* dst, int32_t dstStride, int32_t width, int32_t height)
+{
+	GetBest()->rgbxToBgra(src, srcStride, dst, dstStride, width, height);
+}
+
+void CMy_PixelConvert::RgbxToRgba(const uint8_t* src, int32_t srcStride, uint8_t* dst, int32_t dstStride, int32_t width, int32_t height)
+{
+	GetBest()->rgbxToRgba(src, srcStride, dst, dstStride, width, height);
+}
+
+void CMy_PixelConvert::RgbxToGray8(const uint8_t* src, int32_t srcStride, uint8_t* dst, int32_t dstStride, int32_t width, int32_t height)
+{
+	GetBest()->rgbxToGray8(src, srcStride, dst, dstStride, width, height);
+}
+
+void CMy_PixelConvert::Repack(const uint8_t* src, int32_t srcStride, uint8_t* dst, int32_t dstStride, int32_t rowBytes, int32_t height)
+{
+	GetBest()->repack(src, srcStride, dst, dstStride, rowBytes, height);
+}
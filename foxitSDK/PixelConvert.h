@@ -0,0 +1,54 @@
+﻿#pragma once
+
+/** Common header files. */
+#include <stdint.h>
+#include <stddef.h>
+
+namespace foxitSDK
+{
+	//Instruction sets the conversion kernels are built for, in increasing order.
+	enum FSDK_PixelIsa
+	{
+		FSDK_PIXELISA_SCALAR = 0,
+		FSDK_PIXELISA_SSE2,
+		FSDK_PIXELISA_AVX2,
+		FSDK_PIXELISA_COUNT
+	};
+
+	//Converts height rows of width pixels. Rows are srcStride and dstStride bytes apart.
+	typedef void (*FSDK_PixelConvertProc)(const uint8_t* src, int32_t srcStride, uint8_t* dst, int32_t dstStride, int32_t width, int32_t height);
+	//Copies height rows of rowBytes bytes between buffers with different strides.
+	typedef void (*FSDK_PixelRepackProc)(const uint8_t* src, int32_t srcStride, uint8_t* dst, int32_t dstStride, int32_t rowBytes, int32_t height);
+
+	//One set of kernels. Sources are FSCRT_BITMAPFORMAT_32BPP_RGBx as the SDK renders it: bytes R, G, B and one unused.
+	struct FSDK_PixelKernels
+	{
+		const char*				name;
+		FSDK_PixelConvertProc	rgbxToBgra;			// Swap red and blue, alpha 255.
+		FSDK_PixelConvertProc	rgbxToRgba;			// Alpha 255: premultiplied and straight are the same for opaque pixels.
+		FSDK_PixelConvertProc	rgbxToGray8;		// 0.3 R + 0.59 G + 0.11 B, as the SDK converts to gray.
+		FSDK_PixelRepackProc	repack;
+	};
+
+	//Pixel format conversions for the render output, with SSE2 and AVX2 versions picked by what the CPU runs fastest.
+	//The 32bpp conversions may run in place, with src and dst the same buffer and stride. Other builds than x86 and
+	//x64 only have the scalar kernels.
+	class CMy_PixelConvert
+	{
+	public:
+		//The best instruction set of this CPU, detected once.
+		static FSDK_PixelIsa	GetBestIsa();
+
+		//Kernels of one instruction set, NULL if this build or CPU can't run them.
+		static const FSDK_PixelKernels*	GetKernels(FSDK_PixelIsa isa);
+
+		//The fastest version of each kernel on this CPU, timed once on first use. Any instruction set up to GetBestIsa
+		//may win, kernel by kernel.
+		static const FSDK_PixelKernels*	GetBest();
+
+		static void		RgbxToBgra(const uint8_t* src, int32_t srcStride, uint8_t* dst, int32_t dstStride, int32_t width, int32_t height);
+		static void		RgbxToRgba(const uint8_t* src, int32_t srcStride, uint8_t* dst, int32_t dstStride, int32_t width, int32_t height);
+		static void		RgbxToGray8(const uint8_t* src, int32_t srcStride, uint8_t* dst, int32_t dstStride, int32_t width, int32_t height);
+		static void		Repack(const uint8_t* src, int32_t srcStride, uint8_t* dst, int32_t dstStride, int32_t rowBytes, int32_t height);
+	};
+}
@@ -0,0 +1,347 @@
+﻿#include "PoolAllocator.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+using namespace foxitSDK;
+
+//Header in front of every block. size is the usable size, class is FSDK_POOL_LARGECLASS for blocks from malloc.
+struct FSDK_PoolBlockHeader
+{
+	uint32_t	magic;
+	uint32_t	iClass;
+	uint64_t	size;
+};
+
+#define FSDK_POOL_MAGIC			0x4C4F4F50		// "POOL"
+#define FSDK_POOL_LARGECLASS	0xFFFFFFFF
+#define FSDK_POOL_SLABSIZE		(64 * 1024)
+
+//Owner of a thread cache whose thread is exiting, frees from such a thread go to the central lists.
+static CMy_PoolAllocator* const FSDK_POOL_DEADOWNER = (CMy_PoolAllocator*)(uintptr_t)1;
+
+static FSDK_PoolBlockHeader* GetHeader(void* ptr)
+{
+	return (FSDK_PoolBlockHeader*)((unsigned char*)ptr - sizeof(FSDK_PoolBlockHeader));
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Class CMy_PoolAllocator
+CMy_PoolAllocator::ThreadCache::ThreadCache()
+{
+	owner = NULL;
+	memset(heads, 0, sizeof(heads));
+	memset(counts, 0, sizeof(counts));
+}
+
+CMy_PoolAllocator::ThreadCache::~ThreadCache()
+{
+	if (owner && owner != FSDK_POOL_DEADOWNER)
+		owner->Drain(this);
+	owner = FSDK_POOL_DEADOWNER;
+}
+
+CMy_PoolAllocator::CMy_PoolAllocator()
+{
+	//16 byte steps up to 128, then four classes per power of two up to FSDK_POOL_MAXSMALL.
+	int iClass = 0;
+	for (size_t size = 16; size <= 128; size += 16)
+		m_ClassSize[iClass++] = size;
+	for (size_t base = 128; base < FSDK_POOL_MAXSMALL; base *= 2)
+	{
+		for (size_t k = 1; k <= 4; k++)
+			m_ClassSize[iClass++] = base + base / 4 * k;
+	}
+
+	iClass = 0;
+	for (size_t i = 0; i <= FSDK_POOL_MAXSMALL / 16; i++)
+	{
+		while (m_ClassSize[iClass] < i * 16)
+			iClass++;
+		m_SizeToClass[i] = (uint8_t)iClass;
+	}
+
+	for (int i = 0; i < FSDK_POOL_CLASSCOUNT; i++)
+	{
+		//Move about 32KB per batch: many small objects, few large ones.
+		size_t nBatch = (32 * 1024) / m_ClassSize[i];
+		m_BatchSize[i] = (uint32_t)(nBatch < 2 ? 2 : (nBatch > 32 ? 32 : nBatch));
+		m_Central[i].head = NULL;
+		m_Central[i].count = 0;
+	}
+
+	m_iLiveBytes = 0;
+	m_iLargeBytes = 0;
+	m_iReservedBytes = 0;
+	m_iCentralRefills = 0;
+	m_iCentralReleases = 0;
+	m_iLargeAllocs = 0;
+}
+
+CMy_PoolAllocator::~CMy_PoolAllocator()
+{
+	//Only the calling thread's cache can be reached here, other threads must be done with this allocator.
+	ThreadCache& cache = GetThreadCache();
+	Drain(&cache);
+	if (cache.owner == this)
+		cache.owner = NULL;
+	std::lock_guard<std::mutex> lock(m_SlabLock);
+	for (size_t i = 0; i < m_Slabs.size(); i++)
+		free(m_Slabs[i]);
+	m_Slabs.clear();
+}
+
+CMy_PoolAllocator* CMy_PoolAllocator::GetDefault()
+{
+	static CMy_PoolAllocator* s_pDefault = new CMy_PoolAllocator();
+	return s_pDefault;
+}
+
+CMy_PoolAllocator::ThreadCache& CMy_PoolAllocator::GetThreadCache()
+{
+	static thread_local ThreadCache s_Cache;
+	return s_Cache;
+}
+
+int CMy_PoolAllocator::SizeToClass(size_t size) const
+{
+	return m_SizeToClass[(size + 15) / 16];
+}
+
+void* CMy_PoolAllocator::Alloc(size_t size)
+{
+	if (size > FSDK_POOL_MAXSMALL)
+	{
+		if (size > SIZE_MAX - sizeof(FSDK_PoolBlockHeader))
+			return NULL;
+		FSDK_PoolBlockHeader* pHeader = (FSDK_PoolBlockHeader*)malloc(size + sizeof(FSDK_PoolBlockHeader));
+		if (!pHeader)
+			return NULL;
+		pHeader->magic = FSDK_POOL_MAGIC;
+		pHeader->iClass = FSDK_POOL_LARGECLASS;
+		pHeader->size = size;
+		m_iLargeAllocs++;
+		m_iLargeBytes += size;
+		m_iLiveBytes += size + sizeof(FSDK_PoolBlockHeader);
+		return pHeader + 1;
+	}
+
+	//A zero-sized request still gets the smallest block.
+	int iClass = SizeToClass(size ? size : 1);
+	FSDK_PoolBlockHeader* pHeader = (FSDK_PoolBlockHeader*)AllocSmall(iClass);
+	if (!pHeader)
+		return NULL;
+	pHeader->magic = FSDK_POOL_MAGIC;
+	pHeader->iClass = (uint32_t)iClass;
+	pHeader->size = m_ClassSize[iClass];
+	return pHeader + 1;
+}
+
+void CMy_PoolAllocator::Free(void* ptr)
+{
+	if (!ptr)
+		return;
+
+	FSDK_PoolBlockHeader* pHeader = GetHeader(ptr);
+	if (pHeader->iClass == FSDK_POOL_LARGECLASS)
+	{
+		m_iLargeBytes -= pHeader->size;
+		m_iLiveBytes -= pHeader->size + sizeof(FSDK_PoolBlockHeader);
+		pHeader->magic = 0;
+		free(pHeader);
+		return;
+	}
+	FreeSmall(pHeader, (int)pHeader->iClass);
+}
+
+void* CMy_PoolAllocator::Realloc(void* ptr, size_t newSize)
+{
+	if (!ptr)
+		return Alloc(newSize);
+
+	//Keep the block while the new size still fits its class, and large blocks while they stay large.
+	FSDK_PoolBlockHeader* pHeader = GetHeader(ptr);
+	size_t nOldSize = (size_t)pHeader->size;
+	if (pHeader->iClass != FSDK_POOL_LARGECLASS)
+	{
+		if (newSize <= nOldSize && (newSize == 0 || SizeToClass(newSize) == (int)pHeader->iClass))
+			return ptr;
+	}
+	else if (newSize > FSDK_POOL_MAXSMALL)
+	{
+		if (newSize > SIZE_MAX - sizeof(FSDK_PoolBlockHeader))
+			return NULL;
+		FSDK_PoolBlockHeader* pNew = (FSDK_PoolBlockHeader*)realloc(pHeader, newSize + sizeof(FSDK_PoolBlockHeader));
+		if (!pNew)
+			return NULL;
+		m_iLargeBytes += newSize;
+		m_iLargeBytes -= pNew->size;
+		m_iLiveBytes += newSize;
+		m_iLiveBytes -= pNew->size;
+		pNew->size = newSize;
+		return pNew + 1;
+	}
+
+	void* pNew = Alloc(newSize);
+	if (!pNew)
+		return NULL;
+	memcpy(pNew, ptr, nOldSize < newSize ? nOldSize : newSize);
+	Free(ptr);
+	return pNew;
+}
+
+size_t CMy_PoolAllocator::GetBlockSize(void* ptr)
+{
+	return ptr ? (size_t)GetHeader(ptr)->size : 0;
+}
+
+FSDK_PoolAllocatorStats CMy_PoolAllocator::GetStats()
+{
+	FSDK_PoolAllocatorStats stats;
+	stats.liveBytes = m_iLiveBytes;
+	stats.largeBytes = m_iLargeBytes;
+	stats.reservedBytes = m_iReservedBytes;
+	stats.centralRefills = m_iCentralRefills;
+	stats.centralReleases = m_iCentralReleases;
+	stats.largeAllocs = m_iLargeAllocs;
+	return stats;
+}
+
+void* CMy_PoolAllocator::AllocSmall(int iClass)
+{
+	ThreadCache& cache = GetThreadCache();
+	if (!cache.owner)
+		cache.owner = this;
+
+	if (cache.owner != this)
+	{
+		//The thread cache belongs to another allocator or is gone, take one object from the central list.
+		CentralList& central = m_Central[iClass];
+		std::lock_guard<std::mutex> lock(central.lock);
+		if (!central.head && !CarveSlab(iClass))
+			return NULL;
+		FreeObject* pObject = central.head;
+		central.head = pObject->next;
+		central.count--;
+		m_iLiveBytes += GetClassBlockSize(iClass);
+		return pObject;
+	}
+
+	if (!cache.heads[iClass] && !Refill(&cache, iClass, m_BatchSize[iClass]))
+		return NULL;
+	FreeObject* pObject = cache.heads[iClass];
+	cache.heads[iClass] = pObject->next;
+	cache.counts[iClass]--;
+	return pObject;
+}
+
+void CMy_PoolAllocator::FreeSmall(void* pBlock, int iClass)
+{
+	FreeObject* pObject = (FreeObject*)pBlock;
+	ThreadCache& cache = GetThreadCache();
+	if (!cache.owner)
+		cache.owner = this;
+
+	if (cache.owner != this)
+	{
+		CentralList& central = m_Central[iClass];
+		std::lock_guard<std::mutex> lock(central.lock);
+		pObject->next = central.head;
+		central.head = pObject;
+		central.count++;
+		m_iLiveBytes -= GetClassBlockSize(iClass);
+		return;
+	}
+
+	pObject->next = cache.heads[iClass];
+	cache.heads[iClass] = pObject;
+	cache.counts[iClass]++;
+	//Keep at most two batches per class, so a thread that only frees doesn't hoard memory.
+	if (cache.counts[iClass] >= 2 * m_BatchSize[iClass])
+		Release(&cache, iClass, m_BatchSize[iClass]);
+}
+
+size_t CMy_PoolAllocator::Refill(ThreadCache* pCache, int iClass, size_t nCount)
+{
+	CentralList& central = m_Central[iClass];
+	std::lock_guard<std::mutex> lock(central.lock);
+	if (central.count < nCount && !CarveSlab(iClass) && central.count == 0)
+		return 0;
+
+	size_t nMoved = 0;
+	while (nMoved < nCount && central.head)
+	{
+		FreeObject* pObject = central.head;
+		central.head = pObject->next;
+		pObject->next = pCache->heads[iClass];
+		pCache->heads[iClass] = pObject;
+		nMoved++;
+	}
+	central.count -= nMoved;
+	pCache->counts[iClass] += (uint32_t)nMoved;
+	m_iLiveBytes += nMoved * GetClassBlockSize(iClass);
+	m_iCentralRefills++;
+	return nMoved;
+}
+
+void CMy_PoolAllocator::Release(ThreadCache* pCache, int iClass, size_t nCount)
+{
+	//Unlink the batch first, then splice it into the central list under the lock.
+	FreeObject* pFirst = pCache->heads[iClass];
+	FreeObject* pLast = NULL;
+	size_t nMoved = 0;
+	for (FreeObject* pObject = pFirst; pObject && nMoved < nCount; pObject = pObject->next)
+	{
+		pLast = pObject;
+		nMoved++;
+	}
+	if (!pLast)
+		return;
+	pCache->heads[iClass] = pLast->next;
+	pCache->counts[iClass] -= (uint32_t)nMoved;
+
+	CentralList& central = m_Central[iClass];
+	std::lock_guard<std::mutex> lock(central.lock);
+	pLast->next = central.head;
+	central.head = pFirst;
+	central.count += nMoved;
+	m_iLiveBytes -= nMoved * GetClassBlockSize(iClass);
+	m_iCentralReleases++;
+}
+
+void CMy_PoolAllocator::Drain(ThreadCache* pCache)
+{
+	if (pCache->owner != this)
+		return;
+	for (int i = 0; i < FSDK_POOL_CLASSCOUNT; i++)
+	{
+		if (pCache->counts[i])
+			Release(pCache, i, pCache->counts[i]);
+	}
+}
+
+bool CMy_PoolAllocator::CarveSlab(int iClass)
+{
+	size_t nBlockSize = GetClassBlockSize(iClass);
+	size_t nObjects = FSDK_POOL_SLABSIZE / nBlockSize;
+	if (nObjects < m_BatchSize[iClass])
+		nObjects = m_BatchSize[iClass];
+	unsigned char* pSlab = (unsigned char*)malloc(nObjects * nBlockSize);
+	if (!pSlab)
+		return false;
+	{
+		std::lock_guard<std::mutex> lock(m_SlabLock);
+		m_Slabs.push_back(pSlab);
+	}
+	m_iReservedBytes += nObjects * nBlockSize;
+
+	CentralList& central = m_Central[iClass];
+	for (size_t i = nObjects; i-- > 0;)
+	{
+		FreeObject* pObject = (FreeObject*)(pSlab + i * nBlockSize);
+		pObject->next = central.head;
+		central.head = pObject;
+	}
+	central.count += nObjects;
+	return true;
+}
@@ -0,0 +1,108 @@
+﻿#pragma once
+
+/** Common header files. */
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace foxitSDK
+{
+	//Counters of CMy_PoolAllocator.
+	struct FSDK_PoolAllocatorStats
+	{
+		uint64_t	liveBytes;			// Pooled bytes handed out to threads plus live large blocks, headers included.
+		uint64_t	largeBytes;			// Live large blocks.
+		uint64_t	reservedBytes;		// Slabs taken from the system for the size classes.
+		uint64_t	centralRefills;		// Batches moved from the shared free lists to a thread cache.
+		uint64_t	centralReleases;	// Batches moved back from a thread cache.
+		uint64_t	largeAllocs;		// Allocations passed through to the system allocator.
+	};
+
+	//Size-class allocator behind FSCRT_MEMMGRHANDLER.
+	//Requests up to FSDK_POOL_MAXSMALL bytes are rounded up to one of the size classes and served from per-thread
+	//caches, which move objects to and from a shared free list per class in batches. Larger requests go straight
+	//to malloc. Every block starts with a 16 byte header holding its class, so Free and Realloc need no size.
+	//Memory of the size classes is kept in the pool once taken from the system.
+	class CMy_PoolAllocator
+	{
+	public:
+		CMy_PoolAllocator();
+		~CMy_PoolAllocator();
+
+		//The process-wide allocator. Never destroyed, thread caches may still hand memory back at thread exit.
+		static CMy_PoolAllocator*	GetDefault();
+
+		void*		Alloc(size_t size);
+		void*		Realloc(void* ptr, size_t newSize);
+		void		Free(void* ptr);
+
+		//Usable size of a block returned by Alloc or Realloc.
+		static size_t	GetBlockSize(void* ptr);
+
+		FSDK_PoolAllocatorStats	GetStats();
+
+	private:
+		enum
+		{
+			FSDK_POOL_MAXSMALL = 32 * 1024,
+			FSDK_POOL_CLASSCOUNT = 40,
+			FSDK_POOL_HEADERSIZE = 16
+		};
+
+		struct FreeObject
+		{
+			FreeObject*		next;
+		};
+
+		//Shared free list of one size class.
+		struct CentralList
+		{
+			std::mutex		lock;
+			FreeObject*		head;
+			size_t			count;
+		};
+
+		//Per-thread free lists, one for each size class.
+		struct ThreadCache
+		{
+			CMy_PoolAllocator*	owner;
+			FreeObject*		heads[FSDK_POOL_CLASSCOUNT];
+			uint32_t		counts[FSDK_POOL_CLASSCOUNT];
+
+			ThreadCache();
+			~ThreadCache();
+		};
+
+		static ThreadCache&	GetThreadCache();
+
+		int			SizeToClass(size_t size) const;
+		void*		AllocSmall(int iClass);
+		void		FreeSmall(void* pBlock, int iClass);
+
+		//Move up to nCount objects from the central list of iClass to pCache, carving a new slab if needed.
+		size_t		Refill(ThreadCache* pCache, int iClass, size_t nCount);
+		//Move nCount objects from pCache back to the central list.
+		void		Release(ThreadCache* pCache, int iClass, size_t nCount);
+		void		Drain(ThreadCache* pCache);
+		//Called with the central lock of iClass held.
+		bool		CarveSlab(int iClass);
+		size_t		GetClassBlockSize(int iClass) const { return m_ClassSize[iClass] + FSDK_POOL_HEADERSIZE; }
+
+		size_t		m_ClassSize[FSDK_POOL_CLASSCOUNT];		// Usable bytes of each class.
+		uint32_t	m_BatchSize[FSDK_POOL_CLASSCOUNT];		// Objects moved per refill or release.
+		uint8_t		m_SizeToClass[FSDK_POOL_MAXSMALL / 16 + 1];
+		CentralList	m_Central[FSDK_POOL_CLASSCOUNT];
+
+		std::mutex			m_SlabLock;
+		std::vector<void*>	m_Slabs;
+
+		std::atomic<uint64_t>	m_iLiveBytes;
+		std::atomic<uint64_t>	m_iLargeBytes;
+		std::atomic<uint64_t>	m_iReservedBytes;
+		std::atomic<uint64_t>	m_iCentralRefills;
+		std::atomic<uint64_t>	m_iCentralReleases;
+		std::atomic<uint64_t>	m_iLargeAllocs;
+	};
+}
@@ -0,0 +1,416 @@
+﻿#include "ProgressiveFile.h"
+
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+using namespace foxitSDK;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Class CMy_RangeSet
+CMy_RangeSet::CMy_RangeSet()
+{
+	m_iCovered = 0;
+}
+
+void CMy_RangeSet::Add(uint64_t start, uint64_t end)
+{
+	if (start >= end)
+		return;
+
+	//Merge with every range that overlaps or touches [start, end).
+	auto it = m_Ranges.upper_bound(start);
+	if (it != m_Ranges.begin())
+	{
+		auto prev = it;
+		--prev;
+		if (prev->second >= start)
+			it = prev;
+	}
+	while (it != m_Ranges.end() && it->first <= end)
+	{
+		if (it->first < start)
+			start = it->first;
+		if (it->second > end)
+			end = it->second;
+		m_iCovered -= it->second - it->first;
+		it = m_Ranges.erase(it);
+	}
+	m_Ranges[start] = end;
+	m_iCovered += end - start;
+}
+
+bool CMy_RangeSet::Contains(uint64_t start, uint64_t end) const
+{
+	if (start >= end)
+		return true;
+	auto it = m_Ranges.upper_bound(start);
+	if (it == m_Ranges.begin())
+		return false;
+	--it;
+	return it->first <= start && it->second >= end;
+}
+
+bool CMy_RangeSet::FirstGap(uint64_t start, uint64_t end, uint64_t* pGapStart, uint64_t* pGapEnd) const
+{
+	if (start >= end)
+		return false;
+
+	//Skip the range that covers start, if any.
+	auto it = m_Ranges.upper_bound(start);
+	if (it != m_Ranges.begin())
+	{
+		auto prev = it;
+		--prev;
+		if (prev->second > start)
+			start = prev->second;
+	}
+	if (start >= end)
+		return false;
+
+	if (pGapStart)
+		*pGapStart = start;
+	if (pGapEnd)
+		*pGapEnd = (it != m_Ranges.end() && it->first < end) ? it->first : end;
+	return true;
+}
+
+void CMy_RangeSet::Clear()
+{
+	m_Ranges.clear();
+	m_iCovered = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Class CMy_ProgressiveFile
+CMy_ProgressiveFile::CMy_ProgressiveFile(IMy_FileSource* pSource, bool bOwnSource, size_t nFetchSize, const char* tempDir)
+	: m_Data(64 * 1024 * 1024, tempDir)
+{
+	m_pSource = pSource;
+	m_bOwnSource = bOwnSource;
+	m_iFileSize = pSource ? pSource->GetSize() : 0;
+	m_nFetchSize = nFetchSize ? nFetchSize : 256 * 1024;
+	m_iCursor = 0;
+	m_bStop = false;
+	m_bFailed = false;
+	memset(&m_Stats, 0, sizeof(m_Stats));
+	m_Stats.fileSize = m_iFileSize;
+}
+
+CMy_ProgressiveFile::~CMy_ProgressiveFile()
+{
+	Stop();
+	if (m_bOwnSource && m_pSource)
+		delete m_pSource;
+	m_pSource = NULL;
+}
+
+bool CMy_ProgressiveFile::Start()
+{
+	if (!m_pSource || m_Fetcher.joinable())
+		return false;
+	m_bStop = false;
+	m_Fetcher = std::thread(&CMy_ProgressiveFile::FetcherProc, this);
+	return true;
+}
+
+void CMy_ProgressiveFile::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		m_bStop = true;
+	}
+	m_Changed.notify_all();
+	if (m_Fetcher.joinable())
+		m_Fetcher.join();
+}
+
+bool CMy_ProgressiveFile::IsDataAvail(uint64_t offset, size_t size)
+{
+	if (offset > m_iFileSize || size > m_iFileSize - offset)
+		return false;
+	std::lock_guard<std::mutex> lock(m_Lock);
+	return m_Available.Contains(offset, offset + size);
+}
+
+void CMy_ProgressiveFile::AddHint(uint64_t offset, size_t size)
+{
+	if (offset >= m_iFileSize || size == 0)
+		return;
+	uint64_t iEnd = size > m_iFileSize - offset ? m_iFileSize : offset + size;
+
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		if (m_Available.Contains(offset, iEnd))
+			return;
+		//The SDK is waiting on the latest hint, serve it first.
+		m_Hints.push_front(std::make_pair(offset, iEnd));
+		m_Stats.hintsReceived++;
+	}
+	m_Changed.notify_all();
+}
+
+bool CMy_ProgressiveFile::IsComplete()
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	return m_Available.GetCoveredBytes() >= m_iFileSize;
+}
+
+bool CMy_ProgressiveFile::HasFailed()
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	return m_bFailed;
+}
+
+bool CMy_ProgressiveFile::ReadAt(uint64_t offset, void* buffer, size_t size)
+{
+	if (!buffer || offset > m_iFileSize || size > m_iFileSize - offset)
+		return false;
+	std::lock_guard<std::mutex> lock(m_Lock);
+	if (!m_Available.Contains(offset, offset + size))
+		return false;
+	return m_Data.ReadAt(offset, buffer, size);
+}
+
+void CMy_ProgressiveFile::WaitForData(uint32_t nTimeoutMs)
+{
+	std::unique_lock<std::mutex> lock(m_Lock);
+	if (m_Available.GetCoveredBytes() >= m_iFileSize || m_bFailed)
+		return;
+	m_Changed.wait_for(lock, std::chrono::milliseconds(nTimeoutMs));
+}
+
+FSDK_ProgressiveStats CMy_ProgressiveFile::GetStats()
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	m_Stats.bytesAvailable = m_Available.GetCoveredBytes();
+	return m_Stats;
+}
+
+bool CMy_ProgressiveFile::PickRange(uint64_t* pStart, uint64_t* pEnd, bool* pHinted)
+{
+	uint64_t iGapStart = 0, iGapEnd = 0;
+	while (!m_Hints.empty())
+	{
+		std::pair<uint64_t, uint64_t> hint = m_Hints.front();
+		if (m_Available.FirstGap(hint.first, hint.second, &iGapStart, &iGapEnd))
+		{
+			*pHinted = true;
+			break;
+		}
+		m_Hints.pop_front();
+	}
+
+	if (m_Hints.empty())
+	{
+		//Background fill from the cursor, wrapping around once to pick up holes left by hints.
+		if (!m_Available.FirstGap(m_iCursor, m_iFileSize, &iGapStart, &iGapEnd)
+			&& !m_Available.FirstGap(0, m_iFileSize, &iGapStart, &iGapEnd))
+			return false;
+		*pHinted = false;
+	}
+
+	*pStart = iGapStart;
+	*pEnd = iGapEnd - iGapStart > m_nFetchSize ? iGapStart + m_nFetchSize : iGapEnd;
+	return true;
+}
+
+void CMy_ProgressiveFile::FetcherProc()
+{
+	std::vector<unsigned char> piece;
+	std::unique_lock<std::mutex> lock(m_Lock);
+	while (!m_bStop)
+	{
+		uint64_t iStart = 0, iEnd = 0;
+		bool bHinted = false;
+		if (!PickRange(&iStart, &iEnd, &bHinted))
+			break;		// Everything is here.
+
+		//Fetch outside the lock, the SDK keeps reading what is already available.
+		lock.unlock();
+		piece.resize((size_t)(iEnd - iStart));
+		bool bOk = m_pSource->ReadAt(iStart, piece.data(), piece.size());
+		lock.lock();
+
+		m_Stats.fetches++;
+		if (!bOk || !m_Data.Write(iStart, piece.data(), piece.size()))
+		{
+			m_bFailed = true;
+			break;
+		}
+		m_Available.Add(iStart, iEnd);
+		if (bHinted)
+			m_Stats.hintedBytes += iEnd - iStart;
+		else
+		{
+			m_Stats.backgroundBytes += iEnd - iStart;
+			m_iCursor = iEnd;
+		}
+		m_Changed.notify_all();
+	}
+	m_Changed.notify_all();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Class CMy_ProgressiveFileHandler
+static uint64_t FileSizeToUInt64(const FSCRT_FILESIZE* size)
+{
+	return ((uint64_t)size->hiSize << 32) | size->loSize;
+}
+
+CMy_ProgressiveFileHandler::CMy_ProgressiveFileHandler()
+{
+	ReleaseFileHandle();
+}
+
+CMy_ProgressiveFileHandler::~CMy_ProgressiveFileHandler()
+{
+}
+
+void CMy_ProgressiveFileHandler::InitFileHandle(CMy_ProgressiveFile* pFile)
+{
+	clientData = pFile;
+	Release = g_PrivateRelease;
+	GetSize = g_PrivateGetSize;
+	ReadBlock = g_PrivateReadBlock;
+	WriteBlock = g_PrivateWriteBlock;
+	Flush = g_PrivateFlush;
+	Truncate = g_PrivateTruncate;
+}
+
+void CMy_ProgressiveFileHandler::ReleaseFileHandle()
+{
+	clientData = NULL;
+	Release = NULL;
+	GetSize = NULL;
+	ReadBlock = NULL;
+	WriteBlock = NULL;
+	Flush = NULL;
+	Truncate = NULL;
+}
+
+void CMy_ProgressiveFileHandler::g_PrivateRelease(FS_LPVOID /*clientData*/)
+{
+	//The progressive file is owned by the document, it is deleted there.
+}
+
+FS_RESULT CMy_ProgressiveFileHandler::g_PrivateGetSize(FS_LPVOID clientData, FSCRT_FILESIZE* size)
+{
+	CMy_ProgressiveFile* pFile = (CMy_ProgressiveFile*)clientData;
+	if (!pFile || !size)
+		return FSCRT_ERRCODE_PARAM;
+
+	uint64_t iSize = pFile->GetSize();
+	size->loSize = (FS_DWORD)(iSize & 0xFFFFFFFF);
+	size->hiSize = (FS_DWORD)(iSize >> 32);
+	return FSCRT_ERRCODE_SUCCESS;
+}
+
+FS_RESULT CMy_ProgressiveFileHandler::g_PrivateReadBlock(FS_LPVOID clientData, const FSCRT_FILESIZE* offset, FS_LPVOID buffer, const FSCRT_FILESIZE* size)
+{
+	CMy_ProgressiveFile* pFile = (CMy_ProgressiveFile*)clientData;
+	if (!pFile || !offset || !size || !buffer)
+		return FSCRT_ERRCODE_PARAM;
+
+	uint64_t iSize = FileSizeToUInt64(size);
+	if (iSize > (uint64_t)SIZE_MAX)
+		return FSCRT_ERRCODE_FILE;
+	if (!pFile->ReadAt(FileSizeToUInt64(offset), buffer, (size_t)iSize))
+		return FSCRT_ERRCODE_DATANOTREADY;
+	return FSCRT_ERRCODE_SUCCESS;
+}
+
+FS_RESULT CMy_ProgressiveFileHandler::g_PrivateWriteBlock(FS_LPVOID /*clientData*/, const FSCRT_FILESIZE* /*offset*/, FS_LPCVOID /*buffer*/, const FSCRT_FILESIZE* /*size*/)
+{
+	//Progressive documents are read-only.
+	return FSCRT_ERRCODE_UNSUPPORTED;
+}
+
+FS_RESULT CMy_ProgressiveFileHandler::g_PrivateFlush(FS_LPVOID /*clientData*/)
+{
+	return FSCRT_ERRCODE_SUCCESS;
+}
+
+FS_RESULT CMy_ProgressiveFileHandler::g_PrivateTruncate(FS_LPVOID /*clientData*/, const FSCRT_FILESIZE* /*fileSize*/)
+{
+	return FSCRT_ERRCODE_UNSUPPORTED;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Class CMy_AsyncFile
+CMy_AsyncFile::CMy_AsyncFile()
+{
+	m_pFile = NULL;
+	m_SDKFile = NULL;
+	clientData = NULL;
+	GetFile = NULL;
+	IsDataAvail = NULL;
+	AddDownloadHint = NULL;
+}
+
+CMy_AsyncFile::~CMy_AsyncFile()
+{
+}
+
+void CMy_AsyncFile::InitFileHandle(CMy_ProgressiveFile* pFile)
+{
+	m_pFile = pFile;
+	m_FileHandler.InitFileHandle(pFile);
+	clientData = this;
+	GetFile = g_PrivateGetFile;
+	IsDataAvail = g_PrivateIsDataAvail;
+	AddDownloadHint = g_PrivateAddDownloadHint;
+}
+
+void CMy_AsyncFile::ReleaseFileHandle()
+{
+	m_pFile = NULL;
+	m_SDKFile = NULL;
+	m_FileHandler.ReleaseFileHandle();
+	clientData = NULL;
+	GetFile = NULL;
+	IsDataAvail = NULL;
+	AddDownloadHint = NULL;
+}
+
+FS_RESULT CMy_AsyncFile::g_PrivateGetFile(FS_LPVOID clientData, FSCRT_FILE* file)
+{
+	CMy_AsyncFile* pAsync = (CMy_AsyncFile*)clientData;
+	if (!file)
+		return FSCRT_ERRCODE_PARAM;
+	*file = NULL;
+	if (!pAsync || !pAsync->m_pFile)
+		return FSCRT_ERRCODE_ERROR;
+
+	if (!pAsync->m_SDKFile)
+	{
+		FS_RESULT ret = FSCRT_File_Create_L(&pAsync->m_FileHandler, &pAsync->m_SDKFile);
+		if (ret != FSCRT_ERRCODE_SUCCESS)
+			return ret;
+	}
+	*file = pAsync->m_SDKFile;
+	return FSCRT_ERRCODE_SUCCESS;
+}
+
+FS_RESULT CMy_AsyncFile::g_PrivateIsDataAvail(FS_LPVOID clientData, FS_DWORD offset, FS_DWORD size)
+{
+	CMy_AsyncFile* pAsync = (CMy_AsyncFile*)clientData;
+	if (!pAsync || !pAsync->m_pFile)
+		return FSCRT_ERRCODE_ERROR;
+
+	if (pAsync->m_pFile->IsDataAvail(offset, size))
+		return FSCRT_ERRCODE_SUCCESS;
+	//Asking implies wanting it, so fetch it next.
+	pAsync->m_pFile->AddHint(offset, size);
+	return FSCRT_ERRCODE_DATANOTREADY;
+}
+
+FS_RESULT CMy_AsyncFile::g_PrivateAddDownloadHint(FS_LPVOID clientData, FS_DWORD offset, FS_DWORD size)
+{
+	CMy_AsyncFile* pAsync = (CMy_AsyncFile*)clientData;
+	if (!pAsync || !pAsync->m_pFile)
+		return FSCRT_ERRCODE_ERROR;
+
+	pAsync->m_pFile->AddHint(offset, size);
+	return FSCRT_ERRCODE_SUCCESS;
+}
@@ -0,0 +1,141 @@
+﻿#pragma once
+
+/** Common header files. */
+#include <stdint.h>
+#include <stddef.h>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/** Include header files of SDK. */
+#include "../foxitSDK/include/fsdk.h"
+
+#include "FileSource.h"
+#include "WriteBuffer.h"
+
+namespace foxitSDK
+{
+	//Set of byte ranges [start, end), kept sorted and merged.
+	class CMy_RangeSet
+	{
+	public:
+		CMy_RangeSet();
+
+		void		Add(uint64_t start, uint64_t end);
+		bool		Contains(uint64_t start, uint64_t end) const;
+
+		//First sub-range of [start, end) that is not in the set. Returns false when [start, end) is covered.
+		bool		FirstGap(uint64_t start, uint64_t end, uint64_t* pGapStart, uint64_t* pGapEnd) const;
+
+		uint64_t	GetCoveredBytes() const { return m_iCovered; }
+		void		Clear();
+
+	private:
+		std::map<uint64_t, uint64_t>	m_Ranges;		// start -> end
+		uint64_t						m_iCovered;
+	};
+
+	//Counters of a progressive file.
+	struct FSDK_ProgressiveStats
+	{
+		uint64_t	fileSize;
+		uint64_t	bytesAvailable;		// Bytes already fetched from the slow source.
+		uint64_t	hintsReceived;		// Ranges asked for by the SDK.
+		uint64_t	hintedBytes;		// Bytes fetched because the SDK asked for them.
+		uint64_t	backgroundBytes;	// Bytes fetched by the sequential background fill.
+		uint64_t	fetches;			// ReadAt calls on the slow source.
+	};
+
+	//Local copy of a file that arrives from a slow source.
+	//A background thread fetches ranges the SDK hinted at first, most recent first, and fills the rest front to back.
+	//Fetched bytes are kept in a CMy_WriteBuffer, so big files spill to a temporary file.
+	class CMy_ProgressiveFile
+	{
+	public:
+		CMy_ProgressiveFile(IMy_FileSource* pSource, bool bOwnSource, size_t nFetchSize = 256 * 1024, const char* tempDir = NULL);
+		~CMy_ProgressiveFile();
+
+		bool		Start();
+		void		Stop();
+
+		uint64_t	GetSize() const { return m_iFileSize; }
+		bool		IsDataAvail(uint64_t offset, size_t size);
+		void		AddHint(uint64_t offset, size_t size);
+		bool		IsComplete();
+		bool		HasFailed();
+
+		//Read bytes that are already available. Returns false if any of them is still missing.
+		bool		ReadAt(uint64_t offset, void* buffer, size_t size);
+
+		//Block until more data arrives, the file is complete, or nTimeoutMs passes.
+		void		WaitForData(uint32_t nTimeoutMs);
+
+		FSDK_ProgressiveStats	GetStats();
+
+	private:
+		void		FetcherProc();
+		bool		PickRange(uint64_t* pStart, uint64_t* pEnd, bool* pHinted);
+
+		IMy_FileSource*			m_pSource;
+		bool					m_bOwnSource;
+		uint64_t				m_iFileSize;
+		size_t					m_nFetchSize;
+
+		std::mutex				m_Lock;
+		std::condition_variable	m_Changed;
+		CMy_RangeSet			m_Available;
+		CMy_WriteBuffer			m_Data;
+		std::deque<std::pair<uint64_t, uint64_t> >	m_Hints;
+		uint64_t				m_iCursor;			// Where the background fill goes on.
+		bool					m_bStop;
+		bool					m_bFailed;
+		std::thread				m_Fetcher;
+		FSDK_ProgressiveStats	m_Stats;
+	};
+
+	//Inherited class of FSCRT_FILEHANDLER_L which reads the available part of a CMy_ProgressiveFile.
+	class CMy_ProgressiveFileHandler : public FSCRT_FILEHANDLER_L
+	{
+	public:
+		CMy_ProgressiveFileHandler();
+		~CMy_ProgressiveFileHandler();
+
+		void InitFileHandle(CMy_ProgressiveFile* pFile);
+		void ReleaseFileHandle();
+
+		//Inherited callback funtions.
+		static void g_PrivateRelease(FS_LPVOID clientData);
+		static FS_RESULT g_PrivateGetSize(FS_LPVOID clientData, FSCRT_FILESIZE* size);
+		static FS_RESULT g_PrivateReadBlock(FS_LPVOID clientData, const FSCRT_FILESIZE* offset, FS_LPVOID buffer, const FSCRT_FILESIZE* size);
+		static FS_RESULT g_PrivateWriteBlock(FS_LPVOID clientData, const FSCRT_FILESIZE* offset, FS_LPCVOID buffer, const FSCRT_FILESIZE* size);
+		static FS_RESULT g_PrivateFlush(FS_LPVOID clientData);
+		static FS_RESULT g_PrivateTruncate(FS_LPVOID clientData, const FSCRT_FILESIZE* fileSize);
+	};
+
+	//Inherited class of FSPDF_ASYNCFILEHANDLER over a CMy_ProgressiveFile, used with FSPDF_Doc_AsyncLoad.
+	class CMy_AsyncFile : public FSPDF_ASYNCFILEHANDLER
+	{
+	public:
+		CMy_AsyncFile();
+		~CMy_AsyncFile();
+
+		void InitFileHandle(CMy_ProgressiveFile* pFile);
+		void ReleaseFileHandle();
+
+		//The FSCRT_FILE handed to the SDK by GetFile, NULL until the SDK asked for it. The caller releases it.
+		FSCRT_FILE GetSDKFile() const { return m_SDKFile; }
+
+		//Inherited callback funtions.
+		static FS_RESULT g_PrivateGetFile(FS_LPVOID clientData, FSCRT_FILE* file);
+		static FS_RESULT g_PrivateIsDataAvail(FS_LPVOID clientData, FS_DWORD offset, FS_DWORD size);
+		static FS_RESULT g_PrivateAddDownloadHint(FS_LPVOID clientData, FS_DWORD offset, FS_DWORD size);
+
+	private:
+		CMy_ProgressiveFile*		m_pFile;
+		CMy_ProgressiveFileHandler	m_FileHandler;
+		FSCRT_FILE					m_SDKFile;
+	};
+}
@@ -1,5 +1,8 @@
 ﻿#include "pch.h"
 #include <iostream>
+#include <wrl/implements.h>
+#include <windows.storage.streams.h>
+#include <MemoryBuffer.h>
 #include "SDKDemoCommon.h"
                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                    
 using namespace Platform;
@@ -20,6 +23,316 @@ using namespace Windows::UI::Popups;
 
 using namespace foxitSDK;
 
+//Convert platform string to a UTF-8 std::string.
+static std::string ToUtf8String(Platform::String^ str)
+{
+	if (nullptr == str || str->IsEmpty())
+		return std::string();
+	int size = WideCharToMultiByte(CP_UTF8, 0, str->Data(), -1, NULL, 0, NULL, NULL);
+	std::string result(size, '\0');
+	WideCharToMultiByte(CP_UTF8, 0, str->Data(), -1, &result[0], size, NULL, NULL);
+	result.resize(size - 1);
+	return result;
+}
+
+//Convert UTF-8 text, such as a FSCRT_BSTR, to a platform string.
+static Platform::String^ FromUtf8String(const char* str, int len)
+{
+	if (!str || len <= 0)
+		return ref new Platform::String();
+	int size = MultiByteToWideChar(CP_UTF8, 0, str, len, NULL, 0);
+	std::wstring result(size, L'\0');
+	MultiByteToWideChar(CP_UTF8, 0, str, len, &result[0], size);
+	return ref new Platform::String(result.c_str(), (unsigned int)result.size());
+}
+
+//Block the calling thread until an async operation completes.
+//Unlike task::get() this is allowed on any apartment, including the UI thread.
+template <typename TResult>
+static bool WaitForAsync(IAsyncOperation<TResult>^ operation, TResult* result)
+{
+	bool _bIsOk = false;
+	HANDLE processingHandle = CreateEventEx(NULL, NULL, false, EVENT_ALL_ACCESS);
+	operation->Completed = ref new AsyncOperationCompletedHandler<TResult>([result, processingHandle, &_bIsOk](IAsyncOperation<TResult>^ op, AsyncStatus status)
+	{
+		if (status == AsyncStatus::Completed)
+		{
+			*result = op->GetResults();
+			_bIsOk = true;
+		}
+		SetEvent(processingHandle);
+	});
+	WaitForSingleObjectEx(processingHandle, INFINITE, true);
+	CloseHandle(processingHandle);
+	return _bIsOk;
+}
+
+template <typename TResult, typename TProgress>
+static bool WaitForAsync(IAsyncOperationWithProgress<TResult, TProgress>^ operation, TResult* result)
+{
+	bool _bIsOk = false;
+	HANDLE processingHandle = CreateEventEx(NULL, NULL, false, EVENT_ALL_ACCESS);
+	operation->Completed = ref new AsyncOperationWithProgressCompletedHandler<TResult, TProgress>([result, processingHandle, &_bIsOk](IAsyncOperationWithProgress<TResult, TProgress>^ op, AsyncStatus status)
+	{
+		if (status == AsyncStatus::Completed)
+		{
+			*result = op->GetResults();
+			_bIsOk = true;
+		}
+		SetEvent(processingHandle);
+	});
+	WaitForSingleObjectEx(processingHandle, INFINITE, true);
+	CloseHandle(processingHandle);
+	return _bIsOk;
+}
+
+//Get the raw bytes behind a WinRT buffer.
+static byte* GetBufferBytes(IBuffer^ buffer)
+{
+	Microsoft::WRL::ComPtr<IBufferByteAccess> byteAccess;
+	byte* pBytes = NULL;
+	if (FAILED(reinterpret_cast<IInspectable*>(buffer)->QueryInterface(IID_PPV_ARGS(&byteAccess))) || FAILED(byteAccess->Buffer(&pBytes)))
+		return NULL;
+	return pBytes;
+}
+
+//Floor of a / b for b > 0.
+static int32_t FloorDiv(int32_t a, int32_t b)
+{
+	return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+//Cancels a CMy_CancelToken when the async operation it belongs to is cancelled, for as long as it is in scope.
+//IAsyncInfo::Cancel, and so CancellationToken on the C# side, reaches the SDK's pause handler through it.
+class CMy_CancelLink
+{
+public:
+	CMy_CancelLink(cancellation_token token) : m_Token(token)
+	{
+		if (m_Token.is_cancelable())
+			m_Registration = m_Token.register_callback([this]() { m_Cancel.Cancel(); });
+	}
+
+	~CMy_CancelLink()
+	{
+		if (m_Token.is_cancelable())
+			m_Token.deregister_callback(m_Registration);
+	}
+
+	const CMy_CancelToken*	Get() const { return &m_Cancel; }
+
+	//End the async operation as canceled instead of with a result, once it was cancelled.
+	void	ThrowIfCancelled() const
+	{
+		if (m_Cancel.IsCancelled())
+			cancel_current_task();
+	}
+
+private:
+	cancellation_token	m_Token;
+	cancellation_token_registration	m_Registration;
+	CMy_CancelToken		m_Cancel;
+};
+
+//Pixel buffers rendered pages are delivered in. Never destroyed, the governor keeps a pointer to it.
+static CMy_PixelBufferPool* GetPixelBufferPool();
+
+//IBuffer over a pooled pixel buffer: the SDK renders into it and the caller gets the same memory back.
+//The pixel buffer goes back to the pool when the last reference goes away.
+class CMy_PooledPixelBuffer : public Microsoft::WRL::RuntimeClass<Microsoft::WRL::RuntimeClassFlags<Microsoft::WRL::WinRtClassicComMix>,
+	ABI::Windows::Storage::Streams::IBuffer, Windows::Storage::Streams::IBufferByteAccess>
+{
+	InspectableClass(L"foxitSDK.PooledPixelBuffer", BaseTrust)
+
+public:
+	CMy_PooledPixelBuffer(FSDK_PixelBuffer* pBuffer)
+	{
+		m_pBuffer = pBuffer;
+		m_iLength = (UINT32)((size_t)pBuffer->stride * pBuffer->height);
+	}
+
+	virtual ~CMy_PooledPixelBuffer()
+	{
+		GetPixelBufferPool()->Release(m_pBuffer);
+	}
+
+	STDMETHODIMP Buffer(byte** value)
+	{
+		*value = m_pBuffer->data;
+		return S_OK;
+	}
+
+	STDMETHODIMP get_Capacity(UINT32* value)
+	{
+		*value = (UINT32)m_pBuffer->capacity;
+		return S_OK;
+	}
+
+	STDMETHODIMP get_Length(UINT32* value)
+	{
+		*value = m_iLength;
+		return S_OK;
+	}
+
+	STDMETHODIMP put_Length(UINT32 value)
+	{
+		if (value > m_pBuffer->capacity)
+			return E_INVALIDARG;
+		m_iLength = value;
+		return S_OK;
+	}
+
+private:
+	FSDK_PixelBuffer*	m_pBuffer;
+	UINT32				m_iLength;
+};
+
+//Hand a pooled pixel buffer over to a WinRT buffer, which owns it from then on.
+static IBuffer^ WrapPixelBuffer(FSDK_PixelBuffer* pBuffer)
+{
+	Microsoft::WRL::ComPtr<CMy_PooledPixelBuffer> pWrapper = Microsoft::WRL::Make<CMy_PooledPixelBuffer>(pBuffer);
+	if (!pWrapper)
+	{
+		GetPixelBufferPool()->Release(pBuffer);
+		return nullptr;
+	}
+	ABI::Windows::Storage::Streams::IBuffer* pAbiBuffer = pWrapper.Get();
+	return reinterpret_cast<IBuffer^>(pAbiBuffer);
+}
+
+//The allocator behind FSCRT_MEMMGRHANDLER: accounting over the budget over the pool.
+//Never destroyed, the SDK may free memory late at exit.
+static CMy_MemoryAccounting* GetSDKMemory()
+{
+	static CMy_MemoryAccounting* s_pMemory = new CMy_MemoryAccounting(new CMy_BudgetAllocator(CMy_PoolAllocator::GetDefault()));
+	return s_pMemory;
+}
+
+static CMy_MemoryGovernor* CreateMemoryGovernor()
+{
+	CMy_MemoryGovernor* pGovernor = new CMy_MemoryGovernor();
+	pGovernor->SetSources([]() { return CMy_PoolAllocator::GetDefault()->GetStats().liveBytes; },
+		[](uint32_t nSizeMB) { FSCRT_Library_SetCacheSize((FS_DWORD)nSizeMB); });
+	return pGovernor;
+}
+
+//Watches memory pressure once started. Never destroyed, like the allocator it samples.
+//Created by the first caller, which may be any render thread.
+static CMy_MemoryGovernor* GetMemoryGovernor()
+{
+	static CMy_MemoryGovernor* s_pGovernor = CreateMemoryGovernor();
+	return s_pGovernor;
+}
+
+//A started worker pool of nThreads threads, 0 for one per core.
+static CMy_WorkerPool* CreateWorkerPool(size_t nThreads, bool bBackground)
+{
+	CMy_WorkerPool* pPool = new CMy_WorkerPool();
+	pPool->Start(nThreads, bBackground);
+	return pPool;
+}
+
+//Threads shared by tiled rendering, one per core. Never destroyed, like the allocator.
+static CMy_WorkerPool* GetRenderPool()
+{
+	static CMy_WorkerPool* s_pPool = CreateWorkerPool(0, false);
+	return s_pPool;
+}
+
+//Neighbouring pages are prefetched on this pool: one thread below normal priority, so prefetching never takes a core
+//from the visible page. Never destroyed, like the render pool.
+static CMy_WorkerPool* GetPrefetchPool()
+{
+	static CMy_WorkerPool* s_pPool = CreateWorkerPool(1, true);
+	return s_pPool;
+}
+
+//Edge of the tiles a page is split into when it is larger than one.
+#define FSDK_RENDER_TILESIZE		256
+//A two-pass render previews at this fraction of the full width and height.
+#define FSDK_PREVIEW_SCALE			4
+//Length of the slices LoadPageAsync parses in, progress is reported between them.
+#define FSDK_PARSE_SLICEMS			50
+
+//Default size of the tile cache.
+#define FSDK_TILECACHE_BUDGET		(64 * 1024 * 1024)
+//The tile cache is trimmed before the document caches: tiles are quick to render again once the page is parsed.
+#define FSDK_RECLAIM_TILECACHE		5
+
+//Idle pixel buffers kept for reuse: a few 4K viewports.
+#define FSDK_PIXELPOOL_IDLEBYTES	(128 * 1024 * 1024)
+//Idle pixel buffers are dropped before anything else, they hold no work.
+#define FSDK_RECLAIM_PIXELPOOL		1
+
+static CMy_PixelBufferPool* CreatePixelBufferPool()
+{
+	CMy_PixelBufferPool* pPool = new CMy_PixelBufferPool(FSDK_PIXELPOOL_IDLEBYTES);
+	GetMemoryGovernor()->Register(pPool, "pixelpool", FSDK_RECLAIM_PIXELPOOL, FSDK_PRESSURE_ELEVATED);
+	return pPool;
+}
+
+//Pixel buffers of all renders. Never destroyed, the governor keeps a pointer to it.
+static CMy_PixelBufferPool* GetPixelBufferPool()
+{
+	static CMy_PixelBufferPool* s_pPool = CreatePixelBufferPool();
+	return s_pPool;
+}
+
+static CMy_TileCache* CreateTileCache()
+{
+	CMy_TileCache* pCache = new CMy_TileCache(FSDK_TILECACHE_BUDGET);
+	GetMemoryGovernor()->Register(pCache, "tilecache", FSDK_RECLAIM_TILECACHE, FSDK_PRESSURE_ELEVATED);
+	return pCache;
+}
+
+//Rendered tiles of all documents. Never destroyed, the governor keeps a pointer to it.
+static CMy_TileCache* GetTileCache()
+{
+	static CMy_TileCache* s_pCache = CreateTileCache();
+	return s_pCache;
+}
+
+//Opt-in profiler fed by the memory handler. Never destroyed, the SDK may free memory late at exit.
+static CMy_AllocProfiler* GetAllocProfiler()
+{
+	static CMy_AllocProfiler* s_pProfiler = new CMy_AllocProfiler();
+	return s_pProfiler;
+}
+
+//Where FSDK_Finalize writes the leak report of a running profiler.
+static std::wstring		g_AllocReportPath;
+
+//Tell the profiler about SDK handles created and released by this wrapper.
+static void NoteHandleCreated(FSDK_HandleType type, const void* handle)
+{
+	GetAllocProfiler()->OnHandleCreated(type, handle);
+}
+
+static void NoteHandleReleased(const void* handle)
+{
+	GetAllocProfiler()->OnHandleReleased(handle);
+}
+
+//Priorities of governor consumers, lowest are trimmed first.
+#define FSDK_RECLAIM_TEXTPAGECACHE	7
+#define FSDK_RECLAIM_PAGECACHE		8
+#define FSDK_RECLAIM_READCACHE		10
+#define FSDK_RECLAIM_DOCUMENTCACHE	20
+
+//Default limits of a document's page cache.
+#define FSDK_PAGECACHE_MAXPAGES		8
+#define FSDK_PAGECACHE_BUDGET		(64 * 1024 * 1024)
+//Text-only pages are small, an indexing pass may go back to many of them.
+#define FSDK_TEXTPAGECACHE_MAXPAGES	32
+#define FSDK_TEXTPAGECACHE_BUDGET	(32 * 1024 * 1024)
+
+//Results with which the SDK reports running out of memory.
+static bool IsOutOfMemoryResult(FS_RESULT iRet)
+{
+	return iRet == FSCRT_ERRCODE_OUTOFMEMORY || iRet == FSCRT_ERRCODE_MEMORYREBUILT
+		|| iRet == FSCRT_ERRCODE_UNRECOVERABLE || iRet == FSCRT_ERRCODE_ROLLBACK;
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 //Class CMy_File
@@ -70,7 +383,8 @@ void CMy_File::g_PrivateRelease(FS_LPVOID clientData)
 FS_DWORD CMy_File::g_PrivateGetSize(FS_LPVOID clientData)
 {
 	CMy_FileReadWrite* pFileData = (CMy_FileReadWrite*)clientData;
-	return pFileData->GetSize();
+	int64 iSize = pFileData->GetSize();
+	return iSize > 0xFFFFFFFF ? 0xFFFFFFFF : (FS_DWORD)iSize;
 }
 
 FS_RESULT CMy_File::g_PrivateReadBlock(FS_LPVOID clientData, FS_DWORD offset, FS_LPVOID buffer, FS_DWORD size)
@@ -107,208 +421,821 @@ FS_RESULT CMy_File::g_PrivateFlush(FS_LPVOID clientData)
 
 FS_RESULT CMy_File::g_PrivateTruncate(FS_LPVOID clientData, FS_DWORD size)
 {
+	CMy_FileReadWrite* pFileData = (CMy_FileReadWrite*)clientData;
+	if (!pFileData)
+		return FSCRT_ERRCODE_FILE;
+
+	if (!pFileData->TruncateBlock(size))
+		return FSCRT_ERRCODE_ERROR;
 	return FSCRT_ERRCODE_SUCCESS;
 }
 
-///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// Class CMy_FileReadWrite
-CMy_FileReadWrite::CMy_FileReadWrite()
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Class CMy_FileL
+static int64 FileSizeToInt64(const FSCRT_FILESIZE* size)
 {
-	m_pFile = nullptr;
+	return (int64)(((uint64_t)size->hiSize << 32) | size->loSize);
 }
 
-CMy_FileReadWrite::~CMy_FileReadWrite()
+CMy_FileL::CMy_FileL()
 {
-	Release();
 }
 
-void CMy_FileReadWrite::SetSize(int nSize)
+CMy_FileL::~CMy_FileL()
 {
-	m_iFileSize = nSize;
 }
 
-void CMy_FileReadWrite::CreateFileRead(Windows::Storage::StorageFile^ pFile, int nFileSize)
+void CMy_FileL::InitFileHandle(CMy_FileReadWrite* pFileHandle)
 {
-	m_pFile = pFile;
-	m_iFileSize = nFileSize;
+	clientData = pFileHandle;
+	Release = g_PrivateRelease;
+	GetSize = g_PrivateGetSize;
+	ReadBlock = g_PrivateReadBlock;
+	WriteBlock = g_PrivateWriteBlock;
+	Flush = g_PrivateFlush;
+	Truncate = g_PrivateTruncate;
 }
 
-void CMy_FileReadWrite::Release()
+void CMy_FileL::ReleaseFileHandle()
 {
-	m_pFile = nullptr;
-	if (m_Buffer && m_Buffer->Size > 0)
+	if (clientData)
+		delete (CMy_FileReadWrite*)clientData;
+	clientData = NULL;
+	Release = NULL;
+	GetSize = NULL;
+	ReadBlock = NULL;
+	WriteBlock = NULL;
+	Flush = NULL;
+	Truncate = NULL;
+}
+
+void CMy_FileL::g_PrivateRelease(FS_LPVOID clientData)
+{
+	CMy_FileReadWrite* pFileData = (CMy_FileReadWrite*)clientData;
+
+	if (pFileData)
 	{
-		m_Buffer->Clear();
+		delete pFileData;
 	}
+	pFileData = NULL;
 }
 
-int	CMy_FileReadWrite::GetSize()
+FS_RESULT CMy_FileL::g_PrivateGetSize(FS_LPVOID clientData, FSCRT_FILESIZE* size)
 {
-	return m_iFileSize;
+	CMy_FileReadWrite* pFileData = (CMy_FileReadWrite*)clientData;
+	if (!pFileData || !size)
+		return FSCRT_ERRCODE_PARAM;
+
+	uint64_t iSize = (uint64_t)pFileData->GetSize();
+	size->loSize = (FS_DWORD)(iSize & 0xFFFFFFFF);
+	size->hiSize = (FS_DWORD)(iSize >> 32);
+	return FSCRT_ERRCODE_SUCCESS;
 }
 
-bool CMy_FileReadWrite::ReadBlock(void* buffer, int offset, size_t size)
+FS_RESULT CMy_FileL::g_PrivateReadBlock(FS_LPVOID clientData, const FSCRT_FILESIZE* offset, FS_LPVOID buffer, const FSCRT_FILESIZE* size)
 {
-	if (m_pFile == nullptr)
-		return FALSE;
+	CMy_FileReadWrite* pFileData = (CMy_FileReadWrite*)clientData;
+	if (!pFileData || !offset || !size || !buffer)
+		return FSCRT_ERRCODE_PARAM;
 
-	bool _bIsReadOk = false;
-	HANDLE processingHandle = CreateEventEx(
-		NULL,
-		NULL,
-		false,
-		EVENT_ALL_ACCESS
-		);
-	auto  OpenOp = m_pFile->OpenAsync(Windows::Storage::FileAccessMode::Read);
-	OpenOp->Completed = ref new AsyncOperationCompletedHandler<IRandomAccessStream^>([buffer, offset, size, processingHandle, &_bIsReadOk](IAsyncOperation<IRandomAccessStream^>^ operation, Windows::Foundation::AsyncStatus status)
-	{
-		if (status == Windows::Foundation::AsyncStatus::Completed)
-		{
-			IRandomAccessStream^ readStream = operation->GetResults();
-			readStream->Seek(offset);
-			DataReader^ dataReader = ref new DataReader(readStream);
-			auto LoadOp = dataReader->LoadAsync(size);
-			LoadOp->Completed = ref new AsyncOperationCompletedHandler<unsigned int>([buffer, dataReader, processingHandle, &_bIsReadOk](IAsyncOperation<unsigned int>^ operation, Windows::Foundation::AsyncStatus status)
-			{
-				if (status == Windows::Foundation::AsyncStatus::Completed)
-				{
-					int numBytesLoaded = operation->GetResults();
-					if (numBytesLoaded > 0)
-					{
-						Array<unsigned char, 1>^ fileContent = ref new Array<unsigned char, 1>(numBytesLoaded);
-						dataReader->ReadBytes(fileContent);
-						memcpy(buffer, fileContent->Data, numBytesLoaded);
-						dataReader->DetachStream();
-					}
-					_bIsReadOk = true;
-					SetEvent(processingHandle);
-				}
-				else
-				{
-					_bIsReadOk = false;
-					OutputDebugString(L"LoadAsync status ERROR!!!!!\n");
-					SetEvent(processingHandle);
-				}
-			});
-		}
-		else
-		{
-			_bIsReadOk = false;
-			OutputDebugString(L"status ERROR!!!!!\n");
-			SetEvent(processingHandle);
-		}
-	});
-	WaitForSingleObjectEx(processingHandle, INFINITE, true);
-	CloseHandle(processingHandle);
-	return _bIsReadOk ? TRUE : FALSE;
+	//A single block never exceeds the address space, even though the file can.
+	uint64_t iSize = (uint64_t)FileSizeToInt64(size);
+	if (iSize > (uint64_t)SIZE_MAX)
+		return FSCRT_ERRCODE_FILE;
 
+	if (!pFileData->ReadBlock(buffer, FileSizeToInt64(offset), (size_t)iSize))
+		return FSCRT_ERRCODE_FILE;
+	return FSCRT_ERRCODE_SUCCESS;
 }
 
-bool CMy_FileReadWrite::WriteBlock(const void* buffer, int offset, size_t size)
+FS_RESULT CMy_FileL::g_PrivateWriteBlock(FS_LPVOID clientData, const FSCRT_FILESIZE* offset, FS_LPCVOID buffer, const FSCRT_FILESIZE* size)
 {
-	if (nullptr == m_Buffer)
-	{
-		m_Buffer = ref new Vector<Object^>();
-	}
+	if (!clientData) return FSCRT_ERRCODE_FILE;
+	if (!offset || !size || !buffer) return FSCRT_ERRCODE_PARAM;
 
-	Platform::Array<unsigned char>^ fileContent = ref new Platform::Array<unsigned char>((unsigned char*)buffer, size);
-	m_Buffer->Append(fileContent);
-	int size1 = m_Buffer->Size;
-	return TRUE;
-}
+	CMy_FileReadWrite* pFileData = (CMy_FileReadWrite*)clientData;
+	uint64_t iSize = (uint64_t)FileSizeToInt64(size);
+	if (iSize > (uint64_t)SIZE_MAX)
+		return FSCRT_ERRCODE_FILE;
 
-void CMy_FileReadWrite::ReleaseTempWriteBuffer()
-{
-	if (m_Buffer->Size > 0)
-	{
-		m_Buffer->Clear();
-		m_Buffer = nullptr;
-	}
+	if (!pFileData->WriteBlock(buffer, FileSizeToInt64(offset), (size_t)iSize))
+		return FSCRT_ERRCODE_ERROR;
+	else
+		return FSCRT_ERRCODE_SUCCESS;
 }
 
-Platform::Collections::Vector<Platform::Object^>^ CMy_FileReadWrite::GetFileBuffer()
+FS_RESULT CMy_FileL::g_PrivateFlush(FS_LPVOID clientData)
 {
-	return m_Buffer;
+	return FSCRT_ERRCODE_SUCCESS;
 }
 
-
-/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-//Class FSDK_Document
-FSDK_Document::FSDK_Document()
+FS_RESULT CMy_FileL::g_PrivateTruncate(FS_LPVOID clientData, const FSCRT_FILESIZE* fileSize)
 {
-	m_pFileReader = NULL;
-	m_pFileStream = NULL;
-
-	FileHandle tempFile;
-	tempFile.pointer = NULL;
-	m_hFile = tempFile;
+	CMy_FileReadWrite* pFileData = (CMy_FileReadWrite*)clientData;
+	if (!pFileData)
+		return FSCRT_ERRCODE_FILE;
+	if (!fileSize)
+		return FSCRT_ERRCODE_PARAM;
 
-	DocHandle tempDoc;
-	tempDoc.pointer = NULL;
-	m_hDoc = tempDoc;
+	if (!pFileData->TruncateBlock(FileSizeToInt64(fileSize)))
+		return FSCRT_ERRCODE_ERROR;
+	return FSCRT_ERRCODE_SUCCESS;
+}
 
-	PageHandle tempPage;
-	tempPage.pointer = NULL;
-	m_hPage = tempPage;
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Class CMy_StorageFileSource
+CMy_StorageFileSource::CMy_StorageFileSource()
+{
+	m_Stream = nullptr;
+	m_ReadBuffer = nullptr;
+	m_iStreamSize = 0;
 }
 
-FSDK_Document::~FSDK_Document()
+CMy_StorageFileSource::~CMy_StorageFileSource()
 {
+	Close();
 }
 
-void	FSDK_Document::ReleaseResource()
+bool CMy_StorageFileSource::Open(StorageFile^ pFile)
 {
-	if (m_hPage.pointer)
-	{
-		FSPDF_Page_Clear((FSCRT_PAGE)(m_hPage.pointer));
-		PageHandle tempPage;
-		tempPage.pointer = NULL;
-		m_hPage = tempPage;
-	}
-	if (m_hDoc.pointer)
-	{
-		FSPDF_Doc_Close((FSCRT_DOCUMENT)(m_hDoc.pointer));
-		DocHandle tempDoc;
-		tempDoc.pointer = NULL;
-		m_hDoc = tempDoc;
-	}
-	if (m_hFile.pointer)
+	Close();
+	if (nullptr == pFile)
+		return false;
+
+	IRandomAccessStream^ stream = nullptr;
+	//Let incremental saves append to the file while it is open for reading.
+	if (!WaitForAsync(pFile->OpenAsync(FileAccessMode::Read, StorageOpenOptions::AllowReadersAndWriters), &stream) || nullptr == stream)
 	{
-		FSCRT_File_Release((FSCRT_FILE)(m_hFile.pointer));
-		FileHandle tempFile;
-		tempFile.pointer = NULL;
-		m_hFile = tempFile;
+		OutputDebugString(L"OpenAsync status ERROR!!!!!\n");
+		return false;
 	}
-	if (m_pFileStream)
-		delete m_pFileStream;
-	m_pFileStream = NULL;
+	m_Stream = stream;
+	m_iStreamSize = stream->Size;
+	return true;
+}
 
-	m_pFileReader = NULL;
+void CMy_StorageFileSource::Close()
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	if (nullptr != m_Stream)
+		delete m_Stream;	// Closes the underlying file.
+	m_Stream = nullptr;
+	m_ReadBuffer = nullptr;
+	m_iStreamSize = 0;
 }
 
+uint64_t CMy_StorageFileSource::GetSize()
+{
+	return m_iStreamSize;
+}
 
-IAsyncOperation<IRandomAccessStreamWithContentType^>^ FSDK_Document::RenderPageAsync(PixelSource^ pxsrc, int iStartX, int iStartY, int iSizeX, int iSizeY, int iRotation)
+bool CMy_StorageFileSource::ReadAt(uint64_t offset, void* buffer, size_t size)
 {
-	return create_async([=]()->task < IRandomAccessStreamWithContentType^ > {
+	if (!buffer || offset > m_iStreamSize || size > m_iStreamSize - offset)
+		return false;
 
-		bool ret = GetRenderBitmapData(pxsrc, iStartX, iStartY, iSizeX, iSizeY, iRotation);
-		if (true != ret)
+	std::lock_guard<std::mutex> lock(m_Lock);
+	if (nullptr == m_Stream)
+		return false;
+
+	unsigned char* pDest = (unsigned char*)buffer;
+	m_Stream->Seek(offset);
+	while (size > 0)
+	{
+		unsigned int nChunk = size > 0x10000000 ? 0x10000000 : (unsigned int)size;
+		if (nullptr == m_ReadBuffer || m_ReadBuffer->Capacity < nChunk)
+			m_ReadBuffer = ref new Buffer(nChunk);
+
+		IBuffer^ result = nullptr;
+		if (!WaitForAsync(m_Stream->ReadAsync(m_ReadBuffer, nChunk, InputStreamOptions::None), &result) || nullptr == result)
 		{
-			return create_task([]()->IRandomAccessStreamWithContentType^ {return nullptr; });
+			OutputDebugString(L"ReadAsync status ERROR!!!!!\n");
+			return false;
 		}
+		unsigned int nRead = result->Length;
+		if (nRead == 0)
+			return false;
+
+		//Copy straight out of the WinRT buffer, no intermediate Platform::Array.
+		byte* pBytes = GetBufferBytes(result);
+		if (!pBytes)
+			return false;
+		memcpy(pDest, pBytes, nRead);
+		pDest += nRead;
+		size -= nRead;
+	}
+	return true;
+}
 
-		InMemoryRandomAccessStream^ _stream = ref new InMemoryRandomAccessStream();
-		return task<BitmapEncoder^>(BitmapEncoder::CreateAsync(BitmapEncoder::BmpEncoderId, _stream)).then([=](BitmapEncoder^ encoder)->task < IRandomAccessStreamWithContentType^ > {
-			DataReader^ reader = DataReader::FromBuffer(pxsrc->PixelBuffer);
-			unsigned int bmp_length = pxsrc->PixelBuffer->Length;
-			Array<unsigned char, 1>^ buffer = ref new Array<unsigned char, 1>(pxsrc->PixelBuffer->Length);
-			if (!buffer)
-			{
-				return create_task([]()->IRandomAccessStreamWithContentType^ {return nullptr; });
-			}
-			reader->ReadBytes(buffer);
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Class CMy_StorageStreamSink
+CMy_StorageStreamSink::CMy_StorageStreamSink()
+{
+	m_Stream = nullptr;
+	m_Buffer = nullptr;
+}
 
-			encoder->SetPixelData(BitmapPixelFormat::Rgba8, BitmapAlphaMode::Straight, pxsrc->Width, pxsrc->Height, 96.0, 96.0, buffer);
+CMy_StorageStreamSink::~CMy_StorageStreamSink()
+{
+	Close();
+}
+
+bool CMy_StorageStreamSink::Open(StorageFile^ pFile, bool bTruncate)
+{
+	Close();
+	if (nullptr == pFile)
+		return false;
+
+	IRandomAccessStream^ stream = nullptr;
+	if (!WaitForAsync(pFile->OpenAsync(FileAccessMode::ReadWrite, StorageOpenOptions::AllowReadersAndWriters), &stream) || nullptr == stream)
+	{
+		OutputDebugString(L"OpenAsync status ERROR!!!!!\n");
+		return false;
+	}
+	if (bTruncate)
+		stream->Size = 0;
+	m_Stream = stream;
+	return true;
+}
+
+void CMy_StorageStreamSink::Close()
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	if (nullptr != m_Stream)
+		delete m_Stream;	// Closes the underlying file.
+	m_Stream = nullptr;
+	m_Buffer = nullptr;
+}
+
+uint64_t CMy_StorageStreamSink::GetSize()
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	return nullptr == m_Stream ? 0 : m_Stream->Size;
+}
+
+bool CMy_StorageStreamSink::WriteAt(uint64_t offset, const void* buffer, size_t size)
+{
+	if (!buffer && size)
+		return false;
+
+	std::lock_guard<std::mutex> lock(m_Lock);
+	if (nullptr == m_Stream)
+		return false;
+
+	const unsigned char* pSrc = (const unsigned char*)buffer;
+	m_Stream->Seek(offset);
+	while (size > 0)
+	{
+		unsigned int nChunk = size > 0x400000 ? 0x400000 : (unsigned int)size;
+		if (nullptr == m_Buffer || m_Buffer->Capacity < nChunk)
+			m_Buffer = ref new Buffer(nChunk);
+		byte* pBytes = GetBufferBytes(m_Buffer);
+		if (!pBytes)
+			return false;
+		memcpy(pBytes, pSrc, nChunk);
+		m_Buffer->Length = nChunk;
+
+		unsigned int nWritten = 0;
+		if (!WaitForAsync(m_Stream->WriteAsync(m_Buffer), &nWritten) || nWritten != nChunk)
+		{
+			OutputDebugString(L"WriteAsync status ERROR!!!!!\n");
+			return false;
+		}
+		pSrc += nChunk;
+		size -= nChunk;
+	}
+	return true;
+}
+
+bool CMy_StorageStreamSink::ReadAt(uint64_t offset, void* buffer, size_t size)
+{
+	if (!buffer)
+		return false;
+
+	std::lock_guard<std::mutex> lock(m_Lock);
+	if (nullptr == m_Stream || offset > m_Stream->Size || size > m_Stream->Size - offset)
+		return false;
+
+	unsigned char* pDest = (unsigned char*)buffer;
+	m_Stream->Seek(offset);
+	while (size > 0)
+	{
+		unsigned int nChunk = size > 0x400000 ? 0x400000 : (unsigned int)size;
+		if (nullptr == m_Buffer || m_Buffer->Capacity < nChunk)
+			m_Buffer = ref new Buffer(nChunk);
+
+		IBuffer^ result = nullptr;
+		if (!WaitForAsync(m_Stream->ReadAsync(m_Buffer, nChunk, InputStreamOptions::None), &result) || nullptr == result)
+			return false;
+		unsigned int nRead = result->Length;
+		byte* pBytes = GetBufferBytes(result);
+		if (nRead == 0 || !pBytes)
+			return false;
+		memcpy(pDest, pBytes, nRead);
+		pDest += nRead;
+		size -= nRead;
+	}
+	return true;
+}
+
+bool CMy_StorageStreamSink::Truncate(uint64_t size)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	if (nullptr == m_Stream)
+		return false;
+	m_Stream->Size = size;
+	return true;
+}
+
+bool CMy_StorageStreamSink::Flush()
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	if (nullptr == m_Stream)
+		return false;
+	bool bFlushed = false;
+	return WaitForAsync(m_Stream->FlushAsync(), &bFlushed) && bFlushed;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Class CMy_FileReadWrite
+CMy_FileReadWrite::CMy_FileReadWrite()
+{
+	m_pFile = nullptr;
+	m_iFileSize = 0;
+	m_pReadCache = NULL;
+	m_pWriteBuffer = NULL;
+	m_nSpillThreshold = 64 * 1024 * 1024;
+}
+
+CMy_FileReadWrite::~CMy_FileReadWrite()
+{
+	Release();
+}
+
+void CMy_FileReadWrite::SetSize(int64 nSize)
+{
+	m_iFileSize = nSize;
+}
+
+bool CMy_FileReadWrite::CreateFileRead(Windows::Storage::StorageFile^ pFile, int64 nFileSize)
+{
+	m_pFile = pFile;
+	m_iFileSize = nFileSize;
+
+	//Keep one stream open for the whole document, reads go through the block cache.
+	CMy_StorageFileSource* pSource = new CMy_StorageFileSource();
+	if (!pSource->Open(pFile))
+	{
+		delete pSource;
+		return false;
+	}
+	return CreateFileRead(pSource, true);
+}
+
+bool CMy_FileReadWrite::CreateFileRead(IMy_FileSource* pSource, bool bOwnSource)
+{
+	if (m_pReadCache)
+		delete m_pReadCache;
+	m_pReadCache = NULL;
+	if (!pSource)
+		return false;
+
+	m_pReadCache = CMy_BlockCache::CreateForSource(pSource, bOwnSource);
+	m_iFileSize = (int64)pSource->GetSize();
+	return true;
+}
+
+void CMy_FileReadWrite::Release()
+{
+	m_pFile = nullptr;
+	if (m_pReadCache)
+		delete m_pReadCache;
+	m_pReadCache = NULL;
+	ReleaseTempWriteBuffer();
+}
+
+int64	CMy_FileReadWrite::GetSize()
+{
+	return m_iFileSize;
+}
+
+bool CMy_FileReadWrite::ReadBlock(void* buffer, int64 offset, size_t size)
+{
+	if (!m_pReadCache || offset < 0)
+		return FALSE;
+
+	return m_pReadCache->ReadAt((uint64_t)offset, buffer, size);
+}
+
+bool CMy_FileReadWrite::WriteBlock(const void* buffer, int64 offset, size_t size)
+{
+	if (offset < 0)
+		return FALSE;
+
+	//Pieces land at their offset, so the SDK may seek back and patch earlier output.
+	if (!m_pWriteBuffer)
+		m_pWriteBuffer = new CMy_WriteBuffer(m_nSpillThreshold, m_TempDir.empty() ? NULL : m_TempDir.c_str());
+	return m_pWriteBuffer->Write((uint64_t)offset, buffer, size);
+}
+
+bool CMy_FileReadWrite::TruncateBlock(int64 size)
+{
+	if (size < 0)
+		return FALSE;
+
+	if (!m_pWriteBuffer)
+		m_pWriteBuffer = new CMy_WriteBuffer(m_nSpillThreshold, m_TempDir.empty() ? NULL : m_TempDir.c_str());
+	return m_pWriteBuffer->Truncate((uint64_t)size);
+}
+
+void CMy_FileReadWrite::ReleaseTempWriteBuffer()
+{
+	if (m_pWriteBuffer)
+		delete m_pWriteBuffer;
+	m_pWriteBuffer = NULL;
+}
+
+void CMy_FileReadWrite::SetWriteBufferOptions(size_t nSpillThreshold, const std::string& tempDir)
+{
+	//Takes effect for the next save.
+	m_nSpillThreshold = nSpillThreshold;
+	m_TempDir = tempDir;
+}
+
+FSDK_BlockCacheStats CMy_FileReadWrite::GetReadCacheStats()
+{
+	FSDK_BlockCacheStats stats;
+	memset(&stats, 0, sizeof(stats));
+	if (m_pReadCache)
+		stats = m_pReadCache->GetStats();
+	return stats;
+}
+
+CMy_WriteBuffer* CMy_FileReadWrite::GetFileBuffer()
+{
+	return m_pWriteBuffer;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Class CMy_ReadCacheConsumer
+CMy_ReadCacheConsumer::CMy_ReadCacheConsumer(CMy_BlockCache* pCache)
+{
+	m_pCache = pCache;
+}
+
+uint64_t CMy_ReadCacheConsumer::ReleaseMemory(FSDK_MemoryPressure /*level*/)
+{
+	uint64_t nBytes = m_pCache->GetCachedBytes();
+	m_pCache->Clear();
+	return nBytes;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Class CMy_DocumentCacheConsumer
+std::atomic<uint32_t> CMy_DocumentCacheConsumer::s_nIdleMs(30 * 1000);
+
+CMy_DocumentCacheConsumer::CMy_DocumentCacheConsumer(FSCRT_DOCUMENT document)
+{
+	m_Document = document;
+	m_iLastUseMs = GetTickCount64();
+}
+
+void CMy_DocumentCacheConsumer::Touch()
+{
+	m_iLastUseMs = GetTickCount64();
+}
+
+void CMy_DocumentCacheConsumer::SetIdleTime(uint32_t nIdleMs)
+{
+	s_nIdleMs = nIdleMs;
+}
+
+uint64_t CMy_DocumentCacheConsumer::ReleaseMemory(FSDK_MemoryPressure level)
+{
+	if (level < FSDK_PRESSURE_CRITICAL && GetTickCount64() - m_iLastUseMs < s_nIdleMs)
+		return 0;
+
+	//FSPDF_Doc_ClearCache is thread safe. What it frees shows up as the drop in SDK memory.
+	uint64_t nBefore = GetSDKMemory()->GetBudget()->GetStats().usedBytes;
+	if (FSPDF_Doc_ClearCache(m_Document) != FSCRT_ERRCODE_SUCCESS)
+		return 0;
+	uint64_t nAfter = GetSDKMemory()->GetBudget()->GetStats().usedBytes;
+	return nBefore > nAfter ? nBefore - nAfter : 0;
+}
+
+//Release a parsed page and forget its memory tags.
+static void ReleaseParsedPage(FSCRT_PAGE page)
+{
+	GetSDKMemory()->UnbindPage((const void*)page);
+	NoteHandleReleased((const void*)page);
+	FSPDF_Page_Clear(page);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Class CMy_PagePrefetcher
+CMy_PagePrefetcher::CMy_PagePrefetcher()
+{
+	m_bRunning = false;
+}
+
+CMy_PagePrefetcher::~CMy_PagePrefetcher()
+{
+	Cancel();
+}
+
+bool CMy_PagePrefetcher::Start(const std::function<void(const CMy_CancelToken*)>& job)
+{
+	Cancel();
+	std::shared_ptr<CMy_CancelToken> pCancel = std::make_shared<CMy_CancelToken>();
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		m_pCancel = pCancel;
+		m_bRunning = true;
+	}
+	bool bQueued = GetPrefetchPool()->Submit([this, job, pCancel]()
+	{
+		job(pCancel.get());
+		std::lock_guard<std::mutex> lock(m_Lock);
+		m_bRunning = false;
+		m_Stopped.notify_all();
+	});
+	if (!bQueued)
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		m_bRunning = false;
+	}
+	return bQueued;
+}
+
+void CMy_PagePrefetcher::Cancel()
+{
+	std::unique_lock<std::mutex> lock(m_Lock);
+	if (m_pCancel)
+		m_pCancel->Cancel();
+	m_Stopped.wait(lock, [this]() { return !m_bRunning; });
+}
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Class FSDK_Document
+FSDK_Document::FSDK_Document()
+{
+	m_pFileReader = NULL;
+	m_pFileStream = NULL;
+	m_pLargeFileStream = NULL;
+	m_pMappedFile = NULL;
+	m_iSaveMemoryThreshold = 64 * 1024 * 1024;
+	m_SourceFile = nullptr;
+	m_iBaseFileSize = 0;
+	m_iAppendedSize = 0;
+	memset(&m_LastAppendStats, 0, sizeof(m_LastAppendStats));
+	m_pProgressiveFile = NULL;
+	m_pAsyncFile = NULL;
+	m_iFirstAvailPage = 0;
+	m_pIoTrace = NULL;
+	m_pTracingFile = NULL;
+	m_pTracingFileL = NULL;
+	m_iCurPageIndex = -1;
+	m_iMemoryDocId = 0;
+	m_pReadCacheConsumer = NULL;
+	m_pDocCacheConsumer = NULL;
+	m_pPrefetcher = new CMy_PagePrefetcher();
+	m_iPrefetchDepth = 1;
+	m_pPageCache = new CMy_PageCache(FSDK_PAGECACHE_MAXPAGES, FSDK_PAGECACHE_BUDGET, ReleaseParsedPage);
+	m_pTextPageCache = new CMy_PageCache(FSDK_TEXTPAGECACHE_MAXPAGES, FSDK_TEXTPAGECACHE_BUDGET, ReleaseParsedPage);
+
+	FileHandle tempFile;
+	tempFile.pointer = NULL;
+	m_hFile = tempFile;
+
+	DocHandle tempDoc;
+	tempDoc.pointer = NULL;
+	m_hDoc = tempDoc;
+
+	PageHandle tempPage;
+	tempPage.pointer = NULL;
+	m_hPage = tempPage;
+}
+
+FSDK_Document::~FSDK_Document()
+{
+	//Stops a prefetch still running on the document.
+	delete m_pPrefetcher;
+	m_pPrefetcher = NULL;
+	delete m_pPageCache;
+	m_pPageCache = NULL;
+	delete m_pTextPageCache;
+	m_pTextPageCache = NULL;
+}
+
+void	FSDK_Document::ReleaseResource()
+{
+	//A load still running finishes first, cancelling its LoadPageAsync makes that quick.
+	std::lock_guard<std::mutex> lock(m_LoadLock);
+	CloseDocument();
+}
+
+void	FSDK_Document::CloseDocument()
+{
+	//No prefetch starts while m_LoadLock is held. The one running may wait for m_ParseLock, so it is stopped first.
+	m_pPrefetcher->Cancel();
+	//Parses and text extractions of the document are done once m_ParseLock is ours.
+	std::lock_guard<std::mutex> lock(m_ParseLock);
+	//Parsed pages belong to the document, they go before it.
+	UnregisterMemoryConsumers();
+	std::atomic_store(&m_pCurPage, std::shared_ptr<FSDK_CachedPage>());
+	m_pPageCache->Clear();
+	m_pTextPageCache->Clear();
+	//Renders and extractions still running hold pages of the document.
+	m_pPageCache->WaitForHolders();
+	m_pTextPageCache->WaitForHolders();
+	if (m_hPage.pointer)
+	{
+		PageHandle tempPage;
+		tempPage.pointer = NULL;
+		m_hPage = tempPage;
+	}
+	if (m_hDoc.pointer)
+	{
+		NoteHandleReleased((const void*)m_hDoc.pointer);
+		FSPDF_Doc_Close((FSCRT_DOCUMENT)(m_hDoc.pointer));
+		DocHandle tempDoc;
+		tempDoc.pointer = NULL;
+		m_hDoc = tempDoc;
+	}
+	if (m_iMemoryDocId)
+		GetSDKMemory()->RemoveDocument(m_iMemoryDocId);
+	m_iMemoryDocId = 0;
+	if (m_hFile.pointer)
+	{
+		FSCRT_File_Release((FSCRT_FILE)(m_hFile.pointer));
+		FileHandle tempFile;
+		tempFile.pointer = NULL;
+		m_hFile = tempFile;
+	}
+	if (m_pFileStream)
+		delete m_pFileStream;
+	m_pFileStream = NULL;
+	if (m_pLargeFileStream)
+		delete m_pLargeFileStream;
+	m_pLargeFileStream = NULL;
+	if (m_pMappedFile)
+		delete m_pMappedFile;
+	m_pMappedFile = NULL;
+	if (m_pAsyncFile)
+		delete m_pAsyncFile;
+	m_pAsyncFile = NULL;
+	//Stops the background fetcher before the source goes away.
+	if (m_pProgressiveFile)
+		delete m_pProgressiveFile;
+	m_pProgressiveFile = NULL;
+	m_iFirstAvailPage = 0;
+	m_iCurPageIndex = -1;
+	if (m_pTracingFile)
+		delete m_pTracingFile;
+	m_pTracingFile = NULL;
+	if (m_pTracingFileL)
+		delete m_pTracingFileL;
+	m_pTracingFileL = NULL;
+	StopIoTrace();
+
+	m_pFileReader = NULL;
+	m_SourceFile = nullptr;
+	m_iBaseFileSize = 0;
+	m_iAppendedSize = 0;
+}
+
+
+IAsyncOperationWithProgress<bool, TileRect>^ FSDK_Document::RenderPageTiledAsync(PixelSource^ pxsrc, int iStartX, int iStartY, int iSizeX, int iSizeY, int iRotation, int iTileSize)
+{
+	return create_async([=](progress_reporter<TileRect> reporter, cancellation_token token)->bool
+	{
+		CMy_CancelLink cancel(token);
+		if (m_pDocCacheConsumer)
+			m_pDocCacheConsumer->Touch();
+		//Tiles finish on several threads at once, report them one at a time.
+		std::mutex reportLock;
+		std::function<void(const FSDK_TileRect&)> onTile = [&reporter, &reportLock](const FSDK_TileRect& tile)
+		{
+			TileRect rect;
+			rect.X = tile.x;
+			rect.Y = tile.y;
+			rect.Width = tile.width;
+			rect.Height = tile.height;
+			std::lock_guard<std::mutex> lock(reportLock);
+			reporter.report(rect);
+		};
+		//Tiles are copied straight into the rows of a pooled buffer, which the caller already holds.
+		FSDK_PixelBuffer* pPixels = GetPixelBufferPool()->Acquire(pxsrc->Width, pxsrc->Height, 4);
+		if (!pPixels)
+			return false;
+		uint8_t* pDest = pPixels->data;
+		int32_t iStride = pPixels->stride;
+		pxsrc->Format = PixelFormat::RGBx;
+		pxsrc->Stride = iStride;
+		pxsrc->PixelBuffer = WrapPixelBuffer(pPixels);
+		if (nullptr == pxsrc->PixelBuffer)
+			return false;
+		//The page stays alive for the whole render, even if another page is loaded meanwhile.
+		std::shared_ptr<FSDK_CachedPage> pPage = std::atomic_load(&m_pCurPage);
+		FS_RESULT iRet = RenderTiles(pPage ? pPage->page : NULL, pPage ? pPage->pageIndex : -1, pDest, iStride, pxsrc->Width, pxsrc->Height, FSCRT_BITMAPFORMAT_32BPP_RGBx,
+			FSPDF_PAGERENDERFLAG_NORMAL, iStartX, iStartY, iSizeX, iSizeY, iRotation, iTileSize, onTile, cancel.Get());
+		if (IsOutOfMemoryResult(iRet) && pPage)
+		{
+			//The reopened document has pages of its own, this one must be let go before the old one closes.
+			int32 iPageIndex = pPage->pageIndex;
+			pPage.reset();
+			iRet = RecoverForRender(iPageIndex, pPage);
+			if (iRet == FSCRT_ERRCODE_SUCCESS)
+				iRet = RenderTiles(pPage->page, iPageIndex, pDest, iStride, pxsrc->Width, pxsrc->Height, FSCRT_BITMAPFORMAT_32BPP_RGBx, FSPDF_PAGERENDERFLAG_NORMAL,
+					iStartX, iStartY, iSizeX, iSizeY, iRotation, iTileSize, onTile, cancel.Get());
+		}
+		cancel.ThrowIfCancelled();
+		return iRet == FSCRT_ERRCODE_SUCCESS;
+	});
+}
+
+IAsyncOperation<bool>^ FSDK_Document::RenderPageRawAsync(PixelSource^ pxsrc, int iStartX, int iStartY, int iSizeX, int iSizeY, int iRotation)
+{
+	return create_async([=](cancellation_token token)->bool
+	{
+		CMy_CancelLink cancel(token);
+		bool bOk = GetRenderBitmapData(pxsrc, iStartX, iStartY, iSizeX, iSizeY, iRotation, FSCRT_BITMAPFORMAT_32BPP_BGRA, cancel.Get());
+		cancel.ThrowIfCancelled();
+		return bOk;
+	});
+}
+
+IAsyncOperation<SoftwareBitmap^>^ FSDK_Document::RenderPageToSoftwareBitmapAsync(int iWidth, int iHeight, int iStartX, int iStartY, int iSizeX, int iSizeY, int iRotation)
+{
+	return create_async([=](cancellation_token token)->SoftwareBitmap^
+	{
+		CMy_CancelLink cancel(token);
+		SoftwareBitmap^ bitmap = RenderSoftwareBitmap(iWidth, iHeight, iStartX, iStartY, iSizeX, iSizeY, iRotation, FSPDF_PAGERENDERFLAG_NORMAL, cancel.Get());
+		//A superseded render drops its bitmap right here.
+		cancel.ThrowIfCancelled();
+		if (nullptr != bitmap)
+			StartPrefetch(iWidth, iHeight, iStartX, iStartY, iSizeX, iSizeY, iRotation);
+		return bitmap;
+	});
+}
+
+IAsyncOperationWithProgress<SoftwareBitmap^, SoftwareBitmap^>^ FSDK_Document::RenderPageProgressiveAsync(int iWidth, int iHeight, int iStartX, int iStartY,
+	int iSizeX, int iSizeY, int iRotation)
+{
+	return create_async([=](progress_reporter<SoftwareBitmap^> reporter, cancellation_token token)->SoftwareBitmap^
+	{
+		CMy_CancelLink cancel(token);
+		//Areas of one tile render at full quality about as fast as a preview would.
+		if ((int64)iWidth * iHeight > (int64)FSDK_RENDER_TILESIZE * FSDK_RENDER_TILESIZE)
+		{
+			//The same view at a fraction of the size, with images and shadings drawn quickly.
+			int iScale = FSDK_PREVIEW_SCALE;
+			SoftwareBitmap^ preview = RenderSoftwareBitmap((iWidth + iScale - 1) / iScale, (iHeight + iScale - 1) / iScale,
+				FloorDiv(iStartX, iScale), FloorDiv(iStartY, iScale), (iSizeX + iScale - 1) / iScale, (iSizeY + iScale - 1) / iScale,
+				iRotation, FSPDF_PAGERENDERFLAG_QUICKDRAW, cancel.Get());
+			cancel.ThrowIfCancelled();
+			if (nullptr != preview)
+				reporter.report(preview);
+		}
+		SoftwareBitmap^ bitmap = RenderSoftwareBitmap(iWidth, iHeight, iStartX, iStartY, iSizeX, iSizeY, iRotation, FSPDF_PAGERENDERFLAG_NORMAL, cancel.Get());
+		cancel.ThrowIfCancelled();
+		if (nullptr != bitmap)
+			StartPrefetch(iWidth, iHeight, iStartX, iStartY, iSizeX, iSizeY, iRotation);
+		return bitmap;
+	});
+}
+
+IAsyncOperation<IRandomAccessStreamWithContentType^>^ FSDK_Document::RenderPageAsync(PixelSource^ pxsrc, int iStartX, int iStartY, int iSizeX, int iSizeY, int iRotation)
+{
+	return create_async([=](cancellation_token token)->task < IRandomAccessStreamWithContentType^ > {
+
+		bool ret = false;
+		{
+			CMy_CancelLink cancel(token);
+			ret = GetRenderBitmapData(pxsrc, iStartX, iStartY, iSizeX, iSizeY, iRotation, FSCRT_BITMAPFORMAT_32BPP_RGBx, cancel.Get());
+			cancel.ThrowIfCancelled();
+		}
+		if (true != ret)
+		{
+			return create_task([]()->IRandomAccessStreamWithContentType^ {return nullptr; });
+		}
+
+		InMemoryRandomAccessStream^ _stream = ref new InMemoryRandomAccessStream();
+		return task<BitmapEncoder^>(BitmapEncoder::CreateAsync(BitmapEncoder::BmpEncoderId, _stream)).then([=](BitmapEncoder^ encoder)->task < IRandomAccessStreamWithContentType^ > {
+			//The SDK's RGBx becomes packed RGBA with opaque alpha in the encoder's own buffer, in one pass. pxsrc keeps
+			//its RGBx pixels for the caller.
+			byte* pPixels = GetBufferBytes(pxsrc->PixelBuffer);
+			unsigned int rowBytes = (unsigned int)pxsrc->Width * 4;
+			if (!pPixels)
+			{
+				return create_task([]()->IRandomAccessStreamWithContentType^ {return nullptr; });
+			}
+			Array<unsigned char, 1>^ buffer = ref new Array<unsigned char, 1>(rowBytes * pxsrc->Height);
+			CMy_PixelConvert::RgbxToRgba(pPixels, pxsrc->Stride, buffer->Data, (int32_t)rowBytes, pxsrc->Width, pxsrc->Height);
+			encoder->SetPixelData(BitmapPixelFormat::Rgba8, BitmapAlphaMode::Premultiplied, pxsrc->Width, pxsrc->Height, 96.0, 96.0, buffer);
 			return task<void>(encoder->FlushAsync()).then([=]()->task < IRandomAccessStreamWithContentType^ > {
 				RandomAccessStreamReference^ streamReference = RandomAccessStreamReference::CreateFromStream(_stream);
 				return task<IRandomAccessStreamWithContentType^>(streamReference->OpenReadAsync()).then([=](IRandomAccessStreamWithContentType^ ad)->IRandomAccessStreamWithContentType^ {
@@ -319,58 +1246,523 @@ IAsyncOperation<IRandomAccessStreamWithContentType^>^ FSDK_Document::RenderPageA
 	});
 }
 
-IAsyncOperation<FS_RESULT>^  FSDK_Document::OpenDocumentAsync(Windows::Storage::StorageFile^ pdfFile, int32 iFileSize)
+IAsyncOperation<FS_RESULT>^  FSDK_Document::OpenDocumentAsync(Windows::Storage::StorageFile^ pdfFile, int64 iFileSize)
+{
+	return create_async([=]()->FS_RESULT {
+		if (nullptr == pdfFile)
+			return FSCRT_ERRCODE_ERROR;
+
+		/*std::string s;
+		std::wstring ws = std::wstring(pdfFile->ToString()->Data());
+		s.assign(ws.begin(), ws.end());
+		FSCRT_BSTRC(filename, "D:/1.pdf");
+		iRet = FSCRT_File_CreateFromFileName(&filename, FSCRT_FILEMODE_READONLY, &sdkFile);*/
+
+		RecoverInterruptedAppend(pdfFile);
+		return OpenLargeDocument(pdfFile, iFileSize);
+	});
+}
+
+FS_RESULT FSDK_Document::OpenLargeDocument(Windows::Storage::StorageFile^ pdfFile, int64 iFileSize)
+{
+	FS_RESULT iRet = FSCRT_ERRCODE_ERROR;
+	m_pFileReader = new CMy_FileReadWrite();
+	if (!m_pFileReader->CreateFileRead(pdfFile, iFileSize))
+	{
+		delete m_pFileReader;
+		m_pFileReader = NULL;
+		return FSCRT_ERRCODE_FILE;
+	}
+	m_SourceFile = pdfFile;
+	m_iBaseFileSize = m_pFileReader->GetSize();
+	m_iAppendedSize = 0;
+	m_pLargeFileStream = new CMy_FileL();
+	m_pLargeFileStream->InitFileHandle(m_pFileReader);
+	FSCRT_FILE sdkFile = NULL;
+
+	FSCRT_FILEHANDLER_L* pHandler = m_pLargeFileStream;
+	if (m_pIoTrace)
+	{
+		m_pTracingFileL = new CMy_TracingFileL();
+		m_pTracingFileL->InitFileHandle(m_pLargeFileStream, m_pIoTrace);
+		pHandler = m_pTracingFileL;
+	}
+
+	//Create a FSCRT_FILE object with 64-bit offsets used for loading PDF document.
+	iRet = FSCRT_File_Create_L(pHandler, &sdkFile);
+
+	//Without a FSCRT_FILE nothing releases the handlers, they go here.
+	if (iRet != FSCRT_ERRCODE_SUCCESS)
+	{
+		delete m_pTracingFileL;
+		m_pTracingFileL = NULL;
+		delete m_pLargeFileStream;
+		m_pLargeFileStream = NULL;
+		delete m_pFileReader;
+		m_pFileReader = NULL;
+		m_SourceFile = nullptr;
+		return FSCRT_ERRCODE_FILE;
+	}
+
+	return LoadDocument(sdkFile);
+}
+
+IAsyncOperation<FS_RESULT>^  FSDK_Document::OpenMappedDocumentAsync(Windows::Storage::StorageFile^ pdfFile)
+{
+	return create_async([=]()->FS_RESULT {
+		if (nullptr == pdfFile)
+			return FSCRT_ERRCODE_ERROR;
+		RecoverInterruptedAppend(pdfFile);
+		return OpenMappedDocument(pdfFile);
+	});
+}
+
+FS_RESULT FSDK_Document::OpenMappedDocument(Windows::Storage::StorageFile^ pdfFile)
+{
+	FS_RESULT iRet = FSCRT_ERRCODE_ERROR;
+	//Writes still go through CMy_FileReadWrite, so SaveAsDocument works the same way.
+	m_pFileReader = new CMy_FileReadWrite();
+	m_pFileStream = new CMy_File();
+	m_pFileStream->InitFileHandle(m_pFileReader);
+
+	//Map the file by path. Picked files are often outside the app's reach for CreateFile2,
+	//in that case fall back to buffered reads on the StorageFile stream.
+	std::string path = ToUtf8String(pdfFile->Path);
+	m_pMappedFile = new CMy_MappedFile();
+	if (!m_pMappedFile->InitFileHandle(path.c_str(), NULL, false, m_pFileStream))
+	{
+		CMy_StorageFileSource* pSource = new CMy_StorageFileSource();
+		if (!pSource->Open(pdfFile))
+		{
+			delete pSource;
+			return FSCRT_ERRCODE_FILE;
+		}
+		m_pMappedFile->InitFileHandle(NULL, CMy_BlockCache::CreateForSource(pSource, true), true, m_pFileStream);
+	}
+
+	//FSCRT_FILEHANDLER only addresses 4GB, hand larger files to the 64-bit handler.
+	int64 iFileSize = (int64)m_pMappedFile->GetFileSize();
+	if (iFileSize > 0xFFFFFFFF)
+	{
+		delete m_pMappedFile;
+		m_pMappedFile = NULL;
+		delete m_pFileStream;
+		m_pFileStream = NULL;
+		delete m_pFileReader;
+		m_pFileReader = NULL;
+		return OpenLargeDocument(pdfFile, iFileSize);
+	}
+	m_SourceFile = pdfFile;
+	m_iBaseFileSize = iFileSize;
+	m_iAppendedSize = 0;
+	FSCRT_FILE sdkFile = NULL;
+
+	FSCRT_FILEHANDLER* pHandler = m_pMappedFile;
+	if (m_pIoTrace)
+	{
+		m_pTracingFile = new CMy_TracingFile();
+		m_pTracingFile->InitFileHandle(m_pMappedFile, m_pIoTrace);
+		pHandler = m_pTracingFile;
+	}
+
+	//Create a FSCRT_FILE object used for loading PDF document.
+	iRet = FSCRT_File_Create(pHandler, &sdkFile);
+
+	if (iRet != FSCRT_ERRCODE_SUCCESS)
+	{
+		return iRet;
+	}
+
+	return LoadDocument(sdkFile);
+}
+
+IAsyncOperationWithProgress<FS_RESULT, int>^ FSDK_Document::OpenProgressiveDocumentAsync(StorageFile^ pdfFile, int iLatencyMs, int64 iBytesPerSecond)
 {
-	return create_async([=]()->FS_RESULT {
-		FS_RESULT iRet = FSCRT_ERRCODE_ERROR;
+	return create_async([=](progress_reporter<int> reporter)->FS_RESULT
+	{
 		if (nullptr == pdfFile)
-			return iRet;
-
-		m_pFileReader = new CMy_FileReadWrite();
-		m_pFileReader->CreateFileRead(pdfFile, iFileSize);
-		m_pFileStream = new CMy_File();
-		m_pFileStream->InitFileHandle(m_pFileReader);
-		FSCRT_FILE sdkFile = NULL;
+			return FSCRT_ERRCODE_ERROR;
 
-		//Create a FSCRT_FILE object used for loading PDF document.
-		iRet = FSCRT_File_Create(m_pFileStream, &sdkFile);
-
-		if (iRet != FSCRT_ERRCODE_SUCCESS)
+		CMy_StorageFileSource* pStorage = new CMy_StorageFileSource();
+		if (!pStorage->Open(pdfFile))
 		{
-			return iRet;
+			delete pStorage;
+			return FSCRT_ERRCODE_FILE;
+		}
+		//FSPDF_ASYNCFILEHANDLER only passes 32-bit offsets.
+		if (pStorage->GetSize() > 0xFFFFFFFF)
+		{
+			delete pStorage;
+			return FSCRT_ERRCODE_UNSUPPORTED;
 		}
 
-		FSCRT_DOCUMENT sdkDoc;
-		//Load PDF document
-		iRet = FSPDF_Doc_StartLoad(sdkFile, NULL, &sdkDoc, NULL);
-		if (iRet != FSCRT_ERRCODE_SUCCESS)
+		IMy_FileSource* pSource = pStorage;
+		if (iLatencyMs > 0 || iBytesPerSecond > 0)
+			pSource = new CMy_ThrottledFileSource(pStorage, true, (uint32_t)(iLatencyMs > 0 ? iLatencyMs : 0), (uint64_t)(iBytesPerSecond > 0 ? iBytesPerSecond : 0));
+		std::string tempDir = ToUtf8String(ApplicationData::Current->TemporaryFolder->Path);
+		m_pProgressiveFile = new CMy_ProgressiveFile(pSource, true, 256 * 1024, tempDir.c_str());
+		if (!m_pProgressiveFile->Start())
+			return FSCRT_ERRCODE_ERROR;
+		m_pAsyncFile = new CMy_AsyncFile();
+		m_pAsyncFile->InitFileHandle(m_pProgressiveFile);
+
+		//Every check below asks for what it misses through IsDataAvail/AddDownloadHint, then waits for the fetcher.
+		int iLastPercent = -1;
+		auto reportProgress = [&]()
 		{
+			FSDK_ProgressiveStats stats = m_pProgressiveFile->GetStats();
+			int iPercent = stats.fileSize ? (int)(stats.bytesAvailable * 100 / stats.fileSize) : 100;
+			if (iPercent != iLastPercent)
+			{
+				reporter.report(iPercent);
+				iLastPercent = iPercent;
+			}
+		};
+
+		if (!m_iMemoryDocId)
+			m_iMemoryDocId = GetSDKMemory()->AddDocument();
+		CMy_MemoryScope memoryScope(GetSDKMemory(), m_iMemoryDocId, -1, FSDK_MEMOP_OPEN);
+
+		FSCRT_DOCUMENT sdkDoc = NULL;
+		FS_RESULT iRet = FSPDF_Doc_AsyncLoad(m_pAsyncFile, NULL, &sdkDoc);
+		if (iRet != FSCRT_ERRCODE_SUCCESS)
 			return iRet;
-		}
+		NoteHandleCreated(FSDK_HANDLE_DOCUMENT, sdkDoc);
 
 		DocHandle CurDoc;
 		FileHandle CurFile;
 		CurDoc.pointer = (int64)sdkDoc;
-		CurFile.pointer = (int64)sdkFile;
-
-		m_hFile = CurFile;
+		CurFile.pointer = (int64)m_pAsyncFile->GetSDKFile();
 		m_hDoc = CurDoc;
+		m_hFile = CurFile;
+		RegisterMemoryConsumers();
 
-		/*std::string s;
-		std::wstring ws = std::wstring(pdfFile->ToString()->Data());
-		s.assign(ws.begin(), ws.end());
-		FSCRT_BSTRC(filename, "D:/1.pdf");
-		iRet = FSCRT_File_CreateFromFileName(&filename, FSCRT_FILEMODE_READONLY, &sdkFile);*/
+		FS_BOOL bAvail = 0;
+		while ((iRet = FSPDF_Doc_IsDocAvail(sdkDoc, &bAvail)) == FSCRT_ERRCODE_DATANOTREADY || (iRet == FSCRT_ERRCODE_SUCCESS && !bAvail))
+		{
+			if (m_pProgressiveFile->HasFailed())
+				return FSCRT_ERRCODE_FILE;
+			m_pProgressiveFile->WaitForData(50);
+			reportProgress();
+		}
+		if (iRet != FSCRT_ERRCODE_SUCCESS)
+			return iRet;
+
+		//A linearized file carries its first page right after the header, show it without waiting for the rest.
+		FS_INT32 iLinearized = FSPDF_DOC_LINEARIZED_UNKNOW;
+		m_iFirstAvailPage = 0;
+		while ((iRet = FSPDF_Doc_IsLinearized(sdkDoc, &iLinearized)) == FSCRT_ERRCODE_DATANOTREADY && !m_pProgressiveFile->HasFailed())
+			m_pProgressiveFile->WaitForData(50);
+		if (iRet == FSCRT_ERRCODE_SUCCESS && iLinearized == FSPDF_DOC_LINEARIZED_YES)
+		{
+			FS_INT32 iPageIndex = -1;
+			while ((iRet = FSPDF_Doc_GetFirstAvailPageIndex(sdkDoc, &iPageIndex)) == FSCRT_ERRCODE_DATANOTREADY && !m_pProgressiveFile->HasFailed())
+				m_pProgressiveFile->WaitForData(50);
+			if (iRet == FSCRT_ERRCODE_SUCCESS && iPageIndex >= 0)
+				m_iFirstAvailPage = iPageIndex;
+		}
 
+		iRet = WaitForPageData(m_iFirstAvailPage);
+		reportProgress();
 		return iRet;
 	});
 }
 
+FS_RESULT FSDK_Document::WaitForPageData(int32 iPageIndex, const CMy_CancelToken* pCancel)
+{
+	FSCRT_DOCUMENT sdkDoc = (FSCRT_DOCUMENT)m_hDoc.pointer;
+	if (!m_pProgressiveFile || !sdkDoc)
+		return FSCRT_ERRCODE_SUCCESS;
+
+	FS_BOOL bAvail = 0;
+	FS_RESULT iRet;
+	while ((iRet = FSPDF_Doc_IsPageAvail(sdkDoc, iPageIndex, &bAvail)) == FSCRT_ERRCODE_DATANOTREADY || (iRet == FSCRT_ERRCODE_SUCCESS && !bAvail))
+	{
+		if (m_pProgressiveFile->HasFailed())
+			return FSCRT_ERRCODE_FILE;
+		if (pCancel && pCancel->IsCancelled())
+			return FSDK_ERRCODE_CANCELLED;
+		m_pProgressiveFile->WaitForData(50);
+	}
+	return iRet;
+}
+
+bool FSDK_Document::IsPageAvailable(int32 iPageIndex)
+{
+	FSCRT_DOCUMENT sdkDoc = (FSCRT_DOCUMENT)m_hDoc.pointer;
+	if (!m_pProgressiveFile || !sdkDoc)
+		return true;
+
+	FS_BOOL bAvail = 0;
+	return FSPDF_Doc_IsPageAvail(sdkDoc, iPageIndex, &bAvail) == FSCRT_ERRCODE_SUCCESS && bAvail;
+}
+
+int32 FSDK_Document::GetFirstAvailablePageIndex()
+{
+	return m_iFirstAvailPage;
+}
+
+ProgressiveStats FSDK_Document::GetProgressiveStats()
+{
+	FSDK_ProgressiveStats stats;
+	memset(&stats, 0, sizeof(stats));
+	if (m_pProgressiveFile)
+		stats = m_pProgressiveFile->GetStats();
+
+	ProgressiveStats result;
+	result.FileSize = (int64)stats.fileSize;
+	result.BytesAvailable = (int64)stats.bytesAvailable;
+	result.HintsReceived = (int64)stats.hintsReceived;
+	result.HintedBytes = (int64)stats.hintedBytes;
+	result.BackgroundBytes = (int64)stats.backgroundBytes;
+	result.Fetches = (int64)stats.fetches;
+	return result;
+}
+
+bool FSDK_Document::StartIoTrace(Platform::String^ tracePath)
+{
+	if (nullptr == tracePath)
+		return false;
+
+	//Reuse the recorder of an opened document, its tracing handlers then write to the new trace.
+	if (!m_pIoTrace)
+		m_pIoTrace = new CMy_IoTraceRecorder();
+	if (!m_pIoTrace->Open(ToUtf8String(tracePath).c_str()))
+	{
+		StopIoTrace();
+		return false;
+	}
+	return true;
+}
+
+void FSDK_Document::StopIoTrace()
+{
+	//The tracing handlers keep their pointer until the document is released, a closed recorder ignores them.
+	if (m_pIoTrace)
+		m_pIoTrace->Close();
+	if (!m_pTracingFile && !m_pTracingFileL && m_pIoTrace)
+	{
+		delete m_pIoTrace;
+		m_pIoTrace = NULL;
+	}
+}
+
+FS_RESULT FSDK_Document::LoadDocument(FSCRT_FILE sdkFile)
+{
+	if (!m_iMemoryDocId)
+		m_iMemoryDocId = GetSDKMemory()->AddDocument();
+	CMy_MemoryScope memoryScope(GetSDKMemory(), m_iMemoryDocId, -1, FSDK_MEMOP_OPEN);
+
+	FSCRT_DOCUMENT sdkDoc;
+	//Load PDF document
+	FS_RESULT iRet = FSPDF_Doc_StartLoad(sdkFile, NULL, &sdkDoc, NULL);
+	if (iRet != FSCRT_ERRCODE_SUCCESS)
+	{
+		return iRet;
+	}
+	NoteHandleCreated(FSDK_HANDLE_DOCUMENT, sdkDoc);
+
+	DocHandle CurDoc;
+	FileHandle CurFile;
+	CurDoc.pointer = (int64)sdkDoc;
+	CurFile.pointer = (int64)sdkFile;
+
+	m_hFile = CurFile;
+	m_hDoc = CurDoc;
+	RegisterMemoryConsumers();
+
+	return iRet;
+}
+
+void FSDK_Document::RegisterMemoryConsumers()
+{
+	UnregisterMemoryConsumers();
+	CMy_MemoryGovernor* pGovernor = GetMemoryGovernor();
+	CMy_BlockCache* pReadCache = m_pFileReader ? m_pFileReader->GetReadCache() : NULL;
+	if (pReadCache)
+	{
+		m_pReadCacheConsumer = new CMy_ReadCacheConsumer(pReadCache);
+		pGovernor->Register(m_pReadCacheConsumer, "readcache", FSDK_RECLAIM_READCACHE, FSDK_PRESSURE_ELEVATED);
+	}
+	if (m_hDoc.pointer)
+	{
+		m_pDocCacheConsumer = new CMy_DocumentCacheConsumer((FSCRT_DOCUMENT)m_hDoc.pointer);
+		pGovernor->Register(m_pDocCacheConsumer, "document", FSDK_RECLAIM_DOCUMENTCACHE, FSDK_PRESSURE_HIGH);
+		pGovernor->Register(m_pPageCache, "pagecache", FSDK_RECLAIM_PAGECACHE, FSDK_PRESSURE_ELEVATED);
+		pGovernor->Register(m_pTextPageCache, "textpagecache", FSDK_RECLAIM_TEXTPAGECACHE, FSDK_PRESSURE_ELEVATED);
+	}
+}
+
+void FSDK_Document::UnregisterMemoryConsumers()
+{
+	//Unregister waits for a release in progress, after that the consumers can go.
+	if (m_pReadCacheConsumer)
+	{
+		GetMemoryGovernor()->Unregister(m_pReadCacheConsumer);
+		delete m_pReadCacheConsumer;
+		m_pReadCacheConsumer = NULL;
+	}
+	if (m_pDocCacheConsumer)
+	{
+		GetMemoryGovernor()->Unregister(m_pDocCacheConsumer);
+		delete m_pDocCacheConsumer;
+		m_pDocCacheConsumer = NULL;
+	}
+	GetMemoryGovernor()->Unregister(m_pPageCache);
+	GetMemoryGovernor()->Unregister(m_pTextPageCache);
+}
+
 FS_RESULT FSDK_Document::LoadPageSync(int32 iPageIndex)
 {
+	return LoadPage(iPageIndex, NULL, nullptr);
+}
+
+IAsyncOperationWithProgress<FS_RESULT, int>^ FSDK_Document::LoadPageAsync(int32 iPageIndex)
+{
+	return create_async([=](progress_reporter<int> reporter, cancellation_token token)->FS_RESULT
+	{
+		CMy_CancelLink cancel(token);
+		int iLastPercent = -1;
+		FS_RESULT iRet = LoadPage(iPageIndex, cancel.Get(), [&reporter, &iLastPercent](FSCRT_PROGRESS progress)
+		{
+			FS_INT32 iPercent = 0;
+			if (FSCRT_Progress_GetPercent(progress, &iPercent) == FSCRT_ERRCODE_SUCCESS && iPercent != iLastPercent)
+			{
+				reporter.report((int)iPercent);
+				iLastPercent = iPercent;
+			}
+		});
+		cancel.ThrowIfCancelled();
+		//A page from the page cache reports nothing until here.
+		if (iRet == FSCRT_ERRCODE_SUCCESS && iLastPercent != 100)
+			reporter.report(100);
+		return iRet;
+	});
+}
+
+FS_RESULT FSDK_Document::LoadPage(int32 iPageIndex, const CMy_CancelToken* pCancel, const std::function<void(FSCRT_PROGRESS)>& onSlice)
+{
+	//A load superseded while it waited for the lock has nothing left to do.
+	std::lock_guard<std::mutex> lock(m_LoadLock);
+	if (pCancel && pCancel->IsCancelled())
+		return FSDK_ERRCODE_CANCELLED;
+	//A prefetch may be parsing the very page, it stops within milliseconds.
+	m_pPrefetcher->Cancel();
+	if (m_pDocCacheConsumer)
+		m_pDocCacheConsumer->Touch();
+	//The previous page stays in the page cache.
+	FS_RESULT iRet = ParsePage(iPageIndex, pCancel, onSlice);
+	//Out of memory: drop caches, reopen the document and try once more.
+	if (IsOutOfMemoryResult(iRet) && RecoverFromOutOfMemory() == FSCRT_ERRCODE_SUCCESS)
+		iRet = ParsePage(iPageIndex, pCancel, onSlice);
+	return iRet;
+}
+
+FS_RESULT FSDK_Document::ParsePage(int32 iPageIndex, const CMy_CancelToken* pCancel, const std::function<void(FSCRT_PROGRESS)>& onSlice)
+{
+	CMy_MemoryScope memoryScope(GetSDKMemory(), m_iMemoryDocId, iPageIndex, FSDK_MEMOP_PARSE);
+	//Pages of a progressively opened document can only be parsed once their data is here.
+	FS_RESULT iRet = WaitForPageData(iPageIndex, pCancel);
+	if (iRet != FSCRT_ERRCODE_SUCCESS)
+	{
+		return iRet;
+	}
+	std::shared_ptr<FSDK_CachedPage> pPage;
+	iRet = GetParsedPage(iPageIndex, pCancel, pPage, onSlice);
+	if (iRet != FSCRT_ERRCODE_SUCCESS)
+	{
+		return iRet;
+	}
+	//The parse may have finished as it was cancelled; the page stays in the cache but doesn't become current.
+	if (pCancel && pCancel->IsCancelled())
+	{
+		return FSDK_ERRCODE_CANCELLED;
+	}
+	PageHandle CurPage;
+	CurPage.pointer = (int64)pPage->page;
+
+	std::atomic_store(&m_pCurPage, pPage);
+	m_hPage = CurPage;
+	m_iCurPageIndex = iPageIndex;
+	return FSCRT_ERRCODE_SUCCESS;
+}
+
+FS_RESULT FSDK_Document::GetParsedPage(int32 iPageIndex, const CMy_CancelToken* pCancel, std::shared_ptr<FSDK_CachedPage>& pPage,
+	const std::function<void(FSCRT_PROGRESS)>& onSlice)
+{
+	pPage = m_pPageCache->Lookup(iPageIndex);
+	if (pPage)
+		return FSCRT_ERRCODE_SUCCESS;
+	//Another thread may have parsed the page while this one waited. Find also returns a page dropped from the cache
+	//that a render still holds: its handle is the one FSPDF_Doc_GetPage would return, it must not be parsed again.
+	std::lock_guard<std::mutex> lock(m_ParseLock);
+	pPage = m_pPageCache->Find(iPageIndex);
+	if (pPage)
+		return FSCRT_ERRCODE_SUCCESS;
+	//A parsed page can't be parsed further, a text-only one is cleared first. It shares the handle with the page
+	//parsed now, so an extraction still reading it is waited for.
+	FSCRT_PAGE textPage = m_pTextPageCache->Take(iPageIndex);
+	if (textPage)
+		ReleaseParsedPage(textPage);
+	FSCRT_PAGE pageGet = NULL;
+	uint64_t nBytes = 0;
+	FS_RESULT iRet = ParsePageHandle(iPageIndex, FSPDF_PAGEPARSEFLAG_NORMAL, pCancel, &pageGet, &nBytes, onSlice);
+	if (iRet != FSCRT_ERRCODE_SUCCESS)
+		return iRet;
+	pPage = m_pPageCache->Insert(iPageIndex, pageGet, nBytes);
+	return FSCRT_ERRCODE_SUCCESS;
+}
+
+FS_RESULT FSDK_Document::GetTextPage(int32 iPageIndex, const CMy_CancelToken* pCancel, std::shared_ptr<FSDK_CachedPage>& pPage)
+{
+	//A fully parsed page has its text too. Looking it up doesn't count for the page cache.
+	pPage = m_pPageCache->Find(iPageIndex);
+	if (pPage)
+		return FSCRT_ERRCODE_SUCCESS;
+	pPage = m_pTextPageCache->Lookup(iPageIndex);
+	if (pPage)
+		return FSCRT_ERRCODE_SUCCESS;
+	//The document can't close while m_ParseLock is held. Extractions don't take m_LoadLock, so they wait for the
+	//page data here.
+	std::lock_guard<std::mutex> lock(m_ParseLock);
+	FSCRT_DOCUMENT sdkDoc = (FSCRT_DOCUMENT)m_hDoc.pointer;
+	FS_INT32 nPages = 0;
+	if (!sdkDoc)
+		return FSCRT_ERRCODE_ERROR;
+	FS_RESULT iRet = FSPDF_Doc_CountPages(sdkDoc, &nPages);
+	if (iRet != FSCRT_ERRCODE_SUCCESS)
+		return iRet;
+	if (iPageIndex < 0 || iPageIndex >= nPages)
+		return FSCRT_ERRCODE_PARAM;
+	pPage = m_pPageCache->Find(iPageIndex);
+	if (!pPage)
+		pPage = m_pTextPageCache->Find(iPageIndex);
+	if (pPage)
+		return FSCRT_ERRCODE_SUCCESS;
+	iRet = WaitForPageData(iPageIndex, pCancel);
+	if (iRet != FSCRT_ERRCODE_SUCCESS)
+		return iRet;
+	FSCRT_PAGE pageGet = NULL;
+	uint64_t nBytes = 0;
+	iRet = ParsePageHandle(iPageIndex, FSPDF_PAGEPARSEFLAG_TEXTONLY, pCancel, &pageGet, &nBytes);
+	if (iRet != FSCRT_ERRCODE_SUCCESS)
+		return iRet;
+	pPage = m_pTextPageCache->Insert(iPageIndex, pageGet, nBytes);
+	return FSCRT_ERRCODE_SUCCESS;
+}
+
+FS_RESULT FSDK_Document::ParsePageHandle(int32 iPageIndex, FS_DWORD dwParseFlags, const CMy_CancelToken* pCancel, FSCRT_PAGE* pPage, uint64_t* pBytes,
+	const std::function<void(FSCRT_PROGRESS)>& onSlice)
+{
+	CMy_MemoryScope memoryScope(GetSDKMemory(), m_iMemoryDocId, iPageIndex, FSDK_MEMOP_PARSE);
 	FS_RESULT iRet = FSCRT_ERRCODE_ERROR;
 	FSCRT_PAGE pageGet;
 	FSCRT_DOCUMENT sdkDoc = (FSCRT_DOCUMENT)m_hDoc.pointer;
+	*pPage = NULL;
+	*pBytes = 0;
+	//What the page's parse tag holds before, the page's own memory is what it adds.
+	FSDK_MemoryUsage before;
+	GetSDKMemory()->GetPageUsage(m_iMemoryDocId, iPageIndex, FSDK_MEMOP_PARSE, &before);
 	//Get page with specific page index.
 	iRet = FSPDF_Doc_GetPage(sdkDoc, iPageIndex, &pageGet);
 	if (iRet != FSCRT_ERRCODE_SUCCESS)
@@ -380,111 +1772,553 @@ FS_RESULT FSDK_Document::LoadPageSync(int32 iPageIndex)
 
 	//Start to parse page
 	FSCRT_PROGRESS progressParse = NULL;
-	iRet = FSPDF_Page_StartParse(pageGet, FSPDF_PAGEPARSEFLAG_NORMAL, &progressParse);
+	iRet = FSPDF_Page_StartParse(pageGet, dwParseFlags, &progressParse);
+	NoteHandleCreated(FSDK_HANDLE_PROGRESS, progressParse);
+	if (iRet == FSCRT_ERRCODE_SUCCESS)
+	{
+		//Continue parsing page. Without onSlice, slices only end early when the parse is cancelled.
+		CMy_TimeSlicePause pause(onSlice ? FSDK_PARSE_SLICEMS : 0, pCancel);
+		iRet = pause.Run(progressParse, onSlice);
+	}
+	if (progressParse)
+	{
+		NoteHandleReleased(progressParse);
+		FSCRT_Progress_Release(progressParse);
+	}
+	//A page that failed to parse keeps whatever content was loaded, drop it. Nobody else holds the handle, the
+	//caller found no entry for the page.
 	if (iRet != FSCRT_ERRCODE_FINISHED)
 	{
+		FSPDF_Page_Clear(pageGet);
+		return iRet;
+	}
+	NoteHandleCreated(FSDK_HANDLE_PAGE, pageGet);
+	//Text extraction only gets the page handle, let it find the page's tags.
+	GetSDKMemory()->BindPage(pageGet, m_iMemoryDocId, iPageIndex);
+	FSDK_MemoryUsage after;
+	GetSDKMemory()->GetPageUsage(m_iMemoryDocId, iPageIndex, FSDK_MEMOP_PARSE, &after);
+	*pPage = pageGet;
+	*pBytes = after.liveBytes > before.liveBytes ? after.liveBytes - before.liveBytes : 0;
+	return FSCRT_ERRCODE_SUCCESS;
+}
+
+FS_RESULT FSDK_Document::ReopenDocument()
+{
+	StorageFile^ pdfFile = m_SourceFile;
+	bool bMapped = m_pMappedFile != NULL;
+	int64 iFileSize = m_iBaseFileSize + m_iAppendedSize;
+
+	//Keep an I/O trace running across the reopen.
+	CMy_IoTraceRecorder* pIoTrace = m_pIoTrace;
+	m_pIoTrace = NULL;
+	CloseDocument();
+	m_pIoTrace = pIoTrace;
+
+	if (bMapped)
+		return OpenMappedDocument(pdfFile);
+	return OpenLargeDocument(pdfFile, iFileSize);
+}
+
+FS_RESULT FSDK_Document::RecoverFromOutOfMemory()
+{
+	FSCRT_DOCUMENT sdkDoc = (FSCRT_DOCUMENT)m_hDoc.pointer;
+	if (!sdkDoc)
+		return FSCRT_ERRCODE_ERROR;
+	//A progressively opened document would have to be fetched again.
+	if (m_pProgressiveFile || nullptr == m_SourceFile)
+		return FSCRT_ERRCODE_UNSUPPORTED;
+
+	OutputDebugString(L"Out of memory, reopening document\n");
+	int32 iPageIndex = m_iCurPageIndex;
+	//Nothing else may use the document while the SDK recovers.
+	m_pPrefetcher->Cancel();
+
+	//Let the SDK roll back what it can, then drop its caches before closing.
+	if (m_hPage.pointer)
+		FSCRT_Library_TriggerRecover((FS_LPVOID)m_hPage.pointer, FSCRT_OBJECTTYPE_PAGE);
+	FSCRT_Library_OOMRecover(sdkDoc, FSCRT_OBJECTTYPE_DOCUMENT);
+	FSPDF_Doc_ClearCache(sdkDoc);
+
+	FS_RESULT iRet = ReopenDocument();
+	if (iRet == FSCRT_ERRCODE_SUCCESS && iPageIndex >= 0)
+		iRet = ParsePage(iPageIndex);
+	if (iRet == FSCRT_ERRCODE_SUCCESS)
+		GetSDKMemory()->GetBudget()->NoteRecovery();
+	else
+		OutputDebugString(L"Out of memory recovery ERROR!!!!!\n");
+	return iRet;
+}
+
+FS_RESULT FSDK_Document::RecoverForRender(int32 iPageIndex, std::shared_ptr<FSDK_CachedPage>& pPage)
+{
+	std::lock_guard<std::mutex> lock(m_LoadLock);
+	FS_RESULT iRet = RecoverFromOutOfMemory();
+	if (iRet != FSCRT_ERRCODE_SUCCESS)
+		return iRet;
+	//The current page may be another one by now, the render is for its own page.
+	return GetParsedPage(iPageIndex, NULL, pPage);
+}
+
+void FSDK_Document::SetPrefetchDepth(int32 iDepth)
+{
+	m_iPrefetchDepth = iDepth < 0 ? 0 : iDepth;
+	if (m_iPrefetchDepth == 0)
+		m_pPrefetcher->Cancel();
+}
+
+void FSDK_Document::SetPageCacheLimits(int32 iMaxPages, int64 nBudgetBytes)
+{
+	m_pPageCache->SetLimits(iMaxPages > 0 ? (size_t)iMaxPages : 0, nBudgetBytes > 0 ? (uint64_t)nBudgetBytes : 0);
+}
+
+PageCacheStats FSDK_Document::GetPageCacheStats()
+{
+	FSDK_PageCacheStats stats = m_pPageCache->GetStats();
+	PageCacheStats result;
+	result.Hits = (int64)stats.hits;
+	result.Misses = (int64)stats.misses;
+	result.Evictions = (int64)stats.evictions;
+	result.Pages = (int64)stats.pages;
+	result.Bytes = (int64)stats.bytes;
+	result.MaxPages = (int64)stats.maxPages;
+	result.BudgetBytes = (int64)stats.budgetBytes;
+	return result;
+}
+
+//All the text of a parsed page, nullptr if the SDK fails to read it.
+static Platform::String^ GetPageText(FSCRT_PAGE page)
+{
+	CMy_MemoryScope memoryScope(GetSDKMemory(), (const void*)page, FSDK_MEMOP_TEXT);
+	FSPDF_TEXTPAGE textPage = NULL;
+	if (FSPDF_TextPage_Load(page, &textPage) != FSCRT_ERRCODE_SUCCESS)
+		return nullptr;
+	NoteHandleCreated(FSDK_HANDLE_TEXTPAGE, textPage);
+
+	Platform::String^ text = nullptr;
+	FSCRT_BSTR chars;
+	FSCRT_BStr_Init(&chars);
+	FS_INT32 nChars = 0;
+	if (FSPDF_TextPage_CountChars(textPage, &nChars) == FSCRT_ERRCODE_SUCCESS)
+	{
+		if (nChars <= 0)
+			text = ref new Platform::String();
+		else if (FSPDF_TextPage_GetChars(textPage, 0, nChars, &chars) == FSCRT_ERRCODE_SUCCESS)
+			text = FromUtf8String(chars.str, (int)chars.len);
+	}
+	FSCRT_BStr_Clear(&chars);
+	NoteHandleReleased(textPage);
+	FSPDF_TextPage_Release(textPage);
+	return text;
+}
+
+IAsyncOperation<Platform::String^>^ FSDK_Document::ExtractPageTextAsync(int32 iPageIndex)
+{
+	return create_async([=](cancellation_token token)->Platform::String^
+	{
+		CMy_CancelLink cancel(token);
+		std::shared_ptr<FSDK_CachedPage> pPage;
+		FS_RESULT iRet = GetTextPage(iPageIndex, cancel.Get(), pPage);
+		cancel.ThrowIfCancelled();
 		if (iRet != FSCRT_ERRCODE_SUCCESS)
+			return nullptr;
+		//The page stays alive through pPage even if the cache drops it meanwhile, and the document stays open.
+		return GetPageText(pPage->page);
+	});
+}
+
+void FSDK_Document::SetTextPageCacheLimits(int32 iMaxPages, int64 nBudgetBytes)
+{
+	m_pTextPageCache->SetLimits(iMaxPages > 0 ? (size_t)iMaxPages : 0, nBudgetBytes > 0 ? (uint64_t)nBudgetBytes : 0);
+}
+
+void FSDK_Document::StartPrefetch(int iWidth, int iHeight, int iStartX, int iStartY, int iSizeX, int iSizeY, int iRotation)
+{
+	//A load or close in progress decides what comes next, the next render prefetches again.
+	std::unique_lock<std::mutex> loadLock(m_LoadLock, std::try_to_lock);
+	if (!loadLock.owns_lock())
+		return;
+	FSCRT_DOCUMENT sdkDoc = (FSCRT_DOCUMENT)m_hDoc.pointer;
+	int32 iCurrent = m_iCurPageIndex;
+	int32 iDepth = m_iPrefetchDepth;
+	if (!sdkDoc || iCurrent < 0 || iDepth <= 0)
+		return;
+	FS_INT32 nPages = 0;
+	if (FSPDF_Doc_CountPages(sdkDoc, &nPages) != FSCRT_ERRCODE_SUCCESS)
+		return;
+
+	//Pages too small to tile are only parsed, rendering them takes no time anyway.
+	bool bRender = (int64)iWidth * iHeight > (int64)FSDK_RENDER_TILESIZE * FSDK_RENDER_TILESIZE;
+	m_pPrefetcher->Start([=](const CMy_CancelToken* pCancel)
+	{
+		//Next page first, then the previous one, then further out.
+		for (int32 iStep = 1; iStep <= 2 * iDepth && !pCancel->IsCancelled(); iStep++)
 		{
-			return iRet;
+			int32 iPage = (iStep & 1) ? iCurrent + (iStep + 1) / 2 : iCurrent - iStep / 2;
+			//Pages still being downloaded are left for LoadPageSync to wait for.
+			if (iPage < 0 || iPage >= nPages || !IsPageAvailable(iPage))
+				continue;
+			//A cached page is looked up too, which keeps it ahead of the pages the reader has moved away from.
+			std::shared_ptr<FSDK_CachedPage> pPage;
+			if (GetParsedPage(iPage, pCancel, pPage) != FSCRT_ERRCODE_SUCCESS)
+				continue;
+			//Only the tile cache is filled. Running out of memory here is not worth a recovery, the page just stays unrendered.
+			if (bRender)
+			{
+				CMy_MemoryScope memoryScope(GetSDKMemory(), m_iMemoryDocId, iPage, FSDK_MEMOP_RENDER);
+				RenderTiles(pPage->page, iPage, NULL, 0, iWidth, iHeight, FSCRT_BITMAPFORMAT_32BPP_BGRA, FSPDF_PAGERENDERFLAG_NORMAL,
+					iStartX, iStartY, iSizeX, iSizeY, iRotation, FSDK_RENDER_TILESIZE, nullptr, pCancel);
+			}
 		}
-		//Continue parsing page.
-		//If want to do progressive saving, please use the second parameter of FSCRT_Progress_Continue.
-		//See FSCRT_Progress_Continue for more details.
-		iRet = FSCRT_Progress_Continue(progressParse, NULL);
-		FSCRT_Progress_Release(progressParse);
+	});
+}
+
+bool FSDK_Document::GetRenderBitmapData(PixelSource^ pxsrc, int iStartX, int iStartY, int iSizeX, int iSizeY, int iRotation, int iFormat,
+	const CMy_CancelToken* pCancel)
+{
+	//Render straight into a pooled buffer, which is handed to pxsrc as it is.
+	FSDK_PixelBuffer* pPixels = GetPixelBufferPool()->Acquire(pxsrc->Width, pxsrc->Height, 4);
+	if (!pPixels)
+	{
+		return false;
 	}
-	PageHandle CurPage;
-	CurPage.pointer = (int64)pageGet;
+	FS_RESULT iRet = RenderPixels(pPixels->data, pPixels->stride, pxsrc->Width, pxsrc->Height, iFormat, FSPDF_PAGERENDERFLAG_NORMAL,
+		iStartX, iStartY, iSizeX, iSizeY, iRotation, pCancel);
+	if (FSCRT_ERRCODE_SUCCESS != iRet)
+	{
+		GetPixelBufferPool()->Release(pPixels);
+		return false;
+	}
+	pxsrc->Format = iFormat == FSCRT_BITMAPFORMAT_32BPP_BGRA ? PixelFormat::BGRA : PixelFormat::RGBx;
+	pxsrc->Stride = pPixels->stride;
+	pxsrc->PixelBuffer = WrapPixelBuffer(pPixels);
+	return nullptr != pxsrc->PixelBuffer;
+}
 
-	m_hPage = CurPage;
+SoftwareBitmap^ FSDK_Document::RenderSoftwareBitmap(int iWidth, int iHeight, int iStartX, int iStartY, int iSizeX, int iSizeY, int iRotation,
+	FS_INT32 iRenderFlags, const CMy_CancelToken* pCancel)
+{
+	if (iWidth <= 0 || iHeight <= 0)
+		return nullptr;
+	//The SDK renders into the bitmap's own memory, with the bitmap's stride.
+	SoftwareBitmap^ bitmap = ref new SoftwareBitmap(BitmapPixelFormat::Bgra8, iWidth, iHeight, BitmapAlphaMode::Premultiplied);
+	BitmapBuffer^ buffer = bitmap->LockBuffer(BitmapBufferAccessMode::Write);
+	IMemoryBufferReference^ reference = buffer->CreateReference();
+	Microsoft::WRL::ComPtr<Windows::Foundation::IMemoryBufferByteAccess> byteAccess;
+	byte* pBytes = NULL;
+	UINT32 nCapacity = 0;
+	FS_RESULT iRet = FSCRT_ERRCODE_ERROR;
+	if (SUCCEEDED(reinterpret_cast<IInspectable*>(reference)->QueryInterface(IID_PPV_ARGS(&byteAccess))) && SUCCEEDED(byteAccess->GetBuffer(&pBytes, &nCapacity)))
+	{
+		BitmapPlaneDescription plane = buffer->GetPlaneDescription(0);
+		iRet = RenderPixels(pBytes + plane.StartIndex, plane.Stride, plane.Width, plane.Height, FSCRT_BITMAPFORMAT_32BPP_BGRA, iRenderFlags,
+			iStartX, iStartY, iSizeX, iSizeY, iRotation, pCancel);
+	}
+	//Closing the reference and the buffer unlocks the bitmap.
+	byteAccess = nullptr;
+	delete reference;
+	delete buffer;
+	return FSCRT_ERRCODE_SUCCESS == iRet ? bitmap : nullptr;
+}
+
+FS_RESULT FSDK_Document::RenderPixels(uint8_t* pDest, int32_t iStride, int32_t iWidth, int32_t iHeight, int32_t iFormat, FS_INT32 iRenderFlags,
+	int iStartX, int iStartY, int iSizeX, int iSizeY, int iRotation, const CMy_CancelToken* pCancel)
+{
+	//The page stays alive for the whole render, even if another page is loaded meanwhile.
+	std::shared_ptr<FSDK_CachedPage> pPage = std::atomic_load(&m_pCurPage);
+	FSCRT_PAGE pdfPage = pPage ? pPage->page : NULL;
+	int32 iPageIndex = pPage ? pPage->pageIndex : -1;
+	CMy_MemoryScope memoryScope(GetSDKMemory(), m_iMemoryDocId, iPageIndex, FSDK_MEMOP_RENDER);
+	if (m_pDocCacheConsumer)
+		m_pDocCacheConsumer->Touch();
+	//Large areas are split into tiles and rendered on all cores.
+	if ((int64)iWidth * iHeight > (int64)FSDK_RENDER_TILESIZE * FSDK_RENDER_TILESIZE)
+	{
+		FS_RESULT iRet = RenderTiles(pdfPage, iPageIndex, pDest, iStride, iWidth, iHeight, iFormat, iRenderFlags,
+			iStartX, iStartY, iSizeX, iSizeY, iRotation, FSDK_RENDER_TILESIZE, nullptr, pCancel);
+		if (IsOutOfMemoryResult(iRet) && pPage)
+		{
+			//The reopened document has pages of its own, this one must be let go before the old one closes.
+			pPage.reset();
+			iRet = RecoverForRender(iPageIndex, pPage);
+			if (iRet == FSCRT_ERRCODE_SUCCESS)
+				iRet = RenderTiles(pPage->page, iPageIndex, pDest, iStride, iWidth, iHeight, iFormat, iRenderFlags,
+					iStartX, iStartY, iSizeX, iSizeY, iRotation, FSDK_RENDER_TILESIZE, nullptr, pCancel);
+		}
+		return iRet;
+	}
+	//Slices only end early when the render is cancelled.
+	CMy_TimeSlicePause pause(0, pCancel);
+	FSCRT_BITMAP renderBmp = NULL;
+	FS_RESULT iRet = FSDK_PageToBitmap(pdfPage, iWidth, iHeight, iStartX, iStartY, iSizeX, iSizeY, iRotation, &renderBmp,
+		pDest, iStride, iFormat, &pause, iRenderFlags);
+	//Out of memory: drop caches, reopen the document and render the reloaded page once more.
+	if (IsOutOfMemoryResult(iRet) && pPage)
+	{
+		pPage.reset();
+		iRet = RecoverForRender(iPageIndex, pPage);
+		if (iRet == FSCRT_ERRCODE_SUCCESS)
+			iRet = FSDK_PageToBitmap(pPage->page, iWidth, iHeight, iStartX, iStartY, iSizeX, iSizeY, iRotation, &renderBmp,
+				pDest, iStride, iFormat, &pause, iRenderFlags);
+	}
+	if (FSCRT_ERRCODE_SUCCESS != iRet)
+		return iRet;
+	//The bitmap is only a view of pDest, releasing it leaves the pixels alone.
+	NoteHandleReleased(renderBmp);
+	FSCRT_Bitmap_Release(renderBmp);
 	return FSCRT_ERRCODE_SUCCESS;
 }
 
-bool FSDK_Document::GetRenderBitmapData(PixelSource^ pxsrc, int iStartX, int iStartY, int iSizeX, int iSizeY, int iRotation)
-{
-	FSCRT_BITMAP renderBmp = NULL;
-	FSCRT_PAGE pdfPage = (FSCRT_PAGE)m_hPage.pointer;
-	//Render page to SDK bitmap.
-	FS_RESULT iRet = FSDK_PageToBitmap(pdfPage, pxsrc->Width, pxsrc->Height, iStartX, iStartY, iSizeX, iSizeY, iRotation, &renderBmp);
-	if (FSCRT_ERRCODE_SUCCESS != iRet)
+FS_RESULT FSDK_Document::RenderTiles(FSCRT_PAGE pdfPage, int32 iPageIndex, uint8_t* pDest, int32_t iStride, int32_t iWidth, int32_t iHeight,
+	int32_t iFormat, FS_INT32 iRenderFlags, int iStartX, int iStartY, int iSizeX, int iSizeY, int iRotation, int iTileSize,
+	const std::function<void(const FSDK_TileRect&)>& onTile, const CMy_CancelToken* pCancel)
+{
+	if (!pdfPage || iWidth <= 0 || iHeight <= 0 || iSizeX <= 0 || iSizeY <= 0)
+		return FSCRT_ERRCODE_PARAM;
+
+	FSDK_TileRenderParams params;
+	memset(&params, 0, sizeof(params));
+	params.page = pdfPage;
+	params.width = iWidth;
+	params.height = iHeight;
+	params.format = iFormat;
+	params.tileSize = iTileSize > 0 ? iTileSize : FSDK_RENDER_TILESIZE;
+	params.contextFlags = FSPDF_RENDERCONTEXTFLAG_ANNOT;
+	params.renderFlags = iRenderFlags;
+	params.pAccounting = GetSDKMemory();
+	params.pCancel = pCancel;
+	//One matrix for the whole area, every tile renders with it moved to its own corner.
+	FS_RESULT iRet = FSPDF_Page_GetMatrix(pdfPage, iStartX, iStartY, iSizeX, iSizeY, iRotation, &params.matrix);
+	if (iRet != FSCRT_ERRCODE_SUCCESS)
+		return iRet;
+
+	size_t nStride = (size_t)iStride;
+	//Tiles are anchored at the page's corner, not the view's, so the same tiles come back wherever the page is
+	//scrolled to. Tiles on the page's right and bottom edges are cut to the page; the view around the page stays white.
+	int32_t width = params.width;
+	int32_t height = params.height;
+	int32_t tileSize = params.tileSize;
+	if (pDest && (iStartX > 0 || iStartY > 0 || iStartX + iSizeX < width || iStartY + iSizeY < height))
+		memset(pDest, 0xff, nStride * height);
+	int32_t firstX = FloorDiv(-iStartX, tileSize);
+	int32_t lastX = FloorDiv(width - 1 - iStartX, tileSize);
+	int32_t firstY = FloorDiv(-iStartY, tileSize);
+	int32_t lastY = FloorDiv(height - 1 - iStartY, tileSize);
+	if (firstX < 0)
+		firstX = 0;
+	if (firstY < 0)
+		firstY = 0;
+	if (lastX > (iSizeX - 1) / tileSize)
+		lastX = (iSizeX - 1) / tileSize;
+	if (lastY > (iSizeY - 1) / tileSize)
+		lastY = (iSizeY - 1) / tileSize;
+
+	//Copy the part of a tile inside the view and report it.
+	std::function<void(const FSDK_TileRect&, const uint8_t*, int32_t)> copyTile =
+		[pDest, nStride, width, height, &onTile](const FSDK_TileRect& tile, const uint8_t* pSrc, int32_t stride)
 	{
-		return false;
+		FSDK_TileRect visible;
+		visible.x = tile.x > 0 ? tile.x : 0;
+		visible.y = tile.y > 0 ? tile.y : 0;
+		visible.width = (tile.x + tile.width < width ? tile.x + tile.width : width) - visible.x;
+		visible.height = (tile.y + tile.height < height ? tile.y + tile.height : height) - visible.y;
+		if (!pDest || visible.width <= 0 || visible.height <= 0)
+			return;
+		pSrc += (size_t)(visible.y - tile.y) * stride + (size_t)(visible.x - tile.x) * 4;
+		for (int32_t row = 0; row < visible.height; row++)
+			memcpy(pDest + (visible.y + row) * nStride + (size_t)visible.x * 4, pSrc + (size_t)row * stride, (size_t)visible.width * 4);
+		if (onTile)
+			onTile(visible);
+	};
+
+	//Serve what the cache holds, render the rest.
+	CMy_TileCache* pCache = iPageIndex >= 0 ? GetTileCache() : NULL;
+	if (!pDest && !pCache)
+		return FSCRT_ERRCODE_PARAM;
+	FSDK_TileKey key;
+	memset(&key, 0, sizeof(key));
+	key.document = GetContentFingerprint();
+	key.pageIndex = iPageIndex;
+	key.pageWidth = iSizeX;
+	key.pageHeight = iSizeY;
+	key.rotation = iRotation;
+	key.format = iFormat;
+	key.contextFlags = params.contextFlags;
+	key.renderFlags = params.renderFlags;
+	key.tileSize = tileSize;
+	std::vector<FSDK_TileRect> missing;
+	for (int32_t tileY = firstY; tileY <= lastY; tileY++)
+	{
+		for (int32_t tileX = firstX; tileX <= lastX; tileX++)
+		{
+			FSDK_TileRect tile;
+			tile.x = iStartX + tileX * tileSize;
+			tile.y = iStartY + tileY * tileSize;
+			tile.width = iSizeX - tileX * tileSize < tileSize ? iSizeX - tileX * tileSize : tileSize;
+			tile.height = iSizeY - tileY * tileSize < tileSize ? iSizeY - tileY * tileSize : tileSize;
+			key.tileX = tileX;
+			key.tileY = tileY;
+			std::shared_ptr<const FSDK_CachedTile> pCached = pCache ? pCache->Lookup(key) : std::shared_ptr<const FSDK_CachedTile>();
+			if (pCached && pCached->width == tile.width && pCached->height == tile.height)
+				copyTile(tile, &pCached->pixels[0], pCached->stride);
+			else
+				missing.push_back(tile);
+		}
 	}
 
-	//Get data of SDK bitmap.
-	iRet = FSDK_GetSDKBitmapData(renderBmp, pxsrc);
-	FSCRT_Bitmap_Release(renderBmp);
-	if (FSCRT_ERRCODE_SUCCESS != iRet)
+	CMy_TileRenderer renderer(pDest ? GetRenderPool() : NULL);
+	return renderer.Render(params, missing, [pCache, key, iStartX, iStartY, tileSize, &copyTile](const FSDK_TileRect& tile,
+		const uint8_t* pSrc, int32_t stride, uint64_t renderMicros)
 	{
-		return false;
-	}
-	else
+		copyTile(tile, pSrc, stride);
+		if (pCache)
+		{
+			FSDK_TileKey tileKey = key;
+			tileKey.tileX = (tile.x - iStartX) / tileSize;
+			tileKey.tileY = (tile.y - iStartY) / tileSize;
+			pCache->Insert(tileKey, tile.width, tile.height, pSrc, stride, renderMicros);
+		}
+	});
+}
+
+uint64_t FSDK_Document::GetContentFingerprint()
+{
+	//Without a file the accounting id stands in; it is never reused, so tiles of an earlier open can't match.
+	if (nullptr == m_SourceFile)
+		return 0x8000000000000000ULL | m_iMemoryDocId;
+	//FNV-1a over the path and the size, which grows with every incremental save.
+	uint64_t hash = 14695981039346656037ULL;
+	Platform::String^ path = m_SourceFile->Path;
+	for (const wchar_t* p = path->Data(); *p; p++)
 	{
-		return true;
+		hash ^= (uint64_t)*p;
+		hash *= 1099511628211ULL;
 	}
+	hash ^= (uint64_t)(m_iBaseFileSize + m_iAppendedSize);
+	hash *= 1099511628211ULL;
+	return hash & 0x7fffffffffffffffULL;
 }
 
-IObservableVector<Object^>^ FSDK_Document::SaveAsPDF()
+CMy_WriteBuffer* FSDK_Document::SaveAsPDF(FS_DWORD flags, const CMy_CancelToken* pCancel)
 {
 	FSCRT_DOCUMENT pDoc = (FSCRT_DOCUMENT)m_hDoc.pointer;
 	FSCRT_FILE fxFile = (FSCRT_FILE)m_hFile.pointer;
-	if (!pDoc || !fxFile)
-		return nullptr;
+	if (!pDoc || !fxFile || !m_pFileReader)
+		return NULL;
+	CMy_MemoryScope memoryScope(GetSDKMemory(), m_iMemoryDocId, -1, FSDK_MEMOP_SAVE);
+	if (m_pDocCacheConsumer)
+		m_pDocCacheConsumer->Touch();
 
-	Platform::Collections::Vector<Platform::Object^>^ filebytes = nullptr;
+	//Start from an empty buffer; output beyond the threshold goes to the app's temporary folder.
+	m_pFileReader->ReleaseTempWriteBuffer();
+	size_t nThreshold = (uint64_t)m_iSaveMemoryThreshold > (uint64_t)SIZE_MAX ? SIZE_MAX : (size_t)m_iSaveMemoryThreshold;
+	m_pFileReader->SetWriteBufferOptions(nThreshold, ToUtf8String(ApplicationData::Current->TemporaryFolder->Path));
 
 	//Start saving PDF file
 	FSCRT_PROGRESS progress = NULL;
-	FS_RESULT ret = FSPDF_Doc_StartSaveToFile(pDoc, fxFile, FSPDF_SAVEFLAG_INCREMENTAL, &progress);
+	FS_RESULT ret = FSPDF_Doc_StartSaveToFile(pDoc, fxFile, flags, &progress);
 	if (ret == FSCRT_ERRCODE_SUCCESS)
 	{
-		//Continue to finish saving
-		//If want to do progressive saving, please use the second parameter of FSCRT_Progress_Continue.
-		//See FSCRT_Progress_Continue for more details.
-		ret = FSCRT_Progress_Continue(progress, NULL);
+		NoteHandleCreated(FSDK_HANDLE_PROGRESS, progress);
+		//Continue to finish saving. Slices only end early when the save is cancelled.
+		CMy_TimeSlicePause pause(0, pCancel);
+		ret = pause.Run(progress);
 		//Release saving progress object
+		NoteHandleReleased(progress);
 		FSCRT_Progress_Release(progress);
 	}
-
-	if (m_pFileReader)
+	if (ret != FSCRT_ERRCODE_SUCCESS && ret != FSCRT_ERRCODE_FINISHED)
 	{
-		filebytes = ref new Vector<Object^>();
-		filebytes = m_pFileReader->GetFileBuffer();
+		m_pFileReader->ReleaseTempWriteBuffer();
+		return NULL;
 	}
 
-	return filebytes;
+	return m_pFileReader->GetFileBuffer();
 }
 
-concurrency::task<IOutputStream^> FSDK_Document::WriteByteToFile(StorageFile^ file, IObservableVector<Object^>^ fileBytes)
+concurrency::task<bool> FSDK_Document::WriteByteToFile(StorageFile^ file, CMy_WriteBuffer* pFileBytes)
 {
-	std::shared_ptr<DataWriter^> _spDataWriter = std::make_shared<DataWriter^>(nullptr);
-	if (nullptr == file)
+	if (nullptr == file || !pFileBytes)
 	{
-		return create_task([]()->IOutputStream^ {return nullptr; });
+		return create_task([]()->bool {return false; });
 	}
 	auto OpenOp = file->OpenAsync(FileAccessMode::ReadWrite);
-	return create_task(OpenOp).then([=](IRandomAccessStream^ writeStream)
+	return create_task(OpenOp).then([=](IRandomAccessStream^ writeStream)->bool
 	{
+		//Drop whatever was in the file before, then copy the buffer out in large contiguous writes.
+		writeStream->Size = 0;
 		writeStream->Seek(0);
-		*_spDataWriter = ref new DataWriter(writeStream);
-		auto size = fileBytes->Size;
-		for (unsigned int i = 0; i < size; i++)
+
+		const unsigned int nPieceSize = 4 * 1024 * 1024;
+		uint64_t iTotal = pFileBytes->GetSize();
+		Buffer^ piece = ref new Buffer((unsigned int)(iTotal < nPieceSize ? (iTotal ? iTotal : 1) : nPieceSize));
+		byte* pBytes = GetBufferBytes(piece);
+		if (!pBytes)
+			return false;
+
+		bool bOk = true;
+		for (uint64_t pos = 0; bOk && pos < iTotal;)
+		{
+			unsigned int nCount = (unsigned int)(iTotal - pos < piece->Capacity ? iTotal - pos : piece->Capacity);
+			if (!pFileBytes->ReadAt(pos, pBytes, nCount))
+			{
+				bOk = false;
+				break;
+			}
+			piece->Length = nCount;
+			unsigned int nWritten = 0;
+			bOk = WaitForAsync(writeStream->WriteAsync(piece), &nWritten) && nWritten == nCount;
+			pos += nCount;
+		}
+		bool bFlushed = false;
+		if (bOk)
+			bOk = WaitForAsync(writeStream->FlushAsync(), &bFlushed) && bFlushed;
+		delete writeStream;	// Closes the file.
+		return bOk;
+	}).then([=](task<bool> t)->bool
+	{
+		bool bOk = false;
+		try
 		{
-			Platform::Array<unsigned char>^ fileContent = safe_cast<Platform::Array<unsigned char>^>(fileBytes->GetAt(i));
-			(*_spDataWriter)->WriteBytes(fileContent);
+			bOk = t.get();
 		}
-		return (*_spDataWriter)->StoreAsync();
-	}).then([=](unsigned int bytesStored) {
-		return (*_spDataWriter)->FlushAsync();
-	}).then([=](bool flushSucceeded) {
-		fileBytes->Clear();
-		return (*_spDataWriter)->DetachStream();
+		catch (Platform::Exception^)
+		{
+			bOk = false;
+		}
+		m_pFileReader->ReleaseTempWriteBuffer();
+		return bOk;
 	});
 }
 
+void FSDK_Document::SetSaveMemoryThreshold(int64 nBytes)
+{
+	m_iSaveMemoryThreshold = nBytes < 0 ? 0 : nBytes;
+}
+
+ReadCacheStats FSDK_Document::GetReadCacheStats()
+{
+	ReadCacheStats result = { 0 };
+	if (!m_pFileReader)
+		return result;
+
+	FSDK_BlockCacheStats stats = m_pFileReader->GetReadCacheStats();
+	result.Hits = (int64)stats.hits;
+	result.Misses = (int64)stats.misses;
+	result.BytesRequested = (int64)stats.bytesRequested;
+	result.BytesRead = (int64)stats.bytesRead;
+	result.ReadAheadBlocks = (int64)stats.readAheadBlocks;
+	result.SourceReads = (int64)stats.sourceReads;
+	result.MergedReads = (int64)stats.mergedReads;
+	result.PrefetchBytes = (int64)stats.prefetchBytes;
+	result.WastedPrefetchBytes = (int64)stats.wastedPrefetchBytes;
+	result.SequentialReads = (int64)stats.sequentialReads;
+	result.StridedReads = (int64)stats.stridedReads;
+	return result;
+}
+
 Windows::Foundation::IAsyncOperation<Boolean>^ FSDK_Document::SaveAsDocument(Windows::Storage::StorageFile^ file)
 {
-	return concurrency::create_async([=]()
+	return concurrency::create_async([=](cancellation_token token)
 	{
 		if (nullptr == file)
 		{
@@ -492,45 +2326,260 @@ Windows::Foundation::IAsyncOperation<Boolean>^ FSDK_Document::SaveAsDocument(Win
 		}
 		return concurrency::create_task([=]()
 		{
-			Windows::Foundation::Collections::IObservableVector<Object^>^ buffer = SaveAsPDF();
+			//Cancelling only stops producing the data, nothing is written to file by then.
+			CMy_CancelLink cancel(token);
+			CMy_WriteBuffer* buffer = SaveAsPDF(FSPDF_SAVEFLAG_INCREMENTAL, cancel.Get());
+			cancel.ThrowIfCancelled();
 			return buffer;
 		})
-			.then([=](Windows::Foundation::Collections::IObservableVector<Object^>^ fileBytes)
+			.then([=](CMy_WriteBuffer* fileBytes)
 		{
 			return WriteByteToFile(file, fileBytes);
-		})
-			.then([=](concurrency::task<IOutputStream^> t)
-		{
-			if (nullptr == t.get())
-				return false;
-			return true;
 		});
 	});
 }
+
+IAsyncOperationWithProgress<bool, int>^ FSDK_Document::SaveAsDocumentStreamingAsync(StorageFile^ file)
+{
+	return create_async([=](progress_reporter<int> reporter, cancellation_token token)->bool
+	{
+		CMy_CancelLink cancel(token);
+		FSCRT_DOCUMENT pDoc = (FSCRT_DOCUMENT)m_hDoc.pointer;
+		if (nullptr == file || !pDoc)
+			return false;
+		CMy_MemoryScope memoryScope(GetSDKMemory(), m_iMemoryDocId, -1, FSDK_MEMOP_SAVE);
+		if (m_pDocCacheConsumer)
+			m_pDocCacheConsumer->Touch();
+
+		CMy_StorageStreamSink sink;
+		if (!sink.Open(file))
+			return false;
+
+		//The SDK writes into a small fixed set of slots, a background thread moves them to the file.
+		CMy_WriteBehindQueue queue(&sink);
+		if (!queue.Start())
+			return false;
+		CMy_WriteBehindFile destStream;
+		destStream.InitFileHandle(&queue);
+		FSCRT_FILE destFile = NULL;
+		FS_RESULT ret = FSCRT_File_Create_L(&destStream, &destFile);
+		if (ret != FSCRT_ERRCODE_SUCCESS)
+		{
+			queue.Close();
+			return false;
+		}
+
+		//Start saving PDF file
+		FSCRT_PROGRESS progress = NULL;
+		ret = FSPDF_Doc_StartSaveToFile(pDoc, destFile, FSPDF_SAVEFLAG_INCREMENTAL, &progress);
+		if (ret == FSCRT_ERRCODE_SUCCESS)
+		{
+			NoteHandleCreated(FSDK_HANDLE_PROGRESS, progress);
+			//Continue in time slices so progress can be reported in between.
+			CMy_TimeSlicePause pause(100, cancel.Get());
+			int iLastPercent = -1;
+			ret = pause.Run(progress, [&reporter, &iLastPercent](FSCRT_PROGRESS progress)
+			{
+				FS_INT32 iPercent = 0;
+				if (FSCRT_Progress_GetPercent(progress, &iPercent) == FSCRT_ERRCODE_SUCCESS && iPercent != iLastPercent)
+				{
+					reporter.report((int)iPercent);
+					iLastPercent = iPercent;
+				}
+			});
+			//Release saving progress object
+			NoteHandleReleased(progress);
+			FSCRT_Progress_Release(progress);
+		}
+
+		FSCRT_File_Release(destFile);
+		bool bOk = queue.Close() && (ret == FSCRT_ERRCODE_SUCCESS || ret == FSCRT_ERRCODE_FINISHED);
+		sink.Close();
+		//A cancelled save leaves an incomplete file behind.
+		cancel.ThrowIfCancelled();
+		return bOk;
+	});
+}
+
+//Journal of incremental saves to pdfFile, kept in the app's local folder.
+static StorageFile^ OpenAppendJournal(StorageFile^ pdfFile, bool bCreate)
+{
+	wchar_t name[64];
+	swprintf_s(name, L"fsdk_append_%016llx.journal", (unsigned long long)std::hash<std::wstring>()(pdfFile->Path->Data()));
+	StorageFolder^ folder = ApplicationData::Current->LocalFolder;
+	if (bCreate)
+	{
+		StorageFile^ journal = nullptr;
+		if (!WaitForAsync(folder->CreateFileAsync(ref new String(name), CreationCollisionOption::OpenIfExists), &journal))
+			return nullptr;
+		return journal;
+	}
+
+	IStorageItem^ item = nullptr;
+	if (!WaitForAsync(folder->TryGetItemAsync(ref new String(name)), &item))
+		return nullptr;
+	return dynamic_cast<StorageFile^>(item);
+}
+
+void FSDK_Document::RecoverInterruptedAppend(StorageFile^ pdfFile)
+{
+	StorageFile^ journalFile = OpenAppendJournal(pdfFile, false);
+	if (nullptr == journalFile)
+		return;
+
+	CMy_StorageStreamSink journal;
+	CMy_StorageStreamSink target;
+	if (!journal.Open(journalFile, false) || journal.GetSize() == 0 || !target.Open(pdfFile, false))
+		return;
+	if (!CMy_IncrementalAppender::Recover(&journal, &target))
+		OutputDebugString(L"Recovering interrupted incremental save ERROR!!!!!\n");
+}
+
+IAsyncOperation<bool>^ FSDK_Document::SaveIncrementalAsync()
+{
+	return create_async([=](cancellation_token token)->bool
+	{
+		if (nullptr == m_SourceFile)
+			return false;
+
+		//Only the data of increment is produced; it belongs right after the original data.
+		//It can be cancelled until then, the append itself always runs to the end.
+		CMy_WriteBuffer* pDelta = NULL;
+		{
+			CMy_CancelLink cancel(token);
+			pDelta = SaveAsPDF(FSPDF_SAVEFLAG_INCREMENTONLY, cancel.Get());
+			cancel.ThrowIfCancelled();
+		}
+		if (!pDelta)
+			return false;
+
+		CMy_StorageStreamSink target;
+		CMy_StorageStreamSink journal;
+		StorageFile^ journalFile = OpenAppendJournal(m_SourceFile, true);
+		bool bOk = target.Open(m_SourceFile, false);
+		if (bOk)
+		{
+			//Without a journal the append still happens, it just can't be rolled back after a crash.
+			bool bJournal = nullptr != journalFile && journal.Open(journalFile, false);
+			CMy_IncrementalAppender appender(&target, bJournal ? &journal : NULL, (uint64_t)m_iBaseFileSize);
+			FSDK_IncrementalSaveStats stats;
+			bOk = appender.Append(pDelta, (uint64_t)m_iAppendedSize, &stats);
+			if (bOk)
+			{
+				//The file has a new size and so a new fingerprint, tiles of the old one can't be hit any more.
+				GetTileCache()->Invalidate(GetContentFingerprint());
+				m_iAppendedSize = (int64)stats.bytesWritten;
+				m_LastAppendStats = stats;
+			}
+		}
+		m_pFileReader->ReleaseTempWriteBuffer();
+		return bOk;
+	});
+}
+
+static MemoryUsage ToMemoryUsage(int32 iPageIndex, FSDK_MemoryOp op, const FSDK_MemoryUsage& usage)
+{
+	MemoryUsage result;
+	result.PageIndex = iPageIndex;
+	result.Operation = (MemoryOperation)op;
+	result.LiveBytes = (int64)usage.liveBytes;
+	result.PeakBytes = (int64)usage.peakBytes;
+	result.Allocations = (int64)usage.allocCount;
+	result.Frees = (int64)usage.freeCount;
+	return result;
+}
+
+MemoryUsage FSDK_Document::GetMemoryUsage()
+{
+	FSDK_MemoryUsage usage;
+	memset(&usage, 0, sizeof(usage));
+	if (m_iMemoryDocId)
+		GetSDKMemory()->GetDocumentUsage(m_iMemoryDocId, &usage);
+	return ToMemoryUsage(-1, FSDK_MEMOP_OTHER, usage);
+}
+
+Platform::Array<MemoryUsage>^ FSDK_Document::GetMemoryUsageByTag()
+{
+	std::vector<FSDK_MemoryTagUsage> usage;
+	if (m_iMemoryDocId)
+		GetSDKMemory()->GetTagUsage(m_iMemoryDocId, usage);
+
+	Platform::Array<MemoryUsage>^ result = ref new Platform::Array<MemoryUsage>((unsigned int)usage.size());
+	for (size_t i = 0; i < usage.size(); i++)
+		result[(unsigned int)i] = ToMemoryUsage(usage[i].pageIndex, usage[i].op, usage[i].usage);
+	return result;
+}
+
+IncrementalSaveStats FSDK_Document::GetIncrementalSaveStats()
+{
+	IncrementalSaveStats result;
+	result.BytesWritten = (int64)m_LastAppendStats.bytesWritten;
+	result.BytesSkipped = (int64)m_LastAppendStats.bytesSkipped;
+	return result;
+}
 ///////////////////////////////////////////////////////
 
 /* Callback functions for FSCRT_MEMMGRHANDLER*/
 //Extension to allocate memory buffer. Implementation to FSCRT_MEMMGRHANDLER::Alloc
 static FS_LPVOID	FSDK_Alloc(FS_LPVOID clientData, FS_DWORD size)
 {
-	return malloc((size_t)size);
+	void* ptr = ((CMy_MemoryAccounting*)clientData)->Alloc((size_t)size);
+	GetAllocProfiler()->OnAlloc(ptr, (size_t)size);
+	return ptr;
 }
 
 //Extension to reallocate memory buffer. Implementation to FSCRT_MEMMGRHANDLER::Realloc
 static FS_LPVOID	FSDK_Realloc(FS_LPVOID clientData, FS_LPVOID ptr, FS_DWORD newSize)
 {
-	return realloc(ptr, (size_t)newSize);
+	void* newPtr = ((CMy_MemoryAccounting*)clientData)->Realloc(ptr, (size_t)newSize);
+	if (newSize)
+		GetAllocProfiler()->OnRealloc(ptr, newPtr, (size_t)newSize);
+	return newPtr;
 }
 
 //Extension to free memory buffer. Implementation to FSCRT_MEMMGRHANDLER::Free
 static void			FSDK_Free(FS_LPVOID clientData, FS_LPVOID ptr)
 {
-	free(ptr);
+	//Forget the block first, once freed its address can be handed out again.
+	GetAllocProfiler()->OnFree(ptr);
+	((CMy_MemoryAccounting*)clientData)->Free(ptr);
 }
 /* END: Callback functions for FSCRT_MEMMGRHANDLER*/
 
 static FSCRT_MEMMGRHANDLER	g_MemMgrHandler = { NULL, FSDK_Alloc, FSDK_Realloc, FSDK_Free };
 
+/* Callback functions for FSCRT_APPHANDLER*/
+static FS_RESULT	FSDK_CallFunction(FS_LPVOID clientData, FSCRT_DOCUMENT document, FS_INT32 function, FSCRT_VAR* parameters, FS_INT32 count, FSCRT_VAR* ret)
+{
+	return FSCRT_ERRCODE_UNSUPPORTED;
+}
+
+static FS_RESULT	FSDK_OnEvent(FS_LPVOID clientData, FS_LPVOID senderObject, FS_DWORD senderObjectType, FS_DWORD eventType, FS_LPVOID eventData)
+{
+	return FSCRT_ERRCODE_UNSUPPORTED;
+}
+
+//The failing call returns an out-of-memory result, FSDK_Document recovers from there.
+static void			FSDK_OnOutOfMemory(FS_LPVOID clientData)
+{
+	((CMy_MemoryAccounting*)clientData)->GetBudget()->NoteOutOfMemory();
+	OutputDebugString(L"SDK out of memory\n");
+}
+
+//Called from FSCRT_Library_OOMRecover. The document is closed and reopened afterwards, nothing to restore here.
+static FS_RESULT	FSDK_OnRecover(FS_LPVOID clientData, FS_LPVOID senderObject, FS_DWORD senderObjectType)
+{
+	return FSCRT_ERRCODE_SUCCESS;
+}
+/* END: Callback functions for FSCRT_APPHANDLER*/
+
+static FSCRT_APPHANDLER		g_AppHandler = { NULL, FSDK_CallFunction, FSDK_OnEvent, FSDK_OnOutOfMemory, FSDK_OnRecover };
+
+//FSCRT_Library_CreateMgr needs a fixed buffer of at least 8MB. By default keep it at that, everything above goes through g_MemMgrHandler.
+#define FSDK_LIBRARY_ARENASIZE	(8 * 1024 * 1024)
+static void*				g_pLibraryArena = NULL;
+static size_t				g_nLibraryArenaSize = 0;
+
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 Inherited_PDFFunction::Inherited_PDFFunction()
@@ -540,7 +2589,39 @@ Inherited_PDFFunction::Inherited_PDFFunction()
 
 FS_RESULT Inherited_PDFFunction::FSDK_Initialize()
 {
-	FS_RESULT ret = FSCRT_Library_CreateDefaultMgr();
+	return InitializeLibrary(FSDK_LIBRARY_ARENASIZE, true, 0);
+}
+
+FS_RESULT Inherited_PDFFunction::FSDK_InitializeWithBudget(int64 nArenaBytes, int64 nHeapBytes)
+{
+	if (nArenaBytes < FSDK_LIBRARY_ARENASIZE || nArenaBytes > 0xFFFFFFFF || nHeapBytes < 0)
+		return FSCRT_ERRCODE_PARAM;
+	//With no heap allowance the SDK gets no memory manager and the arena alone is the budget.
+	return InitializeLibrary((size_t)nArenaBytes, nHeapBytes > 0, (uint64_t)nHeapBytes);
+}
+
+FS_RESULT Inherited_PDFFunction::InitializeLibrary(size_t nArenaBytes, bool bHeap, uint64_t nHeapLimit)
+{
+	//Serve the SDK's allocations beyond the arena from the pooled size-class allocator, capped by nHeapLimit.
+	CMy_MemoryAccounting* pMemory = GetSDKMemory();
+	pMemory->GetBudget()->SetLimit(nHeapLimit);
+	g_MemMgrHandler.clientData = pMemory;
+	g_AppHandler.clientData = pMemory;
+
+	if (g_pLibraryArena && g_nLibraryArenaSize != nArenaBytes)
+	{
+		free(g_pLibraryArena);
+		g_pLibraryArena = NULL;
+	}
+	if (!g_pLibraryArena)
+		g_pLibraryArena = malloc(nArenaBytes);
+	if (!g_pLibraryArena)
+		return FSCRT_ERRCODE_OUTOFMEMORY;
+	g_nLibraryArenaSize = nArenaBytes;
+
+	FS_RESULT ret = FSCRT_Library_CreateMgr(g_pLibraryArena, (FS_DWORD)nArenaBytes, bHeap ? &g_MemMgrHandler : NULL);
+	if (ret == FSCRT_ERRCODE_SUCCESS)
+		ret = FSCRT_Library_SetAppHandler(&g_AppHandler);
 	if (ret == FSCRT_ERRCODE_SUCCESS)
 	{
 		//Unlock library, otherwise no methods of SDK can be used
@@ -568,19 +2649,178 @@ FS_RESULT Inherited_PDFFunction::FSDK_Initialize()
 	return ret;
 }
 
+MemoryStats Inherited_PDFFunction::GetMemoryStats()
+{
+	FSDK_PoolAllocatorStats stats = CMy_PoolAllocator::GetDefault()->GetStats();
+	MemoryStats result;
+	result.LiveBytes = (int64)stats.liveBytes;
+	result.LargeBytes = (int64)stats.largeBytes;
+	result.ReservedBytes = (int64)stats.reservedBytes;
+	result.CentralRefills = (int64)stats.centralRefills;
+
+	FS_DWORD nFixedUsed = 0;
+	if (g_pLibraryArena && FSCRT_Library_GetFixedMemSize(&nFixedUsed) != FSCRT_ERRCODE_SUCCESS)
+		nFixedUsed = 0;
+	FSDK_MemoryBudgetStats budget = GetSDKMemory()->GetBudget()->GetStats();
+	result.ArenaBytes = (int64)g_nLibraryArenaSize;
+	result.ArenaUsedBytes = (int64)nFixedUsed;
+	result.HeapBytes = (int64)budget.usedBytes;
+	result.HeapPeakBytes = (int64)budget.peakBytes;
+	result.HeapLimitBytes = (int64)budget.limitBytes;
+	result.FailedAllocations = (int64)budget.failedAllocs;
+	result.OutOfMemoryEvents = (int64)budget.outOfMemoryEvents;
+	result.Recoveries = (int64)budget.recoveries;
+	return result;
+}
+
+bool Inherited_PDFFunction::StartMemoryGovernor(int64 nSoftLimitBytes, int32 iIntervalMs, Platform::String^ logPath)
+{
+	if (nSoftLimitBytes <= 0)
+		return false;
+
+	FSDK_GovernorConfig config;
+	memset(&config, 0, sizeof(config));
+	uint64_t nLimit = (uint64_t)nSoftLimitBytes;
+	config.rssThresholds[FSDK_PRESSURE_ELEVATED] = config.liveThresholds[FSDK_PRESSURE_ELEVATED] = nLimit / 100 * 70;
+	config.rssThresholds[FSDK_PRESSURE_HIGH] = config.liveThresholds[FSDK_PRESSURE_HIGH] = nLimit / 100 * 85;
+	config.rssThresholds[FSDK_PRESSURE_CRITICAL] = config.liveThresholds[FSDK_PRESSURE_CRITICAL] = nLimit;
+	config.intervalMs = iIntervalMs > 0 ? (uint32_t)iIntervalMs : 1000;
+	config.cacheSizeMaxMB = 100;
+	config.cacheSizeMinMB = 8;
+	config.relaxSamples = 10;
+
+	std::string path = ToUtf8String(logPath);
+	return GetMemoryGovernor()->Start(config, path.empty() ? NULL : path.c_str());
+}
+
+void Inherited_PDFFunction::StopMemoryGovernor()
+{
+	GetMemoryGovernor()->Stop();
+}
+
+MemoryPressure Inherited_PDFFunction::GetMemoryPressure()
+{
+	return (MemoryPressure)GetMemoryGovernor()->GetLevel();
+}
+
+void Inherited_PDFFunction::SetTileCacheBudget(int64 nBytes)
+{
+	GetTileCache()->SetBudget(nBytes > 0 ? (uint64_t)nBytes : 0);
+}
+
+TileCacheStats Inherited_PDFFunction::GetTileCacheStats()
+{
+	FSDK_TileCacheStats stats = GetTileCache()->GetStats();
+	TileCacheStats result;
+	result.Hits = (int64)stats.hits;
+	result.Misses = (int64)stats.misses;
+	result.Evictions = (int64)stats.evictions;
+	result.RenderMicrosSaved = (int64)stats.savedMicros;
+	result.Tiles = (int64)stats.tiles;
+	result.Bytes = (int64)stats.bytes;
+	result.BudgetBytes = (int64)stats.budgetBytes;
+	return result;
+}
+
+void Inherited_PDFFunction::ClearTileCache()
+{
+	GetTileCache()->Clear();
+}
+
+void Inherited_PDFFunction::PreallocatePixelBuffers(int32 iWidth, int32 iHeight, int32 iCount)
+{
+	if (iCount > 0)
+		GetPixelBufferPool()->Preallocate(iWidth, iHeight, 4, (size_t)iCount);
+}
+
+PixelSource^ Inherited_PDFFunction::ConvertPixels(PixelSource^ source, PixelFormat format)
+{
+	if (nullptr == source || nullptr == source->PixelBuffer || source->Format != PixelFormat::RGBx || source->Stride < source->Width * 4)
+		return nullptr;
+	if (format != PixelFormat::BGRA && format != PixelFormat::RGBA && format != PixelFormat::Gray8)
+		return nullptr;
+	const uint8_t* pSrc = GetBufferBytes(source->PixelBuffer);
+	if (!pSrc)
+		return nullptr;
+	FSDK_PixelBuffer* pPixels = GetPixelBufferPool()->Acquire(source->Width, source->Height, format == PixelFormat::Gray8 ? 1 : 4);
+	if (!pPixels)
+		return nullptr;
+	if (format == PixelFormat::BGRA)
+		CMy_PixelConvert::RgbxToBgra(pSrc, source->Stride, pPixels->data, pPixels->stride, source->Width, source->Height);
+	else if (format == PixelFormat::RGBA)
+		CMy_PixelConvert::RgbxToRgba(pSrc, source->Stride, pPixels->data, pPixels->stride, source->Width, source->Height);
+	else
+		CMy_PixelConvert::RgbxToGray8(pSrc, source->Stride, pPixels->data, pPixels->stride, source->Width, source->Height);
+
+	PixelSource^ result = ref new PixelSource();
+	result->Format = format;
+	result->Width = source->Width;
+	result->Height = source->Height;
+	result->Stride = pPixels->stride;
+	result->PixelBuffer = WrapPixelBuffer(pPixels);
+	return nullptr == result->PixelBuffer ? nullptr : result;
+}
+
+bool Inherited_PDFFunction::StartAllocationProfiler(int64 nSampleBytes, Platform::String^ reportPath)
+{
+	if (nSampleBytes < 0)
+		return false;
+	g_AllocReportPath = nullptr == reportPath ? std::wstring() : std::wstring(reportPath->Data());
+	GetAllocProfiler()->Start((uint64_t)nSampleBytes);
+	return true;
+}
+
+void Inherited_PDFFunction::StopAllocationProfiler()
+{
+	GetAllocProfiler()->Stop();
+}
+
+bool Inherited_PDFFunction::SaveAllocationReport(Platform::String^ path, bool bListAll)
+{
+	if (nullptr == path || path->IsEmpty())
+		return false;
+	return WriteAllocationReport(path->Data(), bListAll);
+}
+
+bool Inherited_PDFFunction::WriteAllocationReport(const wchar_t* path, bool bListAll)
+{
+	std::string report = GetAllocProfiler()->GetReport(bListAll);
+	FILE* pFile = NULL;
+	if (_wfopen_s(&pFile, path, L"wb") != 0 || !pFile)
+		return false;
+	bool bOk = fwrite(report.data(), 1, report.size(), pFile) == report.size();
+	return fclose(pFile) == 0 && bOk;
+}
+
 void Inherited_PDFFunction::FSDK_Finalize()
 {
+	//The governor calls into the library, stop it first.
+	StopMemoryGovernor();
+
 	//Finitialize PDF module.
 	FSCRT_PDFModule_Finalize();
 
 	//Destroy manager
 	FSCRT_Library_DestroyMgr();
 
-}
+	//Whatever the profiler still sees after the manager is gone was never released.
+	CMy_AllocProfiler* pProfiler = GetAllocProfiler();
+	if (pProfiler->IsRunning())
+	{
+		FSDK_AllocProfileStats stats = pProfiler->GetStats();
+		wchar_t summary[160];
+		swprintf_s(summary, L"SDK leak report: %llu handles, %llu blocks, %llu bytes still alive\n",
+			(unsigned long long)stats.liveHandles, (unsigned long long)stats.liveBlocks, (unsigned long long)stats.liveBytes);
+		OutputDebugString(summary);
+		if (!g_AllocReportPath.empty())
+			WriteAllocationReport(g_AllocReportPath.c_str(), true);
+		pProfiler->Stop();
+	}
+	if (g_pLibraryArena)
+		free(g_pLibraryArena);
+	g_pLibraryArena = NULL;
+	g_nLibraryArenaSize = 0;
 
-FS_RESULT	Inherited_PDFFunction::My_Page_Clear(PageHandle page)
-{
-	return FSPDF_Page_Clear((FSCRT_PAGE)(page.pointer));
 }
 
 FS_RESULT Inherited_PDFFunction::My_Page_GetSize(PageHandle page, FS_FLOAT* width, FS_FLOAT* height)
@@ -597,6 +2837,7 @@ FS_INT32 Inherited_PDFFunction::My_Doc_CountPages(DocHandle doc)
 
 Platform::String^ Inherited_PDFFunction::GetWordFromLocation(PageHandle page, float x, float y, int iStartX, int iStartY, int iSizeX, int iSizeY, int iRotation)
 {
+	CMy_MemoryScope memoryScope(GetSDKMemory(), (const void*)page.pointer, FSDK_MEMOP_TEXT);
 	//load textpage
 	FSPDF_TEXTPAGE textPage = NULL;
 	FS_RESULT ret = FSPDF_TextPage_Load((FSCRT_PAGE)(page.pointer), &textPage); //Load text page
@@ -605,170 +2846,151 @@ Platform::String^ Inherited_PDFFunction::GetWordFromLocation(PageHandle page, fl
 		Platform::String^ word = "false";
 		return word;
 	}
-	
+	NoteHandleCreated(FSDK_HANDLE_TEXTPAGE, textPage);
+
+	//The text page and the string are released on every path below.
+	Platform::String^ word = "false";
+	FSCRT_BSTR tmp_char;
+	FSCRT_BStr_Init(&tmp_char);
+
 	//getmatrix
 	FSCRT_MATRIX mt;
 	ret = FSPDF_Page_GetMatrix((FSCRT_PAGE)(page.pointer), iStartX, iStartY, iSizeX, iSizeY, iRotation, &mt);
-	if (ret != FSCRT_ERRCODE_SUCCESS)
-	{
-		Platform::String^ word = "false";
-		return word;
-	}
-	//get xx and yy from x and y 
-	//(xx,yy) is coordinate in page
-	//(x,y) is position in render image
-	int xx = (x - mt.e)*mt.d - mt.c*(y - mt.f);
-	xx /= (mt.a*mt.d - mt.c*mt.b);
-	int yy = (y - mt.f)*mt.a - (x - mt.e)*mt.b;
-	yy /= (mt.a*mt.d - mt.c*mt.b);
 
-	FS_INT32 charIndex;
-	ret = FSPDF_TextPage_GetCharIndexAtPos(textPage, xx, yy, 1, &charIndex);
-	if (ret != FSCRT_ERRCODE_SUCCESS)
+	FS_INT32 charIndex = 0;
+	if (ret == FSCRT_ERRCODE_SUCCESS)
 	{
-		Platform::String^ word = "false";
-		return word;
+		//get xx and yy from x and y 
+		//(xx,yy) is coordinate in page
+		//(x,y) is position in render image
+		int xx = (x - mt.e)*mt.d - mt.c*(y - mt.f);
+		xx /= (mt.a*mt.d - mt.c*mt.b);
+		int yy = (y - mt.f)*mt.a - (x - mt.e)*mt.b;
+		yy /= (mt.a*mt.d - mt.c*mt.b);
+
+		ret = FSPDF_TextPage_GetCharIndexAtPos(textPage, xx, yy, 1, &charIndex);
 	}
+
 	//judge if chinese character or blank
 	FS_INT32 preIndex = charIndex;
 	FS_INT32 nextIndex = charIndex;
-	FSCRT_BSTR tmp_char;
-	tmp_char.str = NULL;
-
-	bool IsNewLine = false;
-	do
+	if (ret == FSCRT_ERRCODE_SUCCESS)
 	{
-		preIndex--;
-		ret = FSPDF_TextPage_GetChars(textPage, preIndex, 1, &tmp_char);
-		if (ret != FSCRT_ERRCODE_SUCCESS)
+		do
 		{
-			Platform::String^ word = "false";
-			return word;
-		}
-	} while (IsCharacterValid(tmp_char.str[0]) != 0);
-	preIndex = preIndex + 1;
-	do
+			preIndex--;
+			ret = FSPDF_TextPage_GetChars(textPage, preIndex, 1, &tmp_char);
+		} while (ret == FSCRT_ERRCODE_SUCCESS && IsCharacterValid(tmp_char.str[0]) != 0);
+		preIndex = preIndex + 1;
+	}
+	if (ret == FSCRT_ERRCODE_SUCCESS)
 	{
-		nextIndex++;
-		ret = FSPDF_TextPage_GetChars(textPage, nextIndex, 1, &tmp_char);
-		if (ret != FSCRT_ERRCODE_SUCCESS)
+		do
 		{
-			Platform::String^ word = "false";
-			return word;
-		}
-	} while (IsCharacterValid(tmp_char.str[0]) != 0);
-	nextIndex--;
-	
-	ret = FSPDF_TextPage_GetChars(textPage, preIndex, nextIndex - preIndex + 1, &tmp_char);
+			nextIndex++;
+			ret = FSPDF_TextPage_GetChars(textPage, nextIndex, 1, &tmp_char);
+		} while (ret == FSCRT_ERRCODE_SUCCESS && IsCharacterValid(tmp_char.str[0]) != 0);
+		nextIndex--;
+	}
+	if (ret == FSCRT_ERRCODE_SUCCESS)
+		ret = FSPDF_TextPage_GetChars(textPage, preIndex, nextIndex - preIndex + 1, &tmp_char);
 
-	if (ret != FSCRT_ERRCODE_SUCCESS)
+	if (ret == FSCRT_ERRCODE_SUCCESS)
 	{
-		Platform::String^ word = "false";
-		return word;
+		std::string std_string_word(tmp_char.str, tmp_char.len);
+		std::wstring std_wstring_word;
+		std_wstring_word.assign(std_string_word.begin(), std_string_word.end());
+		word = ref new Platform::String(std_wstring_word.c_str());
 	}
 
-	std::string std_string_word(tmp_char.str);
-	std::wstring std_wstring_word;
-	std_wstring_word.assign(std_string_word.begin(), std_string_word.end());
-	Platform::String^ word = ref new Platform::String(std_wstring_word.c_str());
-	
+	FSCRT_BStr_Clear(&tmp_char);
+	NoteHandleReleased(textPage);
 	FSPDF_TextPage_Release(textPage);
 	return word;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-FS_RESULT foxitSDK::FSDK_PageToBitmap(FSCRT_PAGE page, int bmpWidth, int bmpHeight, int iStartX, int iStartY, int iSizeX, int iSizeY, int iRotation, FSCRT_BITMAP *renderBmp)
+FS_RESULT foxitSDK::FSDK_PageToBitmap(FSCRT_PAGE page, int bmpWidth, int bmpHeight, int iStartX, int iStartY, int iSizeX, int iSizeY, int iRotation, FSCRT_BITMAP *renderBmp,
+	void* pBuffer, int iStride, int iFormat, CMy_TimeSlicePause* pPause, FS_INT32 iRenderFlags)
 {
-	FS_RESULT ret = FSCRT_ERRCODE_ERROR;
-	//Get a bitmap handler to hold bitmap data from rendering progress.
-	ret = FSCRT_Bitmap_Create((FS_INT32)bmpWidth, (FS_INT32)bmpHeight, FSCRT_BITMAPFORMAT_32BPP_RGBx, NULL, 0, renderBmp);
-	if (ret != FSCRT_ERRCODE_SUCCESS)
-	{
-		return ret;
-	}
+	//Every object created below is released at the end on all paths, the bitmap is kept only on success.
+	FSCRT_RENDERER renderer = NULL;
+	FSPDF_RENDERCONTEXT rendercontext = NULL;
+	FSCRT_PROGRESS renderProgress = NULL;
+	*renderBmp = NULL;
 
-	//Set rect area and fill the color of bitmap.
-	FSCRT_RECT rect = { 0, 0, (FS_INT32)bmpWidth, (FS_INT32)bmpHeight };
-	ret = FSCRT_Bitmap_FillRect(*renderBmp, FSCRT_ARGB_Encode(0xff, 0xff, 0xff, 0xff), &rect);
-	if (ret != FSCRT_ERRCODE_SUCCESS)
+	//Get a bitmap handler to hold bitmap data from rendering progress.
+	FS_RESULT ret = FSCRT_Bitmap_Create((FS_INT32)bmpWidth, (FS_INT32)bmpHeight, (FS_INT32)iFormat, pBuffer, pBuffer ? iStride : 0, renderBmp);
+	if (ret == FSCRT_ERRCODE_SUCCESS)
 	{
-		FSCRT_Bitmap_Release(*renderBmp);
-		return ret;
+		NoteHandleCreated(FSDK_HANDLE_BITMAP, *renderBmp);
+		//Set rect area and fill the color of bitmap.
+		FSCRT_RECT rect = { 0, 0, (FS_INT32)bmpWidth, (FS_INT32)bmpHeight };
+		ret = FSCRT_Bitmap_FillRect(*renderBmp, FSCRT_ARGB_Encode(0xff, 0xff, 0xff, 0xff), &rect);
 	}
 
 	//Get the page's matrix.
 	FSCRT_MATRIX mt;
-	ret = FSPDF_Page_GetMatrix(page, iStartX, iStartY, iSizeX, iSizeY, iRotation, &mt);
-	if (ret != FSCRT_ERRCODE_SUCCESS)
-	{
-		FSCRT_Bitmap_Release(*renderBmp);
-		return ret;
-	}
+	if (ret == FSCRT_ERRCODE_SUCCESS)
+		ret = FSPDF_Page_GetMatrix(page, iStartX, iStartY, iSizeX, iSizeY, iRotation, &mt);
 
 	//Create a renderer based on a given bitmap, and page will be rendered to this bitmap.
-	FSCRT_RENDERER renderer;
-	ret = FSCRT_Renderer_CreateOnBitmap(*renderBmp, &renderer);
-	if (ret != FSCRT_ERRCODE_SUCCESS)
+	if (ret == FSCRT_ERRCODE_SUCCESS)
 	{
-		FSCRT_Bitmap_Release(*renderBmp);
-		return ret;
+		ret = FSCRT_Renderer_CreateOnBitmap(*renderBmp, &renderer);
+		if (ret == FSCRT_ERRCODE_SUCCESS)
+			NoteHandleCreated(FSDK_HANDLE_RENDERER, renderer);
 	}
 
 	//Create a render context used for rendering page.
-	FSPDF_RENDERCONTEXT rendercontext;
-	ret = FSPDF_RenderContext_Create(&rendercontext);
-	if (ret != FSCRT_ERRCODE_SUCCESS)
+	if (ret == FSCRT_ERRCODE_SUCCESS)
 	{
-		FSCRT_Renderer_Release(renderer);
-		FSCRT_Bitmap_Release(*renderBmp);
-		return ret;
+		ret = FSPDF_RenderContext_Create(&rendercontext);
+		if (ret == FSCRT_ERRCODE_SUCCESS)
+			NoteHandleCreated(FSDK_HANDLE_RENDERCONTEXT, rendercontext);
 	}
+	if (ret == FSCRT_ERRCODE_SUCCESS)
+		ret = FSPDF_RenderContext_SetFlags(rendercontext, FSPDF_RENDERCONTEXTFLAG_ANNOT);
 
-	ret = FSPDF_RenderContext_SetFlags(rendercontext, FSPDF_RENDERCONTEXTFLAG_ANNOT);
-	if (ret != FSCRT_ERRCODE_SUCCESS)
+	//Set the matrix of the given render context.
+	if (ret == FSCRT_ERRCODE_SUCCESS)
+		ret = FSPDF_RenderContext_SetMatrix(rendercontext, &mt);
+
+	//Start to render page.
+	if (ret == FSCRT_ERRCODE_SUCCESS)
 	{
-		//Release render
-		FSCRT_Renderer_Release(renderer);
-		FSPDF_RenderContext_Release(rendercontext);
-		FSCRT_Bitmap_Release(*renderBmp);
-		return ret;
+		ret = FSPDF_RenderContext_StartPage(rendercontext, renderer, page, iRenderFlags, &renderProgress);
+		NoteHandleCreated(FSDK_HANDLE_PROGRESS, renderProgress);
 	}
 
-	//Set the matrix of the given render context.
-	ret = FSPDF_RenderContext_SetMatrix(rendercontext, &mt);
-	if (ret != FSCRT_ERRCODE_SUCCESS)
+	//Continue render progress, in the caller's time slices if it gave a pause handler.
+	if (ret == FSCRT_ERRCODE_SUCCESS)
+		ret = pPause ? pPause->Run(renderProgress) : FSCRT_Progress_Continue(renderProgress, NULL);
+
+	if (renderProgress)
 	{
-		FSCRT_Renderer_Release(renderer);
+		NoteHandleReleased(renderProgress);
+		FSCRT_Progress_Release(renderProgress);
+	}
+	if (rendercontext)
+	{
+		NoteHandleReleased(rendercontext);
 		FSPDF_RenderContext_Release(rendercontext);
-		FSCRT_Bitmap_Release(*renderBmp);
-		return ret;
 	}
-
-	//Start to render page.
-	FSCRT_PROGRESS renderProgress = NULL;
-	ret = FSPDF_RenderContext_StartPage(rendercontext, renderer, page, FSPDF_PAGERENDERFLAG_NORMAL, &renderProgress);
-	if (ret != FSCRT_ERRCODE_SUCCESS)
+	if (renderer)
 	{
+		NoteHandleReleased(renderer);
 		FSCRT_Renderer_Release(renderer);
-		FSPDF_RenderContext_Release(rendercontext);
-		FSCRT_Bitmap_Release(*renderBmp);
-		return ret;
 	}
-
-	//Continue render progress.
-	//If want to do progressive rendering, please use the second parameter of FSCRT_Progress_Continue.
-	//See FSCRT_Progress_Continue for more details.
-	ret = FSCRT_Progress_Continue(renderProgress, NULL);
-
-	FSCRT_Progress_Release(renderProgress);
-	FSCRT_Renderer_Release(renderer);
-	FSPDF_RenderContext_Release(rendercontext);
 	if (FSCRT_ERRCODE_FINISHED == ret)
-		ret = FSCRT_ERRCODE_SUCCESS;
-	else
+		return FSCRT_ERRCODE_SUCCESS;
+	if (*renderBmp)
+	{
+		NoteHandleReleased(*renderBmp);
 		FSCRT_Bitmap_Release(*renderBmp);
-
+		*renderBmp = NULL;
+	}
 	return ret;
 }
 
@@ -801,7 +3023,8 @@ FS_RESULT foxitSDK::FSDK_GetSDKBitmapData(FSCRT_BITMAP bmp, PixelSource^ dib)
 	memcpy(buffer->Data, lpBmpBuf, size);
 	DataWriter ^writer = ref new DataWriter();
 	writer->WriteBytes(buffer);
-	dib->Format = PixelFormat::BGRx;
+	dib->Format = PixelFormat::RGBx;
+	dib->Stride = (int32)stride;
 	dib->PixelBuffer = writer->DetachBuffer();
 	if (!dib->PixelBuffer)
 	{
@@ -10,11 +10,33 @@
 #include <string>
 #include <iostream>
 #include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
 #include <locale.h>
 
 /** Include header files of SDK. */
 #include "../foxitSDK/include/fsdk.h"
 
+#include "BlockCache.h"
+#include "MappedFile.h"
+#include "WriteBuffer.h"
+#include "WriteBehind.h"
+#include "PauseHandler.h"
+#include "IncrementalSave.h"
+#include "ProgressiveFile.h"
+#include "IoTrace.h"
+#include "PoolAllocator.h"
+#include "MemoryBudget.h"
+#include "MemoryAccounting.h"
+#include "MemoryGovernor.h"
+#include "AllocProfiler.h"
+#include "TileRenderer.h"
+#include "TileCache.h"
+#include "PixelBufferPool.h"
+#include "PixelConvert.h"
+#include "PageCache.h"
+
 
 namespace foxitSDK
 {
@@ -27,6 +49,121 @@ namespace foxitSDK
 
 	//PDF page handle. 
 	public value struct PageHandle { int64 pointer; /* The value of the pointer to page */ };
+
+	//Counters of the document read cache.
+	public value struct ReadCacheStats
+	{
+		int64 Hits;				// Blocks served from the cache.
+		int64 Misses;			// Blocks read from the file.
+		int64 BytesRequested;	// Bytes requested by the SDK.
+		int64 BytesRead;		// Bytes read from the file, read-ahead included.
+		int64 ReadAheadBlocks;	// Blocks loaded speculatively.
+		int64 SourceReads;		// Reads issued on the file.
+		int64 MergedReads;		// Block reads saved by merging adjacent missing blocks.
+		int64 PrefetchBytes;	// Bytes loaded speculatively.
+		int64 WastedPrefetchBytes;	// Speculative bytes dropped without being used.
+		int64 SequentialReads;	// Requests recognized as sequential.
+		int64 StridedReads;		// Requests recognized as strided.
+	};
+
+	//Counters of the cache of parsed pages of a document.
+	public value struct PageCacheStats
+	{
+		int64 Hits;				// Pages served without parsing.
+		int64 Misses;			// Pages that had to be parsed.
+		int64 Evictions;		// Pages dropped to stay within the limits or under memory pressure.
+		int64 Pages;			// Pages held now.
+		int64 Bytes;			// Estimated SDK memory of the pages held now.
+		int64 MaxPages;
+		int64 BudgetBytes;
+	};
+
+	//Result of the last incremental append-save.
+	public value struct IncrementalSaveStats
+	{
+		int64 BytesWritten;		// Bytes of the new revision section appended to the file.
+		int64 BytesSkipped;		// Bytes of the original file that were not rewritten.
+	};
+
+	//Counters of the memory manager behind the SDK.
+	public value struct MemoryStats
+	{
+		int64 LiveBytes;		// Bytes handed out, including objects cached by threads.
+		int64 LargeBytes;		// Live blocks too large for the size classes.
+		int64 ReservedBytes;	// Bytes taken from the system for the size classes.
+		int64 CentralRefills;	// Batches moved from the shared free lists to thread caches.
+		int64 ArenaBytes;		// Size of the fixed arena given to FSCRT_Library_CreateMgr.
+		int64 ArenaUsedBytes;	// Part of the arena in use, from FSCRT_Library_GetFixedMemSize.
+		int64 HeapBytes;		// SDK memory taken beyond the arena.
+		int64 HeapPeakBytes;
+		int64 HeapLimitBytes;	// 0 if unlimited.
+		int64 FailedAllocations;	// Requests refused because of the limit.
+		int64 OutOfMemoryEvents;	// Times the SDK reported it ran out of memory.
+		int64 Recoveries;		// Documents reopened after running out of memory.
+	};
+
+	//Operation SDK memory is charged to.
+	public enum class MemoryOperation
+	{
+		Other = 0,
+		Open,
+		Parse,
+		Render,
+		Text,
+		Save
+	};
+
+	//SDK memory charged to a document, or to one page and operation of it. Bytes are as requested by the SDK.
+	public value struct MemoryUsage
+	{
+		int32 PageIndex;		// -1 for work not tied to a page, and for document totals.
+		MemoryOperation Operation;
+		int64 LiveBytes;
+		int64 PeakBytes;
+		int64 Allocations;
+		int64 Frees;
+	};
+
+	//Memory pressure seen by the governor.
+	public enum class MemoryPressure
+	{
+		Normal = 0,
+		Elevated,
+		High,
+		Critical
+	};
+
+	//Counters of a progressively opened document.
+	public value struct ProgressiveStats
+	{
+		int64 FileSize;
+		int64 BytesAvailable;	// Bytes already fetched from the source.
+		int64 HintsReceived;	// Ranges the SDK asked for.
+		int64 HintedBytes;		// Bytes fetched because the SDK asked for them.
+		int64 BackgroundBytes;	// Bytes fetched by the front-to-back fill.
+		int64 Fetches;			// Reads on the source.
+	};
+
+	//A finished tile of a tiled render, in pixels of the render area.
+	public value struct TileRect
+	{
+		int32 X;
+		int32 Y;
+		int32 Width;
+		int32 Height;
+	};
+
+	//Counters of the cache of rendered tiles shared by all documents.
+	public value struct TileCacheStats
+	{
+		int64 Hits;				// Tiles served from the cache.
+		int64 Misses;			// Tiles that had to be rendered.
+		int64 Evictions;		// Tiles dropped to stay within the budget or under memory pressure.
+		int64 RenderMicrosSaved;	// Render time of the tiles served from the cache.
+		int64 Tiles;			// Tiles held now.
+		int64 Bytes;			// Bytes held now.
+		int64 BudgetBytes;
+	};
 	
 	//PDF textpage handle.
 	//public value struct TextPageHandle { int64 pointer; /* The value of the pointer to textpage */ };
@@ -37,7 +174,11 @@ namespace foxitSDK
 	//DIB format Flags. 
 	public enum class PixelFormat
 	{
-		BGRx = 2		    // 4 bytes per pixel, byte order: Blue, Green, Red, not used. 
+		BGRx = 2,		    // 4 bytes per pixel, byte order: Blue, Green, Red, not used. 
+		BGRA = 3,			// 4 bytes per pixel, byte order: Blue, Green, Red, Alpha. Alpha is premultiplied.
+		Gray8 = 4,			// 1 byte per pixel.
+		RGBx = 6,			// 4 bytes per pixel, byte order: Red, Green, Blue, not used. What the SDK renders.
+		RGBA = 7			// 4 bytes per pixel, byte order: Red, Green, Blue, Alpha. Alpha is premultiplied.
 	};
 
 	// A class to present the DIB data created from SDK.
@@ -50,28 +191,132 @@ namespace foxitSDK
 		property Windows::Storage::Streams::IBuffer^		PixelBuffer;	// The DIB pixel source buffer. 
 		property int32										Width;			// The width of DIB. 
 		property int32										Height;			// The height of DIB. 
+		property int32										Stride;			// Bytes from one row of PixelBuffer to the next.
 	};
 
 
+	//IMy_FileSource over a StorageFile. The stream is opened once and kept for the life of the document.
+	class CMy_StorageFileSource : public IMy_FileSource
+	{
+	public:
+		CMy_StorageFileSource();
+		virtual ~CMy_StorageFileSource();
+		bool				Open(Windows::Storage::StorageFile^ pFile);
+		void				Close();
+
+		virtual uint64_t	GetSize();
+		virtual bool		ReadAt(uint64_t offset, void* buffer, size_t size);
+
+	private:
+		std::mutex									m_Lock;			// The stream has a single position.
+		Windows::Storage::Streams::IRandomAccessStream^	m_Stream;
+		Windows::Storage::Streams::Buffer^			m_ReadBuffer;
+		uint64_t									m_iStreamSize;
+	};
+
+	//IMy_FileSink over a StorageFile, used as the destination of a streaming save.
+	class CMy_StorageStreamSink : public IMy_FileSink
+	{
+	public:
+		CMy_StorageStreamSink();
+		virtual ~CMy_StorageStreamSink();
+		//Open pFile for writing. bTruncate drops its old content.
+		bool				Open(Windows::Storage::StorageFile^ pFile, bool bTruncate = true);
+		void				Close();
+
+		virtual uint64_t	GetSize();
+		virtual bool		WriteAt(uint64_t offset, const void* buffer, size_t size);
+		virtual bool		ReadAt(uint64_t offset, void* buffer, size_t size);
+		virtual bool		Truncate(uint64_t size);
+		virtual bool		Flush();
+
+	private:
+		std::mutex									m_Lock;
+		Windows::Storage::Streams::IRandomAccessStream^	m_Stream;
+		Windows::Storage::Streams::Buffer^			m_Buffer;		// Reused for every transfer.
+	};
+
 	//Implementation of callback functions in CMy_File.
 	class CMy_FileReadWrite
 	{
 	public:
 		CMy_FileReadWrite();
 		virtual ~CMy_FileReadWrite();
-		void	CreateFileRead(Windows::Storage::StorageFile^ pFile, int nFileSize);
+		//false if the file can't be opened.
+		bool	CreateFileRead(Windows::Storage::StorageFile^ pFile, int64 nFileSize);
+		//Read through a caller-supplied source instead of a StorageFile, e.g. CMy_PosixFileSource.
+		bool	CreateFileRead(IMy_FileSource* pSource, bool bOwnSource);
 		void	Release();
-		int		GetSize();
-		void	SetSize(int nSize);
-		bool	ReadBlock(void* buffer, int offset, size_t size);
-		bool	WriteBlock(const void* buffer, int offset, size_t size);
+		int64	GetSize();
+		void	SetSize(int64 nSize);
+		bool	ReadBlock(void* buffer, int64 offset, size_t size);
+		bool	WriteBlock(const void* buffer, int64 offset, size_t size);
+		bool	TruncateBlock(int64 size);
 		void	ReleaseTempWriteBuffer();
+		FSDK_BlockCacheStats	GetReadCacheStats();
 
-		Platform::Collections::Vector<Platform::Object^>^ GetFileBuffer();
+		//Saved data above nSpillThreshold bytes goes to a temporary file in tempDir (UTF-8) instead of memory.
+		void	SetWriteBufferOptions(size_t nSpillThreshold, const std::string& tempDir);
+		CMy_WriteBuffer*	GetFileBuffer();
+		CMy_BlockCache*		GetReadCache() { return m_pReadCache; }
 	private:
 		Windows::Storage::StorageFile^						m_pFile;
-		int													m_iFileSize;
-		Platform::Collections::Vector<Platform::Object^>^	m_Buffer;
+		int64												m_iFileSize;
+		CMy_BlockCache*										m_pReadCache;
+		CMy_WriteBuffer*									m_pWriteBuffer;
+		size_t												m_nSpillThreshold;
+		std::string											m_TempDir;
+	};
+
+	//IMy_MemoryConsumer over the read cache of a document.
+	class CMy_ReadCacheConsumer : public IMy_MemoryConsumer
+	{
+	public:
+		CMy_ReadCacheConsumer(CMy_BlockCache* pCache);
+		virtual uint64_t	ReleaseMemory(FSDK_MemoryPressure level);
+
+	private:
+		CMy_BlockCache*		m_pCache;
+	};
+
+	//IMy_MemoryConsumer over the SDK caches of a document. They are cleared with FSPDF_Doc_ClearCache once the
+	//document has been idle for a while, or right away at critical pressure.
+	class CMy_DocumentCacheConsumer : public IMy_MemoryConsumer
+	{
+	public:
+		CMy_DocumentCacheConsumer(FSCRT_DOCUMENT document);
+		virtual uint64_t	ReleaseMemory(FSDK_MemoryPressure level);
+
+		//Mark the document as in use now.
+		void				Touch();
+
+		//Idle time after which a document's caches may be cleared, for all documents.
+		static void			SetIdleTime(uint32_t nIdleMs);
+
+	private:
+		FSCRT_DOCUMENT			m_Document;
+		std::atomic<uint64_t>	m_iLastUseMs;
+		static std::atomic<uint32_t>	s_nIdleMs;
+	};
+
+	//Runs the prefetch job of a document on the prefetch pool. One job runs at a time, starting the next cancels it.
+	//The pages it parses go into the document's page cache.
+	class CMy_PagePrefetcher
+	{
+	public:
+		CMy_PagePrefetcher();
+		~CMy_PagePrefetcher();
+
+		//Cancel the previous job, wait for it, and queue job on the prefetch pool. job polls the token it gets.
+		bool		Start(const std::function<void(const CMy_CancelToken*)>& job);
+		//Cancel the running job and wait until it has stopped. Returns at once if none runs.
+		void		Cancel();
+
+	private:
+		std::mutex				m_Lock;
+		std::condition_variable	m_Stopped;
+		bool					m_bRunning;
+		std::shared_ptr<CMy_CancelToken>	m_pCancel;	// Token of the last job.
 	};
 
 	//Inherited class of FSCRT_FILEHANDLER
@@ -94,6 +339,26 @@ namespace foxitSDK
 	private:
 	};
 
+	//Inherited class of FSCRT_FILEHANDLER_L, the 64-bit variant of CMy_File for files over 2GB.
+	class CMy_FileL : public FSCRT_FILEHANDLER_L
+	{
+	public:
+		CMy_FileL();
+		~CMy_FileL();
+		void InitFileHandle(CMy_FileReadWrite* pFileHandle);
+		void ReleaseFileHandle();
+
+		//Inherited callback funtions.
+		static void g_PrivateRelease(FS_LPVOID clientData);
+		static FS_RESULT g_PrivateGetSize(FS_LPVOID clientData, FSCRT_FILESIZE* size);
+		static FS_RESULT g_PrivateReadBlock(FS_LPVOID clientData, const FSCRT_FILESIZE* offset, FS_LPVOID buffer, const FSCRT_FILESIZE* size);
+		static FS_RESULT g_PrivateWriteBlock(FS_LPVOID clientData, const FSCRT_FILESIZE* offset, FS_LPCVOID buffer, const FSCRT_FILESIZE* size);
+		static FS_RESULT g_PrivateFlush(FS_LPVOID clientData);
+		static FS_RESULT g_PrivateTruncate(FS_LPVOID clientData, const FSCRT_FILESIZE* fileSize);
+
+	private:
+	};
+
 
 
 
@@ -103,22 +368,124 @@ namespace foxitSDK
 	public:
 		FSDK_Document();
 
-		//Open PDF document
-		Windows::Foundation::IAsyncOperation<FS_RESULT>^	OpenDocumentAsync(Windows::Storage::StorageFile^ pdfFile, int32 nFileSize);
+		//Open PDF document. Files of any size are read through the 64-bit FSCRT_FILEHANDLER_L.
+		Windows::Foundation::IAsyncOperation<FS_RESULT>^	OpenDocumentAsync(Windows::Storage::StorageFile^ pdfFile, int64 nFileSize);
+
+		//Open PDF document through a memory-mapped file handler. Falls back to buffered reads when the file can't be mapped.
+		Windows::Foundation::IAsyncOperation<FS_RESULT>^	OpenMappedDocumentAsync(Windows::Storage::StorageFile^ pdfFile);
+
+		//Open PDF document with FSPDF_Doc_AsyncLoad while the file arrives from a slow source. Completes as soon as the
+		//document is available and, for linearized files, its first page; the rest keeps coming in the background.
+		//iLatencyMs and iBytesPerSecond throttle reads on pdfFile to simulate remote storage, 0 means no limit.
+		//Progress is the percentage of the file fetched so far.
+		Windows::Foundation::IAsyncOperationWithProgress<FS_RESULT, int>^	OpenProgressiveDocumentAsync(Windows::Storage::StorageFile^ pdfFile, int iLatencyMs, int64 iBytesPerSecond);
+
+		//Check whether all data of a page has arrived. Always true for documents not opened progressively.
+		bool		IsPageAvailable(int32 iPageIndex);
+
+		//Index of the first page that can be shown, 0 unless a linearized file was opened progressively.
+		int32		GetFirstAvailablePageIndex();
+
+		//Get fetch counters of a progressively opened document.
+		ProgressiveStats	GetProgressiveStats();
+
+		//Record every call the SDK makes on the document file to a binary trace at tracePath.
+		//Call before opening; the trace covers open, page loading, rendering and saving until StopIoTrace or ReleaseResource.
+		//Replay it offline with tools/IoTraceReplay.cpp.
+		bool		StartIoTrace(Platform::String^ tracePath);
+		void		StopIoTrace();
 
-		//Load PDF page and also parse page.
+		//Load PDF page and also parse page. The previous page stays in the page cache, and stays the current page if
+		//the new one fails to load.
+		//If the SDK runs out of memory, the document is closed and reopened and the page loaded once more.
 		FS_RESULT	LoadPageSync(int32 iPageIndex);
 
-		//Release member parameters.
+		//Same as LoadPageSync on a worker thread. The page is parsed in time slices and progress reported in percent
+		//in between. Cancelling stops the parse within milliseconds and keeps the previous current page.
+		Windows::Foundation::IAsyncOperationWithProgress<FS_RESULT, int>^ LoadPageAsync(int32 iPageIndex);
+
+		//Release member parameters. Waits for a page load still running, cancel it first.
 		void		ReleaseResource();
 
-		//Render page asynchronously and convert SDK bitmap data to IRandomAccessStreamWithContentType.
+		//Render operations and saves can be cancelled through IAsyncInfo::Cancel, or a CancellationToken passed to AsTask.
+		//The SDK stops within milliseconds and the operation ends as canceled; its pixels are dropped.
+
+		//Render page asynchronously and convert SDK bitmap data to IRandomAccessStreamWithContentType, a BMP image.
+		//pxsrc gets the rendered RGBx pixels.
 		Windows::Foundation::IAsyncOperation<Windows::Storage::Streams::IRandomAccessStreamWithContentType^>^ \
 			RenderPageAsync(PixelSource^ pxsrc, int iStartX, int iStartY, int iSizeX, int iSizeY, int iRotation);
 
+		//Render page into pxsrc as iTileSize tiles on all cores (0 for the default of 256).
+		//pxsrc->PixelBuffer is set before rendering starts; each tile is reported as progress once its pixels are in it.
+		Windows::Foundation::IAsyncOperationWithProgress<bool, TileRect>^ \
+			RenderPageTiledAsync(PixelSource^ pxsrc, int iStartX, int iStartY, int iSizeX, int iSizeY, int iRotation, int iTileSize);
+
+		//Render page into pxsrc as raw PixelFormat::BGRA pixels, rows pxsrc->Stride bytes apart, with no encoding.
+		//Pages render opaque, so the pixels are the same premultiplied or straight.
+		Windows::Foundation::IAsyncOperation<bool>^ \
+			RenderPageRawAsync(PixelSource^ pxsrc, int iStartX, int iStartY, int iSizeX, int iSizeY, int iRotation);
+
+		//Render page into a new iWidth x iHeight Bgra8 premultiplied SoftwareBitmap, ready for SoftwareBitmapSource.
+		//The SDK renders into the bitmap's own memory. nullptr on failure.
+		Windows::Foundation::IAsyncOperation<Windows::Graphics::Imaging::SoftwareBitmap^>^ \
+			RenderPageToSoftwareBitmapAsync(int iWidth, int iHeight, int iStartX, int iStartY, int iSizeX, int iSizeY, int iRotation);
+
+		//Render page in two passes. A FSPDF_PAGERENDERFLAG_QUICKDRAW preview at a quarter of the width and height is
+		//reported as progress as soon as it is there, to be stretched over the view; the full quality render is the
+		//result. Cancel the operation when the view changes, a refinement in progress stops within milliseconds.
+		//Areas of up to one tile are rendered at full quality only.
+		Windows::Foundation::IAsyncOperationWithProgress<Windows::Graphics::Imaging::SoftwareBitmap^, Windows::Graphics::Imaging::SoftwareBitmap^>^ \
+			RenderPageProgressiveAsync(int iWidth, int iHeight, int iStartX, int iStartY, int iSizeX, int iSizeY, int iRotation);
+
 		//Save current PDF file to another PDF file.
 		Windows::Foundation::IAsyncOperation<bool>^ SaveAsDocument(Windows::Storage::StorageFile^ file);
 
+		//Save current PDF file straight into another PDF file through a bounded write-behind queue.
+		//Memory use does not depend on the document size. Progress is reported in percent.
+		Windows::Foundation::IAsyncOperationWithProgress<bool, int>^ SaveAsDocumentStreamingAsync(Windows::Storage::StorageFile^ file);
+
+		//Save changes back into the opened file by appending only the new revision section after the original data.
+		//Crash-safe: an interrupted save is rolled back the next time the file is opened. Cancelling only works until
+		//the append to the file starts.
+		Windows::Foundation::IAsyncOperation<bool>^ SaveIncrementalAsync();
+
+		//Get SDK memory charged to the opened document: open, parse, render, text and save work on it.
+		MemoryUsage	GetMemoryUsage();
+
+		//Get the same split by page and operation. Counters start over when the document is opened again.
+		Platform::Array<MemoryUsage>^	GetMemoryUsageByTag();
+
+		//Get bytes written and skipped by the last successful SaveIncrementalAsync.
+		IncrementalSaveStats	GetIncrementalSaveStats();
+
+		//Get hit/miss counters of the read cache behind the opened file.
+		ReadCacheStats	GetReadCacheStats();
+
+		//Saved output up to nBytes is kept in memory, larger output spills to a file in the app's temporary folder.
+		void		SetSaveMemoryThreshold(int64 nBytes);
+
+		//After RenderPageToSoftwareBitmapAsync or RenderPageProgressiveAsync has rendered the current page, pages up to
+		//iDepth before and after it are parsed and rendered with the same view on a background thread, nearest first.
+		//The parsed pages go into the page cache and their tiles into the tile cache. 0 turns prefetching off,
+		//the default is 1.
+		void		SetPrefetchDepth(int32 iDepth);
+
+		//Parsed pages are kept so going back to a page doesn't parse it again, least recently used dropped first once
+		//there are more than iMaxPages or they take more than nBudgetBytes of SDK memory. 0 for either disables the
+		//cache. The default is 8 pages and 64 MB.
+		void		SetPageCacheLimits(int32 iMaxPages, int64 nBudgetBytes);
+
+		//Get hit/miss counters of the page cache.
+		PageCacheStats	GetPageCacheStats();
+
+		//Get all the text of a page without making it the current page, for search and indexing. Pages not parsed yet
+		//are parsed for their text only, which skips images and paths, and kept in a text page cache of their own.
+		//Rendering such a page later parses it in full. nullptr on failure.
+		Windows::Foundation::IAsyncOperation<Platform::String^>^ ExtractPageTextAsync(int32 iPageIndex);
+
+		//Limits of the text page cache, as for SetPageCacheLimits. The default is 32 pages and 32 MB.
+		void		SetTextPageCacheLimits(int32 iMaxPages, int64 nBudgetBytes);
+
 		property FileHandle     m_hFile;      // The file handle. 
 		property DocHandle      m_hDoc;       // The doc handle. 
 		property PageHandle		m_hPage;      // The page handle. 
@@ -126,17 +493,127 @@ namespace foxitSDK
 	private:
 		~FSDK_Document();
 
-		//Render page to SDK bitmap and get its data.
-		bool GetRenderBitmapData(PixelSource^ pxsrc, int iStartX, int iStartY, int iSizeX, int iSizeY, int iRotation);
+		//Load PDF document from a created file object and keep the handles.
+		FS_RESULT LoadDocument(FSCRT_FILE sdkFile);
+
+		//Open PDF document through CMy_FileL and load it.
+		FS_RESULT OpenLargeDocument(Windows::Storage::StorageFile^ pdfFile, int64 nFileSize);
+
+		//Open PDF document through CMy_MappedFile and load it.
+		FS_RESULT OpenMappedDocument(Windows::Storage::StorageFile^ pdfFile);
+
+		//Block until the page's data has arrived, the source failed or pCancel is cancelled.
+		FS_RESULT WaitForPageData(int32 iPageIndex, const CMy_CancelToken* pCancel = NULL);
+
+		//LoadPageSync and LoadPageAsync. onSlice, if set, is called between parse slices. A load cancelled before it
+		//finishes doesn't change the current page.
+		FS_RESULT LoadPage(int32 iPageIndex, const CMy_CancelToken* pCancel, const std::function<void(FSCRT_PROGRESS)>& onSlice);
+
+		//Make a page the current page, from the page cache or parsed now. pCancel may be NULL.
+		FS_RESULT ParsePage(int32 iPageIndex, const CMy_CancelToken* pCancel = NULL, const std::function<void(FSCRT_PROGRESS)>& onSlice = nullptr);
+
+		//Get a page from the page cache, parsing it on a miss. The page's data must be available.
+		//A text-only parse of the page is dropped for the full one once no extraction reads it anymore.
+		FS_RESULT GetParsedPage(int32 iPageIndex, const CMy_CancelToken* pCancel, std::shared_ptr<FSDK_CachedPage>& pPage,
+			const std::function<void(FSCRT_PROGRESS)>& onSlice = nullptr);
+
+		//Get a page with its text from either page cache, parsing it text-only on a miss. Checks the page index and
+		//waits for the page's data, all under m_ParseLock so the document stays open.
+		FS_RESULT GetTextPage(int32 iPageIndex, const CMy_CancelToken* pCancel, std::shared_ptr<FSDK_CachedPage>& pPage);
+
+		//Load and parse a page into a new handle bound to its memory tags. dwParseFlags is a FSPDF_PAGEPARSEFLAG_XXX.
+		//Called with m_ParseLock held, once no page cache has an entry for the page: the SDK hands out one handle
+		//per page, an entry still held would be cleared on failure.
+		//pBytes gets the SDK memory the parse took.
+		//Without onSlice the parse runs in one go, with it in FSDK_PARSE_SLICEMS slices with onSlice called in between.
+		FS_RESULT ParsePageHandle(int32 iPageIndex, FS_DWORD dwParseFlags, const CMy_CancelToken* pCancel, FSCRT_PAGE* pPage, uint64_t* pBytes,
+			const std::function<void(FSCRT_PROGRESS)>& onSlice = nullptr);
+
+		//Prefetch the pages around the current one with the view the current page was just rendered with.
+		void		StartPrefetch(int iWidth, int iHeight, int iStartX, int iStartY, int iSizeX, int iSizeY, int iRotation);
 
-		//Save as PDF file.
-		Windows::Foundation::Collections::IObservableVector<Object^>^	SaveAsPDF();
+		//ReleaseResource with m_LoadLock held. Waits for parses, renders and extractions of the document to finish.
+		void		CloseDocument();
 
-		//Write data in byte to file.
-		concurrency::task<Windows::Storage::Streams::IOutputStream^>	WriteByteToFile(Windows::Storage::StorageFile^ file, Windows::Foundation::Collections::IObservableVector<Object^>^ fileBytes);
+		//Close the document and open its file again the same way. Unsaved changes are lost. Called with m_LoadLock held.
+		FS_RESULT ReopenDocument();
+
+		//Let the memory governor trim the document's caches, and stop it again before the document goes away.
+		void		RegisterMemoryConsumers();
+		void		UnregisterMemoryConsumers();
+
+		//Recovery after the SDK ran out of memory: let the SDK roll back, drop its caches, reopen the document
+		//and reload the current page. Not supported for progressively opened documents. Called with m_LoadLock held
+		//and no page of the document held by the calling thread.
+		FS_RESULT RecoverFromOutOfMemory();
+
+		//Recovery for a render that ran out of memory on page iPageIndex: recover under m_LoadLock, then get the same
+		//page of the reopened document into pPage. The render must have let go of its page.
+		FS_RESULT RecoverForRender(int32 iPageIndex, std::shared_ptr<FSDK_CachedPage>& pPage);
+
+		//Render page into a pooled buffer and hand it to pxsrc. iFormat is FSCRT_BITMAPFORMAT_32BPP_RGBx or _BGRA.
+		bool GetRenderBitmapData(PixelSource^ pxsrc, int iStartX, int iStartY, int iSizeX, int iSizeY, int iRotation, int iFormat,
+			const CMy_CancelToken* pCancel);
+
+		//Render the current page into a new Bgra8 premultiplied SoftwareBitmap. nullptr on failure.
+		Windows::Graphics::Imaging::SoftwareBitmap^ RenderSoftwareBitmap(int iWidth, int iHeight, int iStartX, int iStartY, int iSizeX, int iSizeY,
+			int iRotation, FS_INT32 iRenderFlags, const CMy_CancelToken* pCancel);
+
+		//Render the current page into iWidth x iHeight pixels at pDest, rows iStride bytes apart. iRenderFlags is a
+		//FSPDF_PAGERENDERFLAG_XXX. Areas larger than one tile are rendered by RenderTiles. If the SDK runs out of memory,
+		//the document is reopened and the render retried once.
+		//Returns FSDK_ERRCODE_CANCELLED once pCancel is cancelled; pCancel may be NULL.
+		FS_RESULT RenderPixels(uint8_t* pDest, int32_t iStride, int32_t iWidth, int32_t iHeight, int32_t iFormat, FS_INT32 iRenderFlags,
+			int iStartX, int iStartY, int iSizeX, int iSizeY, int iRotation, const CMy_CancelToken* pCancel);
+
+		//Render page iPageIndex into pDest with CMy_TileRenderer. Tiles are anchored at the page's corner and taken
+		//from the tile cache when they were rendered before. onTile may be empty. With pDest NULL the missing tiles only
+		//go into the tile cache, rendered on the calling thread so the render pool stays free for visible pages.
+		FS_RESULT RenderTiles(FSCRT_PAGE pdfPage, int32 iPageIndex, uint8_t* pDest, int32_t iStride, int32_t iWidth, int32_t iHeight, int32_t iFormat, FS_INT32 iRenderFlags,
+			int iStartX, int iStartY, int iSizeX, int iSizeY, int iRotation, int iTileSize, const std::function<void(const FSDK_TileRect&)>& onTile,
+			const CMy_CancelToken* pCancel);
+
+		//Identify the document's content in the tile cache: its file and size, or the open for documents without a file.
+		uint64_t	GetContentFingerprint();
+
+		//Save as PDF file. flags is one or a combination of FSPDF_SAVEFLAG_XXX. NULL on failure or once pCancel is cancelled.
+		CMy_WriteBuffer*	SaveAsPDF(FS_DWORD flags, const CMy_CancelToken* pCancel = NULL);
+
+		//Roll back an incremental save of pdfFile that was interrupted before it committed.
+		void		RecoverInterruptedAppend(Windows::Storage::StorageFile^ pdfFile);
+
+		//Write saved data to file in large contiguous pieces.
+		concurrency::task<bool>	WriteByteToFile(Windows::Storage::StorageFile^ file, CMy_WriteBuffer* pFileBytes);
 
 		CMy_FileReadWrite*	m_pFileReader;
 		CMy_File*			m_pFileStream;
+		CMy_FileL*			m_pLargeFileStream;
+		CMy_MappedFile*		m_pMappedFile;
+		int64				m_iSaveMemoryThreshold;
+
+		Windows::Storage::StorageFile^	m_SourceFile;		// The opened file, target of incremental saves.
+		int64				m_iBaseFileSize;	// Size of the opened file when it was loaded.
+		int64				m_iAppendedSize;	// Size of the revision section appended since then.
+		FSDK_IncrementalSaveStats	m_LastAppendStats;
+
+		CMy_IoTraceRecorder*	m_pIoTrace;
+		CMy_TracingFile*		m_pTracingFile;
+		CMy_TracingFileL*		m_pTracingFileL;
+
+		CMy_ProgressiveFile*	m_pProgressiveFile;
+		CMy_AsyncFile*			m_pAsyncFile;
+		int32				m_iFirstAvailPage;
+		int32				m_iCurPageIndex;	// Index of m_hPage, -1 if none.
+		std::shared_ptr<FSDK_CachedPage>	m_pCurPage;	// Keeps m_hPage alive while it is the current page. Atomic access only.
+		CMy_PageCache*				m_pPageCache;
+		CMy_PageCache*				m_pTextPageCache;	// Pages parsed with FSPDF_PAGEPARSEFLAG_TEXTONLY.
+		std::mutex					m_LoadLock;		// One LoadPage at a time, so the last one started wins.
+		std::mutex					m_ParseLock;	// One parse at a time, so a page is never parsed twice at once.
+		uint64_t			m_iMemoryDocId;		// Accounting id of the opened document, 0 if none.
+		CMy_ReadCacheConsumer*		m_pReadCacheConsumer;
+		CMy_DocumentCacheConsumer*	m_pDocCacheConsumer;
+		CMy_PagePrefetcher*			m_pPrefetcher;
+		int32				m_iPrefetchDepth;
 	};
 
 
@@ -152,8 +629,6 @@ namespace foxitSDK
 	public:
 		Inherited_PDFFunction();
 
-		FS_RESULT	My_Page_Clear(PageHandle page);
-
 		FS_RESULT	My_Page_GetSize(PageHandle page, FS_FLOAT* width, FS_FLOAT* height);
 
 		FS_INT32    My_Doc_CountPages(DocHandle doc);
@@ -178,6 +653,21 @@ namespace foxitSDK
 		*/
 		FS_RESULT	FSDK_Initialize();
 
+		/**
+		* @brief	Initialize Foxit SDK library with a hard memory budget.
+		*
+		* @param[in]	nArenaBytes		Size of the fixed arena handed to FSCRT_Library_CreateMgr, at least 8MB.
+		* @param[in]	nHeapBytes		Memory the SDK may take beyond the arena. 0 confines it to the arena.
+		*
+		* @return	::FSCRT_ERRCODE_SUCCESS for success.<br>
+		*			::FSCRT_ERRCODE_PARAM if nArenaBytes is less than 8MB or over 4GB, or nHeapBytes is negative.<br>
+		*			For more error codes, please refer to macro definitions <b>FSCRT_ERRCODE_XXX</b>.
+		*
+		* @note	Once the budget is used up SDK calls fail with an out-of-memory result instead of growing the process.
+		*		FSDK_Document recovers from that by reopening the document and retrying the page load or render.
+		*/
+		FS_RESULT	FSDK_InitializeWithBudget(int64 nArenaBytes, int64 nHeapBytes);
+
 		/**
 		* @brief	Finalize PDF module and Foxit SDK library.
 		*
@@ -186,7 +676,61 @@ namespace foxitSDK
 		*/
 		void		FSDK_Finalize();
 
+		//Get counters of the pooled allocator that serves the SDK and of the memory budget.
+		MemoryStats	GetMemoryStats();
+
+		/**
+		* @brief	Start the memory-pressure governor.
+		*
+		* @param[in]	nSoftLimitBytes	Pressure is elevated at 70%, high at 85% and critical at 100% of this, for both the
+		*								process working set and the live bytes of the SDK allocator.
+		* @param[in]	iIntervalMs		Time between samples.
+		* @param[in]	logPath			CSV file receiving every sample and decision, or nullptr.
+		*
+		* @return	true if the governor is running.
+		*
+		* @note	Under pressure the governor halves the SDK cache size (FSCRT_Library_SetCacheSize) down to 8MB, clears
+		*		document read caches, then the SDK caches of documents idle for 30 seconds; at critical pressure of all documents.
+		*/
+		bool		StartMemoryGovernor(int64 nSoftLimitBytes, int32 iIntervalMs, Platform::String^ logPath);
+		void		StopMemoryGovernor();
+		MemoryPressure	GetMemoryPressure();
+
+		/**
+		* @brief	Start recording SDK allocations and handles, to find what grows or leaks.
+		*
+		* @param[in]	nSampleBytes	The call stack of about one allocation per this many bytes allocated on a thread is kept.
+		*								0 keeps the stack of every allocation, which is much slower.
+		* @param[in]	reportPath		File FSDK_Finalize writes the leak report to, or nullptr.
+		*
+		* @return	false if nSampleBytes is negative.
+		*
+		* @note	Recording restarts from scratch on every call; memory allocated before is not seen.
+		*		FSDK_Finalize reports every SDK handle and memory block still alive once the manager is destroyed.
+		*/
+		bool		StartAllocationProfiler(int64 nSampleBytes, Platform::String^ reportPath);
+		void		StopAllocationProfiler();
+		//Write the allocation size histogram and the call sites holding most live memory, with bListAll every live handle and block.
+		bool		SaveAllocationReport(Platform::String^ path, bool bListAll);
+
+		//Bytes of rendered tiles kept for all documents, 64MB by default. 0 turns the cache off.
+		//Revisited pages and areas scrolled back into view are copied from the cache instead of rendered again.
+		void		SetTileCacheBudget(int64 nBytes);
+		TileCacheStats	GetTileCacheStats();
+		void		ClearTileCache();
+
+		//Allocate iCount pixel buffers for a iWidth x iHeight viewport ahead of time. Rendered pages are delivered in
+		//pooled buffers that go back to the pool once the PixelSource's PixelBuffer is released.
+		void		PreallocatePixelBuffers(int32 iWidth, int32 iHeight, int32 iCount);
+
+		//Convert PixelFormat::RGBx pixels, as RenderPageAsync and RenderPageTiledAsync deliver them, to BGRA, RGBA or
+		//Gray8 in a new pooled buffer, with the SSE2 or AVX2 kernels when the CPU has them. nullptr for other formats.
+		PixelSource^	ConvertPixels(PixelSource^ source, PixelFormat format);
+
 	private:
+		//bHeap gives the SDK a memory manager for memory beyond the arena, up to nHeapLimit bytes (0 for no limit).
+		FS_RESULT	InitializeLibrary(size_t nArenaBytes, bool bHeap, uint64_t nHeapLimit);
+		bool		WriteAllocationReport(const wchar_t* path, bool bListAll);
 	};
 
 	
@@ -210,11 +754,21 @@ namespace foxitSDK
 	* @param[in]	iSizeY		Used by FSPDF_Page_GetMatrix.
 	* @param[in]	iRotation	Page rotation value. Use one of macro definitions <b>FSCRT_PAGEROTATION_XXX</b>.
 	* @param[out]	renderBmp	Used to receive SDK bitmap object, to which the page has already been rendered.
+	* @param[in]	pBuffer		Memory of at least iStride * bmpHeight bytes the bitmap is created on, or NULL for the SDK
+	*							to allocate it. The caller keeps owning it; releasing the bitmap does not free it.
+	* @param[in]	iStride		Bytes from one row of pBuffer to the next. Ignored if pBuffer is NULL.
+	* @param[in]	iFormat		A 32bpp bitmap format, <b>FSCRT_BITMAPFORMAT_32BPP_XXX</b>. The bitmap is filled opaque white first.
+	* @param[in]	pPause		Runs the render in its time slices and stops it once its cancel token is cancelled.
+	*							NULL renders in one go.
+	* @param[in]	iRenderFlags	<b>FSPDF_PAGERENDERFLAG_XXX</b>.
 	*
 	* @return	::FSCRT_ERRCODE_SUCCESS for success.<br>
+	*			::FSDK_ERRCODE_CANCELLED if the render was cancelled; the bitmap is released then as on any failure.<br>
 	*			For more error codes, please refer to macro definitions <b>FSCRT_ERRCODE_XXX</b>.
 	*/
-	FS_RESULT	FSDK_PageToBitmap(FSCRT_PAGE page, int bmpWidth, int bmpHeight, int iStartX, int iStartY, int iSizeX, int iSizeY, int iRotation, FSCRT_BITMAP *renderBmp);
+	FS_RESULT	FSDK_PageToBitmap(FSCRT_PAGE page, int bmpWidth, int bmpHeight, int iStartX, int iStartY, int iSizeX, int iSizeY, int iRotation, FSCRT_BITMAP *renderBmp,
+		void* pBuffer = NULL, int iStride = 0, int iFormat = FSCRT_BITMAPFORMAT_32BPP_RGBx, CMy_TimeSlicePause* pPause = NULL,
+		FS_INT32 iRenderFlags = FSPDF_PAGERENDERFLAG_NORMAL);
 
 	/**
 	* @brief	Get SDK bitmap's data.
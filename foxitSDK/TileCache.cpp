@@ -0,0 +1,180 @@
+﻿#include "TileCache.h"
+
+#include <string.h>
+
+using namespace foxitSDK;
+
+//Fixed overhead charged per tile on top of its pixels: entry, key and ordering nodes.
+#define FSDK_TILECACHE_ENTRYBYTES	256
+
+bool FSDK_TileKey::operator==(const FSDK_TileKey& other) const
+{
+	return document == other.document && pageIndex == other.pageIndex && pageWidth == other.pageWidth
+		&& pageHeight == other.pageHeight && rotation == other.rotation && format == other.format && contextFlags == other.contextFlags
+		&& renderFlags == other.renderFlags && tileSize == other.tileSize && tileX == other.tileX && tileY == other.tileY;
+}
+
+size_t FSDK_TileKeyHash::operator()(const FSDK_TileKey& key) const
+{
+	//FNV-1a over the fields, not over the struct, which may have padding.
+	uint64_t values[] = { key.document, (uint64_t)(uint32_t)key.pageIndex, (uint64_t)(uint32_t)key.pageWidth,
+		(uint64_t)(uint32_t)key.pageHeight, (uint64_t)(uint32_t)key.rotation, (uint64_t)(uint32_t)key.format, (uint64_t)key.contextFlags,
+		(uint64_t)(uint32_t)key.renderFlags, (uint64_t)(uint32_t)key.tileSize, (uint64_t)(uint32_t)key.tileX, (uint64_t)(uint32_t)key.tileY };
+	uint64_t hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+	{
+		hash ^= values[i];
+		hash *= 1099511628211ULL;
+	}
+	return (size_t)(hash ^ (hash >> 32));
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Class CMy_TileCache
+CMy_TileCache::CMy_TileCache(uint64_t nBudgetBytes)
+{
+	m_Clock = 0;
+	m_nBudget = nBudgetBytes;
+	m_nBytes = 0;
+	memset(&m_Stats, 0, sizeof(m_Stats));
+}
+
+CMy_TileCache::~CMy_TileCache()
+{
+}
+
+void CMy_TileCache::SetBudget(uint64_t nBudgetBytes)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	m_nBudget = nBudgetBytes;
+	EvictTo(m_nBudget);
+}
+
+double CMy_TileCache::GetPriority(const FSDK_CachedTile& tile, uint64_t nBytes) const
+{
+	//At least a microsecond, so tiles that rendered too fast to measure still rank by size.
+	uint64_t nCost = tile.renderMicros ? tile.renderMicros : 1;
+	return m_Clock + (double)nCost / (double)nBytes;
+}
+
+std::shared_ptr<const FSDK_CachedTile> CMy_TileCache::Lookup(const FSDK_TileKey& key)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	EntryMap::iterator it = m_Entries.find(key);
+	if (it == m_Entries.end())
+	{
+		m_Stats.misses++;
+		return std::shared_ptr<const FSDK_CachedTile>();
+	}
+	m_Stats.hits++;
+	m_Stats.savedMicros += it->second.tile->renderMicros;
+
+	Entry& entry = it->second;
+	m_Order.erase(entry.order);
+	entry.priority = GetPriority(*entry.tile, entry.bytes);
+	entry.order = m_Order.insert(std::make_pair(entry.priority, key));
+	return entry.tile;
+}
+
+void CMy_TileCache::Insert(const FSDK_TileKey& key, int32_t width, int32_t height, const uint8_t* pixels, int32_t stride, uint64_t renderMicros)
+{
+	if (width <= 0 || height <= 0 || !pixels)
+		return;
+	//Copy before taking the lock, rows packed to width * 4.
+	std::shared_ptr<FSDK_CachedTile> pTile = std::make_shared<FSDK_CachedTile>();
+	pTile->width = width;
+	pTile->height = height;
+	pTile->stride = width * 4;
+	pTile->renderMicros = renderMicros;
+	uint64_t nBytes = (uint64_t)pTile->stride * height + FSDK_TILECACHE_ENTRYBYTES;
+	pTile->pixels.resize((size_t)pTile->stride * height);
+	for (int32_t row = 0; row < height; row++)
+		memcpy(&pTile->pixels[(size_t)row * pTile->stride], pixels + (size_t)row * stride, (size_t)pTile->stride);
+
+	std::lock_guard<std::mutex> lock(m_Lock);
+	EntryMap::iterator it = m_Entries.find(key);
+	if (it != m_Entries.end())
+		Remove(it);
+	if (nBytes > m_nBudget)
+	{
+		m_Stats.rejected++;
+		return;
+	}
+	EvictTo(m_nBudget - nBytes);
+
+	Entry entry;
+	entry.tile = pTile;
+	entry.bytes = nBytes;
+	entry.priority = GetPriority(*pTile, nBytes);
+	entry.order = m_Order.insert(std::make_pair(entry.priority, key));
+	m_Entries[key] = entry;
+	m_nBytes += nBytes;
+	m_Stats.insertions++;
+}
+
+void CMy_TileCache::Remove(EntryMap::iterator it)
+{
+	m_nBytes -= it->second.bytes;
+	m_Order.erase(it->second.order);
+	m_Entries.erase(it);
+}
+
+uint64_t CMy_TileCache::EvictTo(uint64_t nBytes)
+{
+	uint64_t nReleased = 0;
+	while (m_nBytes > nBytes && !m_Order.empty())
+	{
+		std::multimap<double, FSDK_TileKey>::iterator lowest = m_Order.begin();
+		m_Clock = lowest->first;
+		EntryMap::iterator it = m_Entries.find(lowest->second);
+		nReleased += it->second.bytes;
+		Remove(it);
+		m_Stats.evictions++;
+	}
+	return nReleased;
+}
+
+void CMy_TileCache::Invalidate(uint64_t document)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	for (EntryMap::iterator it = m_Entries.begin(); it != m_Entries.end();)
+	{
+		EntryMap::iterator current = it++;
+		if (current->first.document == document)
+			Remove(current);
+	}
+}
+
+void CMy_TileCache::Clear()
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	m_Entries.clear();
+	m_Order.clear();
+	m_nBytes = 0;
+}
+
+FSDK_TileCacheStats CMy_TileCache::GetStats()
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	FSDK_TileCacheStats stats = m_Stats;
+	stats.tiles = m_Entries.size();
+	stats.bytes = m_nBytes;
+	stats.budgetBytes = m_nBudget;
+	return stats;
+}
+
+void CMy_TileCache::ResetStats()
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	memset(&m_Stats, 0, sizeof(m_Stats));
+}
+
+uint64_t CMy_TileCache::ReleaseMemory(FSDK_MemoryPressure level)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	if (level >= FSDK_PRESSURE_CRITICAL)
+		return EvictTo(0);
+	if (level >= FSDK_PRESSURE_HIGH)
+		return EvictTo(m_nBytes / 4);
+	return EvictTo(m_nBytes / 2);
+}
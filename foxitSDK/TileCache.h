@@ -0,0 +1,118 @@
+﻿#pragma once
+
+/** Common header files. */
+#include <stdint.h>
+#include <stddef.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "MemoryGovernor.h"
+
+namespace foxitSDK
+{
+	//Identifies a rendered tile. Tiles are anchored at the page's top-left corner in device pixels, so the same
+	//tile comes back whatever part of the page is in view.
+	struct FSDK_TileKey
+	{
+		uint64_t	document;		// Fingerprint of the document's content.
+		int32_t		pageIndex;
+		int32_t		pageWidth;		// Page size in device pixels: the scale, quantized to whole pixels.
+		int32_t		pageHeight;
+		int32_t		rotation;
+		int32_t		format;			// FSCRT_BITMAPFORMAT_XXX.
+		uint32_t	contextFlags;	// FSPDF_RENDERCONTEXTFLAG_XXX.
+		int32_t		renderFlags;	// FSPDF_PAGERENDERFLAG_XXX.
+		int32_t		tileSize;
+		int32_t		tileX;			// Tile column and row from the page's corner, negative left of and above it.
+		int32_t		tileY;
+
+		bool		operator==(const FSDK_TileKey& other) const;
+	};
+
+	struct FSDK_TileKeyHash
+	{
+		size_t		operator()(const FSDK_TileKey& key) const;
+	};
+
+	//Pixels of a cached tile, 32bpp rows stride bytes apart. Shared so a hit needs no copy under the lock.
+	struct FSDK_CachedTile
+	{
+		int32_t		width;
+		int32_t		height;
+		int32_t		stride;
+		uint64_t	renderMicros;	// Time the tile took to render.
+		std::vector<uint8_t>	pixels;
+	};
+
+	//Counters of CMy_TileCache.
+	struct FSDK_TileCacheStats
+	{
+		uint64_t	hits;
+		uint64_t	misses;
+		uint64_t	insertions;
+		uint64_t	evictions;
+		uint64_t	rejected;			// Tiles larger than the whole budget.
+		uint64_t	savedMicros;		// Render time of the tiles served from the cache.
+		uint64_t	tiles;
+		uint64_t	bytes;
+		uint64_t	budgetBytes;
+	};
+
+	//Rendered tiles kept up to a byte budget.
+	//Eviction is GreedyDual-Size: a tile's priority is the clock plus its render time per byte, refreshed on every
+	//hit, and the clock advances to the priority of each evicted tile. Among tiles that cost the same to redo this is
+	//plain LRU; tiles that were slow to render outlive cheap ones of the same size.
+	//As a memory consumer it halves at elevated pressure, keeps a quarter at high and empties at critical.
+	class CMy_TileCache : public IMy_MemoryConsumer
+	{
+	public:
+		CMy_TileCache(uint64_t nBudgetBytes);
+		virtual ~CMy_TileCache();
+
+		//Evicts right away if the cache is over the new budget. 0 disables caching.
+		void		SetBudget(uint64_t nBudgetBytes);
+
+		//NULL on a miss.
+		std::shared_ptr<const FSDK_CachedTile>	Lookup(const FSDK_TileKey& key);
+
+		//Copy a rendered tile in, replacing an older one with the same key.
+		void		Insert(const FSDK_TileKey& key, int32_t width, int32_t height, const uint8_t* pixels, int32_t stride, uint64_t renderMicros);
+
+		//Drop every tile of a document, e.g. when its content changed.
+		void		Invalidate(uint64_t document);
+		void		Clear();
+
+		FSDK_TileCacheStats	GetStats();
+		void		ResetStats();
+
+		virtual uint64_t	ReleaseMemory(FSDK_MemoryPressure level);
+
+	private:
+		struct Entry
+		{
+			std::shared_ptr<const FSDK_CachedTile>	tile;
+			uint64_t	bytes;
+			double		priority;
+			std::multimap<double, FSDK_TileKey>::iterator	order;
+		};
+
+		typedef std::unordered_map<FSDK_TileKey, Entry, FSDK_TileKeyHash>	EntryMap;
+
+		//Priority of a tile touched now.
+		double		GetPriority(const FSDK_CachedTile& tile, uint64_t nBytes) const;
+		//Evict lowest priorities first until the cache holds at most nBytes. Called with m_Lock held.
+		uint64_t	EvictTo(uint64_t nBytes);
+		void		Remove(EntryMap::iterator it);
+
+		std::mutex		m_Lock;
+		EntryMap		m_Entries;
+		std::multimap<double, FSDK_TileKey>	m_Order;		// Eviction order, lowest priority first.
+		double			m_Clock;
+		uint64_t		m_nBudget;
+		uint64_t		m_nBytes;
+		FSDK_TileCacheStats	m_Stats;
+	};
+}
@@ -0,0 +1,178 @@
+﻿#include "TileRenderer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+using namespace foxitSDK;
+
+//Shared by the threads working on one Render call. Helpers that start after every tile was taken only look at next.
+struct FSDK_TileJob
+{
+	FSDK_TileRenderParams	params;
+	std::vector<FSDK_TileRect>	tiles;
+	const FSDK_TileCallback*	pOnTile;		// Valid until done reaches the tile count.
+	std::atomic<size_t>		next;
+	std::atomic<bool>		failed;
+
+	std::mutex				lock;
+	std::condition_variable	finished;
+	size_t					done;
+	FS_RESULT				result;
+};
+
+//Take tiles until none are left.
+static void RunTiles(const std::shared_ptr<FSDK_TileJob>& pJob)
+{
+	size_t nTiles = pJob->tiles.size();
+	for (size_t i = pJob->next++; i < nTiles; i = pJob->next++)
+	{
+		FS_RESULT ret = FSCRT_ERRCODE_SUCCESS;
+		if (!pJob->failed)
+			ret = CMy_TileRenderer::RenderTile(pJob->params, pJob->tiles[i], *pJob->pOnTile);
+
+		std::lock_guard<std::mutex> lock(pJob->lock);
+		if (ret != FSCRT_ERRCODE_SUCCESS && pJob->result == FSCRT_ERRCODE_SUCCESS)
+		{
+			pJob->result = ret;
+			pJob->failed = true;
+		}
+		if (++pJob->done == nTiles)
+			pJob->finished.notify_all();
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Class CMy_TileRenderer
+CMy_TileRenderer::CMy_TileRenderer(CMy_WorkerPool* pPool)
+{
+	m_pPool = pPool;
+}
+
+CMy_TileRenderer::~CMy_TileRenderer()
+{
+}
+
+void CMy_TileRenderer::SplitTiles(int32_t width, int32_t height, int32_t tileSize, std::vector<FSDK_TileRect>& tiles)
+{
+	tiles.clear();
+	if (width <= 0 || height <= 0 || tileSize <= 0)
+		return;
+	for (int32_t y = 0; y < height; y += tileSize)
+	{
+		for (int32_t x = 0; x < width; x += tileSize)
+		{
+			FSDK_TileRect tile;
+			tile.x = x;
+			tile.y = y;
+			tile.width = std::min(tileSize, width - x);
+			tile.height = std::min(tileSize, height - y);
+			tiles.push_back(tile);
+		}
+	}
+}
+
+FS_RESULT CMy_TileRenderer::Render(const FSDK_TileRenderParams& params, const FSDK_TileCallback& onTile)
+{
+	std::vector<FSDK_TileRect> tiles;
+	SplitTiles(params.width, params.height, params.tileSize, tiles);
+	if (tiles.empty())
+		return FSCRT_ERRCODE_PARAM;
+	return Render(params, tiles, onTile);
+}
+
+FS_RESULT CMy_TileRenderer::Render(const FSDK_TileRenderParams& params, const std::vector<FSDK_TileRect>& tiles, const FSDK_TileCallback& onTile)
+{
+	if (!params.page)
+		return FSCRT_ERRCODE_PARAM;
+	if (tiles.empty())
+		return FSCRT_ERRCODE_SUCCESS;
+	std::shared_ptr<FSDK_TileJob> pJob = std::make_shared<FSDK_TileJob>();
+	pJob->tiles = tiles;
+	pJob->params = params;
+	pJob->pOnTile = &onTile;
+	pJob->next = 0;
+	pJob->failed = false;
+	pJob->done = 0;
+	pJob->result = FSCRT_ERRCODE_SUCCESS;
+
+	//One helper per pool thread, but no more than there are tiles besides the caller's own.
+	size_t nHelpers = m_pPool ? std::min(m_pPool->GetThreadCount(), pJob->tiles.size() - 1) : 0;
+	for (size_t i = 0; i < nHelpers; i++)
+	{
+		if (!m_pPool->Submit([pJob]() { RunTiles(pJob); }))
+			break;
+	}
+	RunTiles(pJob);
+
+	std::unique_lock<std::mutex> lock(pJob->lock);
+	pJob->finished.wait(lock, [&pJob]() { return pJob->done == pJob->tiles.size(); });
+	return pJob->result;
+}
+
+FS_RESULT CMy_TileRenderer::RenderTile(const FSDK_TileRenderParams& params, const FSDK_TileRect& tile, const FSDK_TileCallback& onTile)
+{
+	if (params.pCancel && params.pCancel->IsCancelled())
+		return FSDK_ERRCODE_CANCELLED;
+	CMy_MemoryScope memoryScope(params.pAccounting, (const void*)params.page, FSDK_MEMOP_RENDER);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	FSCRT_BITMAP bitmap = NULL;
+	FSCRT_RENDERER renderer = NULL;
+	FSPDF_RENDERCONTEXT rendercontext = NULL;
+	FSCRT_PROGRESS renderProgress = NULL;
+
+	FS_INT32 format = params.format ? params.format : FSCRT_BITMAPFORMAT_32BPP_RGBx;
+	FS_RESULT ret = FSCRT_Bitmap_Create(tile.width, tile.height, format, NULL, 0, &bitmap);
+	FSCRT_RECT clipRect = { 0, 0, tile.width, tile.height };
+	if (ret == FSCRT_ERRCODE_SUCCESS)
+		ret = FSCRT_Bitmap_FillRect(bitmap, FSCRT_ARGB_Encode(0xff, 0xff, 0xff, 0xff), &clipRect);
+	if (ret == FSCRT_ERRCODE_SUCCESS)
+		ret = FSCRT_Renderer_CreateOnBitmap(bitmap, &renderer);
+	if (ret == FSCRT_ERRCODE_SUCCESS)
+		ret = FSCRT_Renderer_SetClipRect(renderer, &clipRect);
+	if (ret == FSCRT_ERRCODE_SUCCESS)
+		ret = FSPDF_RenderContext_Create(&rendercontext);
+	if (ret == FSCRT_ERRCODE_SUCCESS)
+		ret = FSPDF_RenderContext_SetFlags(rendercontext, params.contextFlags);
+	if (ret == FSCRT_ERRCODE_SUCCESS)
+	{
+		//Same transformation as the whole area, moved so the tile's corner lands on the bitmap's origin.
+		FSCRT_MATRIX matrix = params.matrix;
+		matrix.e -= (FS_FLOAT)tile.x;
+		matrix.f -= (FS_FLOAT)tile.y;
+		ret = FSPDF_RenderContext_SetMatrix(rendercontext, &matrix);
+	}
+	if (ret == FSCRT_ERRCODE_SUCCESS)
+		ret = FSPDF_RenderContext_StartPage(rendercontext, renderer, params.page, params.renderFlags, &renderProgress);
+	if (ret == FSCRT_ERRCODE_SUCCESS)
+	{
+		//No slice limit, the pause handler only stops the tile once it is cancelled.
+		CMy_TimeSlicePause pause(0, params.pCancel);
+		ret = pause.Run(renderProgress);
+	}
+
+	if (renderProgress)
+		FSCRT_Progress_Release(renderProgress);
+	if (rendercontext)
+		FSPDF_RenderContext_Release(rendercontext);
+	if (renderer)
+		FSCRT_Renderer_Release(renderer);
+
+	if (ret == FSCRT_ERRCODE_FINISHED)
+	{
+		void* pPixels = NULL;
+		FS_INT32 stride = 0;
+		ret = FSCRT_Bitmap_GetLineBuffer(bitmap, 0, &pPixels);
+		if (ret == FSCRT_ERRCODE_SUCCESS)
+			ret = FSCRT_Bitmap_GetLineStride(bitmap, &stride);
+		uint64_t nMicros = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+		if (ret == FSCRT_ERRCODE_SUCCESS)
+			onTile(tile, (const uint8_t*)pPixels, (int32_t)stride, nMicros);
+	}
+	if (bitmap)
+		FSCRT_Bitmap_Release(bitmap);
+	return ret;
+}
@@ -0,0 +1,74 @@
+﻿#pragma once
+
+/** Common header files. */
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+#include <vector>
+
+/** Include header files of SDK. */
+#include "../foxitSDK/include/fsdk.h"
+
+#include "MemoryAccounting.h"
+#include "PauseHandler.h"
+#include "WorkerPool.h"
+
+namespace foxitSDK
+{
+	//A tile of the render area, in device pixels.
+	struct FSDK_TileRect
+	{
+		int32_t		x;
+		int32_t		y;
+		int32_t		width;
+		int32_t		height;
+	};
+
+	//What to render. matrix maps the page to the whole render area, as FSPDF_Page_GetMatrix returns it.
+	struct FSDK_TileRenderParams
+	{
+		FSCRT_PAGE		page;			// A parsed page.
+		FSCRT_MATRIX	matrix;
+		int32_t			width;			// Size of the whole render area.
+		int32_t			height;
+		int32_t			tileSize;		// Edge of a tile, tiles on the right and bottom edges are smaller.
+		int32_t			format;			// FSCRT_BITMAPFORMAT_32BPP_RGBx or _BGRA, 0 for RGBx.
+		FS_DWORD		contextFlags;	// FSPDF_RENDERCONTEXTFLAG_XXX.
+		FS_INT32		renderFlags;	// FSPDF_PAGERENDERFLAG_XXX.
+		CMy_MemoryAccounting*	pAccounting;	// Charges tile rendering to the page if it was bound, may be NULL.
+		const CMy_CancelToken*	pCancel;		// Stops tiles in progress and skips the rest once cancelled, may be NULL.
+	};
+
+	//Receives a finished tile: pixels are 32bpp rows in params.format of tile.width pixels, stride bytes apart.
+	//renderMicros is the time the tile took. Called on worker threads, several at a time; the pixels are only
+	//valid during the call.
+	typedef std::function<void(const FSDK_TileRect& tile, const uint8_t* pixels, int32_t stride, uint64_t renderMicros)>	FSDK_TileCallback;
+
+	//Renders a page area as fixed-size tiles in parallel.
+	//Every tile gets its own bitmap and renderer, clipped to the tile, with the shared page matrix moved to the tile's
+	//origin, so workers never touch the same bitmap. The calling thread renders tiles too and the pool's threads
+	//join in as they become free, so a busy pool only slows a render down.
+	class CMy_TileRenderer
+	{
+	public:
+		//pPool may be NULL, then everything is rendered on the calling thread.
+		CMy_TileRenderer(CMy_WorkerPool* pPool);
+		~CMy_TileRenderer();
+
+		//Render every tile and return once all have been delivered. After the first failing tile the rest are skipped.
+		//Returns FSCRT_ERRCODE_SUCCESS or the result of the first failing tile, FSDK_ERRCODE_CANCELLED once cancelled.
+		FS_RESULT	Render(const FSDK_TileRenderParams& params, const FSDK_TileCallback& onTile);
+
+		//Render the given tiles only. They may lie partly or wholly outside params.width and params.height.
+		FS_RESULT	Render(const FSDK_TileRenderParams& params, const std::vector<FSDK_TileRect>& tiles, const FSDK_TileCallback& onTile);
+
+		//Split a width x height area into tiles, row by row.
+		static void	SplitTiles(int32_t width, int32_t height, int32_t tileSize, std::vector<FSDK_TileRect>& tiles);
+
+		//Render a single tile on the calling thread.
+		static FS_RESULT	RenderTile(const FSDK_TileRenderParams& params, const FSDK_TileRect& tile, const FSDK_TileCallback& onTile);
+
+	private:
+		CMy_WorkerPool*		m_pPool;
+	};
+}
@@ -0,0 +1,108 @@
+﻿#include "WorkerPool.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace foxitSDK;
+
+//Let the calling thread yield to threads of normal priority.
+static void LowerThreadPriority()
+{
+#ifdef _WIN32
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+#elif defined(__linux__)
+	//Linux keeps a nice value per thread.
+	setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), 10);
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Class CMy_WorkerPool
+CMy_WorkerPool::CMy_WorkerPool()
+{
+	m_bStop = false;
+	m_bBackground = false;
+}
+
+CMy_WorkerPool::~CMy_WorkerPool()
+{
+	Stop();
+}
+
+bool CMy_WorkerPool::Start(size_t nThreads, bool bBackground)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	if (!m_Threads.empty())
+		return false;
+	if (nThreads == 0)
+		nThreads = std::thread::hardware_concurrency();
+	if (nThreads == 0)
+		nThreads = 1;
+	m_bStop = false;
+	m_bBackground = bBackground;
+	for (size_t i = 0; i < nThreads; i++)
+		m_Threads.push_back(std::thread(&CMy_WorkerPool::WorkerProc, this));
+	return true;
+}
+
+void CMy_WorkerPool::Stop()
+{
+	std::vector<std::thread> threads;
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		m_bStop = true;
+		threads.swap(m_Threads);
+	}
+	m_Changed.notify_all();
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+}
+
+bool CMy_WorkerPool::Submit(const std::function<void()>& task)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		if (m_Threads.empty() || m_bStop)
+			return false;
+		m_Tasks.push_back(task);
+	}
+	m_Changed.notify_one();
+	return true;
+}
+
+size_t CMy_WorkerPool::GetThreadCount()
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	return m_Threads.size();
+}
+
+size_t CMy_WorkerPool::GetQueueLength()
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	return m_Tasks.size();
+}
+
+void CMy_WorkerPool::WorkerProc()
+{
+	if (m_bBackground)
+		LowerThreadPriority();
+	for (;;)
+	{
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(m_Lock);
+			m_Changed.wait(lock, [this]() { return m_bStop || !m_Tasks.empty(); });
+			//Queued tasks still run after Stop, only an empty queue ends the thread.
+			if (m_Tasks.empty())
+				return;
+			task = m_Tasks.front();
+			m_Tasks.pop_front();
+		}
+		task();
+	}
+}
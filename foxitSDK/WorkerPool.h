@@ -0,0 +1,46 @@
+﻿#pragma once
+
+/** Common header files. */
+#include <stdint.h>
+#include <stddef.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace foxitSDK
+{
+	//Fixed set of threads running submitted tasks in submission order.
+	//Tasks must not wait for other tasks of the same pool, there may be no thread left to run them.
+	class CMy_WorkerPool
+	{
+	public:
+		CMy_WorkerPool();
+		~CMy_WorkerPool();
+
+		//Start nThreads threads, 0 for one per hardware thread. Threads of a background pool run below normal priority,
+		//so they only get the CPU time nothing else wants.
+		bool		Start(size_t nThreads, bool bBackground = false);
+		//Run the tasks already queued, then stop the threads.
+		void		Stop();
+
+		//Returns false if the pool is not running.
+		bool		Submit(const std::function<void()>& task);
+
+		size_t		GetThreadCount();
+		//Tasks queued but not started yet.
+		size_t		GetQueueLength();
+
+	private:
+		void		WorkerProc();
+
+		std::mutex				m_Lock;
+		std::condition_variable	m_Changed;
+		std::deque<std::function<void()> >	m_Tasks;
+		std::vector<std::thread>	m_Threads;
+		bool					m_bStop;
+		bool					m_bBackground;
+	};
+}
@@ -0,0 +1,461 @@
+﻿#include "WriteBehind.h"
+
+#include <string.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+using namespace foxitSDK;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Class CMy_PosixFileSink
+CMy_PosixFileSink::CMy_PosixFileSink()
+{
+#ifdef _WIN32
+	m_pFile = NULL;
+#else
+	m_iFd = -1;
+#endif
+}
+
+CMy_PosixFileSink::~CMy_PosixFileSink()
+{
+	Close();
+}
+
+bool CMy_PosixFileSink::Open(const char* path, bool bTruncate)
+{
+	Close();
+	if (!path)
+		return false;
+
+#ifdef _WIN32
+	//"r+b" needs an existing file.
+	if ((bTruncate || fopen_s(&m_pFile, path, "r+b") != 0) && fopen_s(&m_pFile, path, "w+b") != 0)
+		m_pFile = NULL;
+	if (!m_pFile)
+		return false;
+#else
+	m_iFd = open(path, O_RDWR | O_CREAT | (bTruncate ? O_TRUNC : 0), 0644);
+	if (m_iFd < 0)
+		return false;
+#endif
+	return true;
+}
+
+void CMy_PosixFileSink::Close()
+{
+#ifdef _WIN32
+	if (m_pFile)
+		fclose(m_pFile);
+	m_pFile = NULL;
+#else
+	if (m_iFd >= 0)
+		close(m_iFd);
+	m_iFd = -1;
+#endif
+}
+
+uint64_t CMy_PosixFileSink::GetSize()
+{
+#ifdef _WIN32
+	if (!m_pFile || fflush(m_pFile) != 0)
+		return 0;
+	__int64 iSize = _filelengthi64(_fileno(m_pFile));
+	return iSize < 0 ? 0 : (uint64_t)iSize;
+#else
+	struct stat st;
+	if (m_iFd < 0 || fstat(m_iFd, &st) != 0)
+		return 0;
+	return (uint64_t)st.st_size;
+#endif
+}
+
+bool CMy_PosixFileSink::WriteAt(uint64_t offset, const void* buffer, size_t size)
+{
+	if (!buffer && size)
+		return false;
+
+#ifdef _WIN32
+	if (!m_pFile || _fseeki64(m_pFile, (__int64)offset, SEEK_SET) != 0)
+		return false;
+	return fwrite(buffer, 1, size, m_pFile) == size;
+#else
+	if (m_iFd < 0)
+		return false;
+	const unsigned char* pSrc = (const unsigned char*)buffer;
+	while (size > 0)
+	{
+		ssize_t nWritten = pwrite(m_iFd, pSrc, size, (off_t)offset);
+		if (nWritten <= 0)
+			return false;
+		pSrc += nWritten;
+		offset += (uint64_t)nWritten;
+		size -= (size_t)nWritten;
+	}
+	return true;
+#endif
+}
+
+bool CMy_PosixFileSink::ReadAt(uint64_t offset, void* buffer, size_t size)
+{
+	if (!buffer)
+		return false;
+
+#ifdef _WIN32
+	if (!m_pFile || _fseeki64(m_pFile, (__int64)offset, SEEK_SET) != 0)
+		return false;
+	return fread(buffer, 1, size, m_pFile) == size;
+#else
+	if (m_iFd < 0)
+		return false;
+	unsigned char* pDest = (unsigned char*)buffer;
+	while (size > 0)
+	{
+		ssize_t nRead = pread(m_iFd, pDest, size, (off_t)offset);
+		if (nRead <= 0)
+			return false;
+		pDest += nRead;
+		offset += (uint64_t)nRead;
+		size -= (size_t)nRead;
+	}
+	return true;
+#endif
+}
+
+bool CMy_PosixFileSink::Truncate(uint64_t size)
+{
+#ifdef _WIN32
+	if (!m_pFile || fflush(m_pFile) != 0)
+		return false;
+	return _chsize_s(_fileno(m_pFile), (__int64)size) == 0;
+#else
+	return m_iFd >= 0 && ftruncate(m_iFd, (off_t)size) == 0;
+#endif
+}
+
+bool CMy_PosixFileSink::Flush()
+{
+#ifdef _WIN32
+	return m_pFile && fflush(m_pFile) == 0 && _commit(_fileno(m_pFile)) == 0;
+#else
+	return m_iFd >= 0 && fsync(m_iFd) == 0;
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Class CMy_WriteBehindQueue
+CMy_WriteBehindQueue::CMy_WriteBehindQueue(IMy_FileSink* pSink, size_t nSlotSize, size_t nMaxSlots, CMy_ChunkPool* pPool)
+{
+	m_pSink = pSink;
+	m_pPool = pPool ? pPool : &CMy_ChunkPool::GetDefault();
+	m_nSlotSize = nSlotSize ? nSlotSize : 1024 * 1024;
+	//One slot for the producer to fill while another one is being written.
+	m_nMaxSlots = nMaxSlots < 2 ? 2 : nMaxSlots;
+	m_Current.data = NULL;
+	m_Current.offset = 0;
+	m_Current.length = 0;
+	m_nSlotsInUse = 0;
+	m_bWriting = false;
+	m_bStop = false;
+	m_bFailed = false;
+	m_iSize = 0;
+	memset(&m_Stats, 0, sizeof(m_Stats));
+}
+
+CMy_WriteBehindQueue::~CMy_WriteBehindQueue()
+{
+	Close();
+}
+
+bool CMy_WriteBehindQueue::Start()
+{
+	if (!m_pSink || m_Writer.joinable())
+		return false;
+	m_bStop = false;
+	m_Writer = std::thread(&CMy_WriteBehindQueue::WriterProc, this);
+	return true;
+}
+
+bool CMy_WriteBehindQueue::Write(uint64_t offset, const void* buffer, size_t size)
+{
+	if (!buffer && size)
+		return false;
+
+	std::unique_lock<std::mutex> lock(m_Lock);
+	if (m_bFailed || !m_Writer.joinable())
+		return false;
+	m_Stats.bytesQueued += size;
+
+	const unsigned char* pSrc = (const unsigned char*)buffer;
+	while (size > 0)
+	{
+		//Continue the current slot if this write is adjacent to it.
+		if (m_Current.data && (offset != m_Current.offset + m_Current.length || m_Current.length == m_nSlotSize))
+			SealCurrent();
+
+		if (!m_Current.data)
+		{
+			if (m_nSlotsInUse >= m_nMaxSlots)
+			{
+				m_Stats.producerStalls++;
+				m_Changed.wait(lock, [this] { return m_nSlotsInUse < m_nMaxSlots || m_bFailed; });
+				if (m_bFailed)
+					return false;
+			}
+			m_Current.data = m_pPool->Acquire(m_nSlotSize);
+			if (!m_Current.data)
+			{
+				m_bFailed = true;
+				return false;
+			}
+			m_Current.offset = offset;
+			m_Current.length = 0;
+			m_nSlotsInUse++;
+		}
+
+		size_t nCount = m_nSlotSize - m_Current.length;
+		if (nCount > size)
+			nCount = size;
+		memcpy(m_Current.data + m_Current.length, pSrc, nCount);
+		m_Current.length += nCount;
+		pSrc += nCount;
+		offset += nCount;
+		size -= nCount;
+		if (offset > m_iSize)
+			m_iSize = offset;
+	}
+	return true;
+}
+
+bool CMy_WriteBehindQueue::Truncate(uint64_t size)
+{
+	if (!Drain() || !m_pSink->Truncate(size))
+		return false;
+	m_iSize = size;
+	return true;
+}
+
+bool CMy_WriteBehindQueue::ReadAt(uint64_t offset, void* buffer, size_t size)
+{
+	if (!buffer || offset > m_iSize || size > m_iSize - offset)
+		return false;
+	//The data may still be in a slot, let it reach the sink first.
+	if (!Drain())
+		return false;
+	return m_pSink->ReadAt(offset, buffer, size);
+}
+
+bool CMy_WriteBehindQueue::Flush()
+{
+	if (!Drain())
+		return false;
+	return m_pSink->Flush();
+}
+
+bool CMy_WriteBehindQueue::Close()
+{
+	if (!m_Writer.joinable())
+		return !HasFailed();
+
+	bool bOk = Flush();
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		m_bStop = true;
+	}
+	m_Changed.notify_all();
+	m_Writer.join();
+
+	//Only left over when a write failed.
+	if (m_Current.data)
+		m_pPool->Release(m_Current.data, m_nSlotSize);
+	m_Current.data = NULL;
+	for (size_t i = 0; i < m_Pending.size(); i++)
+		m_pPool->Release(m_Pending[i].data, m_nSlotSize);
+	m_Pending.clear();
+	m_nSlotsInUse = 0;
+	return bOk && !HasFailed();
+}
+
+bool CMy_WriteBehindQueue::HasFailed()
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	return m_bFailed;
+}
+
+FSDK_WriteBehindStats CMy_WriteBehindQueue::GetStats()
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	return m_Stats;
+}
+
+void CMy_WriteBehindQueue::SealCurrent()
+{
+	if (!m_Current.data)
+		return;
+	m_Pending.push_back(m_Current);
+	m_Current.data = NULL;
+	m_Current.length = 0;
+	m_Changed.notify_all();
+}
+
+bool CMy_WriteBehindQueue::Drain()
+{
+	std::unique_lock<std::mutex> lock(m_Lock);
+	if (!m_Writer.joinable())
+		return false;
+	SealCurrent();
+	m_Changed.wait(lock, [this] { return (m_Pending.empty() && !m_bWriting) || m_bFailed; });
+	return !m_bFailed;
+}
+
+void CMy_WriteBehindQueue::WriterProc()
+{
+	std::unique_lock<std::mutex> lock(m_Lock);
+	for (;;)
+	{
+		m_Changed.wait(lock, [this] { return !m_Pending.empty() || m_bStop; });
+		if (m_Pending.empty())
+			break;
+
+		Slot slot = m_Pending.front();
+		m_Pending.pop_front();
+		m_bWriting = true;
+		bool bSkip = m_bFailed;
+		lock.unlock();
+
+		//After a failure the rest is dropped, the save is reported as failed anyway.
+		bool bOk = bSkip || m_pSink->WriteAt(slot.offset, slot.data, slot.length);
+		m_pPool->Release(slot.data, m_nSlotSize);
+
+		lock.lock();
+		if (!bOk)
+			m_bFailed = true;
+		else if (!bSkip)
+		{
+			m_Stats.bytesWritten += slot.length;
+			m_Stats.sinkWrites++;
+		}
+		m_bWriting = false;
+		m_nSlotsInUse--;
+		m_Changed.notify_all();
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Class CMy_WriteBehindFile
+static uint64_t FileSizeToUInt64(const FSCRT_FILESIZE* size)
+{
+	return ((uint64_t)size->hiSize << 32) | size->loSize;
+}
+
+CMy_WriteBehindFile::CMy_WriteBehindFile()
+{
+	clientData = NULL;
+	Release = NULL;
+	GetSize = NULL;
+	ReadBlock = NULL;
+	WriteBlock = NULL;
+	Flush = NULL;
+	Truncate = NULL;
+}
+
+CMy_WriteBehindFile::~CMy_WriteBehindFile()
+{
+}
+
+void CMy_WriteBehindFile::InitFileHandle(CMy_WriteBehindQueue* pQueue)
+{
+	clientData = pQueue;
+	Release = g_PrivateRelease;
+	GetSize = g_PrivateGetSize;
+	ReadBlock = g_PrivateReadBlock;
+	WriteBlock = g_PrivateWriteBlock;
+	Flush = g_PrivateFlush;
+	Truncate = g_PrivateTruncate;
+}
+
+void CMy_WriteBehindFile::ReleaseFileHandle()
+{
+	clientData = NULL;
+	Release = NULL;
+	GetSize = NULL;
+	ReadBlock = NULL;
+	WriteBlock = NULL;
+	Flush = NULL;
+	Truncate = NULL;
+}
+
+void CMy_WriteBehindFile::g_PrivateRelease(FS_LPVOID /*clientData*/)
+{
+	//The queue is owned by whoever started the save, it is closed there.
+}
+
+FS_RESULT CMy_WriteBehindFile::g_PrivateGetSize(FS_LPVOID clientData, FSCRT_FILESIZE* size)
+{
+	CMy_WriteBehindQueue* pQueue = (CMy_WriteBehindQueue*)clientData;
+	if (!pQueue || !size)
+		return FSCRT_ERRCODE_PARAM;
+
+	uint64_t iSize = pQueue->GetSize();
+	size->loSize = (FS_DWORD)(iSize & 0xFFFFFFFF);
+	size->hiSize = (FS_DWORD)(iSize >> 32);
+	return FSCRT_ERRCODE_SUCCESS;
+}
+
+FS_RESULT CMy_WriteBehindFile::g_PrivateReadBlock(FS_LPVOID clientData, const FSCRT_FILESIZE* offset, FS_LPVOID buffer, const FSCRT_FILESIZE* size)
+{
+	CMy_WriteBehindQueue* pQueue = (CMy_WriteBehindQueue*)clientData;
+	if (!pQueue || !offset || !size || !buffer)
+		return FSCRT_ERRCODE_PARAM;
+
+	uint64_t iSize = FileSizeToUInt64(size);
+	if (iSize > (uint64_t)SIZE_MAX)
+		return FSCRT_ERRCODE_FILE;
+	if (!pQueue->ReadAt(FileSizeToUInt64(offset), buffer, (size_t)iSize))
+		return FSCRT_ERRCODE_FILE;
+	return FSCRT_ERRCODE_SUCCESS;
+}
+
+FS_RESULT CMy_WriteBehindFile::g_PrivateWriteBlock(FS_LPVOID clientData, const FSCRT_FILESIZE* offset, FS_LPCVOID buffer, const FSCRT_FILESIZE* size)
+{
+	CMy_WriteBehindQueue* pQueue = (CMy_WriteBehindQueue*)clientData;
+	if (!pQueue)
+		return FSCRT_ERRCODE_FILE;
+	if (!offset || !size || !buffer)
+		return FSCRT_ERRCODE_PARAM;
+
+	uint64_t iSize = FileSizeToUInt64(size);
+	if (iSize > (uint64_t)SIZE_MAX)
+		return FSCRT_ERRCODE_FILE;
+	if (!pQueue->Write(FileSizeToUInt64(offset), buffer, (size_t)iSize))
+		return FSCRT_ERRCODE_ERROR;
+	return FSCRT_ERRCODE_SUCCESS;
+}
+
+FS_RESULT CMy_WriteBehindFile::g_PrivateFlush(FS_LPVOID clientData)
+{
+	CMy_WriteBehindQueue* pQueue = (CMy_WriteBehindQueue*)clientData;
+	if (!pQueue)
+		return FSCRT_ERRCODE_FILE;
+	if (!pQueue->Flush())
+		return FSCRT_ERRCODE_ERROR;
+	return FSCRT_ERRCODE_SUCCESS;
+}
+
+FS_RESULT CMy_WriteBehindFile::g_PrivateTruncate(FS_LPVOID clientData, const FSCRT_FILESIZE* fileSize)
+{
+	CMy_WriteBehindQueue* pQueue = (CMy_WriteBehindQueue*)clientData;
+	if (!pQueue)
+		return FSCRT_ERRCODE_FILE;
+	if (!fileSize)
+		return FSCRT_ERRCODE_PARAM;
+	if (!pQueue->Truncate(FileSizeToUInt64(fileSize)))
+		return FSCRT_ERRCODE_ERROR;
+	return FSCRT_ERRCODE_SUCCESS;
+}
@@ -0,0 +1,152 @@
+﻿#pragma once
+
+/** Common header files. */
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+/** Include header files of SDK. */
+#include "../foxitSDK/include/fsdk.h"
+
+#include "WriteBuffer.h"
+
+namespace foxitSDK
+{
+	//Random-access destination of a save.
+	//Only the write-behind thread calls WriteAt; the other calls come after the queue has been drained.
+	class IMy_FileSink
+	{
+	public:
+		virtual ~IMy_FileSink() {}
+
+		//Current size of the destination, in bytes.
+		virtual uint64_t	GetSize() = 0;
+
+		//Write exactly size bytes at offset, extending the destination if needed.
+		virtual bool		WriteAt(uint64_t offset, const void* buffer, size_t size) = 0;
+
+		//Read back data that was already written. Returns false on short read or I/O error.
+		virtual bool		ReadAt(uint64_t offset, void* buffer, size_t size) = 0;
+
+		virtual bool		Truncate(uint64_t size) = 0;
+
+		//Make everything written so far durable.
+		virtual bool		Flush() = 0;
+	};
+
+	//Sink over a plain file on disk.
+	class CMy_PosixFileSink : public IMy_FileSink
+	{
+	public:
+		CMy_PosixFileSink();
+		virtual ~CMy_PosixFileSink();
+
+		//Create path, or open it. bTruncate drops the old content.
+		bool				Open(const char* path, bool bTruncate = true);
+		void				Close();
+
+		virtual uint64_t	GetSize();
+		virtual bool		WriteAt(uint64_t offset, const void* buffer, size_t size);
+		virtual bool		ReadAt(uint64_t offset, void* buffer, size_t size);
+		virtual bool		Truncate(uint64_t size);
+		virtual bool		Flush();
+
+	private:
+#ifdef _WIN32
+		FILE*				m_pFile;
+#else
+		int					m_iFd;
+#endif
+	};
+
+	//Counters of a write-behind queue.
+	struct FSDK_WriteBehindStats
+	{
+		uint64_t	bytesQueued;		// Bytes handed over by the SDK.
+		uint64_t	bytesWritten;		// Bytes written to the sink.
+		uint64_t	sinkWrites;			// WriteAt calls on the sink, after coalescing.
+		uint64_t	producerStalls;		// Times the SDK thread waited for a free slot.
+	};
+
+	//Bounded write-behind queue in front of an IMy_FileSink.
+	//Writes are copied into a fixed number of pooled slots and written out by a background thread in order,
+	//so memory stays at nSlotSize * nMaxSlots however large the output is. Adjacent writes share a slot.
+	//Write, Truncate, ReadAt and Flush must be called from one thread (the one driving the save).
+	class CMy_WriteBehindQueue
+	{
+	public:
+		//nSlotSize must be a power of two.
+		CMy_WriteBehindQueue(IMy_FileSink* pSink, size_t nSlotSize = 1024 * 1024, size_t nMaxSlots = 8, CMy_ChunkPool* pPool = NULL);
+		~CMy_WriteBehindQueue();
+
+		bool				Start();
+
+		bool				Write(uint64_t offset, const void* buffer, size_t size);
+		bool				Truncate(uint64_t size);
+		bool				ReadAt(uint64_t offset, void* buffer, size_t size);
+
+		//Wait until everything queued is on the sink, then flush the sink.
+		bool				Flush();
+
+		//Flush and stop the background thread. Returns false if any write failed.
+		bool				Close();
+
+		//Logical size of the output: the end of the furthest write, or the truncated size.
+		uint64_t			GetSize() const { return m_iSize; }
+		bool				HasFailed();
+		FSDK_WriteBehindStats	GetStats();
+
+	private:
+		struct Slot
+		{
+			unsigned char*	data;
+			uint64_t		offset;
+			size_t			length;
+		};
+
+		void				WriterProc();
+		void				SealCurrent();
+		bool				Drain();
+
+		IMy_FileSink*		m_pSink;
+		CMy_ChunkPool*		m_pPool;
+		size_t				m_nSlotSize;
+		size_t				m_nMaxSlots;
+
+		std::mutex				m_Lock;
+		std::condition_variable	m_Changed;
+		std::deque<Slot>		m_Pending;
+		Slot					m_Current;			// Slot being filled by the producer, data is NULL when there is none.
+		size_t					m_nSlotsInUse;		// Current + pending + the one being written.
+		bool					m_bWriting;
+		bool					m_bStop;
+		bool					m_bFailed;
+		std::thread				m_Writer;
+
+		uint64_t				m_iSize;
+		FSDK_WriteBehindStats	m_Stats;
+	};
+
+	//Inherited class of FSCRT_FILEHANDLER_L which streams a save to the destination through a CMy_WriteBehindQueue.
+	class CMy_WriteBehindFile : public FSCRT_FILEHANDLER_L
+	{
+	public:
+		CMy_WriteBehindFile();
+		~CMy_WriteBehindFile();
+
+		void InitFileHandle(CMy_WriteBehindQueue* pQueue);
+		void ReleaseFileHandle();
+
+		//Inherited callback funtions.
+		static void g_PrivateRelease(FS_LPVOID clientData);
+		static FS_RESULT g_PrivateGetSize(FS_LPVOID clientData, FSCRT_FILESIZE* size);
+		static FS_RESULT g_PrivateReadBlock(FS_LPVOID clientData, const FSCRT_FILESIZE* offset, FS_LPVOID buffer, const FSCRT_FILESIZE* size);
+		static FS_RESULT g_PrivateWriteBlock(FS_LPVOID clientData, const FSCRT_FILESIZE* offset, FS_LPCVOID buffer, const FSCRT_FILESIZE* size);
+		static FS_RESULT g_PrivateFlush(FS_LPVOID clientData);
+		static FS_RESULT g_PrivateTruncate(FS_LPVOID clientData, const FSCRT_FILESIZE* fileSize);
+	};
+}
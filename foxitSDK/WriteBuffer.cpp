@@ -0,0 +1,359 @@
+﻿#include "WriteBuffer.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+using namespace foxitSDK;
+
+//Chunk sizes double from MIN to MAX, then stay at MAX.
+#define FSDK_WRITEBUFFER_MINCHUNK		(256 * 1024)
+#define FSDK_WRITEBUFFER_MAXCHUNK		(16 * 1024 * 1024)
+
+//Paths are UTF-8; on Windows the CRT only takes them through the wide functions.
+static FILE* OpenFile(const std::string& path, const char* mode)
+{
+#ifdef _WIN32
+	int nLength = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, NULL, 0);
+	if (nLength <= 0)
+		return NULL;
+	std::wstring widePath(nLength, L'\0');
+	MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, &widePath[0], nLength);
+	std::wstring wideMode(mode, mode + strlen(mode));
+	FILE* pFile = NULL;
+	if (_wfopen_s(&pFile, widePath.c_str(), wideMode.c_str()) != 0)
+		return NULL;
+	return pFile;
+#else
+	return fopen(path.c_str(), mode);
+#endif
+}
+
+static void RemoveFile(const std::string& path)
+{
+#ifdef _WIN32
+	int nLength = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, NULL, 0);
+	if (nLength <= 0)
+		return;
+	std::wstring widePath(nLength, L'\0');
+	MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, &widePath[0], nLength);
+	_wremove(widePath.c_str());
+#else
+	remove(path.c_str());
+#endif
+}
+
+static bool SeekFile(FILE* pFile, uint64_t offset)
+{
+#ifdef _WIN32
+	return _fseeki64(pFile, (__int64)offset, SEEK_SET) == 0;
+#else
+	return fseeko(pFile, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Class CMy_ChunkPool
+CMy_ChunkPool::CMy_ChunkPool(size_t nMaxPooledBytes)
+{
+	m_nPooledBytes = 0;
+	m_nMaxPooledBytes = nMaxPooledBytes;
+}
+
+CMy_ChunkPool::~CMy_ChunkPool()
+{
+	Trim();
+}
+
+CMy_ChunkPool& CMy_ChunkPool::GetDefault()
+{
+	static CMy_ChunkPool s_Pool;
+	return s_Pool;
+}
+
+unsigned char* CMy_ChunkPool::Acquire(size_t nSize)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		std::vector<unsigned char*>& chunks = m_FreeChunks[nSize];
+		if (!chunks.empty())
+		{
+			unsigned char* pChunk = chunks.back();
+			chunks.pop_back();
+			m_nPooledBytes -= nSize;
+			return pChunk;
+		}
+	}
+	return (unsigned char*)malloc(nSize);
+}
+
+void CMy_ChunkPool::Release(unsigned char* pChunk, size_t nSize)
+{
+	if (!pChunk)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		if (m_nPooledBytes + nSize <= m_nMaxPooledBytes)
+		{
+			m_FreeChunks[nSize].push_back(pChunk);
+			m_nPooledBytes += nSize;
+			return;
+		}
+	}
+	free(pChunk);
+}
+
+void CMy_ChunkPool::Trim()
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	for (auto it = m_FreeChunks.begin(); it != m_FreeChunks.end(); ++it)
+	{
+		for (size_t i = 0; i < it->second.size(); i++)
+			free(it->second[i]);
+	}
+	m_FreeChunks.clear();
+	m_nPooledBytes = 0;
+}
+
+size_t CMy_ChunkPool::GetPooledBytes()
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	return m_nPooledBytes;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Class CMy_WriteBuffer
+CMy_WriteBuffer::CMy_WriteBuffer(size_t nSpillThreshold, const char* tempDir, CMy_ChunkPool* pPool)
+{
+	m_pPool = pPool ? pPool : &CMy_ChunkPool::GetDefault();
+	m_nSpillThreshold = nSpillThreshold;
+	if (tempDir)
+		m_TempDir = tempDir;
+	m_iCapacity = 0;
+	m_iSize = 0;
+	m_pSpillFile = NULL;
+}
+
+CMy_WriteBuffer::~CMy_WriteBuffer()
+{
+	Reset();
+}
+
+void CMy_WriteBuffer::Reset()
+{
+	for (size_t i = 0; i < m_Chunks.size(); i++)
+		m_pPool->Release(m_Chunks[i].data, m_Chunks[i].size);
+	m_Chunks.clear();
+	m_iCapacity = 0;
+	m_iSize = 0;
+
+	if (m_pSpillFile)
+	{
+		fclose(m_pSpillFile);
+		if (!m_SpillPath.empty())
+			RemoveFile(m_SpillPath);
+	}
+	m_pSpillFile = NULL;
+	m_SpillPath.clear();
+}
+
+bool CMy_WriteBuffer::Write(uint64_t offset, const void* buffer, size_t size)
+{
+	if (!buffer && size)
+		return false;
+	if (size == 0)
+		return true;
+	uint64_t iEnd = offset + size;
+	if (iEnd < offset)
+		return false;
+
+	if (!m_pSpillFile && iEnd > m_nSpillThreshold && !Spill())
+		return false;
+
+	if (m_pSpillFile)
+	{
+		//Bytes between the old end and offset must read back as zero, even after a truncate.
+		if (offset > m_iSize)
+		{
+			std::vector<unsigned char> zeros((size_t)(offset - m_iSize < 65536 ? offset - m_iSize : 65536));
+			for (uint64_t pos = m_iSize; pos < offset; pos += zeros.size())
+			{
+				size_t nCount = (size_t)(offset - pos < zeros.size() ? offset - pos : zeros.size());
+				if (!SeekFile(m_pSpillFile, pos) || fwrite(zeros.data(), 1, nCount, m_pSpillFile) != nCount)
+					return false;
+			}
+		}
+		if (!SeekFile(m_pSpillFile, offset) || fwrite(buffer, 1, size, m_pSpillFile) != size)
+			return false;
+	}
+	else
+	{
+		if (!EnsureCapacity(iEnd))
+			return false;
+
+		uint64_t pos = offset > m_iSize ? m_iSize : offset;
+		const unsigned char* pSrc = (const unsigned char*)buffer;
+		size_t i = FindChunk(pos);
+		while (pos < iEnd)
+		{
+			Chunk& chunk = m_Chunks[i];
+			size_t nBegin = (size_t)(pos - chunk.start);
+			size_t nCount = chunk.size - nBegin;
+			if (pos < offset)
+			{
+				//Zero-fill the gap left by a write past the end.
+				if (nCount > offset - pos)
+					nCount = (size_t)(offset - pos);
+				memset(chunk.data + nBegin, 0, nCount);
+			}
+			else
+			{
+				if (nCount > iEnd - pos)
+					nCount = (size_t)(iEnd - pos);
+				memcpy(chunk.data + nBegin, pSrc + (pos - offset), nCount);
+			}
+			pos += nCount;
+			if (pos == chunk.start + chunk.size)
+				i++;
+		}
+	}
+
+	if (iEnd > m_iSize)
+		m_iSize = iEnd;
+	return true;
+}
+
+bool CMy_WriteBuffer::Truncate(uint64_t size)
+{
+	//Shrinking only moves the logical end; the gap is zeroed on the next write past it.
+	if (size <= m_iSize)
+	{
+		m_iSize = size;
+		return true;
+	}
+	static const unsigned char zero = 0;
+	return Write(size - 1, &zero, 1);
+}
+
+bool CMy_WriteBuffer::ReadAt(uint64_t offset, void* buffer, size_t size)
+{
+	if (!buffer || offset > m_iSize || size > m_iSize - offset)
+		return false;
+	if (size == 0)
+		return true;
+
+	if (m_pSpillFile)
+	{
+		if (!SeekFile(m_pSpillFile, offset))
+			return false;
+		return fread(buffer, 1, size, m_pSpillFile) == size;
+	}
+
+	unsigned char* pDest = (unsigned char*)buffer;
+	uint64_t pos = offset;
+	uint64_t iEnd = offset + size;
+	for (size_t i = FindChunk(pos); pos < iEnd; i++)
+	{
+		const Chunk& chunk = m_Chunks[i];
+		size_t nBegin = (size_t)(pos - chunk.start);
+		size_t nCount = chunk.size - nBegin;
+		if (nCount > iEnd - pos)
+			nCount = (size_t)(iEnd - pos);
+		memcpy(pDest, chunk.data + nBegin, nCount);
+		pDest += nCount;
+		pos += nCount;
+	}
+	return true;
+}
+
+bool CMy_WriteBuffer::EnsureCapacity(uint64_t iEnd)
+{
+	while (m_iCapacity < iEnd)
+	{
+		size_t nSize = FSDK_WRITEBUFFER_MINCHUNK;
+		for (size_t k = 0; k < m_Chunks.size() && nSize < FSDK_WRITEBUFFER_MAXCHUNK; k++)
+			nSize <<= 1;
+
+		Chunk chunk;
+		chunk.data = m_pPool->Acquire(nSize);
+		if (!chunk.data)
+			return false;
+		chunk.size = nSize;
+		chunk.start = m_iCapacity;
+		m_Chunks.push_back(chunk);
+		m_iCapacity += nSize;
+	}
+	return true;
+}
+
+size_t CMy_WriteBuffer::FindChunk(uint64_t offset) const
+{
+	size_t nLow = 0, nHigh = m_Chunks.size();
+	while (nHigh - nLow > 1)
+	{
+		size_t nMid = (nLow + nHigh) / 2;
+		if (m_Chunks[nMid].start <= offset)
+			nLow = nMid;
+		else
+			nHigh = nMid;
+	}
+	return nLow;
+}
+
+bool CMy_WriteBuffer::Spill()
+{
+	static std::atomic<unsigned int> s_iSpillCounter(0);
+
+#ifdef _WIN32
+	if (m_TempDir.empty())
+	{
+		if (tmpfile_s(&m_pSpillFile) != 0)
+			m_pSpillFile = NULL;
+	}
+#else
+	if (m_TempDir.empty())
+	{
+		const char* tempDir = getenv("TMPDIR");
+		m_TempDir = tempDir ? tempDir : "/tmp";
+	}
+#endif
+	if (!m_pSpillFile)
+	{
+		char name[64];
+		snprintf(name, sizeof(name), "/fsdk_save_%p_%u.tmp", (void*)this, s_iSpillCounter++);
+		m_SpillPath = m_TempDir + name;
+		m_pSpillFile = OpenFile(m_SpillPath, "w+b");
+	}
+	if (!m_pSpillFile)
+	{
+		m_SpillPath.clear();
+		return false;
+	}
+
+	//Move what is in memory so far to the file and give the chunks back.
+	uint64_t pos = 0;
+	for (size_t i = 0; i < m_Chunks.size() && pos < m_iSize; i++)
+	{
+		size_t nCount = (size_t)(m_iSize - pos < m_Chunks[i].size ? m_iSize - pos : m_Chunks[i].size);
+		if (fwrite(m_Chunks[i].data, 1, nCount, m_pSpillFile) != nCount)
+		{
+			fclose(m_pSpillFile);
+			m_pSpillFile = NULL;
+			if (!m_SpillPath.empty())
+				RemoveFile(m_SpillPath);
+			m_SpillPath.clear();
+			return false;
+		}
+		pos += nCount;
+	}
+	for (size_t i = 0; i < m_Chunks.size(); i++)
+		m_pPool->Release(m_Chunks[i].data, m_Chunks[i].size);
+	m_Chunks.clear();
+	m_iCapacity = 0;
+	return true;
+}
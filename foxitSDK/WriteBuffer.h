@@ -0,0 +1,83 @@
+﻿#pragma once
+
+/** Common header files. */
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace foxitSDK
+{
+	//Process-wide pool of large power-of-two chunks, reused between saves instead of going back to the heap.
+	class CMy_ChunkPool
+	{
+	public:
+		CMy_ChunkPool(size_t nMaxPooledBytes = 64 * 1024 * 1024);
+		~CMy_ChunkPool();
+
+		static CMy_ChunkPool&	GetDefault();
+
+		//nSize must be a power of two.
+		unsigned char*		Acquire(size_t nSize);
+		void				Release(unsigned char* pChunk, size_t nSize);
+
+		//Free every pooled chunk.
+		void				Trim();
+		size_t				GetPooledBytes();
+
+	private:
+		std::mutex										m_Lock;
+		std::map<size_t, std::vector<unsigned char*> >	m_FreeChunks;
+		size_t											m_nPooledBytes;
+		size_t											m_nMaxPooledBytes;
+	};
+
+	//Random-access write buffer for the output of a save.
+	//Writes honor their offset. Memory grows in geometrically larger chunks taken from a CMy_ChunkPool;
+	//once the buffer would need more than the spill threshold it moves to a temporary file.
+	//Not thread safe: the SDK writes a save from a single thread.
+	class CMy_WriteBuffer
+	{
+	public:
+		CMy_WriteBuffer(size_t nSpillThreshold = 64 * 1024 * 1024, const char* tempDir = NULL, CMy_ChunkPool* pPool = NULL);
+		~CMy_WriteBuffer();
+
+		bool				Write(uint64_t offset, const void* buffer, size_t size);
+		bool				Truncate(uint64_t size);
+		bool				ReadAt(uint64_t offset, void* buffer, size_t size);
+
+		//Logical size: the end of the furthest write, or the truncated size.
+		uint64_t			GetSize() const { return m_iSize; }
+		bool				IsSpilled() const { return m_pSpillFile != NULL; }
+		//Bytes currently held in memory.
+		uint64_t			GetMemoryBytes() const { return m_iCapacity; }
+
+		//Drop all data, return chunks to the pool and delete the temporary file.
+		void				Reset();
+
+	private:
+		struct Chunk
+		{
+			unsigned char*	data;
+			size_t			size;
+			uint64_t		start;
+		};
+
+		bool				EnsureCapacity(uint64_t iEnd);
+		bool				Spill();
+		size_t				FindChunk(uint64_t offset) const;
+
+		CMy_ChunkPool*		m_pPool;
+		size_t				m_nSpillThreshold;
+		std::string			m_TempDir;
+		std::vector<Chunk>	m_Chunks;
+		uint64_t			m_iCapacity;
+		uint64_t			m_iSize;
+
+		FILE*				m_pSpillFile;
+		std::string			m_SpillPath;
+	};
+}
@@ -2,3 +2,5 @@
 
 #include <collection.h>
 #include <ppltasks.h>
+#include <robuffer.h>
+#include <wrl/client.h>
@@ -70,6 +70,7 @@ public renderPage()
             m_PDFPage.pointer = 0;
 
             m_iCurPageIndex = 0;
+            m_iTargetPageIndex = 0;
             m_fPageWidth = 0.0f;
             m_fPageHeight = 0.0f;
 
@@ -93,6 +94,11 @@ public renderPage()
 
         void ReleaseResources()
         {
+            //Closing waits for a load still running, so stop the work in flight first.
+            if (m_LoadCancel != null)
+                m_LoadCancel.Cancel();
+            if (m_RenderCancel != null)
+                m_RenderCancel.Cancel();
             if (m_SDKDocument != null)
                 m_SDKDocument.ReleaseResource();
             m_PDFFunction.FSDK_Finalize();
@@ -108,6 +114,7 @@ protected override void OnNavigatedTo(NavigationEventArgs e)
                 m_PDFPage.pointer = 0;
 
                 m_iCurPageIndex = 0;
+                m_iTargetPageIndex = 0;
                 m_fPageWidth = 0.0f;
                 m_fPageHeight = 0.0f;
 
@@ -138,7 +145,7 @@ private async void OpenPDFDocument(Windows.Storage.StorageFile file)
                 Windows.Storage.FileProperties.BasicProperties properties = await file.GetBasicPropertiesAsync();
                 m_SDKDocument = new FSDK_Document();
                 //Load PDF document
-                int result = await m_SDKDocument.OpenDocumentAsync(file, (int)properties.Size);
+                int result = await m_SDKDocument.OpenDocumentAsync(file, (long)properties.Size);
                 if(result != 0)
                 {
                     //showerrorlog
@@ -146,7 +153,7 @@ private async void OpenPDFDocument(Windows.Storage.StorageFile file)
                 }
                 m_PDFDoc.pointer = m_SDKDocument.m_hDoc.pointer;
                 //Load PDF page
-                result = LoadPage(m_iCurPageIndex);
+                result = await LoadPage(m_iCurPageIndex);
                 if(result != 0)
                 {
                     //showerrorlog
@@ -164,7 +171,7 @@ private async void OpenPDFDocument(Windows.Storage.StorageFile file)
             }
         }
 
-        private int LoadPage(int iPageIndex)
+        private async Task<int> LoadPage(int iPageIndex)
         {// To load and parse page.
             int result = -1;
             if (m_PDFDoc.pointer == 0)
@@ -172,20 +179,37 @@ private int LoadPage(int iPageIndex)
                 //ShowErrorLog("Error: No PDF document has been loaded successfully.", ref new UICommandInvokedHandler(this, &demo_view::renderPage::ReturnCommandInvokedHandler));
                 return result;
             }
-            if (m_PDFPage.pointer != 0)
+            //The page is parsed on a worker thread, a newer LoadPage supersedes the one still running.
+            //The previous page stays current until the new one is parsed.
+            if (m_LoadCancel != null)
+                m_LoadCancel.Cancel();
+            System.Threading.CancellationTokenSource loadCancel = new System.Threading.CancellationTokenSource();
+            m_LoadCancel = loadCancel;
+            m_iTargetPageIndex = iPageIndex;
+            try
             {
-                m_PDFFunction.My_Page_Clear(m_PDFPage);
-                m_PDFPage.pointer = 0;
+                result = await m_SDKDocument.LoadPageAsync(iPageIndex).AsTask(loadCancel.Token);
             }
-            result = m_SDKDocument.LoadPageSync(iPageIndex);
-            if (0 == result)
+            catch (OperationCanceledException)
             {
+                //The newer load takes over, the handles still name the current page.
+                m_PDFDoc.pointer = m_SDKDocument.m_hDoc.pointer;
                 m_PDFPage.pointer = m_SDKDocument.m_hPage.pointer;
+                return result;
+            }
+            //The document may have been reopened after running out of memory.
+            m_PDFDoc.pointer = m_SDKDocument.m_hDoc.pointer;
+            m_PDFPage.pointer = m_SDKDocument.m_hPage.pointer;
+            if (0 == result)
+            {
                 m_iCurPageIndex = iPageIndex;
                 GetPageInfo();
             }
             else
             {
+                //Navigation goes on from the page still shown, unless a newer load has started.
+                if (m_LoadCancel == loadCancel)
+                    m_iTargetPageIndex = m_iCurPageIndex;
                 //ShowErrorLog("Error: Fail to load and parse a page.", ref new UICommandInvokedHandler(this, &demo_view::renderPage::ReturnCommandInvokedHandler),true, ret);
                 ;
             }
@@ -217,21 +241,50 @@ public async void ShowPage()
         {//To render PDF page, finally to the image control.	
          //Calculate render size.
             CalcRenderSize();
-            PixelSource bitmap =  new PixelSource();
-            bitmap.Width = (int)m_iRenderAreaSizeX;
-            bitmap.Height = (int)m_iRenderAreaSizeY;
-            Windows.Storage.Streams.IRandomAccessStreamWithContentType stream = await m_SDKDocument.RenderPageAsync(bitmap, m_iStartX, m_iStartY, m_iRenderAreaSizeX, m_iRenderAreaSizeY, m_iRotation);
-            if (stream == null)
+            //A newer ShowPage supersedes the render still running for the previous one.
+            if (m_RenderCancel != null)
+                m_RenderCancel.Cancel();
+            System.Threading.CancellationTokenSource renderCancel = new System.Threading.CancellationTokenSource();
+            m_RenderCancel = renderCancel;
+            //Raw premultiplied BGRA8 pixels, shown as they are without a BMP encode and decode.
+            //A quick low resolution preview comes first, the full quality page replaces it once it is rendered.
+            bool bRefined = false;
+            Progress<Windows.Graphics.Imaging.SoftwareBitmap> onPreview = new Progress<Windows.Graphics.Imaging.SoftwareBitmap>(async (preview) =>
+            {
+                await ShowBitmap(preview, () => bRefined || renderCancel.IsCancellationRequested);
+            });
+            Windows.Graphics.Imaging.SoftwareBitmap bitmap = null;
+            try
+            {
+                bitmap = await m_SDKDocument.RenderPageProgressiveAsync(m_iRenderAreaSizeX, m_iRenderAreaSizeY, m_iStartX, m_iStartY, m_iRenderAreaSizeX, m_iRenderAreaSizeY, m_iRotation).AsTask(renderCancel.Token, onPreview);
+            }
+            catch (OperationCanceledException)
+            {
+                return;
+            }
+            bRefined = true;
+            //Rendering may have reopened the document after running out of memory.
+            m_PDFDoc.pointer = m_SDKDocument.m_hDoc.pointer;
+            m_PDFPage.pointer = m_SDKDocument.m_hPage.pointer;
+            if (bitmap == null)
             {
                 //ShowErrorLog("Error: Fail to render page.", ref new UICommandInvokedHandler(this, &demo_view::renderPage::ReturnCommandInvokedHandler),true, FSCRT_ERRCODE_ERROR);
                 return;
             }
-            Windows.UI.Xaml.Media.Imaging.BitmapImage bmpImage = new Windows.UI.Xaml.Media.Imaging.BitmapImage();
-            bmpImage.SetSource(stream);
-            image.Width = (int)m_iRenderAreaSizeX;
-            image.Height = (int)m_iRenderAreaSizeY;
-            image.Source = bmpImage;
-            
+            await ShowBitmap(bitmap, () => renderCancel.IsCancellationRequested);
+        }
+
+        private async Task ShowBitmap(Windows.Graphics.Imaging.SoftwareBitmap bitmap, Func<bool> isStale)
+        {//Show a rendered page in the image control, stretched to the render size.
+            int iWidth = m_iRenderAreaSizeX;
+            int iHeight = m_iRenderAreaSizeY;
+            Windows.UI.Xaml.Media.Imaging.SoftwareBitmapSource bmpSource = new Windows.UI.Xaml.Media.Imaging.SoftwareBitmapSource();
+            await bmpSource.SetBitmapAsync(bitmap);
+            if (isStale())
+                return;
+            image.Width = iWidth;
+            image.Height = iHeight;
+            image.Source = bmpSource;
         }
         
         public void CalcRenderSize()
@@ -258,19 +311,19 @@ public void CalcRenderSize()
             }
         }
 
-        public void Search()
+        public async void Search()
         {
             if(m_PDFDoc.pointer == 0)
             {
                 //showerrorlog
                 return;
             }
-            int result = -1;
             int iPageCount = m_PDFFunction.My_Doc_CountPages(m_PDFDoc);
             for(int i = 0;i < iPageCount;i++)
             {
-                result = LoadPage(i);
-                if(result != 0)
+                //Only the text is needed, the current page stays as it is.
+                string text = await m_SDKDocument.ExtractPageTextAsync(i);
+                if(text == null)
                 {
                     return;
                 }
@@ -286,6 +339,7 @@ public void Search()
         //FSCRT_PAGE m_PDFPage;              // SDK page handle of current loaded page.
         
         private int                                 m_iCurPageIndex;               //Index of current loaded page.
+        private int                                 m_iTargetPageIndex;            //Index of the page being loaded, m_iCurPageIndex when no load runs.
         private float                               m_fPageWidth;             // Page width of current page.
         private float                               m_fPageHeight;            // Page Height of current page.
 
@@ -306,12 +360,15 @@ public void Search()
         private bool m_bFitWidth;
         private bool m_bFitHeight;
 
+        private System.Threading.CancellationTokenSource m_RenderCancel;   //Cancels the render of the last ShowPage.
+        private System.Threading.CancellationTokenSource m_LoadCancel;     //Cancels the parse of the last LoadPage.
+
         private Point m_BeginLocation;
         private Point m_EndLocation;
         private Inherited_PDFFunction m_PDFFunction;
         private bool m_mousestate;
 
-        private void Click_BTN_NextPage(object sender, RoutedEventArgs e)
+        private async void Click_BTN_NextPage(object sender, RoutedEventArgs e)
         {//Button click event:to turn to the next page
             if (m_PDFDoc.pointer == 0 || m_PDFPage.pointer == 0)
             {
@@ -320,11 +377,11 @@ private void Click_BTN_NextPage(object sender, RoutedEventArgs e)
             }
             int iPageCount;
             iPageCount = m_PDFFunction.My_Doc_CountPages(m_PDFDoc);
-            int iPageIndex = m_iCurPageIndex;
+            int iPageIndex = m_iTargetPageIndex;
             if(iPageIndex < iPageCount - 1)
             {
                 iPageIndex++;
-                int result = LoadPage(iPageIndex);
+                int result = await LoadPage(iPageIndex);
                 if(result != 0)
                 {
                     return;
@@ -333,7 +390,7 @@ private void Click_BTN_NextPage(object sender, RoutedEventArgs e)
             }
         }
 
-        private void Click_BTN_PrePage(object sender, RoutedEventArgs e)
+        private async void Click_BTN_PrePage(object sender, RoutedEventArgs e)
         {// Button click event: to turn to the previous page
             if (m_PDFDoc.pointer == 0 || m_PDFPage.pointer == 0)
             {
@@ -342,12 +399,12 @@ private void Click_BTN_PrePage(object sender, RoutedEventArgs e)
             }
             int iPageCount;
             iPageCount = m_PDFFunction.My_Doc_CountPages(m_PDFDoc);
-            int iPageIndex = m_iCurPageIndex;
+            int iPageIndex = m_iTargetPageIndex;
 
             if (iPageIndex > 0)
             {
                 iPageIndex--;
-                int result = LoadPage(iPageIndex);
+                int result = await LoadPage(iPageIndex);
                 if (result != 0)
                 {
                     return;
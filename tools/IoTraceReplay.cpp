@@ -0,0 +1,94 @@
+﻿//Replays an I/O trace recorded by FSDK_Document::StartIoTrace against a file backend and prints
+//throughput and latency percentiles, next to the numbers of the recorded run.
+//
+//Build on Linux from the repository root:
+//  g++ -std=c++14 -O2 -pthread -IfoxitSDK tools/IoTraceReplay.cpp foxitSDK/IoTrace.cpp foxitSDK/FileSource.cpp foxitSDK/MappedFile.cpp foxitSDK/BlockCache.cpp foxitSDK/WriteBehind.cpp foxitSDK/WriteBuffer.cpp -o IoTraceReplay
+//
+//Usage:
+//  IoTraceReplay <trace> <file> [buffered|mmap|cached|throttled] [latencyMs] [bytesPerSecond] [--timing]
+//The file should be a copy of the document the trace was recorded on. Writes are not replayed.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "IoTrace.h"
+#include "FileSource.h"
+#include "MappedFile.h"
+#include "BlockCache.h"
+
+using namespace foxitSDK;
+
+static void PrintStats(const char* title, const FSDK_IoReplayStats& stats)
+{
+	printf("%s\n", title);
+	printf("  reads %llu (%llu bytes), writes %llu, other %llu, skipped %llu, failed %llu\n",
+		(unsigned long long)stats.reads, (unsigned long long)stats.bytesRead, (unsigned long long)stats.writes,
+		(unsigned long long)stats.otherOps, (unsigned long long)stats.skippedOps, (unsigned long long)stats.failedOps);
+	printf("  elapsed %.3f ms, read throughput %.2f MB/s\n", stats.elapsedNs / 1e6, stats.readMBps);
+	printf("  read latency us: p50 %.1f  p90 %.1f  p99 %.1f  max %.1f  mean %.1f\n",
+		stats.readLatency.p50 / 1e3, stats.readLatency.p90 / 1e3, stats.readLatency.p99 / 1e3,
+		stats.readLatency.max / 1e3, stats.readLatency.mean / 1e3);
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 3)
+	{
+		fprintf(stderr, "usage: %s <trace> <file> [buffered|mmap|cached|throttled] [latencyMs] [bytesPerSecond] [--timing]\n", argv[0]);
+		return 2;
+	}
+	const char* tracePath = argv[1];
+	const char* filePath = argv[2];
+	const char* backend = argc > 3 ? argv[3] : "buffered";
+	uint32_t nLatencyMs = argc > 4 ? (uint32_t)strtoul(argv[4], NULL, 10) : 0;
+	uint64_t iBytesPerSecond = argc > 5 ? strtoull(argv[5], NULL, 10) : 0;
+	bool bKeepTiming = argc > 6 && strcmp(argv[6], "--timing") == 0;
+
+	IMy_FileSource* pSource = NULL;
+	if (strcmp(backend, "mmap") == 0)
+	{
+		CMy_MappedFileSource* pMapped = new CMy_MappedFileSource();
+		if (pMapped->Open(filePath) && !pMapped->IsMapped())
+			fprintf(stderr, "warning: mapping failed, reads are buffered\n");
+		pSource = pMapped;
+	}
+	else
+	{
+		CMy_PosixFileSource* pFile = new CMy_PosixFileSource();
+		if (!pFile->Open(filePath))
+		{
+			fprintf(stderr, "cannot open %s\n", filePath);
+			delete pFile;
+			return 1;
+		}
+		pSource = pFile;
+		if (strcmp(backend, "cached") == 0)
+			pSource = CMy_BlockCache::CreateForSource(pFile, true);
+		else if (strcmp(backend, "throttled") == 0)
+			pSource = new CMy_ThrottledFileSource(pFile, true, nLatencyMs, iBytesPerSecond);
+		else if (strcmp(backend, "buffered") != 0)
+		{
+			fprintf(stderr, "unknown backend %s\n", backend);
+			delete pSource;
+			return 2;
+		}
+	}
+
+	FSDK_IoReplayStats recorded, replayed;
+	if (!CMy_IoTraceReplay::Summarize(tracePath, &recorded))
+	{
+		fprintf(stderr, "cannot read trace %s\n", tracePath);
+		delete pSource;
+		return 1;
+	}
+	PrintStats("recorded:", recorded);
+
+	bool bOk = CMy_IoTraceReplay::Run(tracePath, pSource, NULL, bKeepTiming, &replayed);
+	delete pSource;
+	if (!bOk)
+		return 1;
+	printf("\n");
+	PrintStats(backend, replayed);
+	return 0;
+}
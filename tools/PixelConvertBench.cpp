@@ -0,0 +1,155 @@
+﻿//Measures the pixel conversion kernels of foxitSDK/PixelConvert.cpp and prints GB/s per kernel and instruction set,
+//counting the bytes read plus the bytes written. Every kernel's output is checked against the scalar kernel first.
+//
+//Build on Linux x86-64 from the repository root:
+//  g++ -std=c++14 -O2 -IfoxitSDK tools/PixelConvertBench.cpp foxitSDK/PixelConvert.cpp -o PixelConvertBench
+//
+//Usage:
+//  PixelConvertBench [width] [height] [iterations]
+//The default is a 3840 x 2160 frame, 64-byte aligned rows as CMy_PixelBufferPool hands them out, 50 iterations.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+#include "PixelConvert.h"
+
+using namespace foxitSDK;
+
+enum BenchKernel
+{
+	BENCH_BGRA = 0,
+	BENCH_RGBA,
+	BENCH_GRAY8,
+	BENCH_REPACK,
+	BENCH_COUNT
+};
+
+static const char* g_KernelNames[BENCH_COUNT] = { "rgbx->bgra", "rgbx->rgba", "rgbx->gray8", "repack" };
+
+static int32_t AlignStride(int32_t bytes)
+{
+	return (bytes + 63) / 64 * 64;
+}
+
+//Run one kernel once. Repacks go from aligned rows to packed ones, as for an encoder.
+static void RunKernel(const FSDK_PixelKernels* pKernels, BenchKernel kernel, const uint8_t* src, int32_t srcStride,
+	uint8_t* dst, int32_t width, int32_t height)
+{
+	switch (kernel)
+	{
+	case BENCH_BGRA:
+		pKernels->rgbxToBgra(src, srcStride, dst, srcStride, width, height);
+		break;
+	case BENCH_RGBA:
+		pKernels->rgbxToRgba(src, srcStride, dst, srcStride, width, height);
+		break;
+	case BENCH_GRAY8:
+		pKernels->rgbxToGray8(src, srcStride, dst, AlignStride(width), width, height);
+		break;
+	default:
+		pKernels->repack(src, srcStride, dst, width * 4, width * 4, height);
+		break;
+	}
+}
+
+//Whether two kernel tables share the kernel under test.
+static bool SameKernel(const FSDK_PixelKernels* pA, const FSDK_PixelKernels* pB, BenchKernel kernel)
+{
+	switch (kernel)
+	{
+	case BENCH_BGRA:
+		return pA->rgbxToBgra == pB->rgbxToBgra;
+	case BENCH_RGBA:
+		return pA->rgbxToRgba == pB->rgbxToRgba;
+	case BENCH_GRAY8:
+		return pA->rgbxToGray8 == pB->rgbxToGray8;
+	default:
+		return pA->repack == pB->repack;
+	}
+}
+
+static uint64_t GetBytesMoved(BenchKernel kernel, int32_t width, int32_t height)
+{
+	uint64_t nPixels = (uint64_t)width * height;
+	return nPixels * 4 + nPixels * (kernel == BENCH_GRAY8 ? 1 : 4);
+}
+
+int main(int argc, char* argv[])
+{
+	int32_t width = argc > 1 ? atoi(argv[1]) : 3840;
+	int32_t height = argc > 2 ? atoi(argv[2]) : 2160;
+	int iterations = argc > 3 ? atoi(argv[3]) : 50;
+	if (width <= 0 || height <= 0 || iterations <= 0)
+	{
+		fprintf(stderr, "usage: %s [width] [height] [iterations]\n", argv[0]);
+		return 2;
+	}
+
+	int32_t stride = AlignStride(width * 4);
+	size_t nBytes = (size_t)stride * height;
+	std::vector<uint8_t> srcStorage(nBytes + 64);
+	std::vector<uint8_t> dstStorage(nBytes + 64);
+	std::vector<uint8_t> refStorage(nBytes + 64);
+	uint8_t* src = (uint8_t*)(((uintptr_t)&srcStorage[0] + 63) & ~(uintptr_t)63);
+	uint8_t* dst = (uint8_t*)(((uintptr_t)&dstStorage[0] + 63) & ~(uintptr_t)63);
+	uint8_t* ref = (uint8_t*)(((uintptr_t)&refStorage[0] + 63) & ~(uintptr_t)63);
+	uint32_t seed = 12345;
+	for (size_t i = 0; i < nBytes; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		src[i] = (uint8_t)(seed >> 16);
+	}
+
+	static const char* isaNames[FSDK_PIXELISA_COUNT] = { "scalar", "sse2", "avx2" };
+	printf("%d x %d, stride %d, %d iterations, best instruction set: %s\n", width, height, stride, iterations,
+		isaNames[CMy_PixelConvert::GetBestIsa()]);
+	printf("%-12s", "kernel");
+	for (int isa = 0; isa < FSDK_PIXELISA_COUNT; isa++)
+		printf("%12s", isaNames[isa]);
+	printf("%12s   (GB/s)\n", "picked");
+
+	const FSDK_PixelKernels* pScalar = CMy_PixelConvert::GetKernels(FSDK_PIXELISA_SCALAR);
+	const FSDK_PixelKernels* pBest = CMy_PixelConvert::GetBest();
+	int failures = 0;
+	for (int kernel = 0; kernel < BENCH_COUNT; kernel++)
+	{
+		printf("%-12s", g_KernelNames[kernel]);
+		memset(ref, 0, nBytes);
+		RunKernel(pScalar, (BenchKernel)kernel, src, stride, ref, width, height);
+		for (int isa = 0; isa < FSDK_PIXELISA_COUNT; isa++)
+		{
+			const FSDK_PixelKernels* pKernels = CMy_PixelConvert::GetKernels((FSDK_PixelIsa)isa);
+			if (!pKernels)
+			{
+				printf("%12s", "-");
+				continue;
+			}
+			memset(dst, 0, nBytes);
+			RunKernel(pKernels, (BenchKernel)kernel, src, stride, dst, width, height);
+			if (memcmp(dst, ref, nBytes) != 0)
+			{
+				printf("%12s", "MISMATCH");
+				failures++;
+				continue;
+			}
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			for (int i = 0; i < iterations; i++)
+				RunKernel(pKernels, (BenchKernel)kernel, src, stride, dst, width, height);
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			double gbps = (double)GetBytesMoved((BenchKernel)kernel, width, height) * iterations / seconds / 1e9;
+			printf("%12.2f", gbps);
+		}
+		const char* picked = "?";
+		for (int isa = 0; isa < FSDK_PIXELISA_COUNT; isa++)
+		{
+			const FSDK_PixelKernels* pKernels = CMy_PixelConvert::GetKernels((FSDK_PixelIsa)isa);
+			if (pKernels && SameKernel(pKernels, pBest, (BenchKernel)kernel))
+				picked = isaNames[isa];
+		}
+		printf("%12s\n", picked);
+	}
+	return failures ? 1 : 0;
+}